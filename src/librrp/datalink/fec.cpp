@@ -0,0 +1,357 @@
+#include "fec.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// GF(2^8) with the 0x11D polynomial and generator 2. exp is doubled so a product never needs a % 255, built at
+// compile time so on the esp32 the tables sit in flash.
+struct GaloisTables {
+    uint8_t exp[512];
+    uint8_t log[256];
+
+    constexpr GaloisTables() : exp(), log() {
+        unsigned x = 1;
+        for (unsigned i = 0; i < 255; ++i) {
+            exp[i] = static_cast<uint8_t>(x);
+            exp[i + 255] = static_cast<uint8_t>(x);
+            log[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= 0x11D;
+            }
+        }
+        exp[510] = exp[0];
+        exp[511] = exp[1];
+    }
+};
+
+constexpr GaloisTables tables;
+
+int popcount(uint64_t bits) {
+    int count = 0;
+    for (; bits; bits &= bits - 1) {
+        ++count;
+    }
+    return count;
+}
+
+}
+
+uint8_t ReedSolomon::multiply(uint8_t a, uint8_t b) {
+    return (a && b) ? tables.exp[tables.log[a] + tables.log[b]] : 0;
+}
+
+uint8_t ReedSolomon::inverse(uint8_t a) {
+    return a ? tables.exp[255 - tables.log[a]] : 0;
+}
+
+void ReedSolomon::multiplyAdd(uint8_t* dst, const uint8_t* src, uint8_t coefficient, size_t length) {
+    if (coefficient == 0) {
+        return;
+    }
+    if (coefficient == 1) {
+        for (size_t i = 0; i < length; ++i) {
+            dst[i] ^= src[i];
+        }
+        return;
+    }
+    const uint8_t* exp = tables.exp + tables.log[coefficient];
+    for (size_t i = 0; i < length; ++i) {
+        if (src[i]) {
+            dst[i] ^= exp[tables.log[src[i]]];
+        }
+    }
+}
+
+void ReedSolomon::accumulate(uint8_t* symbol, const std::vector<uint8_t>& frame, uint8_t coefficient) {
+    const uint8_t prefix[FecHeader::symbolOverhead] = {static_cast<uint8_t>(frame.size() >> 8), static_cast<uint8_t>(frame.size())};
+    multiplyAdd(symbol, prefix, coefficient, FecHeader::symbolOverhead);
+    multiplyAdd(symbol + FecHeader::symbolOverhead, frame.data(), coefficient, frame.size());
+}
+
+bool ReedSolomon::invert(uint8_t* matrix, size_t size) {
+    if (size > maxParityFrames) {
+        return false;
+    }
+    uint8_t result[maxParityFrames * maxParityFrames] = {};
+    for (size_t i = 0; i < size; ++i) {
+        result[i * size + i] = 1;
+    }
+
+    // gauss jordan, subtraction is xor so eliminating a row is a multiplyAdd
+    for (size_t column = 0; column < size; ++column) {
+        size_t pivot = column;
+        while (pivot < size && !matrix[pivot * size + column]) {
+            ++pivot;
+        }
+        if (pivot == size) {
+            return false;
+        }
+        if (pivot != column) {
+            std::swap_ranges(matrix + pivot * size, matrix + (pivot + 1) * size, matrix + column * size);
+            std::swap_ranges(result + pivot * size, result + (pivot + 1) * size, result + column * size);
+        }
+
+        const uint8_t scale = inverse(matrix[column * size + column]);
+        for (size_t i = 0; i < size; ++i) {
+            matrix[column * size + i] = multiply(matrix[column * size + i], scale);
+            result[column * size + i] = multiply(result[column * size + i], scale);
+        }
+
+        for (size_t row = 0; row < size; ++row) {
+            const uint8_t factor = matrix[row * size + column];
+            if (row != column && factor) {
+                multiplyAdd(matrix + row * size, matrix + column * size, factor, size);
+                multiplyAdd(result + row * size, result + column * size, factor, size);
+            }
+        }
+    }
+    std::copy(result, result + size * size, matrix);
+    return true;
+}
+
+FecEncoder::FecEncoder(uint8_t dataFrames, uint8_t parityFrames) {
+    configure(dataFrames, parityFrames);
+}
+
+void FecEncoder::configure(uint8_t dataFrames, uint8_t parityFrames) {
+    m_dataFrames = static_cast<uint8_t>(std::min<size_t>(dataFrames, ReedSolomon::maxDataFrames));
+    m_parityFrames = static_cast<uint8_t>(std::min<size_t>(parityFrames, ReedSolomon::maxParityFrames));
+    m_count = 0;
+    m_parityCount = 0;
+    m_nextParity = 0;
+}
+
+void FecEncoder::dataFrame(const std::vector<uint8_t>& payload, std::vector<uint8_t>& frame) const {
+    frame.clear();
+    frame.push_back(m_block);
+    frame.push_back(static_cast<uint8_t>(m_count));
+    frame.insert(frame.end(), payload.begin(), payload.end());
+}
+
+void FecEncoder::dataSent(const std::vector<uint8_t>& payload) {
+    if (m_data.size() <= m_count) {
+        m_data.resize(m_count + 1);
+    }
+    m_data[m_count++].assign(payload.begin(), payload.end());
+    if (m_count >= m_dataFrames) {
+        close();
+    }
+}
+
+void FecEncoder::flush() {
+    if (m_count) {
+        close();
+    }
+}
+
+bool FecEncoder::parityFrame(std::vector<uint8_t>& frame) const {
+    if (m_nextParity >= m_parityCount) {
+        return false;
+    }
+    frame.assign(m_parity[m_nextParity].begin(), m_parity[m_nextParity].end());
+    return true;
+}
+
+void FecEncoder::close() {
+    size_t length = 0;
+    for (size_t i = 0; i < m_count; ++i) {
+        length = std::max(length, m_data[i].size());
+    }
+    length += FecHeader::symbolOverhead;
+
+    if (m_parity.size() < m_parityFrames) {
+        m_parity.resize(m_parityFrames);
+    }
+    for (uint8_t row = 0; row < m_parityFrames; ++row) {
+        std::vector<uint8_t>& frame = m_parity[row];
+        frame.assign(FecHeader::paritySize + length, 0);
+        frame[0] = m_block;
+        frame[1] = FecHeader::parityFlag | row;
+        frame[2] = static_cast<uint8_t>(m_count);
+        for (size_t column = 0; column < m_count; ++column) {
+            ReedSolomon::accumulate(frame.data() + FecHeader::paritySize, m_data[column], ReedSolomon::coefficient(row, static_cast<uint8_t>(column)));
+        }
+    }
+
+    // parity of an earlier block not yet sent is superseded
+    m_parityCount = m_parityFrames;
+    m_nextParity = 0;
+    m_count = 0;
+    ++m_block;
+}
+
+FecDecoder::FecDecoder(size_t maxSources):
+    m_maxSources(std::max<size_t>(maxSources, 1))
+{}
+
+size_t FecDecoder::receive(uint8_t source, std::vector<uint8_t>& frame) {
+    if (frame.size() < FecHeader::dataSize) {
+        throw std::runtime_error("fec frame shorter than its header");
+    }
+    const uint8_t id = frame[0];
+    const uint8_t index = frame[1];
+
+    if (index & FecHeader::parityFlag) {
+        const uint8_t row = index & ~FecHeader::parityFlag;
+        if (frame.size() < FecHeader::paritySize) {
+            throw std::runtime_error("fec parity frame shorter than its header");
+        }
+        const uint8_t dataFrames = frame[2];
+        if (row >= ReedSolomon::maxParityFrames || dataFrames == 0 || dataFrames > ReedSolomon::maxDataFrames) {
+            throw std::runtime_error("fec parity header out of range");
+        }
+        Block& block = find(source, id);
+        if (block.dataFrames && block.dataFrames != dataFrames) {
+            throw std::runtime_error("fec parity disagrees on block size");
+        }
+        block.dataFrames = dataFrames;
+        if (block.parity.size() <= row) {
+            block.parity.resize(row + 1);
+        }
+        block.parity[row].assign(frame.begin() + FecHeader::paritySize, frame.end());
+        block.parityPresent |= uint32_t(1) << row;
+        frame.clear();
+        return block.done ? 0 : reconstruct(block);
+    }
+
+    if (index >= ReedSolomon::maxDataFrames) {
+        throw std::runtime_error("fec data index out of range");
+    }
+    Block& block = find(source, id);
+    if (block.data.size() <= index) {
+        block.data.resize(index + 1);
+    }
+    block.data[index].assign(frame.begin() + FecHeader::dataSize, frame.end());
+    block.dataPresent |= uint64_t(1) << index;
+    frame.erase(frame.begin(), frame.begin() + FecHeader::dataSize);
+    return block.done ? 0 : reconstruct(block);
+}
+
+FecDecoder::Block& FecDecoder::find(uint8_t source, uint8_t id) {
+    auto it = std::find_if(m_blocks.begin(), m_blocks.end(), [source, id](const Block& block) { return block.source == source && block.id == id; });
+    if (it != m_blocks.end()) {
+        it->lastUsed = ++m_useCounter;
+        return *it;
+    }
+
+    // a new block from this source, replacing the older of the two kept for it, or else the least recently heard
+    // block of anyone once the table is full
+    auto older = m_blocks.end();
+    size_t kept = 0;
+    for (auto block = m_blocks.begin(); block != m_blocks.end(); ++block) {
+        if (block->source == source) {
+            ++kept;
+            if (older == m_blocks.end() || block->started < older->started) {
+                older = block;
+            }
+        }
+    }
+    if (kept >= 2) {
+        it = older;
+    } else if (m_blocks.size() < 2 * m_maxSources) {
+        m_blocks.emplace_back();
+        it = m_blocks.end() - 1;
+    } else {
+        it = std::min_element(m_blocks.begin(), m_blocks.end(), [](const Block& a, const Block& b) { return a.lastUsed < b.lastUsed; });
+    }
+
+    Block& block = *it;
+    block.source = source;
+    block.id = id;
+    block.dataFrames = 0;
+    block.done = false;
+    block.dataPresent = 0;
+    block.parityPresent = 0;
+    block.started = block.lastUsed = ++m_useCounter;
+    return block;
+}
+
+size_t FecDecoder::reconstruct(Block& block) {
+    if (!block.dataFrames) {
+        return 0;
+    }
+    const uint64_t wanted = (block.dataFrames >= 64) ? ~uint64_t(0) : (uint64_t(1) << block.dataFrames) - 1;
+    const uint64_t missing = wanted & ~block.dataPresent;
+    const size_t count = static_cast<size_t>(popcount(missing));
+    if (count == 0) {
+        block.done = true;
+        return 0;
+    }
+    if (static_cast<size_t>(popcount(block.parityPresent)) < count) {
+        return 0;
+    }
+
+    // solve for the missing columns with as many of the parity rows we have
+    uint8_t columns[ReedSolomon::maxParityFrames];
+    uint8_t rows[ReedSolomon::maxParityFrames];
+    for (size_t column = 0, n = 0; n < count; ++column) {
+        if (missing & (uint64_t(1) << column)) {
+            columns[n++] = static_cast<uint8_t>(column);
+        }
+    }
+    for (size_t row = 0, n = 0; n < count; ++row) {
+        if (block.parityPresent & (uint32_t(1) << row)) {
+            rows[n++] = static_cast<uint8_t>(row);
+        }
+    }
+
+    // a block that doesn't add up is given up on rather than rebuilt into garbage
+    block.done = true;
+    const size_t length = block.parity[rows[0]].size();
+    if (length < FecHeader::symbolOverhead) {
+        return 0;
+    }
+    for (size_t n = 0; n < count; ++n) {
+        if (block.parity[rows[n]].size() != length) {
+            return 0;
+        }
+    }
+    for (size_t column = 0; column < block.dataFrames; ++column) {
+        if ((block.dataPresent & (uint64_t(1) << column)) && block.data[column].size() + FecHeader::symbolOverhead > length) {
+            return 0;
+        }
+    }
+
+    // take the data we have out of each parity frame, leaving only the missing columns' share
+    if (m_symbols.size() < count) {
+        m_symbols.resize(count);
+    }
+    for (size_t n = 0; n < count; ++n) {
+        m_symbols[n].assign(block.parity[rows[n]].begin(), block.parity[rows[n]].end());
+        for (size_t column = 0; column < block.dataFrames; ++column) {
+            if (block.dataPresent & (uint64_t(1) << column)) {
+                ReedSolomon::accumulate(m_symbols[n].data(), block.data[column], ReedSolomon::coefficient(rows[n], static_cast<uint8_t>(column)));
+            }
+        }
+    }
+
+    uint8_t matrix[ReedSolomon::maxParityFrames * ReedSolomon::maxParityFrames];
+    for (size_t r = 0; r < count; ++r) {
+        for (size_t c = 0; c < count; ++c) {
+            matrix[r * count + c] = ReedSolomon::coefficient(rows[r], columns[c]);
+        }
+    }
+    if (!ReedSolomon::invert(matrix, count)) {
+        return 0;
+    }
+
+    if (m_recovered.size() < count) {
+        m_recovered.resize(count);
+    }
+    for (size_t c = 0; c < count; ++c) {
+        std::vector<uint8_t>& symbol = m_recovered[c];
+        symbol.assign(length, 0);
+        for (size_t n = 0; n < count; ++n) {
+            ReedSolomon::multiplyAdd(symbol.data(), m_symbols[n].data(), matrix[c * count + n], length);
+        }
+        const size_t frameLength = (static_cast<size_t>(symbol[0]) << 8) | symbol[1];
+        if (frameLength + FecHeader::symbolOverhead > length) {
+            return 0;
+        }
+        symbol.erase(symbol.begin(), symbol.begin() + FecHeader::symbolOverhead);
+        symbol.resize(frameLength);
+    }
+    return count;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Systematic Reed-Solomon erasure code over GF(2^8), used across a block of frames rather than within one.
+ * Data frames go out unchanged, parity frames follow the block and any lost data frames can be rebuilt as long as
+ * no more were lost than parity frames arrived.
+ *
+ * Parity row i over data column j is the Cauchy element 1 / ((0x80 | i) ^ j), so every square submatrix is
+ * invertible and a block can be closed with fewer data frames than configured without changing the parity rows.
+ * Frames of different lengths are coded as [length (2 bytes, big endian)][frame] zero padded to the longest.
+ */
+namespace ReedSolomon
+{
+	constexpr size_t maxDataFrames = 64;		// per block, bit mask width on the decoder
+	constexpr size_t maxParityFrames = 16;
+
+	uint8_t multiply(uint8_t a, uint8_t b);
+	uint8_t inverse(uint8_t a);		// 0 for 0
+
+	/**
+	 * @brief Coefficient of data frame column in parity frame row
+	 */
+	inline uint8_t coefficient(uint8_t row, uint8_t column)
+	{
+		return inverse(static_cast<uint8_t>(0x80 | row) ^ column);
+	}
+
+	/**
+	 * @brief dst[i] ^= coefficient * src[i], the only per byte loop in encode and decode
+	 */
+	void multiplyAdd(uint8_t* dst, const uint8_t* src, uint8_t coefficient, size_t length);
+
+	/**
+	 * @brief Add coefficient times the coded form of frame (length prefix then frame, padding adds nothing) into the
+	 * symbol, which must be at least frame.size() + 2 long
+	 */
+	void accumulate(uint8_t* symbol, const std::vector<uint8_t>& frame, uint8_t coefficient);
+
+	/**
+	 * @brief Invert a square matrix in place, stored row major
+	 *
+	 * @return false if it is singular
+	 */
+	bool invert(uint8_t* matrix, size_t size);
+}
+
+/**
+ * @brief Block header in front of every FEC frame, after the TDMA header
+ *
+ * data:   [block][index]					index < 0x80
+ * parity: [block][0x80 | row][data frames]	data frames is how many the block was closed with
+ */
+struct FecHeader
+{
+	static constexpr uint8_t parityFlag = 0x80;
+	static constexpr size_t dataSize = 2;
+	static constexpr size_t paritySize = 3;
+	static constexpr size_t maxSize = paritySize;
+	static constexpr size_t symbolOverhead = 2;		// length prefix of each coded frame
+};
+
+/**
+ * @brief Sending side, collects the data frames of the open block and computes its parity when it closes.
+ * Storage is reused from block to block so steady state encoding doesn't allocate.
+ */
+class FecEncoder
+{
+	public:
+		/**
+		 * @param dataFrames per block, 0 disables
+		 * @param parityFrames per block
+		 */
+		FecEncoder(uint8_t dataFrames = 0, uint8_t parityFrames = 0);
+
+		/**
+		 * @brief Change the block size, drops the open block and any parity not yet sent
+		 */
+		void configure(uint8_t dataFrames, uint8_t parityFrames);
+		bool enabled() const {return m_dataFrames && m_parityFrames;}
+		uint8_t getDataFrames() const {return m_dataFrames;}
+		uint8_t getParityFrames() const {return m_parityFrames;}
+
+		/**
+		 * @brief frame = header for the next data frame + payload. Nothing is recorded until dataSent().
+		 */
+		void dataFrame(const std::vector<uint8_t>& payload, std::vector<uint8_t>& frame) const;
+
+		/**
+		 * @brief payload went on air as the frame dataFrame() built, closes the block once it is full
+		 */
+		void dataSent(const std::vector<uint8_t>& payload);
+
+		/**
+		 * @brief Close the open block early with the data frames it has, nothing if it is empty
+		 */
+		void flush();
+
+		/**
+		 * @brief frame = the next unsent parity frame of the last closed block, header included
+		 *
+		 * @return false if there is none
+		 */
+		bool parityFrame(std::vector<uint8_t>& frame) const;
+		void paritySent() {++m_nextParity;}
+
+		size_t openFrames() const {return m_count;}
+		size_t pendingParity() const {return m_parityCount - m_nextParity;}
+
+	private:
+		void close();
+
+		uint8_t m_dataFrames;
+		uint8_t m_parityFrames;
+
+		uint8_t m_block = 0;						// id of the open block
+		std::vector<std::vector<uint8_t>> m_data;	// frames of the open block, m_count in use
+		size_t m_count = 0;
+
+		std::vector<std::vector<uint8_t>> m_parity;	// parity frames of the last closed block, with headers
+		size_t m_parityCount = 0;
+		size_t m_nextParity = 0;
+};
+
+/**
+ * @brief Receiving side, tracks the last two blocks of each sender (parity for one block goes out while the next is
+ * filling) and rebuilds lost data frames once enough parity has arrived. A sender starting a third block abandons
+ * whatever couldn't be rebuilt of the first.
+ */
+class FecDecoder
+{
+	public:
+		/**
+		 * @param maxSources senders tracked at once, the least recently heard is evicted when full
+		 */
+		explicit FecDecoder(size_t maxSources = 16);
+
+		/**
+		 * @brief Take a FEC frame (TDMA header already removed) from source. The block header is stripped, leaving
+		 * the payload of a data frame to deliver and nothing of a parity frame.
+		 *
+		 * @return number of earlier data frames rebuilt by this one, read with recovered()
+		 * @throws std::runtime_error if the block header is malformed
+		 */
+		size_t receive(uint8_t source, std::vector<uint8_t>& frame);
+
+		const std::vector<uint8_t>& recovered(size_t index) const {return m_recovered[index];}
+
+	private:
+		struct Block
+		{
+			uint8_t source;
+			uint8_t id;
+			uint8_t dataFrames;						// from the parity header, 0 until one arrives
+			bool done;								// nothing left to rebuild
+			uint64_t started;
+			uint64_t lastUsed;
+			uint64_t dataPresent;					// bit per data index
+			uint32_t parityPresent;					// bit per parity row
+			std::vector<std::vector<uint8_t>> data;
+			std::vector<std::vector<uint8_t>> parity;
+		};
+
+		Block& find(uint8_t source, uint8_t id);
+		size_t reconstruct(Block& block);
+
+		std::vector<Block> m_blocks;
+		size_t m_maxSources;
+		uint64_t m_useCounter = 0;
+
+		std::vector<std::vector<uint8_t>> m_recovered;	// reused, only as many as receive() returned are valid
+		std::vector<std::vector<uint8_t>> m_symbols;	// scratch for reconstruct
+};
@@ -0,0 +1,221 @@
+#pragma once
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/seqlock.h>
+
+/**
+ * @brief Rolling link quality for a single neighbour
+ */
+struct LinkStats
+{
+	uint8_t address;			// rnp address of the neighbour
+	uint32_t rxCount;			// packets received
+	uint32_t lostCount;			// packets missed, estimated from gaps in the sequence number
+	uint32_t duplicateCount;	// packets received with a repeated sequence number
+	float packetRssi;			// dBm of the last packet
+	float packetSnr;			// dB of the last packet
+	float rssi;					// dBm, exponentially weighted average
+	float snr;					// dB, exponentially weighted average
+	float freqError;			// Hz, exponentially weighted average
+	float per;					// packet error rate, exponentially weighted average over expected packets
+	uint32_t ackedCount;		// our frames the neighbour said it heard, from the acknowledgements it piggybacks
+	uint32_t unackedCount;		// our frames it said it missed
+	uint32_t timeLastHeard;		// ms
+};
+
+/**
+ * @brief Fixed size table of per neighbour link statistics. Written only from the radio loop, read from
+ * anywhere. Readers never block the writer, they retry if they raced an update (seqlock) so getInfo() users
+ * on other tasks always see a consistent entry.
+ *
+ * @tparam MaxNeighbours number of neighbours tracked, the least recently heard is evicted when full
+ */
+template <size_t MaxNeighbours>
+class LinkStatsTable
+{
+	public:
+		LinkStatsTable() = default;
+
+		// copies take a consistent snapshot, so info structs holding a table stay copyable
+		LinkStatsTable(const LinkStatsTable& other)
+		{
+			other.m_lock.read([this, &other]() { m_entries = other.m_entries; m_count = other.m_count; });
+		}
+
+		LinkStatsTable& operator=(const LinkStatsTable& other)
+		{
+			if (this != &other){
+				decltype(m_entries) entries;
+				size_t count = 0;
+				other.m_lock.read([&entries, &count, &other]() { entries = other.m_entries; count = other.m_count; });
+				m_lock.write([this, &entries, count]() { m_entries = entries; m_count = count; });
+			}
+			return *this;
+		}
+
+		/**
+		 * @brief Record a received packet. Writer side, radio loop only.
+		 *
+		 * @param address source of the packet
+		 * @param sequence link layer sequence number of the packet
+		 * @param rssi dBm
+		 * @param snr dB
+		 * @param freqError Hz
+		 * @param now ms timestamp of reception
+		 */
+		void update(uint8_t address, uint8_t sequence, float rssi, float snr, float freqError, uint32_t now)
+		{
+			m_lock.write([&]() {
+				Entry& entry = findOrInsert(address, now);
+				LinkStats& stats = entry.stats;
+
+				uint32_t lost = 0;
+				if (entry.sequenceValid){
+					const uint8_t gap = static_cast<uint8_t>(sequence - entry.lastSequence);
+					if (gap == 0){
+						++stats.duplicateCount;
+						return;
+					}
+					// a huge jump is more likely a restarted neighbour than 100+ lost packets
+					lost = (gap <= maxSequenceGap) ? gap - 1 : 0;
+				}
+				entry.lastSequence = sequence;
+				entry.sequenceValid = true;
+
+				const bool first = (stats.rxCount == 0);
+				++stats.rxCount;
+				stats.lostCount += lost;
+				stats.packetRssi = rssi;
+				stats.packetSnr = snr;
+				stats.rssi = first ? rssi : stats.rssi + smoothing * (rssi - stats.rssi);
+				stats.snr = first ? snr : stats.snr + smoothing * (snr - stats.snr);
+				stats.freqError = first ? freqError : stats.freqError + smoothing * (freqError - stats.freqError);
+				for (uint32_t i = 0; i < lost; ++i){
+					stats.per += smoothing * (1.0f - stats.per);
+				}
+				stats.per -= smoothing * stats.per;
+				stats.timeLastHeard = now;
+			});
+		}
+
+		/**
+		 * @brief Record whether the neighbour heard our last frame. Writer side, radio loop only.
+		 *
+		 * @param address neighbour reporting
+		 * @param heard true if it heard the frame
+		 * @param now ms timestamp of the report
+		 */
+		void acknowledged(uint8_t address, bool heard, uint32_t now)
+		{
+			m_lock.write([&]() {
+				LinkStats& stats = findOrInsert(address, now).stats;
+				if (heard){
+					++stats.ackedCount;
+				}
+				else{
+					++stats.unackedCount;
+				}
+			});
+		}
+
+		/**
+		 * @brief Record how many of our frames the neighbour heard and missed, for frames it reports on in bulk.
+		 * Writer side, radio loop only.
+		 *
+		 * @param address neighbour reporting
+		 * @param heard frames it heard
+		 * @param missed frames it missed
+		 * @param now ms timestamp of the report
+		 */
+		void acknowledged(uint8_t address, uint32_t heard, uint32_t missed, uint32_t now)
+		{
+			m_lock.write([&]() {
+				LinkStats& stats = findOrInsert(address, now).stats;
+				stats.ackedCount += heard;
+				stats.unackedCount += missed;
+			});
+		}
+
+		/**
+		 * @brief Consistent copy of the stats for one neighbour, safe to call from any thread
+		 *
+		 * @return false if the neighbour is not in the table
+		 */
+		bool get(uint8_t address, LinkStats& stats) const
+		{
+			bool found = false;
+			m_lock.read([&]() {
+				found = false;
+				for (size_t i = 0; i < m_count; ++i){
+					if (m_entries[i].stats.address == address){
+						stats = m_entries[i].stats;
+						found = true;
+						return;
+					}
+				}
+			});
+			return found;
+		}
+
+		/**
+		 * @brief Consistent copy of the whole table, safe to call from any thread
+		 *
+		 * @return number of valid entries in out
+		 */
+		size_t snapshot(std::array<LinkStats, MaxNeighbours>& out) const
+		{
+			size_t count = 0;
+			m_lock.read([&]() {
+				count = m_count;
+				for (size_t i = 0; i < count; ++i){
+					out[i] = m_entries[i].stats;
+				}
+			});
+			return count;
+		}
+
+		void clear()
+		{
+			m_lock.write([this]() { m_count = 0; });
+		}
+
+		static constexpr size_t capacity() { return MaxNeighbours; }
+
+	private:
+		struct Entry
+		{
+			LinkStats stats;
+			uint8_t lastSequence;
+			bool sequenceValid;
+		};
+
+		Entry& findOrInsert(uint8_t address, uint32_t now)
+		{
+			size_t oldest = 0;
+			for (size_t i = 0; i < m_count; ++i){
+				if (m_entries[i].stats.address == address){
+					return m_entries[i];
+				}
+				if (m_entries[i].stats.timeLastHeard < m_entries[oldest].stats.timeLastHeard){
+					oldest = i;
+				}
+			}
+			const size_t index = (m_count < MaxNeighbours) ? m_count++ : oldest;
+			m_entries[index] = Entry{};
+			m_entries[index].stats.address = address;
+			m_entries[index].stats.timeLastHeard = now;
+			return m_entries[index];
+		}
+
+		static constexpr float smoothing = 0.125f;
+		static constexpr uint8_t maxSequenceGap = 64;
+
+		std::array<Entry, MaxNeighbours> m_entries{};
+		size_t m_count = 0;
+		SeqLock m_lock;
+};
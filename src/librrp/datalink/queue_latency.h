@@ -0,0 +1,49 @@
+#pragma once
+
+// std
+#include <vector>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/latency_histogram.h>
+
+/**
+ * @brief Serialized packet waiting in a datalink send buffer
+ */
+struct QueuedFrame
+{
+	std::vector<uint8_t> data;
+	uint64_t timeEnqueued;		// us on the radio clock
+};
+
+/**
+ * @brief How long frames spend in a datalink between sendPacket() and the air, safe to read while the radio loop
+ * is running
+ */
+struct QueueLatency
+{
+	// 8 buckets per power of two (within 12.5%) up to ~33s, 184 buckets rather than the default 384 as every
+	// datalink instance carries two
+	using Histogram = LatencyHistogram<8, 25>;
+
+	Histogram queueWait;	// enqueue to start of transmission
+	Histogram total;		// enqueue to end of transmission
+
+	/**
+	 * @brief Writer side, radio loop only
+	 *
+	 * @param onAirStart us, when the physical layer accepted the frame
+	 * @param airtime us the frame spends on air
+	 */
+	void record(const QueuedFrame& frame, uint64_t onAirStart, uint64_t airtime)
+	{
+		queueWait.record(onAirStart - frame.timeEnqueued);
+		total.record(onAirStart + airtime - frame.timeEnqueued);
+	}
+
+	void reset()
+	{
+		queueWait.reset();
+		total.reset();
+	}
+};
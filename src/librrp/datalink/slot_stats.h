@@ -0,0 +1,169 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/seqlock.h>
+
+/**
+ * @brief How a TDMA node has used the medium since it started. Every slot this node owned is
+ * exactly one of used, heartbeat, yielded or idle.
+ */
+struct SlotStats
+{
+	uint32_t slotsOwned;			// tx windows held while joined
+	uint32_t slotsUsed;				// owned windows that carried data
+	uint32_t slotsHeartbeat;		// owned windows that only carried a heartbeat
+	uint32_t slotsYielded;			// owned windows handed to a node with frames queued
+	uint32_t slotsIdle;				// owned windows left empty
+	uint32_t slotsStolen;			// other nodes' windows we sent a frame in after they yielded them to us
+	uint32_t heartbeatsReceived;
+	uint64_t bytesSent;				// everything put on air including tdma headers, acks and join requests
+	uint64_t bytesReceived;			// every frame that passed the tdma header check
+	uint64_t airtimeSent;			// us
+	uint64_t airtimeReceived;		// us
+	uint32_t resyncs;				// slot boundary moved to line up with a received frame
+	int32_t lastResyncOffset;		// us the boundary moved by on the last resync, + is later
+	uint32_t nodeListResizes;		// node list changed length after joining
+	uint32_t unexpectedSource;		// frames heard in a window owned by a different node
+
+	// exponentially weighted, updated once per frame (every node's window once)
+	float slotUtilisation;			// fraction of owned windows carrying data
+	float txDutyCycle;				// fraction of the frame spent transmitting
+	float rxDutyCycle;				// fraction of the frame spent receiving
+	float frameLength;				// us
+};
+
+/**
+ * @brief SlotStats written from the radio loop and readable from any task without blocking it, same scheme as
+ * LinkStatsTable
+ */
+class SlotStatsCounter
+{
+	public:
+		SlotStatsCounter() = default;
+
+		SlotStatsCounter(const SlotStatsCounter& other):
+			m_stats(other.get())
+		{}
+
+		SlotStatsCounter& operator=(const SlotStatsCounter& other)
+		{
+			if (this != &other){
+				const SlotStats stats = other.get();
+				m_lock.write([this, &stats]() { m_stats = stats; });
+			}
+			return *this;
+		}
+
+		/**
+		 * @brief Consistent copy of the counters, safe to call from any thread
+		 */
+		SlotStats get() const
+		{
+			SlotStats stats;
+			m_lock.read([this, &stats]() { stats = m_stats; });
+			return stats;
+		}
+
+		// writer side, radio loop only
+
+		/**
+		 * @brief One of our tx windows has ended
+		 */
+		void ownedSlot(bool data, bool heartbeat, bool yielded)
+		{
+			m_lock.write([this, data, heartbeat, yielded]() {
+				++m_stats.slotsOwned;
+				if (data){
+					++m_stats.slotsUsed;
+				}
+				else if (heartbeat){
+					++m_stats.slotsHeartbeat;
+				}
+				else if (yielded){
+					++m_stats.slotsYielded;
+				}
+				else{
+					++m_stats.slotsIdle;
+				}
+			});
+		}
+
+		void stoleSlot()
+		{
+			m_lock.write([this]() { ++m_stats.slotsStolen; });
+		}
+
+		void sent(size_t bytes, uint64_t airtime)
+		{
+			m_lock.write([this, bytes, airtime]() { m_stats.bytesSent += bytes; m_stats.airtimeSent += airtime; });
+		}
+
+		void received(size_t bytes, uint64_t airtime)
+		{
+			m_lock.write([this, bytes, airtime]() { m_stats.bytesReceived += bytes; m_stats.airtimeReceived += airtime; });
+		}
+
+		void heartbeatReceived()
+		{
+			m_lock.write([this]() { ++m_stats.heartbeatsReceived; });
+		}
+
+		/**
+		 * @param offset us the slot boundary moved by
+		 */
+		void resync(int64_t offset)
+		{
+			m_lock.write([this, offset]() { ++m_stats.resyncs; m_stats.lastResyncOffset = static_cast<int32_t>(offset); });
+		}
+
+		void nodeListResized()
+		{
+			m_lock.write([this]() { ++m_stats.nodeListResizes; });
+		}
+
+		void unexpectedSource()
+		{
+			m_lock.write([this]() { ++m_stats.unexpectedSource; });
+		}
+
+		/**
+		 * @brief Fold the frame that just ended into the rolling rates
+		 *
+		 * @param now us, start of the next frame
+		 */
+		void frameEnded(uint64_t now)
+		{
+			if (m_frameStartTime && now > m_frameStartTime){
+				const float length = static_cast<float>(now - m_frameStartTime);
+				m_lock.write([this, length]() {
+					const uint32_t owned = m_stats.slotsOwned - m_frameStart.slotsOwned;
+					const bool first = (m_stats.frameLength == 0);
+					if (owned){
+						const float utilisation = static_cast<float>(m_stats.slotsUsed - m_frameStart.slotsUsed) / owned;
+						m_stats.slotUtilisation = first ? utilisation : m_stats.slotUtilisation + smoothing * (utilisation - m_stats.slotUtilisation);
+					}
+					const float tx = (m_stats.airtimeSent - m_frameStart.airtimeSent) / length;
+					const float rx = (m_stats.airtimeReceived - m_frameStart.airtimeReceived) / length;
+					m_stats.txDutyCycle = first ? tx : m_stats.txDutyCycle + smoothing * (tx - m_stats.txDutyCycle);
+					m_stats.rxDutyCycle = first ? rx : m_stats.rxDutyCycle + smoothing * (rx - m_stats.rxDutyCycle);
+					m_stats.frameLength = first ? length : m_stats.frameLength + smoothing * (length - m_stats.frameLength);
+				});
+			}
+			m_frameStart = m_stats;		// only the writer touches m_stats, no need to go through the lock
+			m_frameStartTime = now;
+		}
+
+	private:
+		static constexpr float smoothing = 0.125f;
+
+		SlotStats m_stats{};
+		SeqLock m_lock;
+
+		// counters as they were at the start of the current frame
+		SlotStats m_frameStart{};
+		uint64_t m_frameStartTime = 0;
+};
@@ -0,0 +1,215 @@
+#include "slot_tracer.h"
+#include <algorithm>
+
+SlotTracer::SlotTracer(std::string name, size_t capacity, TimeSource reference):
+    m_name(std::move(name)),
+    m_reference(std::move(reference)),
+    m_events(std::max<size_t>(capacity, 1))
+{}
+
+void SlotTracer::slot(uint64_t localTime, uint8_t slot, uint8_t owner, bool owned) {
+    push(localTime, SlotTraceType::SLOT, slot, owner, owned, 0, 0, nullptr);
+}
+
+void SlotTracer::tx(uint64_t localTime, uint8_t slot, const char* packetType, uint8_t destination, size_t bytes, uint64_t airtime) {
+    push(localTime, SlotTraceType::TX, slot, destination, false, static_cast<int32_t>(bytes), airtime, packetType);
+}
+
+void SlotTracer::rx(uint64_t localTime, uint8_t slot, const char* packetType, uint8_t source, size_t bytes, uint64_t airtime) {
+    push(localTime, SlotTraceType::RX, slot, source, false, static_cast<int32_t>(bytes), airtime, packetType);
+}
+
+void SlotTracer::resync(uint64_t localTime, uint8_t slot, int64_t offset) {
+    push(localTime, SlotTraceType::RESYNC, slot, 0, false, static_cast<int32_t>(offset), 0, nullptr);
+}
+
+void SlotTracer::discovery(uint64_t localTime, uint8_t slot, const char* phase) {
+    push(localTime, SlotTraceType::DISCOVERY, slot, 0, false, 0, 0, phase);
+}
+
+void SlotTracer::joined(uint64_t localTime, uint8_t slot) {
+    push(localTime, SlotTraceType::JOINED, slot, 0, false, 0, 0, nullptr);
+}
+
+void SlotTracer::push(uint64_t localTime, SlotTraceType type, uint8_t slot, uint8_t peer, bool owned, int32_t value, uint64_t duration, const char* label) {
+    uint64_t time = m_reference ? m_reference() : localTime;
+    if (type == SlotTraceType::RX) {
+        time -= std::min(time, duration);   // reported once the frame has arrived, it started one airtime earlier
+    }
+
+    const size_t capacity = m_events.size();
+    size_t index;
+    if (m_count < capacity) {
+        index = (m_head + m_count) % capacity;
+        ++m_count;
+    } else {
+        index = m_head;
+        m_head = (m_head + 1) % capacity;
+        ++m_dropped;
+    }
+    m_events[index] = SlotTraceEvent{time, duration, type, slot, peer, owned, value, label};
+}
+
+std::vector<SlotTraceEvent> SlotTracer::events() const {
+    std::vector<SlotTraceEvent> events;
+    events.reserve(m_count);
+    for (size_t i = 0; i < m_count; ++i) {
+        events.push_back(m_events[(m_head + i) % m_events.size()]);
+    }
+    return events;
+}
+
+void SlotTracer::clear() {
+    m_head = 0;
+    m_count = 0;
+    m_dropped = 0;
+}
+
+namespace {
+
+// trace viewer threads within each node's process
+constexpr int slotTrack = 1;
+constexpr int airTrack = 2;
+constexpr int discoveryTrack = 3;
+
+std::string escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+class TraceWriter {
+public:
+    explicit TraceWriter(std::ostream& out) : m_out(out) {
+        m_out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    }
+
+    ~TraceWriter() {
+        m_out << "\n]}\n";
+    }
+
+    void metadata(const char* name, int pid, int tid, const std::string& value) {
+        begin();
+        m_out << "{\"name\":\"" << name << "\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid
+              << ",\"args\":{\"name\":\"" << escape(value) << "\"}}";
+    }
+
+    // opens an event, the caller adds any args then calls end()
+    void span(const std::string& name, const char* category, int pid, int tid, uint64_t time, uint64_t duration) {
+        begin();
+        m_out << "{\"name\":\"" << escape(name) << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":" << pid
+              << ",\"tid\":" << tid << ",\"ts\":" << time << ",\"dur\":" << duration << ",\"args\":{";
+        m_firstArg = true;
+    }
+
+    void instant(const std::string& name, const char* category, int pid, int tid, uint64_t time, const char* scope = "t") {
+        begin();
+        m_out << "{\"name\":\"" << escape(name) << "\",\"cat\":\"" << category << "\",\"ph\":\"i\",\"s\":\"" << scope
+              << "\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"ts\":" << time << ",\"args\":{";
+        m_firstArg = true;
+    }
+
+    template <typename T>
+    void arg(const char* name, T value) {
+        m_out << (m_firstArg ? "" : ",") << "\"" << name << "\":" << value;
+        m_firstArg = false;
+    }
+
+    void end() {
+        m_out << "}}";
+    }
+
+private:
+    void begin() {
+        m_out << (m_first ? "\n" : ",\n");
+        m_first = false;
+    }
+
+    std::ostream& m_out;
+    bool m_first = true;
+    bool m_firstArg = true;
+};
+
+}
+
+void SlotTracer::writeChromeTrace(std::ostream& out, const std::vector<const SlotTracer*>& tracers) {
+    TraceWriter writer(out);
+
+    for (size_t i = 0; i < tracers.size(); ++i) {
+        const int pid = static_cast<int>(i) + 1;
+        const std::vector<SlotTraceEvent> events = tracers[i]->events();
+        writer.metadata("process_name", pid, 0, tracers[i]->getName());
+        writer.metadata("thread_name", pid, slotTrack, "slots");
+        writer.metadata("thread_name", pid, airTrack, "air");
+        writer.metadata("thread_name", pid, discoveryTrack, "discovery");
+        if (events.empty()) {
+            continue;
+        }
+
+        uint64_t traceEnd = 0;
+        for (const auto& event : events) {
+            traceEnd = std::max(traceEnd, event.time + event.duration);
+        }
+        if (tracers[i]->getDropped()) {
+            writer.instant(std::to_string(tracers[i]->getDropped()) + " earlier events dropped", "trace", pid, slotTrack, events.front().time, "p");
+            writer.end();
+        }
+
+        // slots and discovery phases run until the next one starts
+        auto nextOf = [&events, traceEnd](size_t from, SlotTraceType a, SlotTraceType b) {
+            for (size_t j = from + 1; j < events.size(); ++j) {
+                if (events[j].type == a || events[j].type == b) {
+                    return events[j].time;
+                }
+            }
+            return traceEnd;
+        };
+
+        for (size_t j = 0; j < events.size(); ++j) {
+            const SlotTraceEvent& event = events[j];
+            switch (event.type) {
+                case SlotTraceType::SLOT: {
+                    const uint64_t end = nextOf(j, SlotTraceType::SLOT, SlotTraceType::SLOT);
+                    writer.span("slot " + std::to_string(event.slot) + (event.owned ? " (tx)" : ""), "slot", pid, slotTrack, event.time, end - event.time);
+                    writer.arg("owner", static_cast<int>(event.peer));
+                    writer.arg("owned", event.owned ? "true" : "false");
+                    writer.end();
+                    break;
+                }
+                case SlotTraceType::TX:
+                case SlotTraceType::RX: {
+                    const bool tx = (event.type == SlotTraceType::TX);
+                    writer.span(std::string(tx ? "tx " : "rx ") + (event.label ? event.label : "?"), tx ? "tx" : "rx", pid, airTrack, event.time, event.duration);
+                    writer.arg(tx ? "destination" : "source", static_cast<int>(event.peer));
+                    writer.arg("bytes", event.value);
+                    writer.arg("slot", static_cast<int>(event.slot));
+                    writer.end();
+                    break;
+                }
+                case SlotTraceType::RESYNC: {
+                    writer.instant("resync", "resync", pid, slotTrack, event.time);
+                    writer.arg("offset_us", event.value);
+                    writer.end();
+                    break;
+                }
+                case SlotTraceType::DISCOVERY: {
+                    const uint64_t end = nextOf(j, SlotTraceType::DISCOVERY, SlotTraceType::JOINED);
+                    writer.span(event.label ? event.label : "?", "discovery", pid, discoveryTrack, event.time, end - event.time);
+                    writer.end();
+                    break;
+                }
+                case SlotTraceType::JOINED: {
+                    writer.instant("joined", "discovery", pid, discoveryTrack, event.time);
+                    writer.arg("slot", static_cast<int>(event.slot));
+                    writer.end();
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+
+enum class SlotTraceType : uint8_t
+{
+	SLOT,			// time window shifted, lasts until the next SLOT
+	TX,
+	RX,
+	RESYNC,			// slot boundary moved to line up with a received frame
+	DISCOVERY,		// discovery phase entered, lasts until the next DISCOVERY or JOINED
+	JOINED			// out of discovery
+};
+
+struct SlotTraceEvent
+{
+	uint64_t time;			// us on the tracer's time base, start of the event
+	uint64_t duration;		// us, airtime for TX and RX
+	SlotTraceType type;
+	uint8_t slot;			// time window the radio was in
+	uint8_t peer;			// SLOT owner, TX destination, RX source
+	bool owned;				// SLOT is our tx window
+	int32_t value;			// TX/RX bytes, RESYNC offset in us (+ is later)
+	const char* label;		// TX/RX packet type, DISCOVERY phase, must be a string literal
+};
+
+/**
+ * @brief Optional timeline of what a TDMA radio did and when, kept in a bounded buffer that overwrites its oldest
+ * events. Written only from the radio loop, dump it once the radio has stopped.
+ *
+ * Give every node in a simulation the same reference time source (e.g SimWorld::getTimeSource()) and their traces
+ * line up on one timeline, with each node's own slot boundaries drifting against the others.
+ */
+class SlotTracer
+{
+	public:
+		using TimeSource = std::function<uint64_t()>;	// us
+
+		/**
+		 * @param name shown for this node in the trace viewer
+		 * @param capacity events kept, the oldest are dropped once full
+		 * @param reference time base events are stamped with, the radio's own clock if null
+		 */
+		SlotTracer(std::string name, size_t capacity = 8192, TimeSource reference = nullptr);
+
+		// writer side, called by the radio with its own clock time
+
+		void slot(uint64_t localTime, uint8_t slot, uint8_t owner, bool owned);
+		void tx(uint64_t localTime, uint8_t slot, const char* packetType, uint8_t destination, size_t bytes, uint64_t airtime);
+		/**
+		 * @param localTime when the frame finished arriving, the event is placed at the start of the frame
+		 */
+		void rx(uint64_t localTime, uint8_t slot, const char* packetType, uint8_t source, size_t bytes, uint64_t airtime);
+		void resync(uint64_t localTime, uint8_t slot, int64_t offset);
+		void discovery(uint64_t localTime, uint8_t slot, const char* phase);
+		void joined(uint64_t localTime, uint8_t slot);
+
+		const std::string& getName() const {return m_name;}
+		size_t size() const {return m_count;}
+		uint64_t getDropped() const {return m_dropped;}
+
+		/**
+		 * @brief Events oldest first
+		 */
+		std::vector<SlotTraceEvent> events() const;
+		void clear();
+
+		/**
+		 * @brief Write the traces of one or more nodes as a single Chrome trace event JSON document, opens in
+		 * Perfetto (ui.perfetto.dev) or chrome://tracing with one process per node
+		 */
+		static void writeChromeTrace(std::ostream& out, const std::vector<const SlotTracer*>& tracers);
+
+	private:
+		void push(uint64_t localTime, SlotTraceType type, uint8_t slot, uint8_t peer, bool owned, int32_t value, uint64_t duration, const char* label);
+
+		const std::string m_name;
+		TimeSource m_reference;
+
+		std::vector<SlotTraceEvent> m_events;	// ring, allocated once up front
+		size_t m_head = 0;						// oldest event
+		size_t m_count = 0;
+		uint64_t m_dropped = 0;
+};
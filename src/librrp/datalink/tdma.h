@@ -4,16 +4,25 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <array>
 #include <queue>
 #include <algorithm>
+#include <atomic>
 
 // Ric
 #include <libriccore/riccorelogging.h>
 #include <librnp/rnp_interface.h>
 #include <librnp/rnp_packet.h>
 #include <librnp/rnp_networkmanager.h>
-#include <libriccore/platform/millis.h>
 #include <librrp/rrp_nvs_save.h>
+#include <librrp/physical/physical_layer_traits.h>
+#include <librrp/datalink/link_stats.h>
+#include <librrp/datalink/slot_stats.h>
+#include <librrp/datalink/queue_latency.h>
+#include <librrp/datalink/slot_tracer.h>
+#include <librrp/datalink/fec.h>
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
 
 struct TDMARadioInterfaceInfo : public RnpInterfaceInfo 
 {
@@ -21,6 +30,20 @@ struct TDMARadioInterfaceInfo : public RnpInterfaceInfo
 	size_t maxPayloadSize;
 	size_t currentSendBufferSize;
     bool sendBufferOverflow;
+	bool joined;	// out of discovery and holding a tx timewindow
+
+	// link quality of the last packet received
+	float packetRssi;
+	float packetSnr;
+	float packetFreqError;
+	LinkStatsTable<16> linkStats;	// per neighbour, safe to read while the radio loop is running
+	SlotStatsCounter slotStats;		// medium usage of this node, also safe to read while the radio loop is running
+	QueueLatency queueLatency;		// sendPacket() to air, also safe to read while the radio loop is running
+
+	// forward error correction, see setFec()
+	uint32_t fecParitySent;
+	uint32_t fecParityReceived;
+	uint32_t fecRecovered;			// data frames lost on air and rebuilt from parity
 };
 
 enum TDMA_MODE : uint8_t
@@ -44,24 +67,101 @@ enum DISCOVERY_PHASE : uint8_t
 enum PACKET_TYPE : uint8_t
 {
     NORMAL,
-    ACK,
-    NACK,
-    JOINREQUEST,
-    HEARTBEAT
+    JOINREQUEST = 3,	// 1 and 2 were ACK and NACK, gone since acks and join grants went in TDMAControl
+    HEARTBEAT,
+    FEC_DATA,		// NORMAL with a FecHeader, part of a block
+    FEC_PARITY,		// FecHeader + parity over the sender's last block, nothing to deliver by itself
+    YIELD			// header only, the owner has nothing to send and hands the rest of its window to dest
 };
 
-template <typename PhysicalLayer>
+// TDMA header at the start of every frame, followed by a TDMAControl section with PACKET_TYPE_CONTROL, then the
+// payload:
+// [type | flags][registered nodes][time window][source][destination][info][sequence]
+// Firmware from before the sequence byte, flags and control section sent a 6 byte header ([type] to [info]) and
+// acked with separate frames, so it can't share a network with this. PACKET_TYPE_VERSION tells the two apart: we
+// refuse its frames, and it never gets the ACK it waits for to join ours.
+
+// or'd into the type of every frame with the header above, so frames from older firmware are refused, not misread
+constexpr uint8_t PACKET_TYPE_VERSION = 0x10;
+// or'd into the type of a frame sent in the rest of a window yielded to its sender, so receivers don't take its
+// timing for the start of the window or its source for the window's owner
+constexpr uint8_t PACKET_TYPE_STOLEN = 0x80;
+// or'd into the type of a frame with a TDMAControl section after its header
+constexpr uint8_t PACKET_TYPE_CONTROL = 0x40;
+// or'd into the type of a frame whose TDMAControl section ends in heard count reports
+constexpr uint8_t PACKET_TYPE_REPORTS = 0x20;
+constexpr uint8_t PACKET_TYPE_FLAGS = PACKET_TYPE_VERSION | PACKET_TYPE_STOLEN | PACKET_TYPE_CONTROL | PACKET_TYPE_REPORTS;
+
+/**
+ * @brief Control section between the TDMA header and the payload of every frame a joined node sends (data, parity,
+ * heartbeat and yield frames), in place of separate ack frames
+ *
+ * [heard (2 bytes, big endian)][queued][grant address][grant window]
+ * then with PACKET_TYPE_REPORTS [reports][reports x (address, heard count (2 bytes, big endian))]
+ *
+ * heard:	bit i set if the sender heard the owner of the (i + 1)th window before the one this frame is in, which
+ * 			acknowledges the last frame of up to heardWindows other nodes straight away
+ * queued:	frames the sender still has queued behind this one, 255 for 255 or more
+ * grant:	answer to a join request, the requester's address and the tx window it now holds (a new one at the end, or
+ * 			the one it had if it joined before), address 0 for none. Repeated in every frame until the requester is
+ * 			heard in its window, or the join request would have timed out. Never in a stolen frame, the requester
+ * 			takes the window the frame is in for the granting node's.
+ * reports:	how many frames the sender has heard from some of the other registered nodes in all, taking turns through
+ * 			them. The fallback for frames heard doesn't reach in time (more than heardWindows windows apart, or the
+ * 			report in it lost), the node reported on puts the count against its own. One in every data and parity
+ * 			frame with room left for it in the window, as many as fit in heartbeats, one in every m_maxCountsNoTx
+ * 			yield frames so a node that only yields still reports without taking much from the node it yields to,
+ * 			none in stolen frames. A node whose frames have been too big for a report for m_maxCountsNoTx of its
+ * 			windows sends a heartbeat in place of the next.
+ */
+struct TDMAControl
+{
+	static constexpr size_t size = 5;			// without reports
+	static constexpr size_t heardWindows = 16;
+	static constexpr size_t grantOffset = 3;
+	static constexpr size_t reportSize = 3;		// and a byte for the number of them
+	static constexpr size_t maxReports = 32;
+
+	struct Report
+	{
+		uint8_t address;
+		uint16_t heardCount;	// frames heard from address, wrapping
+	};
+
+	uint16_t heard;
+	uint8_t queued;
+	uint8_t grantAddress;
+	uint8_t grantWindow;
+	uint8_t reports;
+	std::array<Report, maxReports> report;
+};
+
+template <typename PhysicalLayer, typename Clock = PlatformClock>
 class TDMARadio : public RnpInterface 
 {
+	static_assert(PhysicalLayerTraits::Check<PhysicalLayer>::value, "TDMARadio PhysicalLayer does not satisfy the physical layer contract");
+
 	public:
 		TDMARadio(PhysicalLayer& physicalLayer,
 				RnpNetworkManager& networkManager,
 				uint8_t id = 2,
 				std::string name = "TDMA radio")
-			: 	m_networkManager(networkManager),
-				m_physicalLayer(physicalLayer),
+			: 	TDMARadio(physicalLayer, networkManager, Clock(), id, name)
+				{}
+
+		/**
+		 * @param clock time source for all slot timing, each node in a simulation can be given its own
+		 */
+		TDMARadio(PhysicalLayer& physicalLayer,
+				RnpNetworkManager& networkManager,
+				Clock clock,
+				uint8_t id = 2,
+				std::string name = "TDMA radio")
+			: 	RnpInterface(id, name),
 				m_info{},
-				RnpInterface(id, name)
+				m_physicalLayer(physicalLayer),
+				m_networkManager(networkManager),
+				m_clock(std::move(clock))
 				{
 					m_info.MTU = 256;
 					m_info.maxPayloadSize = 80;
@@ -75,9 +175,21 @@ class TDMARadio : public RnpInterface
 				calcTimeWindowLength();
 				m_timeWindows = 1;			// single timewindow where node just listens
 			}
-			m_timeMovedTimeWindow = millis();
-			srand(millis() ^ reinterpret_cast<uintptr_t>(this));
-			m_discoveryTimeout = 8000 + rand() % 4000;
+			m_timeMovedTimeWindow = m_clock.micros();
+			if (!m_seeded){
+				m_rng.seed(m_clock.micros() ^ reinterpret_cast<uintptr_t>(this));
+			}
+			m_discoveryTimeout = (8000 + m_rng.nextBelow(4000)) * 1000;
+		}
+
+		/**
+		 * @brief Fix the seed for discovery backoff and join requests, call before setup(). Unseeded radios seed
+		 * from the clock, so only simulations that want repeatable runs need this.
+		 */
+		void setSeed(uint64_t seed)
+		{
+			m_rng.seed(seed);
+			m_seeded = true;
 		}
 
 		void sendPacket(RnpPacket& data) override
@@ -96,31 +208,62 @@ class TDMARadio : public RnpInterface
 				return;
 			}
 
-			std::unique_ptr<std::vector<uint8_t>> serializedPacket = std::make_unique<std::vector<uint8_t>>();
-			data.serialize(*serializedPacket);
-			m_sendBuffer.push(*serializedPacket);
+			QueuedFrame frame{{}, m_clock.micros()};
+			data.serialize(frame.data);
+			m_sendBuffer.push(std::move(frame));
 			m_info.sendBufferOverflow = false;
 			m_info.currentSendBufferSize += dataSize;
 		}
 
 		void update() override
 		{
+			if (m_queueLatencyResetRequested.exchange(false, std::memory_order_relaxed)){
+				m_info.queueLatency.reset();
+			}
+			const uint64_t timeLastPacketReceived = m_timeLastPacketReceived;
 			getPacket();	// gotta scan for packets on every loop otherwise packet time-based info is inaccurate
-			if (millis() - (m_timeMovedTimeWindow) >= m_timeWindowLength){
+			const bool packetJustReceived = m_timeLastPacketReceived != timeLastPacketReceived;
+			if (m_clock.micros() - (m_timeMovedTimeWindow) >= m_timeWindowLength){
+				const uint8_t endedTimeWindow = m_currTimeWindow;
 				m_currTimeWindow = (m_currTimeWindow + 1) % m_timeWindows;	// shift timewindow
 				RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Shifted timewindow to " + std::to_string(m_currTimeWindow));
-				m_timeMovedTimeWindow = millis();
+				m_timeMovedTimeWindow = m_clock.micros();
+				if (m_tracer){
+					const uint8_t owner = (m_currTimeWindow < m_regNodes.size()) ? m_regNodes[m_currTimeWindow] : 0;
+					m_tracer->slot(m_timeMovedTimeWindow, m_currTimeWindow, owner, m_currMode != TDMA_MODE::DISCOVERY && m_currTimeWindow == m_txTimeWindow);
+				}
+
+				if (m_currMode != TDMA_MODE::DISCOVERY){
+					if (endedTimeWindow == m_txTimeWindow){
+						m_info.slotStats.ownedSlot(m_packetSent, m_heartbeatSent, m_skippingTurn);
+						m_ownFrameSent = m_packetSent || m_heartbeatSent || m_skippingTurn;
+					}
+					if (m_currTimeWindow == 0){
+						m_info.slotStats.frameEnded(m_timeMovedTimeWindow);
+					}
+				}
 		
-				// reset bools
+				m_heardHistory = static_cast<uint16_t>((m_heardHistory << 1) | (m_heardThisWindow ? 1 : 0));
+				m_heardThisWindow = false;
+
+				// reset bools, bar a frame read on this same update, it still has to be handled
 				m_packetSent = false;
-				m_received = false;
+				m_received = m_received && packetJustReceived;
 				m_txWindowDone = false;
 				m_rxWindowDone = false;
 				m_skippingTurn = false;
+				m_heartbeatSent = false;
 			}
 		
 			if (m_currMode == TDMA_MODE::DISCOVERY){
+				if (m_tracer && m_currDiscoveryPhase != m_tracedDiscoveryPhase){
+					m_tracer->discovery(m_clock.micros(), m_currTimeWindow, discoveryPhaseName(m_currDiscoveryPhase));
+					m_tracedDiscoveryPhase = m_currDiscoveryPhase;
+				}
 				discovery();
+				if (m_tracer && m_currMode != TDMA_MODE::DISCOVERY){
+					m_tracer->joined(m_clock.micros(), m_currTimeWindow);
+				}
 			}
 			else{
 				if(m_currTimeWindow == m_txTimeWindow){
@@ -142,14 +285,148 @@ class TDMARadio : public RnpInterface
 			return &m_info;
 		}
 
+		const Clock& getClock() const {
+			return m_clock;
+		}
+
+		/**
+		 * @brief Record slot shifts, frames on air, resyncs and discovery phases into tracer, null to stop tracing.
+		 * Call from the radio loop, or before it starts.
+		 */
+		void setTracer(std::shared_ptr<SlotTracer> tracer)
+		{
+			m_tracer = std::move(tracer);
+			m_tracedDiscoveryPhase = tracedNothing;
+		}
+
+		/**
+		 * @brief Protect outgoing frames with a Reed-Solomon code across blocks of dataFrames consecutive frames,
+		 * with parityFrames parity frames per block sent in tx windows that would otherwise go unused. Up to
+		 * parityFrames lost frames per block are rebuilt by every receiver, at the cost of the late ones arriving
+		 * after the rest of the block. Under light load a block is closed early once it has been open for
+		 * dataFrames tdma frames. 0 for either turns it off (the default).
+		 *
+		 * FEC frames need a longer window, so whether FEC is on is a network setting: every node must have it on or
+		 * every node off, set before setup(). Block sizes can differ, receivers decode whatever blocks they are sent.
+		 */
+		void setFec(uint8_t dataFrames, uint8_t parityFrames)
+		{
+			m_fecEncoder.configure(dataFrames, parityFrames);
+		}
+
+		/**
+		 * @brief Hand tx windows we have nothing to send in to the node with the most frames queued. A short YIELD
+		 * frame at the start of the window names that node (every data frame carries how many more its sender has
+		 * queued), and it sends its next frame in the rest of the window if it still fits. Off by default.
+		 *
+		 * Any node yielded to takes the window whether or not it yields its own, so this can differ between nodes.
+		 */
+		void setSlotYielding(bool enabled)
+		{
+			m_slotYielding = enabled;
+		}
+
+		/**
+		 * @brief Clear the queue latency histograms. Safe to call from any task, takes effect on the next update()
+		 */
+		void resetQueueLatency()
+		{
+			m_queueLatencyResetRequested.store(true, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Clock time (us) at which update() next has something to do, assuming no packet arrives and nothing
+		 * is queued before then. Lets a scheduler sleep the node rather than poll it.
+		 */
+		uint64_t nextDeadline()
+		{
+			const uint64_t now = m_clock.micros();
+			const uint64_t windowEnd = m_timeMovedTimeWindow + m_timeWindowLength;
+
+			if (m_currMode == TDMA_MODE::DISCOVERY){
+				switch (m_currDiscoveryPhase){
+					case DISCOVERY_PHASE::SNIFFING:
+						return earliest(now, windowEnd, m_timeEnteredDiscovery + m_discoveryTimeout + 1);
+					case DISCOVERY_PHASE::JOIN_REQUEST:
+						return (m_currTimeWindow == m_txTimeWindow) ? now : earliest(now, windowEnd, windowEnd);
+					case DISCOVERY_PHASE::JOIN_REQUEST_RESPONSE:
+						return earliest(now, windowEnd, m_timeJoinRequestSent + m_joinRequestTimeout + 1);
+					default:
+						return now;		// transitional phases run straight through
+				}
+			}
+
+			// in our tx window with something left to send, otherwise nothing happens until the window shifts
+			if (m_currTimeWindow == m_txTimeWindow && !m_txWindowDone && !(m_sendBuffer.size() && m_packetSent)){
+				return now;
+			}
+			return earliest(now, windowEnd, windowEnd);
+		}
+
 	private:
+		// lets tests/microbench call the per frame functions (getPacket, the header packing) in isolation
+		friend struct TDMARadioProbe;
+
+		/**
+		 * @brief What a neighbour has told us about our frames: its last heard count, and what its heard bitmaps have
+		 * acknowledged since
+		 */
+		struct AckTally
+		{
+			uint16_t sent = 0;			// m_framesSent when its last count came in
+			uint16_t heardCount = 0;	// its last count
+			uint16_t heard = 0;			// of our frames since, heard going by its bitmaps
+			uint16_t missed = 0;		// and missed
+			bool valid = false;			// had a count from it
+		};
+
+		/**
+		 * @brief Control state kept for the node registered in a tx window
+		 */
+		struct Neighbour
+		{
+			uint8_t address = 0;		// node it was kept for, a window that changes hands starts over
+			uint8_t backlog = 0;		// frames it last said it had queued
+			uint16_t heardCount = 0;	// frames with a control section heard from it, wrapping
+			AckTally tally;				// what it has told us about our frames
+		};
+
+		// whichever of a and b comes first, now if either has already passed
+		static uint64_t earliest(uint64_t now, uint64_t a, uint64_t b)
+		{
+			return std::max(now, std::min(a, b));
+		}
+
+		/**
+		 * @brief Biggest frame a window is sized for. Acks and join grants ride in the control section of each node's
+		 * next frame, so no time is set aside for separate ack frames. FEC overhead only counts when it is on, which
+		 * is why it has to be on network wide.
+		 */
+		size_t maxFrameSize() const
+		{
+			const size_t fecOverhead = m_fecEncoder.enabled() ? FecHeader::maxSize + FecHeader::symbolOverhead : 0;
+			return m_info.maxPayloadSize + m_tdmaHeaderSize + TDMAControl::size + fecOverhead;
+		}
+
+		// heard count reports that still fit in the window after a frame of size bytes without any
+		size_t reportRoom(size_t size) const
+		{
+			return (maxFrameSize() > size + 1) ? (maxFrameSize() - size - 1) / TDMAControl::reportSize : 0;
+		}
+
+		// our frames have gone without heard count reports for long enough that the next one has to carry some
+		bool reportDue() const
+		{
+			return m_countsNoReport >= m_maxCountsNoTx && neighbours();
+		}
 
 		void calcTimeWindowLength()
 		{
 			float maxFrameLength = 2;	// assuming 2 seconds
 			float clockDrift = 2e-5;	// s/s worst drift based on the current xtal
 			float Tg = maxFrameLength * clockDrift;		// this calc doesnt give big enough value, i think it should be calculated based on the loop speed, clock drift is negligible in comparison
-			m_timeWindowLength = (m_physicalLayer.calculateAirtime(m_info.maxPayloadSize + m_tdmaHeaderSize) + m_physicalLayer.calculateAirtime(m_tdmaHeaderSize) + Tg) * 1e3f;	// (payload + TDMA header) + ack
+			m_timeWindowLength = (m_physicalLayer.calculateAirtime(maxFrameSize()) + Tg) * 1e6f;	// us
+			m_guardTime = Tg * 1e6f;
 			RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Calculated timewindow length = " + std::to_string(m_timeWindowLength));
 		}
 	
@@ -159,7 +436,8 @@ class TDMARadio : public RnpInterface
 
 				case DISCOVERY_PHASE::ENTRY: {
 					RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Entered Discovery");
-					m_timeEnteredDiscovery = millis();					// timestamp entry into discovery
+					m_timeEnteredDiscovery = m_clock.micros();					// timestamp entry into discovery
+					m_info.joined = false;
 					m_currDiscoveryPhase = DISCOVERY_PHASE::SNIFFING; 	// transition to next phase
 					break;
 				}
@@ -170,7 +448,7 @@ class TDMARadio : public RnpInterface
 						m_currDiscoveryPhase = DISCOVERY_PHASE::SYNCING;       // transition to network syncing
 						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Network detected");
 					}
-					else if (millis() - m_timeEnteredDiscovery > m_discoveryTimeout){
+					else if (m_clock.micros() - m_timeEnteredDiscovery > m_discoveryTimeout){
 						m_currDiscoveryPhase = DISCOVERY_PHASE::INIT_NETWORK;  // transition to network initialisation
 						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: No network activity detected, initialising network");
 					}
@@ -194,13 +472,14 @@ class TDMARadio : public RnpInterface
 
 				case DISCOVERY_PHASE::JOIN_REQUEST: {
 					if(m_currTimeWindow == m_txTimeWindow){
-						if (static_cast<float>(rand())/RAND_MAX > 0.5){
+						if (m_rng.nextFloat() > 0.5f){
 							std::vector<uint8_t> emptyPacket;
-							if(sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::JOINREQUEST, m_lastPacketSource) > 0){
+							if(sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::JOINREQUEST, m_lastLinkSource) > 0){
 								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Join request sent");
 								m_packetSent = true;
 								m_received = false;
-								m_timeJoinRequestSent = millis();
+								m_timeJoinRequestSent = m_clock.micros();
+								m_joinRequestDest = m_lastLinkSource;
 								m_currDiscoveryPhase = DISCOVERY_PHASE::JOIN_REQUEST_RESPONSE; // transition to waiting for response
 							}
 						}
@@ -213,48 +492,29 @@ class TDMARadio : public RnpInterface
 
 				case DISCOVERY_PHASE::JOIN_REQUEST_RESPONSE: {
 
-					// join request ack
-					if(m_received && m_lastPacketType == PACKET_TYPE::ACK && m_lastPacketDest == m_networkManager.getAddress()){
-						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received join request ack");
+					// join grant, piggybacked on the next frame the node we asked sends in its own window
+					if(m_received && hasGrantFor(m_networkManager.getAddress())){
+						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received join grant");
 
 						m_timeWindows = m_lastPacketRegNodes + 1;   // set local number of timewindows to match network
-						m_txTimeWindow = m_timeWindows - 2;			// set local tx timewindow
+						m_txTimeWindow = m_lastPacketControl.grantWindow;	// a new window at the end, or ours from before if we had joined already
 						m_currTimeWindow = m_lastPacketTimeWindow;
 
 						m_regNodes.resize(m_lastPacketRegNodes);
-						m_regNodes[m_lastPacketInfo] = m_lastPacketSource;	// m_lastPacketInfo field contains the tx timewindow of the acking node in the case of an ack
-						m_regNodes[m_regNodes.size() - 1] = m_networkManager.getAddress();	// add self to end of list
+						m_regNodes[m_lastPacketTimeWindow] = m_lastLinkSource;	// sent in its own window
+						m_regNodes[m_txTimeWindow] = m_networkManager.getAddress();
 
 						m_received = false;
 						m_currDiscoveryPhase = DISCOVERY_PHASE::EXIT;
 
-						for (int i = 0; i < m_regNodes.size(); ++i){
+						for (size_t i = 0; i < m_regNodes.size(); ++i){
 							RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("reg nodes after discovery phase: " + std::to_string(m_regNodes[i]));
 						}
 					}
 
-					// join request nack
-					else if(m_received && m_lastPacketType == PACKET_TYPE::NACK && m_lastPacketDest == m_networkManager.getAddress()){  
-
-						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: This node has joined before");
-						m_currTimeWindow = m_lastPacketTimeWindow;    // sync local current timewindow to network
-						m_timeWindows = m_lastPacketRegNodes + 1;
-						m_txTimeWindow = m_lastPacketInfo;	// m_lastPacketInfo field contains the tx timewindow of the requesting node in the case of a nack
-
-						// TODO: this needs to change cuz we need to place the address of the nacking node in the right position in the reg nodes list
-						m_regNodes.push_back(m_lastPacketSource);
-						m_regNodes.insert(m_regNodes.begin() + m_txTimeWindow, m_networkManager.getAddress());
-						//
-						m_received = false;
-						m_currDiscoveryPhase = DISCOVERY_PHASE::EXIT;
-
-						for (int i = 0; i < m_regNodes.size(); ++i){
-							RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("reg nodes after discovery phase: " + std::to_string(m_regNodes[i]));
-						}
-					}
-
-					// join request expired
-					if (millis() - m_timeJoinRequestSent > m_joinRequestTimeout || (m_received && m_lastPacketType == PACKET_TYPE::HEARTBEAT)){
+					// join request expired, or the node we asked has had its window without granting it
+					else if (m_clock.micros() - m_timeJoinRequestSent > m_joinRequestTimeout
+						|| (m_received && m_lastPacketHasControl && !m_lastPacketStolen && m_lastLinkSource == m_joinRequestDest)){
 						m_currDiscoveryPhase = DISCOVERY_PHASE::JOIN_REQUEST;  // try again
 					}
 					break;
@@ -263,6 +523,7 @@ class TDMARadio : public RnpInterface
 				
 				case DISCOVERY_PHASE::EXIT: {
 					m_currMode = TDMA_MODE::TRANSMIT;      // to exit out of discovery, assign any other mode other than discovery
+					m_info.joined = true;
 					RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Exiting discovery");
 					break;
 				}
@@ -283,15 +544,31 @@ class TDMARadio : public RnpInterface
 			std::vector<uint8_t> data;
 		
 			if (m_physicalLayer.readPacket(data)){
-				m_received = true;
-				m_timeLastPacketReceived = millis();
+				const uint64_t timeRead = m_clock.micros();
 		
 				try{					// unpack TDMA header
 					unpackTDMAHeader(data); // modifies data vector
 				} catch (std::exception& e){
 					RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Error: " + std::string(e.what()));
-					return;
+					return;		// not heard as far as discovery and slot timing go
+				}
+				m_received = true;
+				m_timeLastPacketReceived = timeRead;
+
+				if (m_lastPacketStolen && m_currMode == TDMA_MODE::DISCOVERY){
+					m_received = false;		// sent partway into a window, no good for finding where windows start
+				}
+
+				m_info.slotStats.received(m_lastPacketSize, airtime(m_lastPacketSize));
+				if (m_tracer){
+					m_tracer->rx(m_timeLastPacketReceived, m_currTimeWindow, packetTypeName(m_lastPacketType), m_lastLinkSource, m_lastPacketSize, airtime(m_lastPacketSize));
 				}
+
+				const PhysicalLayerInfo* phyInfo = m_physicalLayer.getInfo();
+				m_info.packetRssi = phyInfo->packetRssi;
+				m_info.packetSnr = phyInfo->packetSnr;
+				m_info.packetFreqError = phyInfo->packetFreqError;
+				m_info.linkStats.update(m_lastLinkSource, m_lastPacketSequence, phyInfo->packetRssi, phyInfo->packetSnr, phyInfo->packetFreqError, static_cast<uint32_t>(m_timeLastPacketReceived / 1000));
 		
 				// TODO: fix this shit
 				if (m_currMode != TDMA_MODE::DISCOVERY && m_lastPacketRegNodes - static_cast<uint8_t>(m_regNodes.size()) > 0){  //local node list is shorter
@@ -299,80 +576,255 @@ class TDMARadio : public RnpInterface
 					m_regNodes.resize(m_lastPacketRegNodes);
 					m_timeWindows = m_lastPacketRegNodes + 1;
 					m_currTimeWindow = m_lastPacketTimeWindow;
+					m_info.slotStats.nodeListResized();
 				}        
 		
-				if (data.size()){     // packet contains something after unpacking the tdma header
-		
-					if (_packetBuffer == nullptr){
+				if (m_lastPacketHasControl){
+					control();
+				}
+
+				size_t recovered = 0;
+				if (m_lastPacketType == PACKET_TYPE::FEC_DATA || m_lastPacketType == PACKET_TYPE::FEC_PARITY){
+					try{
+						recovered = m_fecDecoder.receive(m_lastLinkSource, data);	// strips the block header
+					} catch (std::exception& e){
+						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Error: " + std::string(e.what()));
 						return;
 					}
-					std::unique_ptr<RnpPacketSerialized> packet_ptr;
-					try
-					{
-						packet_ptr = std::make_unique<RnpPacketSerialized>(data);
-					}
-					catch (std::exception& e)
-					{
-						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Deserialization error: " + std::string(e.what()));
-						return;
+					if (m_lastPacketType == PACKET_TYPE::FEC_PARITY){
+						++m_info.fecParityReceived;
 					}
+				}
 		
-					// update member variables with rnp header info
-					m_lastPacketSource = packet_ptr->header.source;
-					m_lastPacketDest = packet_ptr->header.destination;
-		
-					// update source interface
-					packet_ptr->header.src_iface = getID();
-					_packetBuffer->push(std::move(packet_ptr));	// add packet ptr to rnp packet buffer
+				if (data.size()){     // packet contains something after unpacking the tdma header
+					// the rnp source and destination are end to end and go up with the packet, a frame we hear may be
+					// one its sender forwards for another node, so slots, grants and link stats stay on the link ones
+					std::unique_ptr<RnpPacketSerialized> packet_ptr = deserialize(data);
+					if (packet_ptr){
+						deliver(std::move(packet_ptr));
+					}
 				}
+
+				// data frames lost earlier in the block, rebuilt from this one
+				for (size_t i = 0; i < recovered; ++i){
+					RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Recovered lost packet from FEC parity");
+					++m_info.fecRecovered;
+					std::unique_ptr<RnpPacketSerialized> packet_ptr = deserialize(m_fecDecoder.recovered(i));
+					if (packet_ptr){
+						deliver(std::move(packet_ptr));
+					}
+				}
+			}
+		}
+
+		/**
+		 * @brief Take in the control section of the frame just unpacked, join grants are left to discovery
+		 */
+		void control(){
+			const TDMAControl& control = m_lastPacketControl;
+			Neighbour* sender = lastSender();
+			if (sender){
+				sender->backlog = control.queued;		// for picking who to yield our idle windows to
+			}
+			if (m_lastPacketStolen){
+				return;
+			}
+			m_heardThisWindow = true;
+			if (m_lastLinkSource == m_grantAddress){
+				m_grantAddress = 0;		// joined, no need to keep granting
+			}
+			if (!sender || m_lastLinkSource == m_networkManager.getAddress()){
+				return;
+			}
+			++sender->heardCount;
+			const uint32_t now = static_cast<uint32_t>(m_timeLastPacketReceived / 1000);
+			AckTally& tally = sender->tally;
+
+			// whether the sender heard our last frame, if it was one of the windows it reports on and its count
+			// hasn't covered that frame already
+			if (m_currMode != TDMA_MODE::DISCOVERY && m_ownFrameSent && !(tally.valid && covered(tally.sent, m_ownFrameNumber))){
+				const size_t back = (m_lastPacketTimeWindow + m_timeWindows - 1 - m_txTimeWindow) % m_timeWindows;
+				if (back < TDMAControl::heardWindows){
+					const bool heard = (control.heard >> back) & 1;
+					m_info.linkStats.acknowledged(m_lastLinkSource, heard, now);
+					if (heard){
+						++tally.heard;
+					}
+					else{
+						++tally.missed;
+					}
+				}
+			}
+
+			// how many of our frames it has heard in all, whatever the bitmaps since its last count haven't told us
+			for (size_t i = 0; i < control.reports; ++i){
+				if (control.report[i].address == m_networkManager.getAddress()){
+					reconcile(tally, control.report[i].heardCount, now);
+				}
+			}
+		}
+
+		/**
+		 * @brief Put a neighbour's count of the frames it has heard from us against the frames we sent since its last
+		 * count. Frames the heard bitmaps already acknowledged or missed in between are taken off, the rest are the
+		 * ones that left its bitmap before it could report them.
+		 */
+		void reconcile(AckTally& tally, uint16_t heardCount, uint32_t now)
+		{
+			const uint16_t sent = static_cast<uint16_t>(m_framesSent - tally.sent);
+			const uint16_t heard = static_cast<uint16_t>(heardCount - tally.heardCount);
+			if (tally.valid && heard <= sent){		// more heard than sent is a neighbour that restarted, start over
+				const uint16_t missed = sent - heard;
+				m_info.linkStats.acknowledged(m_lastLinkSource, heard - std::min(heard, tally.heard), missed - std::min(missed, tally.missed), now);
+			}
+			tally = {m_framesSent, heardCount, 0, 0, true};
+		}
+
+		/**
+		 * @brief Control state for address, registered in window
+		 *
+		 * @return nullptr if the window is past the end of our node list
+		 */
+		Neighbour* neighbour(size_t window, uint8_t address)
+		{
+			if (window >= m_regNodes.size()){
+				return nullptr;
+			}
+			if (m_neighbours.size() < m_regNodes.size()){
+				m_neighbours.resize(m_regNodes.size());
+			}
+			Neighbour& entry = m_neighbours[window];
+			if (entry.address != address){
+				entry = Neighbour{};
+				entry.address = address;
+			}
+			return &entry;
+		}
+
+		Neighbour* neighbour(uint8_t address)
+		{
+			return neighbour(std::find(m_regNodes.begin(), m_regNodes.end(), address) - m_regNodes.begin(), address);
+		}
+
+		// control state for the sender of the frame just unpacked, kept under the window it was sent in unless that
+		// window belongs to someone else, which the frame may be sent before rx() registers it in
+		Neighbour* lastSender()
+		{
+			const size_t window = m_lastPacketTimeWindow;
+			if (m_lastPacketStolen || window >= m_regNodes.size() || (m_regNodes[window] && m_regNodes[window] != m_lastLinkSource)){
+				return neighbour(m_lastLinkSource);
+			}
+			return neighbour(window, m_lastLinkSource);
+		}
+
+		// control state for the node registered in window, nullptr if nothing has been heard from it there
+		const Neighbour* knownNeighbour(size_t window) const
+		{
+			if (window >= m_neighbours.size() || !m_regNodes[window] || m_neighbours[window].address != m_regNodes[window]){
+				return nullptr;
+			}
+			return &m_neighbours[window];
+		}
+
+		// whether our frame numbered frame is one of the first sent we had sent, numbers wrapping
+		static bool covered(uint16_t sent, uint16_t frame)
+		{
+			return static_cast<uint16_t>(sent - frame) < 0x8000;
+		}
+
+		// a join grant still to go out with our frames, dropped once the requester would have given up on it
+		bool grantPending()
+		{
+			if (m_grantAddress && m_clock.micros() - m_timeGranted > m_joinRequestTimeout){
+				m_grantAddress = 0;
+			}
+			return m_grantAddress;
+		}
+
+		// the frame just unpacked grants address a tx window, and can be trusted to say where windows are
+		bool hasGrantFor(uint8_t address) const
+		{
+			return m_lastPacketHasControl && !m_lastPacketStolen && m_lastPacketControl.grantAddress == address
+				&& m_lastPacketControl.grantWindow < m_lastPacketRegNodes && m_lastPacketTimeWindow < m_lastPacketRegNodes;
+		}
+
+		std::unique_ptr<RnpPacketSerialized> deserialize(const std::vector<uint8_t>& data)
+		{
+			if (_packetBuffer == nullptr){
+				return nullptr;
+			}
+			try
+			{
+				return std::make_unique<RnpPacketSerialized>(data);
 			}
+			catch (std::exception& e)
+			{
+				RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Deserialization error: " + std::string(e.what()));
+				return nullptr;
+			}
+		}
+
+		void deliver(std::unique_ptr<RnpPacketSerialized> packet_ptr)
+		{
+			// update source interface
+			packet_ptr->header.src_iface = getID();
+			_packetBuffer->push(std::move(packet_ptr));	// add packet ptr to rnp packet buffer
 		}
 
 		void tx(){
 
 			if(m_sendBuffer.size()){    //buffer not empty
 
-				// if(m_countsNoAck > m_maxCountsNoAck){  	// check if exceed limit on resends
-				// 	uint8_t poppedPacketSize = sizeof(m_sendBuffer.back());
-				// 	m_sendBuffer.pop();      			// pop old packet
-				// 	m_info.currentSendBufferSize -= poppedPacketSize;
-				// 	m_countsNoAck = 0;      				// reset counter
-				// 	m_txWindowDone = true;
-				// }
-
-				if(!m_packetSent){
-					uint8_t bytesWritten = sendPacketWithTDMAHeader(m_sendBuffer.front(), PACKET_TYPE::NORMAL, 0) - m_tdmaHeaderSize;
-					if (bytesWritten){
+				if(!m_packetSent && reportDue() && !reportRoom(queuedFrameSize())){
+					// too big for a heard count report again, this window reports instead
+					std::vector<uint8_t> emptyPacket;
+					if (sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::HEARTBEAT, 0)){
+						m_heartbeatSent = true;
+					}
+					m_txWindowDone = true;
+				}
+				else if(!m_packetSent){
+					if (sendQueuedFrame(false)){
 						m_packetSent = true;
 						m_received = false;
-						m_sendBuffer.pop();
-						m_info.currentSendBufferSize -= bytesWritten;
-						// m_countsNoAck++;  // just trust me bro, it makes sense
-						m_countsNoTx = 0; 
-						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: RNP packet sent");
 					}
 				}
-				else{                   // packet has been sent
-					// RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Waiting for Ack");
-					// if (m_received)
-					// {
-					// 	RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("received something: " +  std::to_string(m_lastPacketType));
-					// }
-					// if (m_received && m_lastPacketType == PACKET_TYPE::ACK){ // packet got acked
-					// 	RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("got Ack");
-					// 	uint8_t poppedPacketSize = sizeof(m_sendBuffer.back());
-					// 	m_sendBuffer.pop();      			// pop old packet
-					// 	m_info.currentSendBufferSize -= poppedPacketSize;
-					// 	m_countsNoAck = 0;      				// reset counter
-					// 	m_txWindowDone = true;
-					// }
-				} 
 		
 			}
 			else{                           // buffer empty
-				if (m_countsNoTx >= m_maxCountsNoTx){        // node didn't transmit in a long time
+				if (m_fecEncoder.enabled() && !m_packetSent){
+					// a block that would have filled by now at a frame per tdma frame is closed with what it has, so
+					// light traffic still gets parity without closing a block after every frame
+					const uint64_t blockTime = static_cast<uint64_t>(m_fecEncoder.getDataFrames()) * m_timeWindows * m_timeWindowLength;
+					if (m_clock.micros() - m_timeFecBlockOpened >= blockTime){
+						m_fecEncoder.flush();
+					}
+					if (m_fecEncoder.parityFrame(m_fecFrame) && sendPacketWithTDMAHeader(m_fecFrame, PACKET_TYPE::FEC_PARITY, 0)){
+						m_fecEncoder.paritySent();
+						++m_info.fecParitySent;
+						m_packetSent = true;
+						m_countsNoTx = 0;						// keeps our slot alive as well as a heartbeat would
+						m_txWindowDone = true;
+						return;
+					}
+				}
+				if (m_slotYielding && !m_packetSent){
+					const uint8_t nominee = yieldNominee();
 					std::vector<uint8_t> emptyPacket;
-					sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::HEARTBEAT, 0);
+					if (nominee && sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::YIELD, nominee)){
+						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Yielded timewindow to " + std::to_string(nominee));
+						neighbour(nominee)->backlog = 0;	// until whatever it sends in our window says otherwise
+						m_skippingTurn = true;
+						m_countsNoTx = 0;			// heard by everyone, as good as a heartbeat
+						m_txWindowDone = true;
+						return;
+					}
+				}
+				if (m_countsNoTx >= m_maxCountsNoTx || grantPending()){        // node didn't transmit in a long time, or has a join grant to send
+					std::vector<uint8_t> emptyPacket;
+					if (sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::HEARTBEAT, 0)){
+						m_heartbeatSent = true;
+					}
 					m_countsNoTx = 0;
 					m_txWindowDone = true;
 					RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Heartbeat packet sent");
@@ -385,11 +837,96 @@ class TDMARadio : public RnpInterface
 			}
 		}
 
+		/**
+		 * @brief Put the frame at the front of the send buffer on air
+		 *
+		 * @param stolen sent in the rest of a window its owner yielded to us
+		 * @return false if the physical layer didn't take it, the frame stays queued
+		 */
+		bool sendQueuedFrame(bool stolen){
+			const uint64_t onAirStart = m_clock.micros();
+			QueuedFrame& frame = m_sendBuffer.front();
+			const size_t dataSize = frame.data.size();
+			size_t bytesWritten;
+			if (m_fecEncoder.enabled()){
+				m_fecEncoder.dataFrame(frame.data, m_fecFrame);		// the queued frame stays as it is for the block's parity
+				bytesWritten = sendPacketWithTDMAHeader(m_fecFrame, PACKET_TYPE::FEC_DATA, 0, 255, stolen);
+				if (bytesWritten){
+					if (!m_fecEncoder.openFrames()){
+						m_timeFecBlockOpened = onAirStart;
+					}
+					m_fecEncoder.dataSent(frame.data);
+				}
+			}
+			else{
+				bytesWritten = sendPacketWithTDMAHeader(frame.data, PACKET_TYPE::NORMAL, 0, 255, stolen);
+			}
+			if (!bytesWritten){
+				return false;
+			}
+			m_info.queueLatency.record(frame, onAirStart, airtime(bytesWritten));
+			m_sendBuffer.pop();
+			m_info.currentSendBufferSize -= dataSize;
+			m_countsNoTx = 0; 
+			RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: RNP packet sent");
+			return true;
+		}
+
+		// bytes on air for the frame at the front of the send buffer, without heard count reports
+		size_t queuedFrameSize() const
+		{
+			return m_tdmaHeaderSize + TDMAControl::size + m_sendBuffer.front().data.size() + (m_fecEncoder.enabled() ? FecHeader::dataSize : 0);
+		}
+
+		/**
+		 * @brief The owner of the current window has handed us the rest of it, send our next frame if it still fits
+		 */
+		void steal(){
+			if (m_sendBuffer.empty()){
+				return;
+			}
+			const uint64_t windowEnd = m_timeMovedTimeWindow + m_timeWindowLength;
+			if (m_clock.micros() + airtime(queuedFrameSize()) + m_guardTime > windowEnd){
+				return;			// would still be on air when the next owner starts
+			}
+			if (sendQueuedFrame(true)){
+				m_info.slotStats.stoleSlot();
+			}
+		}
+
+		/**
+		 * @brief Who to yield our window to: the registered node with the most frames queued going by the control
+		 * section of the last frame heard from it, ties to whoever's window comes first after ours
+		 *
+		 * @return its address, 0 if nobody has anything waiting
+		 */
+		uint8_t yieldNominee() const
+		{
+			uint8_t nominee = 0;
+			uint8_t most = 0;
+			for (size_t i = 1; i < m_regNodes.size(); ++i){
+				const size_t window = (m_txTimeWindow + i) % m_regNodes.size();
+				const Neighbour* known = knownNeighbour(window);
+				if (known && known->address != m_networkManager.getAddress() && known->backlog > most){
+					nominee = known->address;
+					most = known->backlog;
+				}
+			}
+			return nominee;
+		}
+
 		void rx(){
 
 			if(m_received){
-				if (!(m_lastPacketType == ACK || m_lastPacketType == NACK)){	// cuz acks and nacks can be sent at the end of the timewindow
-					m_timeMovedTimeWindow = m_timeLastPacketReceived - static_cast<uint32_t>(m_physicalLayer.calculateAirtime(m_lastPacketSize)*1e3f);
+				if (!m_lastPacketStolen){	// stolen frames are sent partway into the window, after a yield
+					const uint64_t timeWindowStart = m_timeLastPacketReceived - static_cast<uint64_t>(m_physicalLayer.calculateAirtime(m_lastPacketSize)*1e6f);
+					if (timeWindowStart != m_timeMovedTimeWindow){
+						m_info.slotStats.resync(static_cast<int64_t>(timeWindowStart - m_timeMovedTimeWindow));
+						if (m_tracer){
+							m_tracer->resync(m_clock.micros(), m_currTimeWindow, static_cast<int64_t>(timeWindowStart - m_timeMovedTimeWindow));
+						}
+					}
+					m_timeMovedTimeWindow = timeWindowStart;
 				}
 		
 				switch (m_lastPacketType) {
@@ -398,41 +935,44 @@ class TDMARadio : public RnpInterface
 						
 						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received join request");
 		
-						if (m_lastPacketDest == m_networkManager.getAddress()){
-							auto it = find(m_regNodes.begin(), m_regNodes.end(), m_lastPacketSource);
+						if (m_lastLinkDest == m_networkManager.getAddress()){
+							auto it = find(m_regNodes.begin(), m_regNodes.end(), m_lastLinkSource);
 			
 							if(it == m_regNodes.end()){                        		// node has not been registered yet
-								m_regNodes.push_back(m_lastPacketSource);           // add to node list
-								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: RNP Node (requesting node) " + std::to_string(m_lastPacketSource) + " added to list");
+								m_regNodes.push_back(m_lastLinkSource);           // add to node list
+								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: RNP Node (requesting node) " + std::to_string(m_lastLinkSource) + " added to list");
 								m_timeWindows = m_regNodes.size() + 1;             	// update number of timewindows
-								std::vector<uint8_t> emptyPacket;
-								sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::ACK, m_lastPacketSource, m_txTimeWindow);
+								m_info.slotStats.nodeListResized();
+								m_grantAddress = m_lastLinkSource;				// granted in our next frames
+								m_grantWindow = static_cast<uint8_t>(m_regNodes.size() - 1);
+								m_timeGranted = m_clock.micros();
 								m_rxWindowDone = true;
-								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Join request acked");
+								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Join request granted");
 							}
 							else{                                                   // node has already been registered
-								uint8_t requesterTxTimewindow = static_cast<uint8_t>(it - m_regNodes.begin());
-								std::vector<uint8_t> emptyPacket;
-								sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::NACK, m_lastPacketSource, requesterTxTimewindow);
+								m_grantAddress = m_lastLinkSource;				// given back the window it had
+								m_grantWindow = static_cast<uint8_t>(it - m_regNodes.begin());
+								m_timeGranted = m_clock.micros();
 								m_rxWindowDone = true;      
-								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Join request nacked");   
+								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Join request from a registered node granted its old window");   
 							}
 						}
 						break;
 					}
 						
 					
-					case PACKET_TYPE::NORMAL: {                                  // handling RNP packet
+					case PACKET_TYPE::NORMAL:
+					case PACKET_TYPE::FEC_DATA:
+					case PACKET_TYPE::FEC_PARITY: {                              // handling RNP packet
 						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received RNP packet");
-						// std::vector<uint8_t> emptyPacket;
-						// sendPacketWithTDMAHeader(emptyPacket, PACKET_TYPE::ACK, m_lastPacketSource);
-						if (m_lastPacketSource != m_regNodes[m_currTimeWindow]){
+						if (!m_lastPacketStolen && m_currTimeWindow < m_regNodes.size() && m_lastLinkSource != m_regNodes[m_currTimeWindow]){	// the last window is the join window, nobody owns it
 							if (!m_regNodes[m_currTimeWindow]){
-								m_regNodes[m_currTimeWindow] = m_lastPacketSource;
-								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Updating 0 value with missed address " + std::to_string(m_lastPacketSource));
+								m_regNodes[m_currTimeWindow] = m_lastLinkSource;
+								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Updating 0 value with missed address " + std::to_string(m_lastLinkSource));
 							}
 							else{
-								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received packet from " + std::to_string(m_lastPacketSource) + " when expecting " + std::to_string(m_regNodes[m_currTimeWindow]));
+								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received packet from " + std::to_string(m_lastLinkSource) + " when expecting " + std::to_string(m_regNodes[m_currTimeWindow]));
+								m_info.slotStats.unexpectedSource();
 							}
 						}
 						m_rxWindowDone = true; 
@@ -441,19 +981,29 @@ class TDMARadio : public RnpInterface
 
 					case PACKET_TYPE::HEARTBEAT: { 
 						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received heartbeat packet");
-						if (m_lastPacketSource != m_regNodes[m_currTimeWindow]){
+						m_info.slotStats.heartbeatReceived();
+						if (m_currTimeWindow < m_regNodes.size() && m_lastLinkSource != m_regNodes[m_currTimeWindow]){	// the last window is the join window, nobody owns it
 							if (!m_regNodes[m_currTimeWindow]){
-								m_regNodes[m_currTimeWindow] = m_lastPacketSource;
-								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Updating 0 value with missed address " + std::to_string(m_lastPacketSource));
+								m_regNodes[m_currTimeWindow] = m_lastLinkSource;
+								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Updating 0 value with missed address " + std::to_string(m_lastLinkSource));
 							}
 							else{
-								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received packet from " + std::to_string(m_lastPacketSource) + " when expecting " + std::to_string(m_regNodes[m_currTimeWindow]));
+								RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received packet from " + std::to_string(m_lastLinkSource) + " when expecting " + std::to_string(m_regNodes[m_currTimeWindow]));
+								m_info.slotStats.unexpectedSource();
 							}
 						}
 						m_rxWindowDone = true; 
 						break; 
 					}
 		
+					case PACKET_TYPE::YIELD: {
+						if (m_lastLinkDest == m_networkManager.getAddress()){
+							steal();
+						}
+						m_rxWindowDone = true;
+						break;
+					}
+
 					default: {                                                  // handling other packet
 						RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("TDMA Radio: Received packet type: " + std::to_string(m_lastPacketType));
 						m_rxWindowDone = true;
@@ -469,9 +1019,13 @@ class TDMARadio : public RnpInterface
 			m_currTimeWindow = m_lastPacketTimeWindow;    // sync local current timewindow to network
 			m_txTimeWindow = m_lastPacketRegNodes;        // set to send join request in the n+1th timewindow
 			m_timeWindows = m_lastPacketRegNodes+1;       // update local number of timewindows
-			RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Syncing: time last packet received = " + std::to_string(m_timeLastPacketReceived) + ", airtime of packet = " + std::to_string(static_cast<uint32_t>(m_physicalLayer.calculateAirtime(m_lastPacketSize)*1e3f)) + 
+			RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Syncing: time last packet received = " + std::to_string(m_timeLastPacketReceived) + ", airtime of packet = " + std::to_string(static_cast<uint64_t>(m_physicalLayer.calculateAirtime(m_lastPacketSize)*1e6f)) + 
 				"last packet timewindow = " + std::to_string(m_lastPacketTimeWindow));
-			m_timeMovedTimeWindow = m_timeLastPacketReceived - static_cast<uint32_t>(m_physicalLayer.calculateAirtime(m_lastPacketSize)*1e3f);
+			const uint64_t timeWindowStart = m_timeLastPacketReceived - static_cast<uint64_t>(m_physicalLayer.calculateAirtime(m_lastPacketSize)*1e6f);
+			if (m_tracer){
+				m_tracer->resync(m_clock.micros(), m_currTimeWindow, static_cast<int64_t>(timeWindowStart - m_timeMovedTimeWindow));
+			}
+			m_timeMovedTimeWindow = timeWindowStart;
 			m_synced = true;                        // syncing complete
 		}
 
@@ -480,51 +1034,184 @@ class TDMARadio : public RnpInterface
 			m_timeWindows = m_regNodes.size() + 1;    				// there should n+1 timewindows
 			m_txTimeWindow = 0;  									// tx timewindow of this node
 			m_currTimeWindow = m_txTimeWindow;
-			m_timeMovedTimeWindow = millis();
+			m_timeMovedTimeWindow = m_clock.micros();
 		}
 
 		size_t sendPacketWithTDMAHeader(std::vector<uint8_t> &packet, PACKET_TYPE packettype, uint8_t destinationNode){
-			std::vector<uint8_t> TDMAHeader = {static_cast<uint8_t>(packettype), static_cast<uint8_t>(m_regNodes.size()), 
-				m_currTimeWindow, static_cast<uint8_t>(m_networkManager.getAddress()), 
-				static_cast<uint8_t>(destinationNode), static_cast<uint8_t>(255)};
-			packet.insert(packet.begin(), TDMAHeader.begin(), TDMAHeader.end());
-			return (m_physicalLayer.sendPacket(packet));
+			return sendPacketWithTDMAHeader(packet, packettype, destinationNode, static_cast<uint8_t>(255));
 		}
 
-		size_t sendPacketWithTDMAHeader(std::vector<uint8_t> &packet, PACKET_TYPE packettype, uint8_t destinationNode, uint8_t info){
-			std::vector<uint8_t> TDMAHeader = {static_cast<uint8_t>(packettype), static_cast<uint8_t>(m_regNodes.size()), 
+		size_t sendPacketWithTDMAHeader(std::vector<uint8_t> &packet, PACKET_TYPE packettype, uint8_t destinationNode, uint8_t info, bool stolen = false){
+			const bool control = (packettype != PACKET_TYPE::JOINREQUEST);
+			size_t reports = 0;
+			if (control && !stolen && (packettype != PACKET_TYPE::YIELD || reportDue())){
+				const size_t room = reportRoom(m_tdmaHeaderSize + TDMAControl::size + packet.size());
+				reports = std::min({room, packettype == PACKET_TYPE::HEARTBEAT ? TDMAControl::maxReports : 1, neighbours()});
+			}
+			const uint8_t flags = PACKET_TYPE_VERSION | (stolen ? PACKET_TYPE_STOLEN : 0) | (control ? PACKET_TYPE_CONTROL : 0) | (reports ? PACKET_TYPE_REPORTS : 0);
+			std::vector<uint8_t> TDMAHeader = {static_cast<uint8_t>(packettype | flags), static_cast<uint8_t>(m_regNodes.size()), 
 				m_currTimeWindow, static_cast<uint8_t>(m_networkManager.getAddress()), 
-				static_cast<uint8_t>(destinationNode), info};
+				static_cast<uint8_t>(destinationNode), info, m_txSequence++};
+			const bool granting = control && !stolen && grantPending();
+			if (control){
+				size_t queued = m_sendBuffer.size();
+				if (queued && (packettype == PACKET_TYPE::NORMAL || packettype == PACKET_TYPE::FEC_DATA)){
+					--queued;		// the front of the queue is what's going out
+				}
+				TDMAHeader.push_back(static_cast<uint8_t>(m_heardHistory >> 8));
+				TDMAHeader.push_back(static_cast<uint8_t>(m_heardHistory));
+				TDMAHeader.push_back(static_cast<uint8_t>(std::min<size_t>(queued, 255)));
+				TDMAHeader.push_back(granting ? m_grantAddress : 0);
+				TDMAHeader.push_back(granting ? m_grantWindow : 0);
+				if (reports){
+					pushReports(TDMAHeader, reports);
+				}
+			}
 			packet.insert(packet.begin(), TDMAHeader.begin(), TDMAHeader.end());
-			return (m_physicalLayer.sendPacket(packet));
+			const size_t bytesWritten = m_physicalLayer.sendPacket(packet);
+			if (bytesWritten && control && !stolen){
+				m_ownFrameNumber = ++m_framesSent;
+				m_countsNoReport = reports ? 0 : static_cast<uint8_t>(std::min(m_countsNoReport + 1, 255));
+			}
+			if (bytesWritten){
+				m_info.slotStats.sent(bytesWritten, airtime(bytesWritten));
+				if (m_tracer){
+					m_tracer->tx(m_clock.micros(), m_currTimeWindow, packetTypeName(packettype), destinationNode, bytesWritten, airtime(bytesWritten));
+				}
+			}
+			return bytesWritten;
+		}
+
+		/**
+		 * @brief Add count heard count reports to the end of header, carrying on through the registered nodes from
+		 * where the last frame left off
+		 *
+		 * @param count no more than neighbours()
+		 */
+		void pushReports(std::vector<uint8_t>& header, size_t count)
+		{
+			header.push_back(static_cast<uint8_t>(count));
+			while (count){
+				m_nextReport = (m_nextReport + 1) % m_regNodes.size();
+				const uint8_t address = m_regNodes[m_nextReport];
+				if (address == 0 || address == m_networkManager.getAddress()){
+					continue;
+				}
+				const Neighbour* known = knownNeighbour(m_nextReport);
+				const uint16_t heardCount = known ? known->heardCount : 0;
+				header.push_back(address);
+				header.push_back(static_cast<uint8_t>(heardCount >> 8));
+				header.push_back(static_cast<uint8_t>(heardCount));
+				--count;
+			}
+		}
+
+		// registered nodes other than us to report heard counts for
+		size_t neighbours() const
+		{
+			return std::count_if(m_regNodes.begin(), m_regNodes.end(), [this](uint8_t address) {
+				return address != 0 && address != m_networkManager.getAddress();
+			});
+		}
+
+		// us on air for a frame of size bytes
+		uint64_t airtime(size_t size) const
+		{
+			return static_cast<uint64_t>(m_physicalLayer.calculateAirtime(size)*1e6f);
+		}
+
+		static const char* packetTypeName(PACKET_TYPE type)
+		{
+			switch (type){
+				case PACKET_TYPE::NORMAL: return "NORMAL";
+				case PACKET_TYPE::JOINREQUEST: return "JOINREQUEST";
+				case PACKET_TYPE::HEARTBEAT: return "HEARTBEAT";
+				case PACKET_TYPE::FEC_DATA: return "FEC_DATA";
+				case PACKET_TYPE::FEC_PARITY: return "FEC_PARITY";
+				case PACKET_TYPE::YIELD: return "YIELD";
+				default: return "UNKNOWN";
+			}
+		}
+
+		static const char* discoveryPhaseName(DISCOVERY_PHASE phase)
+		{
+			switch (phase){
+				case DISCOVERY_PHASE::ENTRY: return "ENTRY";
+				case DISCOVERY_PHASE::SNIFFING: return "SNIFFING";
+				case DISCOVERY_PHASE::INIT_NETWORK: return "INIT_NETWORK";
+				case DISCOVERY_PHASE::SYNCING: return "SYNCING";
+				case DISCOVERY_PHASE::JOIN_REQUEST: return "JOIN_REQUEST";
+				case DISCOVERY_PHASE::JOIN_REQUEST_RESPONSE: return "JOIN_REQUEST_RESPONSE";
+				case DISCOVERY_PHASE::EXIT: return "EXIT";
+				default: return "UNKNOWN";
+			}
 		}
 
 		void unpackTDMAHeader(std::vector<uint8_t> &packet){
-		    uint8_t initial_size = packet.size();
+		    size_t initial_size = packet.size();
+			if (initial_size < m_tdmaHeaderSize) {
+				throw std::runtime_error("packet shorter than tdma header");
+			}
+			if (!(packet[0] & PACKET_TYPE_VERSION)) {
+				throw std::runtime_error("tdma header from older firmware");
+			}
 			auto it = packet.begin();
 
 			m_lastPacketSize = initial_size;
 
-			m_lastPacketType = static_cast<PACKET_TYPE>(*it++);
+			m_lastPacketStolen       = (*it & PACKET_TYPE_STOLEN) != 0;
+			m_lastPacketHasControl   = (*it & PACKET_TYPE_CONTROL) != 0;
+			const bool hasReports    = (*it & PACKET_TYPE_REPORTS) != 0;
+			m_lastPacketType = static_cast<PACKET_TYPE>(*it++ & ~PACKET_TYPE_FLAGS);
 			m_lastPacketRegNodes     = *it++;
 			m_lastPacketTimeWindow   = *it++;
-			m_lastPacketSource       = *it++;
-			m_lastPacketDest         = *it++;
+			m_lastLinkSource       = *it++;
+			m_lastLinkDest         = *it++;
 		
 			if (*it != 255) {
 				m_lastPacketInfo = *it;
 			}
 			++it;
+			m_lastPacketSequence     = *it++;
+
+			size_t headerSize = m_tdmaHeaderSize;
+			if (m_lastPacketHasControl){
+				headerSize += TDMAControl::size;
+				if (initial_size < headerSize){
+					throw std::runtime_error("packet shorter than tdma control section");
+				}
+				m_lastPacketControl.heard = static_cast<uint16_t>((it[0] << 8) | it[1]);
+				m_lastPacketControl.queued = it[2];
+				m_lastPacketControl.grantAddress = it[TDMAControl::grantOffset];
+				m_lastPacketControl.grantWindow = it[TDMAControl::grantOffset + 1];
+				m_lastPacketControl.reports = 0;
+				it += TDMAControl::size;
+				if (hasReports){
+					if (initial_size < headerSize + 1 || *it > TDMAControl::maxReports){
+						throw std::runtime_error("bad tdma control section reports");
+					}
+					m_lastPacketControl.reports = *it++;
+					headerSize += 1 + m_lastPacketControl.reports * TDMAControl::reportSize;
+					if (initial_size < headerSize){
+						throw std::runtime_error("packet shorter than tdma control section reports");
+					}
+					for (size_t i = 0; i < m_lastPacketControl.reports; ++i){
+						m_lastPacketControl.report[i] = {it[0], static_cast<uint16_t>((it[1] << 8) | it[2])};
+						it += TDMAControl::reportSize;
+					}
+				}
+			}
 		
 			packet.erase(packet.begin(), it);
 		
-			if (initial_size - static_cast<uint8_t>(packet.size()) != m_tdmaHeaderSize) {
+			if (initial_size - packet.size() != headerSize) {
 				throw std::runtime_error("size mismatch");
 			}
 		
 		};
 
-		std::queue<std::vector<uint8_t>> m_sendBuffer; 
+		std::queue<QueuedFrame> m_sendBuffer; 
+		std::atomic<bool> m_queueLatencyResetRequested{false};
 
 		uint8_t m_timeWindows;
 		uint8_t m_currTimeWindow;
@@ -532,44 +1219,79 @@ class TDMARadio : public RnpInterface
 		
 		std::vector<uint8_t> m_regNodes;
 
-		uint32_t m_timeMovedTimeWindow = 0;
-		uint32_t m_timeWindowLength;
-		uint32_t m_timeLastPacketReceived;
-		uint32_t m_discoveryTimeout = 10e3;
-		static constexpr uint32_t m_joinRequestTimeout = 5e3;
-		uint32_t m_timeEnteredDiscovery;
-		uint32_t m_timeJoinRequestSent = 0;
+		// all times in us on m_clock
+		uint64_t m_timeMovedTimeWindow = 0;
+		uint64_t m_timeWindowLength;
+		uint64_t m_timeLastPacketReceived = 0;
+		uint64_t m_discoveryTimeout = 10e6;
+		static constexpr uint64_t m_joinRequestTimeout = 5e6;
+		uint64_t m_timeEnteredDiscovery;
+		uint64_t m_timeJoinRequestSent = 0;
 
-		uint8_t m_countsNoAck = 0;
-		static constexpr uint8_t m_maxCountsNoAck = 2;
 		uint8_t m_countsNoTx = 0;
 		static constexpr uint8_t m_maxCountsNoTx = 10;
 
 		float m_joinDutyCycle = 0.5;
 
+		Xoshiro256 m_rng;
+		bool m_seeded = false;
+
 		bool m_packetSent = false;
 		bool m_received = false;
 		bool m_synced = false;
 		bool m_txWindowDone;
 		bool m_rxWindowDone;
-		bool m_skippingTurn = false;
+		bool m_skippingTurn = false;	// yielded our tx window
+		bool m_heartbeatSent = false;
 
 		TDMA_MODE m_currMode = TDMA_MODE::DISCOVERY;
 
 		DISCOVERY_PHASE m_currDiscoveryPhase = DISCOVERY_PHASE::ENTRY;
 
-		uint8_t m_tdmaHeaderSize = 6;
-
-		uint8_t m_lastPacketSource;
-		uint8_t m_lastPacketDest;
+		FecEncoder m_fecEncoder;
+		FecDecoder m_fecDecoder;
+		std::vector<uint8_t> m_fecFrame;	// reused for every FEC frame sent
+		uint64_t m_timeFecBlockOpened = 0;	// us, first data frame of the open block went on air
+
+		bool m_slotYielding = false;
+		uint64_t m_guardTime = 0;				// us, kept clear at the end of a window
+
+		// piggybacked control, see TDMAControl
+		uint16_t m_heardHistory = 0;			// bit i: heard the owner of the (i + 1)th window back
+		bool m_heardThisWindow = false;
+		bool m_ownFrameSent = false;			// our last tx window carried something for the others to acknowledge
+		uint16_t m_framesSent = 0;				// frames with a control section sent in our own windows, wrapping
+		uint16_t m_ownFrameNumber = 0;			// m_framesSent as of the frame in our last tx window
+		size_t m_nextReport = 0;				// index into m_regNodes of the last node reported on
+		uint8_t m_countsNoReport = 0;			// frames in our own windows since the last with reports
+		std::vector<Neighbour> m_neighbours;	// by tx window, grown to m_regNodes as windows are heard from
+		uint8_t m_grantAddress = 0;				// join request to answer in our frames, 0 for none
+		uint8_t m_grantWindow = 0;
+		uint64_t m_timeGranted = 0;				// us
+		uint8_t m_joinRequestDest = 0;			// who we asked to join through
+
+		std::shared_ptr<SlotTracer> m_tracer;
+		static constexpr uint8_t tracedNothing = 0xFF;
+		uint8_t m_tracedDiscoveryPhase = tracedNothing;		// last phase handed to m_tracer
+
+		uint8_t m_tdmaHeaderSize = 7;
+		uint8_t m_txSequence = 0;	// incremented for every frame we put on air, lets receivers estimate loss
+
+		uint8_t m_lastLinkSource;		// the node that put the last frame on air, not the rnp source of what it carries
+		uint8_t m_lastLinkDest;
 		uint8_t m_lastPacketRegNodes;
 		uint8_t m_lastPacketTimeWindow;
 		uint8_t m_lastPacketInfo;
+		uint8_t m_lastPacketSequence;
 		PACKET_TYPE m_lastPacketType;
+		bool m_lastPacketStolen = false;
+		bool m_lastPacketHasControl = false;
+		TDMAControl m_lastPacketControl{};
 		size_t m_lastPacketSize;
 
 		TDMARadioInterfaceInfo m_info;
 		PhysicalLayer& m_physicalLayer;
 		RnpNetworkManager& m_networkManager;
+		Clock m_clock;
 
 };
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include <vector>
 #include <string>
 #include <queue>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
 
 // Ric
 #include <librnp/rnp_interface.h>
@@ -12,6 +15,10 @@
 #include <librnp/rnp_networkmanager.h>
 #include <libriccore/riccorelogging.h>
 
+#include <librrp/physical/physical_layer_traits.h>
+#include <librrp/datalink/link_stats.h>
+#include <librrp/datalink/queue_latency.h>
+#include <librrp/util/clock.h>
 
 // #include <librrp/rrp_nvs_save.h>
 
@@ -27,28 +34,45 @@ struct RadioInterfaceInfo : public RnpInterfaceInfo {
 	uint32_t txCount;
 	uint32_t rxCount;
 
-	    int rssi;
-    int packet_rssi;
-    float snr;
-    float packet_snr;
-    long freqError;
+    int rssi;           // dBm, smoothed for the neighbour last heard
+    int packet_rssi;    // dBm, last packet
+    float snr;          // dB, smoothed for the neighbour last heard
+    float packet_snr;   // dB, last packet
+    long freqError;     // Hz, last packet
+    LinkStatsTable<16> linkStats;   // per neighbour, safe to read while the radio loop is running
+    QueueLatency queueLatency;      // sendPacket() to air, also safe to read while the radio loop is running
 };
 
 struct TimeoutConfig {
-    uint32_t turnTimeout;
+    uint32_t turnTimeout;   // ms
 };
 
-template <typename PhysicalLayer>
+template <typename PhysicalLayer, typename Clock = PlatformClock>
 class TimeoutRadio : public RnpInterface {
+    static_assert(PhysicalLayerTraits::Check<PhysicalLayer>::value, "TimeoutRadio PhysicalLayer does not satisfy the physical layer contract");
+
 public:
     TimeoutRadio(PhysicalLayer& physicalLayer,
 		RnpNetworkManager& networkManager,
         uint8_t id = 2, 
         std::string name = "Timeout radio")
+        : TimeoutRadio(physicalLayer, networkManager, Clock(), id, name)
+          {}
+
+    /**
+     * @param clock time source for the turn timeout, each node in a simulation can be given its own
+     */
+    TimeoutRadio(PhysicalLayer& physicalLayer,
+		RnpNetworkManager& networkManager,
+        Clock clock,
+        uint8_t id = 2, 
+        std::string name = "Timeout radio")
         : RnpInterface(id, name),
 		  _physicalLayer(physicalLayer), 
 		  _networkManager(networkManager),
-          _info{} 
+          _clock(std::move(clock)),
+          _info{},
+          _config(defaultConfig)
 		  {
             _info.MTU = 256;
             _info.sendBufferSize = 2048;
@@ -82,9 +106,9 @@ public:
             return;
         }
 
-        std::vector<uint8_t> serializedPacket;
-        data.serialize(serializedPacket);
-        _sendBuffer.push(serializedPacket); // add to send buffer
+        QueuedFrame frame{{}, _clock.micros()};
+        data.serialize(frame.data);
+        _sendBuffer.push(std::move(frame)); // add to send buffer
         _info.sendBufferOverflow = false;
         _info.currentSendBufferSize += dataSize;
         checkSendBuffer(); // see if we can send 
@@ -92,7 +116,10 @@ public:
     }
 
     void update() override {
-        
+        if (_queueLatencyResetRequested.exchange(false, std::memory_order_relaxed)){
+            _info.queueLatency.reset();
+        }
+
         std::vector<uint8_t> rxData;
         if (_physicalLayer.readPacket(rxData)){  // received data
 
@@ -101,6 +128,16 @@ public:
             if (_packetBuffer == nullptr){
                 return;
             }
+            if (rxData.size() < linkHeaderSize){
+                return;
+            }
+            if (rxData[0] != linkHeaderVersion){
+                RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Timeout Radio: dropped frame with link header version " + std::to_string(rxData[0]));
+                return;
+            }
+            const uint8_t sender = rxData[1];     // link neighbour, the rnp source is the end to end one
+            const uint8_t sequence = rxData[2];
+            rxData.erase(rxData.begin(), rxData.begin() + linkHeaderSize);
             std::unique_ptr<RnpPacketSerialized> packet_ptr;
 
             try{
@@ -112,6 +149,17 @@ public:
                 return;
             }
 
+            const PhysicalLayerInfo* phyInfo = _physicalLayer.getInfo();
+            _info.linkStats.update(sender, sequence, phyInfo->packetRssi, phyInfo->packetSnr, phyInfo->packetFreqError, _clock.millis());
+            _info.packet_rssi = static_cast<int>(std::lround(phyInfo->packetRssi));
+            _info.packet_snr = phyInfo->packetSnr;
+            _info.freqError = std::lround(phyInfo->packetFreqError);
+            LinkStats neighbourStats;
+            if (_info.linkStats.get(sender, neighbourStats)){
+                _info.rssi = static_cast<int>(std::lround(neighbourStats.rssi));
+                _info.snr = neighbourStats.snr;
+            }
+
             //update source interface
             packet_ptr->header.src_iface = getID();
             _packetBuffer->push(std::move(packet_ptr));//add packet ptr  to buffer
@@ -129,23 +177,34 @@ public:
             return; // exit if nothing in the buffer
         }
 
-        if (_info.received || (millis()-_info.prevTimeSent > _config.turnTimeout)){
+        if (_info.received || (_clock.micros() - _timeSent > static_cast<uint64_t>(_config.turnTimeout) * 1000)){
             sendFromBuffer();
         }
     }
 
     void sendFromBuffer()
     {
-        size_t bytes_written = _physicalLayer.sendPacket(_sendBuffer.front());
+        std::vector<uint8_t>& packet = _sendBuffer.front().data;
+        // sender and sequence number let receivers estimate loss per neighbour
+        const uint8_t linkHeader[linkHeaderSize] = {linkHeaderVersion, static_cast<uint8_t>(_networkManager.getAddress()), _txSequence};
+        packet.insert(packet.begin(), linkHeader, linkHeader + linkHeaderSize);
+        const uint64_t onAirStart = _clock.micros();
+        size_t bytes_written = _physicalLayer.sendPacket(packet);
         if (bytes_written){ // if we succesfully send packet
+            _info.queueLatency.record(_sendBuffer.front(), onAirStart, static_cast<uint64_t>(_physicalLayer.calculateAirtime(packet.size()) * 1e6f));
             _sendBuffer.pop(); //remove packet from buffer
-            _info.currentSendBufferSize -= bytes_written;
+            _info.currentSendBufferSize -= bytes_written - linkHeaderSize;
+            ++_txSequence;
             _info.txDone = false;
-            _info.prevTimeSent = millis();
+            _timeSent = _clock.micros();
+            _info.prevTimeSent = static_cast<uint32_t>(_timeSent / 1000);
             _info.received = false;
 			_info.txCount++;
             RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Timeout Radio: packet sent");
         }
+        else{
+            packet.erase(packet.begin(), packet.begin() + linkHeaderSize);
+        }
     }
     
 
@@ -154,6 +213,32 @@ public:
         return &_info;
     }
 
+    const Clock& getClock() const {
+        return _clock;
+    }
+
+    /**
+     * @brief Clear the queue latency histograms. Safe to call from any task, takes effect on the next update()
+     */
+    void resetQueueLatency() {
+        _queueLatencyResetRequested.store(true, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Clock time (us) at which update() next has something to do, assuming no packet arrives and nothing
+     * is queued before then. Lets a scheduler sleep the node rather than poll it.
+     */
+    uint64_t nextDeadline() {
+        const uint64_t now = _clock.micros();
+        if (_sendBuffer.size() == 0){
+            return now + idleDeadline;
+        }
+        if (_info.received){
+            return now;
+        }
+        return std::max(now, _timeSent + static_cast<uint64_t>(_config.turnTimeout) * 1000 + 1);
+    }
+
     // const TimeoutConfig& getConfig() const {
     //     return _config;
     // }
@@ -193,9 +278,19 @@ public:
 private:
     PhysicalLayer& _physicalLayer;
 	RnpNetworkManager& _networkManager;
+    Clock _clock;
     RadioInterfaceInfo _info;
     TimeoutConfig _config;
     static constexpr TimeoutConfig defaultConfig{static_cast<uint32_t>(250)};
 
-    std::queue<std::vector<uint8_t>> _sendBuffer;
+    std::queue<QueuedFrame> _sendBuffer;
+    std::atomic<bool> _queueLatencyResetRequested{false};
+
+    // older firmware sent bare rnp packets, which start with the rnp start byte rather than a version, and can't
+    // share a network with this
+    static constexpr size_t linkHeaderSize = 3;     // [version][sender address][sequence]
+    static constexpr uint8_t linkHeaderVersion = 1;
+    static constexpr uint64_t idleDeadline = 1000000;   // us, nothing to do until something is queued
+    uint8_t _txSequence = 0;
+    uint64_t _timeSent = 0;    // us on _clock
 };
@@ -0,0 +1,251 @@
+#include "capture.h"
+#include <cstring>
+#include <algorithm>
+#include <libriccore/riccorelogging.h>
+
+#if !defined(ESP_PLATFORM)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr char CaptureWriter::magic[8];
+
+CaptureWriter::~CaptureWriter() {
+    close();
+}
+
+bool CaptureWriter::isOpen() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+#if defined(ESP_PLATFORM)
+    return m_file != nullptr;
+#else
+    return m_map != nullptr;
+#endif
+}
+
+uint32_t CaptureWriter::nodeId(const void* node) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto it = m_nodeIds.find(node);
+    if (it == m_nodeIds.end()) {
+        it = m_nodeIds.emplace(node, static_cast<uint32_t>(m_nodeIds.size())).first;
+    }
+    return it->second;
+}
+
+void CaptureWriter::write(const CaptureRecordHeader& header, const uint8_t* payload, const CaptureReceiver* receivers) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    const size_t size = sizeof(header) + header.payloadSize + header.receiverCount * sizeof(CaptureReceiver);
+    if (!reserve(size)) {
+        return;
+    }
+    append(&header, sizeof(header));
+    append(payload, header.payloadSize);
+    append(receivers, header.receiverCount * sizeof(CaptureReceiver));
+    ++m_recordCount;
+
+#if !defined(ESP_PLATFORM)
+    std::memcpy(m_map + offsetof(CaptureFileHeader, recordCount), &m_recordCount, sizeof(m_recordCount));
+#endif
+}
+
+uint64_t CaptureWriter::getRecordCount() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_recordCount;
+}
+
+uint64_t CaptureWriter::getBytesWritten() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_used;
+}
+
+#if defined(ESP_PLATFORM)
+
+bool CaptureWriter::open(const std::string& path) {
+    close();
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_file = std::fopen(path.c_str(), "wb");
+    if (m_file == nullptr) {
+        RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Capture: failed to open " + path);
+        return false;
+    }
+    CaptureFileHeader header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    m_used = 0;
+    m_recordCount = 0;
+    append(&header, sizeof(header));
+    return true;
+}
+
+void CaptureWriter::close() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_file == nullptr) {
+        return;
+    }
+    // stdio can't keep the count current as it goes, patch it in at the end
+    std::fseek(m_file, offsetof(CaptureFileHeader, recordCount), SEEK_SET);
+    std::fwrite(&m_recordCount, sizeof(m_recordCount), 1, m_file);
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+bool CaptureWriter::reserve(size_t) {
+    return m_file != nullptr;
+}
+
+void CaptureWriter::append(const void* data, size_t size) {
+    std::fwrite(data, 1, size, m_file);
+    m_used += size;
+}
+
+#else
+
+bool CaptureWriter::open(const std::string& path) {
+    close();
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Capture: failed to open " + path);
+        return false;
+    }
+    m_used = 0;
+    m_recordCount = 0;
+    if (!reserve(sizeof(CaptureFileHeader))) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    CaptureFileHeader header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    append(&header, sizeof(header));
+    return true;
+}
+
+void CaptureWriter::close() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_map != nullptr) {
+        ::munmap(m_map, m_capacity);
+        m_map = nullptr;
+        m_capacity = 0;
+    }
+    if (m_fd >= 0) {
+        if (::ftruncate(m_fd, static_cast<off_t>(m_used)) != 0) {
+            RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Capture: failed to trim capture file");
+        }
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool CaptureWriter::reserve(size_t bytes) {
+    if (m_fd < 0) {
+        return false;
+    }
+    if (m_used + bytes <= m_capacity) {
+        return true;
+    }
+
+    // grow the file and remap it, in big steps so this is rare
+    const size_t capacity = std::max(m_capacity + growStep, m_used + bytes);
+    if (::ftruncate(m_fd, static_cast<off_t>(capacity)) != 0) {
+        RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Capture: failed to grow capture file");
+        return false;
+    }
+    if (m_map != nullptr) {
+        ::munmap(m_map, m_capacity);
+    }
+    void* map = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Capture: failed to map capture file");
+        m_map = nullptr;
+        m_capacity = 0;
+        return false;
+    }
+    m_map = static_cast<uint8_t*>(map);
+    m_capacity = capacity;
+    return true;
+}
+
+void CaptureWriter::append(const void* data, size_t size) {
+    if (size) {
+        std::memcpy(m_map + m_used, data, size);
+    }
+    m_used += size;
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(CaptureFileHeader)) {
+        ::close(fd);
+        return false;
+    }
+    void* map = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);    // the mapping keeps the file alive
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const uint8_t*>(map);
+    m_size = static_cast<size_t>(info.st_size);
+
+    CaptureFileHeader header;
+    std::memcpy(&header, m_data, sizeof(header));
+    if (std::memcmp(header.magic, CaptureWriter::magic, sizeof(header.magic)) != 0 || header.version != CaptureWriter::version) {
+        close();
+        return false;
+    }
+    m_recordCount = header.recordCount;
+    rewind();
+    return true;
+}
+
+void CaptureReader::close() {
+    if (m_data != nullptr) {
+        ::munmap(const_cast<uint8_t*>(m_data), m_size);
+        m_data = nullptr;
+    }
+    m_size = 0;
+    m_offset = 0;
+    m_recordCount = 0;
+    m_recordsRead = 0;
+}
+
+void CaptureReader::rewind() {
+    m_offset = sizeof(CaptureFileHeader);
+    m_recordsRead = 0;
+}
+
+bool CaptureReader::next(CaptureRecord& record) {
+    if (m_data == nullptr || m_recordsRead >= m_recordCount || m_offset + sizeof(CaptureRecordHeader) > m_size) {
+        return false;
+    }
+    std::memcpy(&record.header, m_data + m_offset, sizeof(record.header));
+    const size_t payloadOffset = m_offset + sizeof(record.header);
+    const size_t receiversOffset = payloadOffset + record.header.payloadSize;
+    const size_t end = receiversOffset + record.header.receiverCount * sizeof(CaptureReceiver);
+    if (end > m_size) {
+        return false;
+    }
+
+    record.payload = m_data + payloadOffset;
+    record.receivers.resize(record.header.receiverCount);
+    if (record.header.receiverCount) {
+        std::memcpy(record.receivers.data(), m_data + receiversOffset, record.header.receiverCount * sizeof(CaptureReceiver));
+    }
+    m_offset = end;
+    ++m_recordsRead;
+    return true;
+}
+
+#endif
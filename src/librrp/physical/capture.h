@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <cstdio>
+
+/**
+ * Binary over the air capture. A capture file is a CaptureFileHeader followed by one record per transmission:
+ *
+ *     CaptureRecordHeader
+ *     uint8_t         payload[header.payloadSize]
+ *     CaptureReceiver receivers[header.receiverCount]
+ *
+ * Everything is little endian and unpadded, read records with CaptureReader rather than casting. Node ids are small
+ * integers handed out by the writer in the order it first sees each node, so they are stable across runs of the same
+ * seed, and a node keeps the same id on every channel.
+ */
+
+enum class CaptureOutcome : uint8_t
+{
+	DELIVERED,
+	CAPTURED,				// delivered over a weaker same sf packet
+	COLLISION,				// lost to same sf interference
+	INTER_SF_COLLISION,		// lost to interference from another sf
+	HALF_DUPLEX,			// receiver was transmitting
+	BELOW_SENSITIVITY,
+	RANDOM_DROP,
+	NOT_LISTENING,			// receiver on another sf, or gone before the packet finished
+	LINK_LOSS,				// dropped by the link's loss model or in an outage, see RadioImpairment
+	CORRUPTED				// delivered with injected bit errors
+};
+
+struct CaptureFileHeader
+{
+	char magic[8];				// "RRPCAP\0\0"
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t recordCount;		// kept up to date while writing, so a capture cut short still reads back
+};
+
+struct CaptureRecordHeader
+{
+	uint64_t start;				// us, world time
+	uint64_t end;				// us
+	uint32_t sender;			// node id
+	uint16_t channel;
+	uint16_t payloadSize;
+	uint16_t receiverCount;
+	uint8_t spreadingFactor;
+	uint8_t reserved;
+	float txPower;				// dBm
+};
+
+struct CaptureReceiver
+{
+	uint32_t receiver;			// node id
+	float rssi;					// dBm
+	float snr;					// dB, against noise plus same sf interference, only meaningful once delivered
+	CaptureOutcome outcome;
+	uint8_t reserved[3];
+};
+
+static_assert(sizeof(CaptureFileHeader) == 24, "capture file header must be unpadded");
+static_assert(sizeof(CaptureRecordHeader) == 32, "capture record header must be unpadded");
+static_assert(sizeof(CaptureReceiver) == 16, "capture receiver must be unpadded");
+
+/**
+ * @brief Streams records into a capture file. On linux the file is memory mapped and grown in large steps, so a record
+ * is a memcpy rather than a syscall, elsewhere it falls back to buffered stdio. Safe to share between channels and
+ * threads.
+ */
+class CaptureWriter
+{
+public:
+	static constexpr char magic[8] = {'R', 'R', 'P', 'C', 'A', 'P', 0, 0};
+	static constexpr uint32_t version = 1;
+
+	CaptureWriter() = default;
+	CaptureWriter(const CaptureWriter&) = delete;
+	CaptureWriter& operator=(const CaptureWriter&) = delete;
+	~CaptureWriter();
+
+	/**
+	 * @brief Create (or truncate) the capture file, false if it can't be created
+	 */
+	bool open(const std::string& path);
+
+	/**
+	 * @brief Flush, trim the file to what was written and close it. Called by the destructor.
+	 */
+	void close();
+
+	bool isOpen() const;
+
+	/**
+	 * @brief Id of a node in this capture, assigned on first use
+	 */
+	uint32_t nodeId(const void* node);
+
+	void write(const CaptureRecordHeader& header, const uint8_t* payload, const CaptureReceiver* receivers);
+
+	uint64_t getRecordCount() const;
+	uint64_t getBytesWritten() const;
+
+private:
+	bool reserve(size_t bytes);
+	void append(const void* data, size_t size);
+
+	mutable std::mutex m_mtx;
+	std::unordered_map<const void*, uint32_t> m_nodeIds;
+	uint64_t m_recordCount = 0;
+	uint64_t m_used = 0;		// bytes including the file header
+
+#if defined(ESP_PLATFORM)
+	std::FILE* m_file = nullptr;
+#else
+	int m_fd = -1;
+	uint8_t* m_map = nullptr;
+	size_t m_capacity = 0;
+	static constexpr size_t growStep = 16 * 1024 * 1024;
+#endif
+};
+
+/**
+ * @brief One decoded record, payload points into the reader's mapping and is valid until the reader is closed
+ */
+struct CaptureRecord
+{
+	CaptureRecordHeader header;
+	const uint8_t* payload;
+	std::vector<CaptureReceiver> receivers;
+};
+
+/**
+ * @brief Sequential reader over a memory mapped capture file, host only
+ */
+class CaptureReader
+{
+public:
+	CaptureReader() = default;
+	CaptureReader(const CaptureReader&) = delete;
+	CaptureReader& operator=(const CaptureReader&) = delete;
+	~CaptureReader();
+
+	/**
+	 * @brief Map a capture file, false if it is missing or not a capture
+	 */
+	bool open(const std::string& path);
+	void close();
+
+	/**
+	 * @brief Decode the next record into record, reusing its storage. False at the end of the capture or on a
+	 * truncated record.
+	 */
+	bool next(CaptureRecord& record);
+
+	void rewind();
+
+	uint64_t getRecordCount() const {return m_recordCount;}
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+	size_t m_offset = 0;
+	uint64_t m_recordCount = 0;
+	uint64_t m_recordsRead = 0;
+};
@@ -1,12 +1,11 @@
 #include "lora_sim_physical_layer.h"
 #include <thread>
 #include <sstream>
-#include <libriccore/platform/millis.h>
 #include <libriccore/riccorelogging.h>
 
-RadioChannelManager LoRaSimPhysicalLayer::radioChannelManager;
-
-LoRaSimPhysicalLayer::LoRaSimPhysicalLayer(float frequency, float bandwidth, uint8_t spreadingFactor, uint8_t codingRate, uint8_t preambleLength, bool crcEnabled, bool implicitHeader, bool lowDataRateOptimization)
+LoRaSimPhysicalLayer::LoRaSimPhysicalLayer(SimWorld& world, float frequency, float bandwidth, uint8_t spreadingFactor, uint8_t codingRate, uint8_t preambleLength, bool crcEnabled, bool implicitHeader, bool lowDataRateOptimization):
+	m_world(world),
+	m_linkRng(world.nextSeed())
 	{
 		m_info.frequency = frequency;
       	m_info.bandwidth = bandwidth;
@@ -18,65 +17,88 @@ LoRaSimPhysicalLayer::LoRaSimPhysicalLayer(float frequency, float bandwidth, uin
       	m_info.lowDataRateOptimization = lowDataRateOptimization;
 	}
 
+LoRaSimPhysicalLayer::~LoRaSimPhysicalLayer(){
+	if (m_currentChannel != -1) {
+		m_world.getChannelManager().unregisterNode(m_currentChannel, this);
+	}
+	m_world.getChannelManager().removeNode(this);
+}
+
 bool LoRaSimPhysicalLayer::setup(){
     RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa Sim Physical Layer: setup complete");
     return true;
 }
 
-bool LoRaSimPhysicalLayer::isBusy(){
-	return false;
-}
-
 size_t LoRaSimPhysicalLayer::sendPacket(std::vector<uint8_t> data){
-	if (m_currentChannel == -1) return 0;
+	if (!m_channel) return 0;
 
-	uint32_t airtimeMs = static_cast<uint32_t>(calculateAirtime(data.size()) * 1000);
+	uint32_t airtimeUs = static_cast<uint32_t>(calculateAirtime(data.size()) * 1e6f);
 	
-    auto channel = radioChannelManager.getChannel(m_currentChannel);
     RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa Sim Physical Layer: sending packet on channel " + std::to_string(m_currentChannel));
-    channel->transmitPacket(data, airtimeMs, this);
+    m_channel->transmitPacket(data, airtimeUs, this, m_info.spreadingFactor, m_linkModel.txPower);
 	
 	return data.size();
 }
 
-size_t LoRaSimPhysicalLayer::readPacket(std::vector<uint8_t>& data){
-    if (!m_rxBuffer.empty()) {
-        data = m_rxBuffer.front();
-        m_rxBuffer.pop();
-        return data.size();
-    }    
-	return 0;
-}
-
-float LoRaSimPhysicalLayer::calculateAirtime(size_t payloadSize) const {
-    float tSymbol = std::pow(2, m_info.spreadingFactor) / m_info.bandwidth;
-
-    int payloadSymbols = 8 + std::max(
-        static_cast<int>(std::ceil(
-            (8.0 * payloadSize - 4.0 * m_info.spreadingFactor + 28.0 + 16.0 * m_info.crcEnabled - 20.0 * m_info.implicitHeader) /
-            (4.0 * (m_info.spreadingFactor - 2.0 * m_info.lowDataRateOptimization))
-        ) * (m_info.codingRate + 4)), 
-        0);
-
-    // Total time = T_symbol * (Preamble + Payload)
-    return tSymbol * (m_info.preambleLength + payloadSymbols);
-}
-
 void LoRaSimPhysicalLayer::restart(){
     //do something maybe
 }
 
 
-void LoRaSimPhysicalLayer::setChannel(int newChannel){
+void LoRaSimPhysicalLayer::setChannel(uint8_t newChannel){
 	if (m_currentChannel != -1) {
-		radioChannelManager.unregisterNode(m_currentChannel, this);
+		m_world.getChannelManager().unregisterNode(m_currentChannel, this);
 	}
 	
 	m_currentChannel = newChannel;
+	m_channel = m_world.getChannelManager().getChannel(m_currentChannel);
 	
-	radioChannelManager.registerNode(m_currentChannel, this, [this](const std::vector<uint8_t>& data) { pushToRxBuffer(data); });
+	m_world.getChannelManager().registerNode(m_currentChannel, this, 
+		[this](const std::vector<uint8_t>& data, const RadioReception& reception) { pushToRxBuffer(data, reception); },
+		m_info.spreadingFactor);
+}
+
+void LoRaSimPhysicalLayer::pushToRxBuffer(const std::vector<uint8_t>& data, const RadioReception& reception) {
+	std::lock_guard<std::mutex> lock(m_rxMutex);
+	if (m_rxFilter && !m_rxFilter(data)) {
+		return;
+	}
+	if (reception.corrupted && m_info.crcEnabled) {
+		++m_info.crcErrors;		// without crc the bit errors go up to the datalink
+		return;
+	}
+
+	LoRaSimRxFrame frame;
+	frame.data = data;
+	frame.rssi = reception.rssi;
+	frame.snr = reception.snr;
+	frame.freqError = m_linkModel.freqError;
+	if (m_linkModel.freqErrorStdDev > 0) {
+		frame.freqError += m_linkModel.freqErrorStdDev * m_linkRng.nextNormal();
+	}
+	frame.timestamp = static_cast<uint32_t>(m_world.now() / 1000);	// world ms, the phy has no node clock of its own
+	m_rxBuffer.push(std::move(frame));
+
+	if (m_rxNotifier) {
+		m_rxNotifier();
+	}
+}
+
+void LoRaSimPhysicalLayer::setLinkModel(const LoRaSimLinkModel& linkModel) {
+	std::lock_guard<std::mutex> lock(m_rxMutex);
+	m_linkModel = linkModel;
+}
+
+void LoRaSimPhysicalLayer::setPosition(const NodePosition& position) {
+	m_world.getChannelManager().setNodePosition(this, position);
+}
+
+void LoRaSimPhysicalLayer::setRxNotifier(std::function<void()> notifier) {
+	std::lock_guard<std::mutex> lock(m_rxMutex);
+	m_rxNotifier = std::move(notifier);
 }
 
-void LoRaSimPhysicalLayer::pushToRxBuffer(std::vector<uint8_t> data) {
-	m_rxBuffer.push(data);
+void LoRaSimPhysicalLayer::setRxFilter(RxFilter filter) {
+	std::lock_guard<std::mutex> lock(m_rxMutex);
+	m_rxFilter = std::move(filter);
 }
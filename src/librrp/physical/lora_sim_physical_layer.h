@@ -9,10 +9,15 @@
 #include <atomic>
 #include <cmath>
 #include <algorithm>
+#include <random>
+#include <functional>
+#include <cstdint>
 
 // ric
 #include "radio_channel_manager.h"
 #include "radio_channel.h"
+#include "sim_world.h"
+#include <librrp/util/xoshiro.h>
 
 struct LoRaSimPhysicalLayerInfo : public PhysicalLayerInfo {
     float frequency;       // Frequency in Hz
@@ -23,29 +28,125 @@ struct LoRaSimPhysicalLayerInfo : public PhysicalLayerInfo {
     bool crcEnabled;        // CRC enabled or not
     bool implicitHeader;    // Implicit header mode or not
     bool lowDataRateOptimization; // Low data rate optimization flag
+    uint32_t crcErrors;     // corrupted frames thrown away with crc enabled, see RadioImpairment
 };
 
-class LoRaSimPhysicalLayer : public PhysicalLayerBase {
+/**
+ * @brief Radio parameters of this node that shape the link. Received power, fading and interference are
+ * modelled by the RadioChannel (see RadioChannelConfig)
+ */
+struct LoRaSimLinkModel {
+    float txPower = 13.0;           // dBm
+    float freqError = 0.0;          // mean carrier offset seen on received packets, Hz
+    float freqErrorStdDev = 0.0;    // Hz
+};
+
+/**
+ * @brief Time on air in seconds of a payload with the given modulation (Semtech AN1200.13)
+ */
+inline float loraAirtime(const LoRaSimPhysicalLayerInfo& info, size_t payloadSize)
+{
+	const float tSymbol = std::pow(2, info.spreadingFactor) / info.bandwidth;
+
+	const int payloadSymbols = 8 + std::max(
+		static_cast<int>(std::ceil(
+			(8.0 * payloadSize - 4.0 * info.spreadingFactor + 28.0 + 16.0 * info.crcEnabled - 20.0 * info.implicitHeader) /
+			(4.0 * (info.spreadingFactor - 2.0 * info.lowDataRateOptimization))
+		) * (info.codingRate + 4)), 
+		0);
+
+	// Total time = T_symbol * (Preamble + Payload)
+	return tSymbol * (info.preambleLength + payloadSymbols);
+}
+
+struct LoRaSimRxFrame {
+    std::vector<uint8_t> data;
+    float rssi;
+    float snr;
+    float freqError;
+    uint32_t timestamp;
+};
+
+class LoRaSimPhysicalLayer final {
 
     public:
-		LoRaSimPhysicalLayer(float frequency, float bandwidth, uint8_t spreadingFactor, uint8_t codingRate = 1, uint8_t preambleLength = 8, 
+		using RxFilter = std::function<bool(const std::vector<uint8_t>&)>;
+
+		LoRaSimPhysicalLayer(SimWorld& world, float frequency, float bandwidth, uint8_t spreadingFactor, uint8_t codingRate = 1, uint8_t preambleLength = 8, 
 			bool crcEnabled = true, bool implicitHeader = false, bool lowDataRateOptimization = false);
-        ~LoRaSimPhysicalLayer() override = default;
-        bool setup() override;
-        size_t sendPacket(std::vector<uint8_t> data) override;
-        size_t readPacket(std::vector<uint8_t>& data) override;
-        bool isBusy() override;
-        void restart() override;
-		float calculateAirtime(size_t payloadSize) const;
-		const PhysicalLayerInfo* getInfo() override {return &m_info;}
-		void setChannel(int newChannel);
-		void pushToRxBuffer(std::vector<uint8_t> data);
+        ~LoRaSimPhysicalLayer();
+        bool setup();
+        size_t sendPacket(std::vector<uint8_t> data);
+
+        size_t readPacket(std::vector<uint8_t>& data)
+		{
+			if (m_channel) {
+				m_channel->update();	// deliver anything that has come off air since the last poll
+			}
+
+			std::lock_guard<std::mutex> lock(m_rxMutex);
+			if (m_rxBuffer.empty()) {
+				return 0;
+			}
+			LoRaSimRxFrame& frame = m_rxBuffer.front();
+			data.swap(frame.data);
+			m_info.timeLastPacketReceived = frame.timestamp;
+			m_info.packetRssi = frame.rssi;
+			m_info.packetSnr = frame.snr;
+			m_info.packetFreqError = frame.freqError;
+			m_rxBuffer.pop();
+			return data.size();
+		}
+
+        bool isBusy() {return m_channel && m_channel->isTransmitting(this);}
+        void restart();
+
+		float calculateAirtime(size_t payloadSize) const {return loraAirtime(m_info, payloadSize);}
+
+		const PhysicalLayerInfo* getInfo() {return &m_info;}
+		void setChannel(uint8_t newChannel);
+		void pushToRxBuffer(const std::vector<uint8_t>& data, const RadioReception& reception);
+
+		void setLinkModel(const LoRaSimLinkModel& linkModel);
+		const LoRaSimLinkModel& getLinkModel() const {return m_linkModel;}
+
+		/**
+		 * @brief World time (us) at which a packet this radio sent comes off air and has to be delivered by a
+		 * readPacket() call, UINT64_MAX if nothing is in flight
+		 */
+		uint64_t nextEventTime() const {return m_channel ? m_channel->nextCompletion(this) : UINT64_MAX;}
+
+		/**
+		 * @brief Called (from whichever thread resolves the channel) every time a packet lands in the rx buffer,
+		 * so a scheduler can wake the node instead of polling readPacket()
+		 */
+		void setRxNotifier(std::function<void()> notifier);
+
+		/**
+		 * @brief Frames the filter returns false for are thrown away on arrival as if they were never heard, for
+		 * scripted faults (e.g a lost join ack). Called under the rx lock from whichever thread resolves the
+		 * channel, null keeps everything.
+		 */
+		void setRxFilter(RxFilter filter);
+
+		/**
+		 * @brief Place this radio in the simulated topology, unplaced radios hear and are heard by everyone
+		 */
+		void setPosition(const NodePosition& position);
 
     protected:
 
-        std::queue<std::vector<uint8_t>> m_rxBuffer;
-		LoRaSimPhysicalLayerInfo m_info;
+		// pushed to from whichever node thread resolves the channel, read from this node's thread
+		std::mutex m_rxMutex;
+        std::queue<LoRaSimRxFrame> m_rxBuffer;
+		LoRaSimPhysicalLayerInfo m_info{};
+
+		LoRaSimLinkModel m_linkModel;
+		std::function<void()> m_rxNotifier;
+		RxFilter m_rxFilter;
+		SimWorld& m_world;
+		Xoshiro256 m_linkRng;
 
 		int m_currentChannel = -1;
-		static RadioChannelManager radioChannelManager;
+		std::shared_ptr<RadioChannel> m_channel;
 };
\ No newline at end of file
@@ -1,107 +1,348 @@
 #include "lora_sx1280.h"
 #include <libriccore/riccorelogging.h>
+#include <libriccore/platform/millis.h>
 
-volatile bool LoRaSX1280::receivedFlag = false;
+#if defined(ESP32)
+#define LORA_SX1280_ISR_ATTR IRAM_ATTR
+#else
+#define LORA_SX1280_ISR_ATTR
+#endif
+
+volatile uint32_t LoRaSX1280::irqCount = 0;
+volatile uint32_t LoRaSX1280::irqTimestamp = 0;
+
+// dio1 is shared between tx done and rx done, the driver state tells us which one fired. Keep this
+// minimal, the spi transfers happen in service()
+LORA_SX1280_ISR_ATTR void LoRaSX1280::setFlag(void)
+{
+	irqTimestamp = millis();
+	irqCount = irqCount + 1;
+}
 
 LoRaSX1280::LoRaSX1280(int cs, int irq, int rst, int gpio, SPIClass& spi):
+	m_config(m_defaultConfig),
+	m_busyPin(gpio),
 	module(cs, irq, rst, gpio, spi),
 	sx1280(&module)
 {}
 
 bool LoRaSX1280::setup()
 {
-    delay(1500);
+	const uint32_t setupStart = millis();
+
+	// the chip holds busy high until its power on calibration is done, no need to sleep for a fixed time. RadioLib
+	// only configures the pin in begin(), so it has to be made an input here before it is polled
+	pinMode(m_busyPin, INPUT);
+	if (!waitWhileBusy(bootBusyTimeout))
+	{
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: busy line stuck high!");
+		return (false);
+	}
 
 	if (sx1280.begin() != RADIOLIB_ERR_NONE)
 	{
 		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: driver setup failed!");
 		return (false);
 	}
-	sx1280.setPacketReceivedAction(setFlag);
-	m_config = m_defaultConfig;
+	sx1280.setDio1Action(setFlag);
+
+	if (!writeConfig(m_config, true))
+	{
+		return (false);
+	}
+	m_initialised = true;
+
+	startReceive();
+
+	RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: setup complete in " + std::to_string(millis() - setupStart) + "ms");
+	return (true);
+}
+
+bool LoRaSX1280::applyConfig(const LoRaSX1280Config& config)
+{
+	if (!m_initialised)
+	{
+		// written in full by setup()
+		m_config = config;
+		return (true);
+	}
+
+	service();
+
+	if (m_state == RadioState::TRANSMITTING)
+	{
+		// modem params cant change mid packet, picked up as soon as the current packet is off air
+		m_pendingConfig = config;
+		m_configPending = true;
+		return (true);
+	}
 
-    if (sx1280.setFrequency(m_config.frequency) == RADIOLIB_ERR_INVALID_FREQUENCY) {
+	const bool wasReceiving = (m_state == RadioState::RECEIVING);
+	if (wasReceiving)
+	{
+		sx1280.standby();
+		m_state = RadioState::STANDBY;
+	}
+
+	const bool success = writeConfig(config, false);
+
+	if (wasReceiving)
+	{
+		resume();
+	}
+	return (success);
+}
+
+bool LoRaSX1280::writeConfig(const LoRaSX1280Config& config, bool force)
+{
+	// only touch registers that actually change, each setter is its own spi transaction
+
+    if ((force || config.frequency != m_config.frequency) && sx1280.setFrequency(config.frequency) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Selected frequency is invalid for this module!");
 		return (false);
     }
+	m_config.frequency = config.frequency;
 
-    if (sx1280.setBandwidth(m_config.bandwidth) == RADIOLIB_ERR_INVALID_BANDWIDTH) {
+    if ((force || config.bandwidth != m_config.bandwidth) && sx1280.setBandwidth(config.bandwidth) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Selected bandwidth is invalid for this module!");
         return (false);
     }
+	m_config.bandwidth = config.bandwidth;
 
-    if (sx1280.setSpreadingFactor(m_config.spreadingFactor) == RADIOLIB_ERR_INVALID_SPREADING_FACTOR) {
+    if ((force || config.spreadingFactor != m_config.spreadingFactor) && sx1280.setSpreadingFactor(config.spreadingFactor) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Selected spreading factor is invalid for this module!");
         return (false);
     }
+	m_config.spreadingFactor = config.spreadingFactor;
 
-    if (sx1280.setCodingRate(m_config.codingRate) == RADIOLIB_ERR_INVALID_CODING_RATE) {
+    if ((force || config.codingRate != m_config.codingRate) && sx1280.setCodingRate(config.codingRate) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Selected coding rate is invalid for this module!");
         return (false);
     }
+	m_config.codingRate = config.codingRate;
 
-    if (sx1280.setSyncWord(m_config.syncByte) != RADIOLIB_ERR_NONE) {
+    if ((force || config.syncByte != m_config.syncByte) && sx1280.setSyncWord(config.syncByte) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Unable to set sync word!");
         return (false);
     }
+	m_config.syncByte = config.syncByte;
 
-    if (sx1280.setOutputPower(m_config.txPower) == RADIOLIB_ERR_INVALID_OUTPUT_POWER) {
+    if ((force || config.txPower != m_config.txPower) && sx1280.setOutputPower(config.txPower) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Selected output power is invalid for this module!");
         return (false);
     }
+	m_config.txPower = config.txPower;
 
-    if (sx1280.setPreambleLength(m_config.preambleLength) == RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH) {
+    if ((force || config.preambleLength != m_config.preambleLength) && sx1280.setPreambleLength(config.preambleLength) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Selected preamble length is invalid for this module!");
         return (false);
     }
+	m_config.preambleLength = config.preambleLength;
 
-    if (sx1280.setCRC(m_config.crcEnabled) == RADIOLIB_ERR_INVALID_CRC_CONFIGURATION) {
+    if ((force || config.crcEnabled != m_config.crcEnabled) && sx1280.setCRC(config.crcEnabled) != RADIOLIB_ERR_NONE) {
         RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: Selected CRC is invalid for this module!");
         return (false);
     }
+	m_config.crcEnabled = config.crcEnabled;
 
-    delay(1000);
-
-	RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: setup complete");
+	m_config.implicitHeader = config.implicitHeader;
 	return (true);
 }
 
-size_t LoRaSX1280::sendPacket(std::vector<uint8_t> data)
+bool LoRaSX1280::waitWhileBusy(uint32_t timeout)
 {
-	if (sx1280.transmit(data.data(), data.size()) == RADIOLIB_ERR_NONE)
+	const uint32_t start = millis();
+	while (digitalRead(m_busyPin))
 	{
-		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: packet sent");
-		return (data.size());
-	} 
-	RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: transmit failed");
-	return (0);
+		if (millis() - start > timeout)
+		{
+			return (false);
+		}
+	}
+	return (true);
 }
 
-size_t LoRaSX1280::readPacket(std::vector<uint8_t>& data)
+size_t LoRaSX1280::sendPacket(std::vector<uint8_t> data)
 {
-	if (!receivedFlag)
+	service();
+
+	const size_t len = data.size();
+	if (!m_txQueue.push(std::move(data)))
+	{
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: tx queue full");
 		return (0);
-	receivedFlag = false;
-	size_t len = sx1280.getPacketLength();
-	data.resize(len);
-	if (sx1280.readData(data.data(), len) == RADIOLIB_ERR_NONE)
-		return (len);
-	else
-	{
-		data.clear();
+	}
+
+	if (m_state != RadioState::TRANSMITTING && !startNextTransmit() && m_txQueue.empty())
+	{
+		// packet was rejected by the radio
+		startReceive();
 		return (0);
 	}
+	return (len);
+}
+
+void LoRaSX1280::restart()
+{
+	m_initialised = false;
+	m_configPending = false;
+	m_txQueue.clear();
+
+	if (!waitWhileBusy(bootBusyTimeout) || sx1280.begin() != RADIOLIB_ERR_NONE)
+	{
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: restart failed!");
+		m_state = RadioState::STANDBY;
+		return;
+	}
+	sx1280.setDio1Action(setFlag);
+	m_irqHandled = irqCount;
+
+	if (!writeConfig(m_config, true))
+	{
+		m_state = RadioState::STANDBY;
+		return;
+	}
+	m_initialised = true;
+	startReceive();
+}
+
+void LoRaSX1280::setChannel(uint8_t channel)
+{
+	const float frequency = channelBaseFrequency + channel * channelSpacing;
+	if (frequency > channelMaxFrequency)
+	{
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: channel " + std::to_string(channel) + " is out of band");
+		return;
+	}
+
+	LoRaSX1280Config config = m_configPending ? m_pendingConfig : m_config;
+	config.frequency = frequency;
+	applyConfig(config);
+}
+
+void LoRaSX1280::service()
+{
+	const uint32_t count = irqCount;
+	const uint32_t pending = count - m_irqHandled;
+
+	if (m_state == RadioState::TRANSMITTING && !pending && millis() - m_txStartTime > m_txTimeout)
+	{
+		// dio never fired, dont let a missed interrupt wedge the driver in tx forever
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: transmit timed out");
+		completeTransmit();
+		return;
+	}
+
+	if (!pending)
+		return;
+	m_irqHandled = count;
+
+	switch (m_state)
+	{
+		case RadioState::TRANSMITTING:
+		{
+			if (pending > 1)
+			{
+				// a frame completed just as we switched to tx, its fifo contents were overwritten by our payload
+				m_info.rxMissedCount += pending - 1;
+			}
+			RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: packet sent");
+			completeTransmit();
+			break;
+		}
+		case RadioState::RECEIVING:
+		{
+			if (pending > 1)
+			{
+				// the fifo only holds the latest frame, anything before it is gone
+				m_info.rxMissedCount += pending - 1;
+			}
+			drainReceivedFrame();
+			resume();
+			break;
+		}
+		default:
+		{
+			break;
+		}
+	}
 }
 
-bool LoRaSX1280::isBusy()
+void LoRaSX1280::completeTransmit()
 {
+	sx1280.finishTransmit();
+	m_state = RadioState::STANDBY;
+	if (m_configPending)
+	{
+		m_configPending = false;
+		writeConfig(m_pendingConfig, false);
+	}
+	resume();
+}
+
+void LoRaSX1280::drainReceivedFrame()
+{
+	// read into scratch first, a full ring only gives up its oldest frame for one that was actually read
+	const size_t len = sx1280.getPacketLength();
+	m_rxScratch.resize(len);
+	if (sx1280.readData(m_rxScratch.data(), len) != RADIOLIB_ERR_NONE)
+	{
+		++m_info.rxReadErrors;
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: failed to read received packet");
+		return;
+	}
+
+	if (m_rxRing.full())
+	{
+		// keep the freshest frames, stale ones are the least useful to the datalink
+		m_rxRing.pop();
+		++m_info.rxOverflowCount;
+	}
+
+	LoRaSX1280RxFrame& frame = m_rxRing.acquire();
+	frame.data.swap(m_rxScratch);		// buffers are swapped round rather than copied
+	frame.rssi = sx1280.getRSSI();
+	frame.snr = sx1280.getSNR();
+	frame.freqError = static_cast<float>(sx1280.getFrequencyError());
+	frame.timestamp = irqTimestamp;
+	m_rxRing.commit();
+}
+
+bool LoRaSX1280::startNextTransmit()
+{
+	while (!m_txQueue.empty())
+	{
+		std::vector<uint8_t>& packet = m_txQueue.front();
+		const int16_t state = sx1280.startTransmit(packet.data(), packet.size());
+		if (state == RADIOLIB_ERR_NONE)
+		{
+			m_state = RadioState::TRANSMITTING;
+			m_txStartTime = millis();
+			m_txTimeout = static_cast<uint32_t>(calculateAirtime(packet.size()) * 2e3f) + 100;
+			m_txQueue.pop();
+			return (true);
+		}
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: transmit failed, error " + std::to_string(state));
+		m_txQueue.pop();
+	}
 	return (false);
 }
 
-void LoRaSX1280::restart()
-{}
+void LoRaSX1280::resume()
+{
+	if (!startNextTransmit())
+	{
+		startReceive();
+	}
+}
 
-float 	LoRaSX1280::calculateAirtime(size_t payloadSize)
+void LoRaSX1280::startReceive()
 {
-	return (sx1280.getTimeOnAir(payloadSize)/1e6f);
+	if (sx1280.startReceive() != RADIOLIB_ERR_NONE)
+	{
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("LoRa SX1280: failed to start receive");
+		m_state = RadioState::STANDBY;
+		return;
+	}
+	m_state = RadioState::RECEIVING;
 }
@@ -1,14 +1,28 @@
 #pragma once
 
 #include "physical_layer_base.h"
+#include <librrp/util/ring_buffer.h>
 
 #include <cmath>
+#include <algorithm>
 // #include <Preferences.h>
 #include <RadioLib.h>
 #include <SPI.h>
 
 struct LoRaSX1280LayerInfo : public PhysicalLayerInfo
 {
+	uint32_t rxOverflowCount;	// frames discarded because the rx ring was full
+	uint32_t rxMissedCount;		// dio interrupts that fired again before the previous frame was drained
+	uint32_t rxReadErrors;		// received frames that couldn't be read out of the radio fifo
+};
+
+struct LoRaSX1280RxFrame
+{
+	std::vector<uint8_t> data;
+	float rssi;				// dBm
+	float snr;				// dB
+	float freqError;		// Hz
+	uint32_t timestamp;		// millis() when the rx done interrupt fired
 };
 
 struct LoRaSX1280Config
@@ -24,26 +38,133 @@ struct LoRaSX1280Config
     bool implicitHeader;    // Implicit header mode or not
 };
 
-class LoRaSX1280 : public PhysicalLayerBase
+class LoRaSX1280 final
 {
 	public:
 		LoRaSX1280(int cs, int irq, int rst, int gpio, SPIClass& spi);
-		~LoRaSX1280() override = default;
-		bool 	setup() override;
-        size_t	sendPacket(std::vector<uint8_t> data) override;
-        size_t	readPacket(std::vector<uint8_t>& data) override;
-        bool	isBusy() override;
-        void	restart() override;
-		float 	calculateAirtime(size_t payloadSize);
-		const PhysicalLayerInfo* getInfo() override {return &m_info;}
-		void setChannel(uint8_t channel){};
+		~LoRaSX1280() = default;
+		bool 	setup();
+		/**
+		 * @brief Non-blocking send, the packet is either handed to the radio straight away or queued
+		 * behind the packet currently on air. Returns the number of bytes accepted, 0 if the tx queue is full.
+		 */
+        size_t	sendPacket(std::vector<uint8_t> data);
+		/**
+		 * @brief Pops the oldest frame from the rx ring. The frame buffer is swapped into data so no copy is made.
+		 */
+        size_t	readPacket(std::vector<uint8_t>& data)
+		{
+			service();
+
+			if (m_rxRing.empty())
+				return (0);
+
+			LoRaSX1280RxFrame& frame = m_rxRing.front();
+			data.swap(frame.data);
+			m_info.timeLastPacketReceived = frame.timestamp;
+			m_info.packetRssi = frame.rssi;
+			m_info.packetSnr = frame.snr;
+			m_info.packetFreqError = frame.freqError;
+			m_rxRing.pop();
+			return (data.size());
+		}
+
+		/**
+		 * @brief True while a packet is on air or waiting in the tx queue
+		 */
+        bool	isBusy()
+		{
+			service();
+			return (m_state == RadioState::TRANSMITTING || !m_txQueue.empty());
+		}
+
+        void	restart();
+
+		/**
+		 * @brief LoRa time on air in seconds from the SX1280 datasheet, computed from the cached config so it
+		 * is const and never touches the radio
+		 */
+		float 	calculateAirtime(size_t payloadSize) const
+		{
+			const uint8_t sf = m_config.spreadingFactor;
+			const float coeff1 = (sf < 7) ? 6.25f : 4.25f;
+			const int32_t coeff2 = (sf < 7) ? 4 * sf : 4 * sf + 8;
+			const int32_t coeff3 = (sf < 11) ? 4 * sf : 4 * (sf - 2);
+			const int32_t payloadBits = static_cast<int32_t>(8 * payloadSize) + (m_config.crcEnabled ? 16 : 0) - coeff2 + (m_config.implicitHeader ? 0 : 20);
+			const float payloadSymbols = std::ceil(static_cast<float>(std::max<int32_t>(payloadBits, 0)) / coeff3) * m_config.codingRate;
+			const float symbols = m_config.preambleLength + coeff1 + 8.0f + payloadSymbols;
+			return ((static_cast<float>(1 << sf) / m_config.bandwidth) * symbols * 1e-3f);
+		}
+
+		const PhysicalLayerInfo* getInfo() {return &m_info;}
+		/**
+		 * @brief Retune to channel n of the 2.4GHz channel plan, applied live without restarting the radio
+		 */
+		void setChannel(uint8_t channel);
+
+		/**
+		 * @brief Apply a new radio config at runtime. Only parameters that differ from the current config are
+		 * written. If a packet is on air the config is applied as soon as it has been sent.
+		 */
+		bool applyConfig(const LoRaSX1280Config& config);
+		const LoRaSX1280Config& getConfig() const {return m_config;}
+
+		/**
+		 * @brief Deferred half of the dio interrupt, completes a finished tx or drains a received frame into
+		 * the rx ring and moves the radio on to the next queued packet or back into receive. This is run from
+		 * sendPacket, readPacket and isBusy, but can also be called from a higher rate task so bursts of
+		 * frames are drained before the radio fifo is overwritten.
+		 */
+		void service();
+
+		static constexpr size_t txQueueSize = 4;
+		static constexpr size_t rxRingSize = 8;
+
+		static constexpr float channelBaseFrequency = 2400.0;	// MHz
+		static constexpr float channelSpacing = 1.0;			// MHz
+		static constexpr float channelMaxFrequency = 2483.5;	// MHz, top of the ISM band
 
 	private:
 
-		static void setFlag(void){receivedFlag = false;};
-		static volatile bool receivedFlag;
-		LoRaSX1280LayerInfo m_info;
-		LoRaSX1280Config m_config;
+		enum class RadioState : uint8_t
+		{
+			STANDBY,
+			RECEIVING,
+			TRANSMITTING
+		};
+
+		bool writeConfig(const LoRaSX1280Config& config, bool force);
+		/**
+		 * @brief Poll the busy line until the chip is ready to accept commands
+		 */
+		bool waitWhileBusy(uint32_t timeout);
+		void completeTransmit();
+		void drainReceivedFrame();
+		bool startNextTransmit();
+		void startReceive();
+		/**
+		 * @brief Send the next queued packet if there is one, otherwise go back to listening
+		 */
+		void resume();
+
+		static void setFlag(void);
+		static volatile uint32_t irqCount;
+		static volatile uint32_t irqTimestamp;
+		uint32_t m_irqHandled = 0;
+
+		RadioState m_state = RadioState::STANDBY;
+		RingBuffer<std::vector<uint8_t>, txQueueSize> m_txQueue;
+		uint32_t m_txStartTime = 0;
+		uint32_t m_txTimeout = 0;
+		RingBuffer<LoRaSX1280RxFrame, rxRingSize> m_rxRing;
+		std::vector<uint8_t> m_rxScratch;		// a frame is read here before it takes a slot in the ring
+
+		static constexpr uint32_t bootBusyTimeout = 100;	// ms
+		bool m_initialised = false;
+		bool m_configPending = false;
+		LoRaSX1280Config m_pendingConfig;
+
+		LoRaSX1280LayerInfo m_info{};
 		LoRaSX1280Config m_defaultConfig{static_cast<float>(2400.0),
 			static_cast<float>(812.5),
 			static_cast<uint8_t>(12),
@@ -53,7 +174,9 @@ class LoRaSX1280 : public PhysicalLayerBase
 			static_cast<uint16_t>(16),
 			false,
 			false};
+		LoRaSX1280Config m_config;
+		int m_busyPin;
 		Module module;
 		SX1280 sx1280;
 		SPIClass spi;
-};
\ No newline at end of file
+};
@@ -2,14 +2,24 @@
 #include <cstdint>
 #include <vector>
 #include <cstddef>
+#include <utility>
 
 
 struct PhysicalLayerInfo {
 	uint32_t timeLastPacketReceived;
+	// link quality of the packet last returned by readPacket
+	float packetRssi;		// dBm
+	float packetSnr;		// dB
+	float packetFreqError;	// Hz
 
     virtual ~PhysicalLayerInfo(){};
 };
 
+/**
+ * @brief Runtime polymorphic physical layer interface. The concrete physical layers don't inherit from this
+ * so that the datalinks can call them without virtual dispatch (see physical_layer_traits.h), wrap them in a
+ * PhysicalLayerAdapter where a PhysicalLayerBase is needed.
+ */
 class PhysicalLayerBase
 {
     public:
@@ -21,5 +31,30 @@ class PhysicalLayerBase
         virtual size_t readPacket(std::vector<uint8_t>& data) = 0;
         virtual bool isBusy() = 0;
         virtual void restart() = 0;
+		virtual float calculateAirtime(size_t payloadSize) const = 0;
+		virtual void setChannel(uint8_t channel) = 0;
 		virtual const PhysicalLayerInfo* getInfo() = 0;
 };
+
+template <typename PhysicalLayer>
+class PhysicalLayerAdapter final : public PhysicalLayerBase
+{
+    public:
+        PhysicalLayerAdapter(PhysicalLayer& physicalLayer):
+            m_physicalLayer(physicalLayer)
+        {}
+
+        bool setup() override {return m_physicalLayer.setup();}
+        size_t sendPacket(std::vector<uint8_t> data) override {return m_physicalLayer.sendPacket(std::move(data));}
+        size_t readPacket(std::vector<uint8_t>& data) override {return m_physicalLayer.readPacket(data);}
+        bool isBusy() override {return m_physicalLayer.isBusy();}
+        void restart() override {m_physicalLayer.restart();}
+		float calculateAirtime(size_t payloadSize) const override {return m_physicalLayer.calculateAirtime(payloadSize);}
+		void setChannel(uint8_t channel) override {m_physicalLayer.setChannel(channel);}
+		const PhysicalLayerInfo* getInfo() override {return m_physicalLayer.getInfo();}
+
+        PhysicalLayer& get() {return m_physicalLayer;}
+
+    private:
+        PhysicalLayer& m_physicalLayer;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "physical_layer_base.h"
+
+/**
+ * @brief Compile time contract for the PhysicalLayer template parameter of the datalinks (TDMARadio, TimeoutRadio).
+ *
+ * A physical layer is any type providing:
+ *
+ *     bool 	setup();
+ *     size_t 	sendPacket(std::vector<uint8_t> data);			// bytes accepted, 0 on failure
+ *     size_t 	readPacket(std::vector<uint8_t>& data);			// bytes read, 0 if nothing received
+ *     bool 	isBusy();
+ *     void 	restart();
+ *     float 	calculateAirtime(size_t payloadSize) const;		// seconds
+ *     void 	setChannel(uint8_t channel);
+ *     const PhysicalLayerInfo* getInfo();
+ *
+ * The datalinks call these directly on the concrete type so they can be inlined, there is no need to
+ * inherit from PhysicalLayerBase. PhysicalLayerAdapter wraps a physical layer when runtime polymorphism
+ * is actually needed.
+ */
+namespace PhysicalLayerTraits
+{
+	template <typename T, typename = void>
+	struct has_setup : std::false_type {};
+	template <typename T>
+	struct has_setup<T, std::void_t<decltype(std::declval<T&>().setup())>>
+		: std::is_convertible<decltype(std::declval<T&>().setup()), bool> {};
+
+	template <typename T, typename = void>
+	struct has_sendPacket : std::false_type {};
+	template <typename T>
+	struct has_sendPacket<T, std::void_t<decltype(std::declval<T&>().sendPacket(std::declval<std::vector<uint8_t>&>()))>>
+		: std::is_convertible<decltype(std::declval<T&>().sendPacket(std::declval<std::vector<uint8_t>&>())), size_t> {};
+
+	template <typename T, typename = void>
+	struct has_readPacket : std::false_type {};
+	template <typename T>
+	struct has_readPacket<T, std::void_t<decltype(std::declval<T&>().readPacket(std::declval<std::vector<uint8_t>&>()))>>
+		: std::is_convertible<decltype(std::declval<T&>().readPacket(std::declval<std::vector<uint8_t>&>())), size_t> {};
+
+	template <typename T, typename = void>
+	struct has_isBusy : std::false_type {};
+	template <typename T>
+	struct has_isBusy<T, std::void_t<decltype(std::declval<T&>().isBusy())>>
+		: std::is_convertible<decltype(std::declval<T&>().isBusy()), bool> {};
+
+	template <typename T, typename = void>
+	struct has_restart : std::false_type {};
+	template <typename T>
+	struct has_restart<T, std::void_t<decltype(std::declval<T&>().restart())>> : std::true_type {};
+
+	// const so the datalinks can use it from const contexts, and so it can't touch the radio
+	template <typename T, typename = void>
+	struct has_calculateAirtime : std::false_type {};
+	template <typename T>
+	struct has_calculateAirtime<T, std::void_t<decltype(std::declval<const T&>().calculateAirtime(std::declval<size_t>()))>>
+		: std::is_floating_point<decltype(std::declval<const T&>().calculateAirtime(std::declval<size_t>()))> {};
+
+	template <typename T, typename = void>
+	struct has_setChannel : std::false_type {};
+	template <typename T>
+	struct has_setChannel<T, std::void_t<decltype(std::declval<T&>().setChannel(std::declval<uint8_t>()))>> : std::true_type {};
+
+	template <typename T, typename = void>
+	struct has_getInfo : std::false_type {};
+	template <typename T>
+	struct has_getInfo<T, std::void_t<decltype(std::declval<T&>().getInfo())>>
+		: std::is_convertible<decltype(std::declval<T&>().getInfo()), const PhysicalLayerInfo*> {};
+
+	template <typename T>
+	inline constexpr bool isPhysicalLayer = has_setup<T>::value && has_sendPacket<T>::value && has_readPacket<T>::value
+		&& has_isBusy<T>::value && has_restart<T>::value && has_calculateAirtime<T>::value
+		&& has_setChannel<T>::value && has_getInfo<T>::value;
+
+	/**
+	 * @brief Instantiate to get one diagnostic per missing member rather than a wall of template errors
+	 * from deep inside the datalink, i.e static_assert(PhysicalLayerTraits::Check<PHY>::value);
+	 */
+	template <typename T>
+	struct Check
+	{
+		static_assert(has_setup<T>::value, "PhysicalLayer must provide bool setup()");
+		static_assert(has_sendPacket<T>::value, "PhysicalLayer must provide size_t sendPacket(std::vector<uint8_t>)");
+		static_assert(has_readPacket<T>::value, "PhysicalLayer must provide size_t readPacket(std::vector<uint8_t>&)");
+		static_assert(has_isBusy<T>::value, "PhysicalLayer must provide bool isBusy()");
+		static_assert(has_restart<T>::value, "PhysicalLayer must provide void restart()");
+		static_assert(has_calculateAirtime<T>::value, "PhysicalLayer must provide float calculateAirtime(size_t) const");
+		static_assert(has_setChannel<T>::value, "PhysicalLayer must provide void setChannel(uint8_t)");
+		static_assert(has_getInfo<T>::value, "PhysicalLayer must provide const PhysicalLayerInfo* getInfo()");
+
+		static constexpr bool value = isPhysicalLayer<T>;
+	};
+}
@@ -1,74 +1,481 @@
 #include "radio_channel.h"
-#include <random>
-#include <libriccore/riccorelogging.h>
+#include <cmath>
 
-RadioChannel::RadioChannel() {}
+namespace {
+    // co channel rejection between lora spreading factors, desired sf (rows) vs interferer sf (columns) for sf7..12.
+    // Croce et al. "Impact of LoRa imperfect orthogonality", the diagonal is replaced by the configurable capture threshold
+    constexpr float sfRejection[6][6] = {
+        {  0,  -8,  -9,  -9,  -9,  -9},
+        {-11,   0, -11, -12, -13, -13},
+        {-15, -13,   0, -13, -14, -15},
+        {-19, -18, -17,   0, -17, -18},
+        {-22, -22, -21, -20,   0, -20},
+        {-25, -25, -25, -24, -23,   0}
+    };
 
-void RadioChannel::transmitPacket(const std::vector<uint8_t>& data, uint32_t airtimeMs, void* senderId) {
+    size_t sfIndex(uint8_t spreadingFactor) {
+        return static_cast<size_t>(std::min<uint8_t>(std::max<uint8_t>(spreadingFactor, 7), 12) - 7);
+    }
+
+    float dbmToMw(float dbm) {
+        return std::pow(10.0f, dbm / 10.0f);
+    }
+
+    float mwToDbm(float mw) {
+        return 10.0f * std::log10(mw);
+    }
+}
+
+RadioChannel::RadioChannel(TimeSource timeSource, uint64_t seed):
+    m_timeSource(std::move(timeSource)),
+    m_rng(seed)
+{
+    if (!m_timeSource) {
+        const auto epoch = std::chrono::steady_clock::now();
+        m_timeSource = [epoch]() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count());
+        };
+    }
+}
+
+void RadioChannel::transmitPacket(const std::vector<uint8_t>& data, uint32_t airtimeUs, void* senderId, uint8_t spreadingFactor, float txPower) {
     std::lock_guard<std::mutex> lock(mtx);
-    auto now = std::chrono::steady_clock::now();
+    const uint64_t start = now();
+
+    Transmission transmission;
+    transmission.data = std::make_shared<const std::vector<uint8_t>>(data);
+    transmission.senderId = senderId;
+    transmission.start = start;
+    transmission.end = start + airtimeUs;
+    transmission.spreadingFactor = spreadingFactor;
+    transmission.txPower = txPower;
+    transmission.delivered = false;
+
+    // path loss first, in whatever order the model gives
+    if (m_topologyModel) {
+        m_links.clear();
+        m_topologyModel(senderId, m_links);
+        transmission.rxPower.reserve(m_links.size());
+        for (const auto& link : m_links) {
+            auto receiver = m_receivers.find(link.receiverId);
+            if (link.receiverId != senderId && receiver != m_receivers.end()) {
+                transmission.rxPower.push_back({link.receiverId, receiver->second.order, txPower - link.pathLoss});
+            }
+        }
+    }
+    else {
+        transmission.rxPower.reserve(m_receivers.size());
+        for (const auto& receiver : m_receivers) {
+            if (receiver.first != senderId) {
+                const float pathLoss = m_pathLossModel ? m_pathLossModel(senderId, receiver.first) : m_config.defaultPathLoss;
+                transmission.rxPower.push_back({receiver.first, receiver.second.order, txPower - pathLoss});
+            }
+        }
+    }
+    std::sort(transmission.rxPower.begin(), transmission.rxPower.end(),
+        [](const LinkPower& a, const LinkPower& b) { return a.order < b.order; });
 
-    if (m_busy && now < m_busyUntil) {
-        RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("RadioChannel: Packet collision — channel is busy");
-		m_collisionDetected = true;
-        return;
+    // then fading in registration order. Power is fixed per link for the duration of the packet, so the same fade
+    // is seen whether this packet is the one being received or the one interfering
+    if (m_config.fadingStdDev > 0) {
+        for (auto& link : transmission.rxPower) {
+            link.power += m_config.fadingStdDev * m_rng.nextNormal();
+        }
     }
 
-	RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("RadioChannel: airtime = " + std::to_string(airtimeMs) + ", size = " + std::to_string(data.size()));
+    m_transmissions.push_back(std::move(transmission));
+    ++m_stats.transmissions;
+    m_stats.airtime += airtimeUs;
+}
+
+void RadioChannel::update() {
+    // held across the callbacks so a receiver can't be unregistered (and destroyed) mid delivery
+    std::lock_guard<std::mutex> deliveryLock(m_deliveryMtx);
 
-	// Start transmission
-    m_busy = true;
-    m_busyUntil = now + std::chrono::milliseconds(airtimeMs);
+    std::vector<Delivery> deliveries;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const uint64_t time = now();
 
-    std::thread([this, data, airtimeMs, senderId]() {
-		std::this_thread::sleep_for(std::chrono::milliseconds(airtimeMs));
+        // jittered deliveries that have come due, merged with the ones resolved now below
+        const auto due = std::find_if(m_delayed.begin(), m_delayed.end(), [time](const Delivery& delivery) { return delivery.due > time; });
+        deliveries.insert(deliveries.end(), std::make_move_iterator(m_delayed.begin()), std::make_move_iterator(due));
+        m_delayed.erase(m_delayed.begin(), due);
+        const bool jittered = m_impaired || !deliveries.empty();
 
-		std::lock_guard<std::mutex> lock(mtx);
+        // resolve in order of finishing so receivers see packets in the order they came off air
+        std::vector<Transmission*> finished;
+        for (auto& transmission : m_transmissions) {
+            if (!transmission.delivered && transmission.end <= time) {
+                finished.push_back(&transmission);
+            }
+        }
+        std::stable_sort(finished.begin(), finished.end(), [](const Transmission* a, const Transmission* b) { return a->end < b->end; });
 
-		static std::random_device rd;
-        static std::mt19937 gen(rd());
-        static std::uniform_real_distribution<> dis(0.0, 1.0);
+        for (Transmission* transmission : finished) {
+            resolve(*transmission, deliveries);
+            if (m_capture) {
+                capture(*transmission);
+            }
+            transmission->delivered = true;
+        }
 
-		if (dis(gen) < m_packetDropProbability) {
-            RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("RadioChannel: Packet randomly dropped");
-        } else if (m_collisionDetected){
-			RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("RadioChannel: Packet collison - packet already on air getting dropped");
-		} else{
-        	// Deliver the packet to all registered receivers except the sender itself
-			for (const auto& receiver : m_receivers) {
-				if (receiver.receiverId != senderId) {
-					receiver.callback(data);
-				}
-			}
-		}
+        prune(time);
 
-        m_busy = false;
-		m_collisionDetected = false;
+        if (jittered) {
+            // hold back whatever jitter pushed past now, the rest go out in the order they are due
+            auto late = std::stable_partition(deliveries.begin(), deliveries.end(), [time](const Delivery& delivery) { return delivery.due <= time; });
+            for (auto it = late; it != deliveries.end(); ++it) {
+                auto position = std::upper_bound(m_delayed.begin(), m_delayed.end(), it->due,
+                    [](uint64_t due, const Delivery& delivery) { return due < delivery.due; });
+                m_delayed.insert(position, std::move(*it));
+            }
+            deliveries.erase(late, deliveries.end());
+            std::stable_sort(deliveries.begin(), deliveries.end(), [](const Delivery& a, const Delivery& b) { return a.due < b.due; });
+        }
+    }
 
-    }).detach();
+    // callbacks run outside the main lock so receivers are free to transmit straight away
+    for (const auto& delivery : deliveries) {
+        delivery.callback(*delivery.data, delivery.reception);
+    }
 }
 
-void RadioChannel::registerReceiver(void* receiverId, ReceiveCallback callback) {
-    std::lock_guard<std::mutex> lock(mtx);
-    m_receivers.push_back({receiverId, callback});
+void RadioChannel::resolve(const Transmission& transmission, std::vector<Delivery>& deliveries) {
+    m_captureReceivers.clear();
+    auto record = [this](const LinkPower& link, CaptureOutcome outcome, float snr) {
+        if (m_capture) {
+            m_captureReceivers.push_back({m_capture->nodeId(link.receiverId), link.power, snr, outcome, {}});
+        }
+    };
+
+    // only receivers that were in range and listening when the packet started can get it
+    for (const auto& link : transmission.rxPower) {
+        auto receiver = m_receivers.find(link.receiverId);
+        if (receiver == m_receivers.end() || receiver->second.spreadingFactor != transmission.spreadingFactor) {
+            record(link, CaptureOutcome::NOT_LISTENING, 0);
+            continue;   // gone, or a radio on a different sf that never locks onto this packet
+        }
+        void* const receiverId = link.receiverId;
+        const float* signal = &link.power;
+
+        bool halfDuplex = false;
+        bool interSfLoss = false;
+        float sameSfInterference = 0;   // mW
+
+        for (const auto& other : m_transmissions) {
+            if (other.start >= transmission.end) {
+                break;      // everything after started once this one was off air
+            }
+            if (&other == &transmission || other.end <= transmission.start) {
+                continue;   // no overlap
+            }
+            if (other.senderId == receiverId) {
+                halfDuplex = true;
+                break;
+            }
+            const float* interference = findPower(other, link.order);
+            if (interference == nullptr) {
+                continue;
+            }
+            if (other.spreadingFactor == transmission.spreadingFactor) {
+                sameSfInterference += dbmToMw(*interference);
+            }
+            else if (*signal - *interference < sirThreshold(transmission.spreadingFactor, other.spreadingFactor, m_config.captureThreshold)) {
+                interSfLoss = true;
+            }
+        }
+
+        const float snr = *signal - mwToDbm(dbmToMw(m_config.noiseFloor) + sameSfInterference);
+
+        if (halfDuplex) {
+            ++m_stats.halfDuplexLosses;
+            record(link, CaptureOutcome::HALF_DUPLEX, snr);
+            continue;
+        }
+        if (*signal - m_config.noiseFloor < demodulationFloor(transmission.spreadingFactor)) {
+            ++m_stats.belowSensitivity;
+            record(link, CaptureOutcome::BELOW_SENSITIVITY, snr);
+            continue;
+        }
+        if (sameSfInterference > 0 && *signal - mwToDbm(sameSfInterference) < m_config.captureThreshold) {
+            ++m_stats.collisions;
+            record(link, CaptureOutcome::COLLISION, snr);
+            continue;
+        }
+        if (interSfLoss) {
+            ++m_stats.interSfCollisions;
+            record(link, CaptureOutcome::INTER_SF_COLLISION, snr);
+            continue;
+        }
+        if (m_packetDropProbability > 0 && m_rng.nextFloat() < m_packetDropProbability) {
+            ++m_stats.randomDrops;
+            record(link, CaptureOutcome::RANDOM_DROP, snr);
+            continue;
+        }
+
+        Delivery delivery{receiver->second.callback, transmission.data, {*signal, snr}, transmission.senderId, receiverId, transmission.end};
+        const RadioImpairment* impairment = m_impaired ? impairmentOf(transmission.senderId, receiverId) : nullptr;
+        if (impairment) {
+            if (std::any_of(impairment->outages.begin(), impairment->outages.end(),
+                    [&transmission](const RadioOutage& outage) { return outage.covers(transmission.start); })) {
+                ++m_stats.outageLosses;
+                record(link, CaptureOutcome::LINK_LOSS, snr);
+                continue;
+            }
+            if (lostToLossModel(*impairment, {transmission.senderId, receiverId}, transmission.start)) {
+                ++m_stats.linkLosses;
+                record(link, CaptureOutcome::LINK_LOSS, snr);
+                continue;
+            }
+            if (impairment->bitErrorRate > 0) {
+                delivery.data = corrupt(transmission.data, impairment->bitErrorRate);
+                delivery.reception.corrupted = (delivery.data != transmission.data);
+            }
+            if (impairment->maxJitter > 0) {
+                delivery.due += m_rng.nextBelow(impairment->maxJitter + 1);
+                m_stats.jittered += (delivery.due > transmission.end) ? 1 : 0;
+            }
+        }
+
+        if (sameSfInterference > 0) {
+            ++m_stats.captured;
+        }
+        ++m_stats.delivered;
+        if (delivery.reception.corrupted) {
+            ++m_stats.corrupted;
+            record(link, CaptureOutcome::CORRUPTED, snr);
+        }
+        else {
+            record(link, sameSfInterference > 0 ? CaptureOutcome::CAPTURED : CaptureOutcome::DELIVERED, snr);
+        }
+
+        deliveries.push_back(std::move(delivery));
+    }
 }
 
-void RadioChannel::unregisterReceiver(void* receiverId) {
-    std::lock_guard<std::mutex> lock(mtx);
+const RadioImpairment* RadioChannel::impairmentOf(void* senderId, void* receiverId) const {
+    if (!m_linkImpairments.empty()) {
+        auto it = m_linkImpairments.find({senderId, receiverId});
+        if (it != m_linkImpairments.end()) {
+            return it->second.enabled() ? &it->second : nullptr;
+        }
+    }
+    return m_impairment.enabled() ? &m_impairment : nullptr;
+}
+
+bool RadioChannel::lostToLossModel(const RadioImpairment& impairment, const LinkKey& link, uint64_t time) {
+    switch (impairment.lossModel) {
+        case RadioLossModel::BERNOULLI:
+            return m_rng.nextFloat() < impairment.lossProbability;
+
+        case RadioLossModel::GILBERT_ELLIOTT: {
+            auto sojourn = [this](float mean) {
+                return static_cast<uint64_t>(-std::log(1.0f - m_rng.nextFloat()) * mean) + 1;
+            };
+            auto fade = m_fades.find(link);
+            if (fade == m_fades.end()) {
+                // a link first seen part way through, in either state with its long run odds
+                const bool bad = m_rng.nextFloat() * (impairment.meanGoodTime + impairment.meanBadTime) < impairment.meanBadTime;
+                fade = m_fades.emplace(link, FadeState{bad, time + sojourn(bad ? impairment.meanBadTime : impairment.meanGoodTime)}).first;
+            }
+            FadeState& state = fade->second;
+            while (state.until <= time) {
+                state.bad = !state.bad;
+                state.until += sojourn(state.bad ? impairment.meanBadTime : impairment.meanGoodTime);
+            }
+            const float loss = state.bad ? impairment.lossBad : impairment.lossGood;
+            return loss > 0 && m_rng.nextFloat() < loss;
+        }
+
+        default:
+            return false;
+    }
+}
+
+std::shared_ptr<const std::vector<uint8_t>> RadioChannel::corrupt(const std::shared_ptr<const std::vector<uint8_t>>& data, float bitErrorRate) {
+    // jump straight from one errored bit to the next, the gaps between independent errors are geometric
+    const size_t bits = data->size() * 8;
+    const double logGood = std::log1p(-static_cast<double>(std::min(bitErrorRate, 0.999999f)));
+    auto gap = [this, logGood]() {
+        return static_cast<size_t>(std::log(1.0 - m_rng.nextFloat()) / logGood);
+    };
+
+    size_t bit = gap();
+    if (bit >= bits) {
+        return data;    // came through clean, shared with every other receiver
+    }
+    auto corrupted = std::make_shared<std::vector<uint8_t>>(*data);
+    for (; bit < bits; bit += 1 + gap()) {
+        (*corrupted)[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+    }
+    return corrupted;
+}
+
+void RadioChannel::capture(const Transmission& transmission) {
+    CaptureRecordHeader header{};
+    header.start = transmission.start;
+    header.end = transmission.end;
+    header.sender = m_capture->nodeId(transmission.senderId);
+    header.channel = m_captureChannel;
+    header.payloadSize = static_cast<uint16_t>(std::min<size_t>(transmission.data->size(), UINT16_MAX));
+    header.receiverCount = static_cast<uint16_t>(std::min<size_t>(m_captureReceivers.size(), UINT16_MAX));
+    header.spreadingFactor = transmission.spreadingFactor;
+    header.txPower = transmission.txPower;
+    m_capture->write(header, transmission.data->data(), m_captureReceivers.data());
+}
 
-    // Remove the receiver from the list
-    m_receivers.erase(
-        std::remove_if(m_receivers.begin(), m_receivers.end(),
-            [receiverId](const Receiver& receiver) {
-                return receiver.receiverId == receiverId;
+void RadioChannel::prune(uint64_t time) {
+    // a finished packet has to be kept while anything it overlapped is still waiting to be resolved
+    uint64_t horizon = time;
+    for (const auto& transmission : m_transmissions) {
+        if (!transmission.delivered) {
+            horizon = std::min(horizon, transmission.start);
+        }
+    }
+    m_transmissions.erase(
+        std::remove_if(m_transmissions.begin(), m_transmissions.end(),
+            [horizon](const Transmission& transmission) {
+                return transmission.delivered && transmission.end <= horizon;
             }
         ),
-        m_receivers.end()
+        m_transmissions.end()
     );
+}
+
+const float* RadioChannel::findPower(const Transmission& transmission, uint64_t receiverOrder) {
+    auto link = std::lower_bound(transmission.rxPower.begin(), transmission.rxPower.end(), receiverOrder,
+        [](const LinkPower& a, uint64_t order) { return a.order < order; });
+    if (link == transmission.rxPower.end() || link->order != receiverOrder) {
+        return nullptr;
+    }
+    return &link->power;
+}
 
+void RadioChannel::registerReceiver(void* receiverId, ReceiveCallback callback, uint8_t spreadingFactor) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_receivers[receiverId] = {callback, spreadingFactor, m_nextReceiverOrder++};
+}
+
+void RadioChannel::unregisterReceiver(void* receiverId) {
+    std::lock_guard<std::mutex> deliveryLock(m_deliveryMtx);
+    std::lock_guard<std::mutex> lock(mtx);
+
+    m_receivers.erase(receiverId);
+
+    // pending deliveries hold the receiver's callback, per link state is for the node's time on this channel only
+    m_delayed.erase(std::remove_if(m_delayed.begin(), m_delayed.end(),
+        [receiverId](const Delivery& delivery) { return delivery.receiverId == receiverId; }), m_delayed.end());
+    auto involves = [receiverId](const auto& entry) { return entry.first.first == receiverId || entry.first.second == receiverId; };
+    for (auto it = m_fades.begin(); it != m_fades.end();) {
+        it = involves(*it) ? m_fades.erase(it) : std::next(it);
+    }
+    for (auto it = m_linkImpairments.begin(); it != m_linkImpairments.end();) {
+        it = involves(*it) ? m_linkImpairments.erase(it) : std::next(it);
+    }
+    m_impaired = m_impairment.enabled() || !m_linkImpairments.empty();
 }
 
 bool RadioChannel::isBusy() const {
     std::lock_guard<std::mutex> lock(mtx);
-    return m_busy && (std::chrono::steady_clock::now() < m_busyUntil);
+    const uint64_t time = now();
+    return std::any_of(m_transmissions.begin(), m_transmissions.end(),
+        [time](const Transmission& transmission) { return transmission.start <= time && time < transmission.end; });
+}
+
+bool RadioChannel::isTransmitting(void* senderId) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    const uint64_t time = now();
+    return std::any_of(m_transmissions.begin(), m_transmissions.end(),
+        [time, senderId](const Transmission& transmission) { return transmission.senderId == senderId && time < transmission.end; });
+}
+
+uint64_t RadioChannel::nextCompletion(const void* senderId) const {
+    std::lock_guard<std::mutex> lock(mtx);
+    uint64_t completion = UINT64_MAX;
+    for (const auto& transmission : m_transmissions) {
+        if (!transmission.delivered && transmission.senderId == senderId) {
+            completion = std::min(completion, transmission.end);
+        }
+    }
+    for (const auto& delivery : m_delayed) {
+        if (delivery.senderId == senderId) {
+            completion = std::min(completion, delivery.due);
+            break;      // ordered by due
+        }
+    }
+    return completion;
+}
+
+void RadioChannel::setConfig(const RadioChannelConfig& config) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_config = config;
+}
+
+void RadioChannel::setPacketDropProbability(float probability) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_packetDropProbability = probability;
+}
+
+void RadioChannel::setImpairment(const RadioImpairment& impairment) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_impairment = impairment;
+    m_fades.clear();
+    m_impaired = m_impairment.enabled() || !m_linkImpairments.empty();
+}
+
+void RadioChannel::setLinkImpairment(void* senderId, void* receiverId, const RadioImpairment& impairment) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_linkImpairments[{senderId, receiverId}] = impairment;
+    m_fades.erase({senderId, receiverId});
+    m_impaired = true;
+}
+
+void RadioChannel::clearLinkImpairment(void* senderId, void* receiverId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_linkImpairments.erase({senderId, receiverId});
+    m_fades.erase({senderId, receiverId});
+    m_impaired = m_impairment.enabled() || !m_linkImpairments.empty();
+}
+
+void RadioChannel::setPathLossModel(PathLossModel pathLossModel) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_pathLossModel = std::move(pathLossModel);
+}
+
+void RadioChannel::setTopologyModel(TopologyModel topologyModel) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_topologyModel = std::move(topologyModel);
+}
+
+void RadioChannel::setCapture(std::shared_ptr<CaptureWriter> writer, uint16_t channelId) {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_capture = std::move(writer);
+    m_captureChannel = channelId;
+}
+
+RadioChannelStats RadioChannel::getStats() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return m_stats;
+}
+
+void RadioChannel::resetStats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    m_stats = RadioChannelStats{};
+}
+
+float RadioChannel::sirThreshold(uint8_t desiredSf, uint8_t interfererSf, float captureThreshold) {
+    if (desiredSf == interfererSf) {
+        return captureThreshold;
+    }
+    return sfRejection[sfIndex(desiredSf)][sfIndex(interfererSf)];
+}
+
+float RadioChannel::demodulationFloor(uint8_t spreadingFactor) {
+    // -7.5dB at sf7, 2.5dB lower per sf step (semtech datasheets)
+    return -7.5f - 2.5f * (static_cast<float>(spreadingFactor) - 7.0f);
+}
+
+uint64_t RadioChannel::now() const {
+    return m_timeSource();
 }
@@ -1,40 +1,277 @@
 #pragma once
 
 #include <vector>
+#include <deque>
+#include <memory>
 #include <functional>
 #include <mutex>
 #include <chrono>
 #include <thread>
 #include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <map>
+#include <utility>
+#include <cmath>
+#include <cstdint>
 
+#include <librrp/util/xoshiro.h>
+#include "capture.h"
+
+struct RadioReception {
+    float rssi;     // dBm
+    float snr;      // dB, signal to noise plus interference
+    bool corrupted = false;     // bit errors were injected, the frame would fail a crc
+};
+
+struct RadioChannelConfig {
+    float captureThreshold = 6.0;   // dB a packet must be above the sum of same sf interferers to survive
+    float noiseFloor = -105.0;      // dBm
+    float fadingStdDev = 0.0;       // dB, log normal shadowing applied per link per packet
+    float defaultPathLoss = 83.0;   // dB, used for every link when no path loss model is set
+};
+
+/**
+ * @brief A window in which a link loses everything, repeating every period if period isn't 0
+ */
+struct RadioOutage {
+    uint64_t start;         // us, channel time
+    uint64_t duration;      // us
+    uint64_t period = 0;    // us
+
+    bool covers(uint64_t time) const {
+        if (time < start) {
+            return false;
+        }
+        return (period ? (time - start) % period : time - start) < duration;
+    }
+};
+
+enum class RadioLossModel : uint8_t {
+    NONE,
+    BERNOULLI,          // every packet lost independently with lossProbability
+    GILBERT_ELLIOTT     // the link fades in and out, see RadioImpairment
+};
+
+/**
+ * @brief Faults applied to packets that survive interference and sensitivity, per channel or per link.
+ *
+ * Gilbert-Elliott runs in time rather than per packet: each link alternates between a good and a bad (faded) state
+ * with exponentially distributed sojourns, so a fade wipes out every packet it covers however busy the link is.
+ * Each link fades independently. Bit errors are flipped into a copy of the frame for that receiver and flagged on
+ * the reception, a simulated phy with crc enabled throws such frames away. Jitter delays handing the frame to the
+ * receiver, it doesn't move it on air.
+ */
+struct RadioImpairment {
+    RadioLossModel lossModel = RadioLossModel::NONE;
+    float lossProbability = 0;      // BERNOULLI
+    float meanGoodTime = 10e6;      // us, GILBERT_ELLIOTT
+    float meanBadTime = 1e6;        // us
+    float lossGood = 0;             // loss probability while good
+    float lossBad = 1;              // loss probability while faded
+    std::vector<RadioOutage> outages;
+    float bitErrorRate = 0;         // per bit of every frame delivered
+    uint32_t maxJitter = 0;         // us, each delivery is held back uniformly 0 - maxJitter
+
+    bool enabled() const {
+        return lossModel != RadioLossModel::NONE || !outages.empty() || bitErrorRate > 0 || maxJitter > 0;
+    }
+
+    /**
+     * @brief Gilbert-Elliott with the given long run loss and mean fade length, lost outright while faded
+     */
+    static RadioImpairment burst(float loss, float meanFadeTime) {
+        RadioImpairment impairment;
+        impairment.lossModel = RadioLossModel::GILBERT_ELLIOTT;
+        impairment.meanBadTime = meanFadeTime;
+        impairment.meanGoodTime = meanFadeTime * (1.0f - loss) / std::max(loss, 1e-6f);
+        return impairment;
+    }
+};
+
+struct RadioLink {
+    void* receiverId;
+    float pathLoss;     // dB
+};
+
+/**
+ * @brief Outcome counters, every (packet, receiver) pair lands in exactly one of the loss/delivery buckets
+ */
+struct RadioChannelStats {
+    uint64_t transmissions;         // packets put on air
+    uint64_t airtime;               // us, summed over every packet put on air
+    uint64_t delivered;             // successful receptions
+    uint64_t captured;              // successful receptions that overlapped a same sf packet
+    uint64_t collisions;            // lost to same sf interference
+    uint64_t interSfCollisions;     // lost to interference from a different sf
+    uint64_t halfDuplexLosses;      // receiver was itself transmitting
+    uint64_t belowSensitivity;      // too weak to demodulate
+    uint64_t randomDrops;
+    uint64_t linkLosses;            // dropped by the link's loss model
+    uint64_t outageLosses;          // dropped in a scheduled outage
+    uint64_t corrupted;             // delivered with bit errors, also counted as delivered
+    uint64_t jittered;              // delivered late, also counted as delivered
+};
+
+/**
+ * @brief Shared medium for simulated radios. Every transmission is kept as an interval on air, when it finishes
+ * each receiver decides independently whether it got the packet based on the power of the packet at that receiver
+ * against everything else that overlapped it (capture effect, LoRa sf quasi-orthogonality, half duplex).
+ *
+ * Deliveries happen lazily from update(), which the simulated physical layers call whenever they poll for packets,
+ * so there is no thread per packet in flight.
+ *
+ * Which receivers hear a sender comes from, in order of preference, the topology model (only the receivers in range,
+ * see RadioChannelManager), the path loss model (evaluated for every receiver) or the default path loss.
+ *
+ * Random draws (fading, drops) are made in receiver registration order, never pointer order, so a channel driven
+ * from a single thread gives the same outcomes for the same seed on every run.
+ */
 class RadioChannel {
 public:
-    using ReceiveCallback = std::function<void(const std::vector<uint8_t>&)>;
+    using ReceiveCallback = std::function<void(const std::vector<uint8_t>&, const RadioReception&)>;
+    using TimeSource = std::function<uint64_t()>;                                   // us
+    using PathLossModel = std::function<float(void* senderId, void* receiverId)>;  // dB
+    using TopologyModel = std::function<void(void* senderId, std::vector<RadioLink>& links)>;
+
+    RadioChannel(TimeSource timeSource = nullptr, uint64_t seed = std::random_device{}());
 
-    RadioChannel();
+    void transmitPacket(const std::vector<uint8_t>& data, uint32_t airtimeUs, void* senderId, uint8_t spreadingFactor = 7, float txPower = 13.0);
 
-    void transmitPacket(const std::vector<uint8_t>& data, uint32_t airtimeMs, void* senderId);
+    /**
+     * @brief Resolve and deliver every transmission that has finished by now
+     */
+    void update();
 
-    void registerReceiver(void* receiverId, ReceiveCallback callback);
+    void registerReceiver(void* receiverId, ReceiveCallback callback, uint8_t spreadingFactor = 7);
     void unregisterReceiver(void* receiverId);
 
     bool isBusy() const;
+    bool isTransmitting(void* senderId) const;
+
+    /**
+     * @brief End time (us) of the sender's earliest packet still waiting to be resolved or, with jitter, to be
+     * handed to a receiver, UINT64_MAX if none. The update() after this time delivers it.
+     */
+    uint64_t nextCompletion(const void* senderId) const;
+
+    void setConfig(const RadioChannelConfig& config);
+    void setPacketDropProbability(float probability);
+
+    /**
+     * @brief Faults for every link on this channel without one of its own
+     */
+    void setImpairment(const RadioImpairment& impairment);
+
+    /**
+     * @brief Faults for packets from sender to receiver only, replacing the channel's. Forgotten when either end
+     * unregisters.
+     */
+    void setLinkImpairment(void* senderId, void* receiverId, const RadioImpairment& impairment);
+    void clearLinkImpairment(void* senderId, void* receiverId);
+    void setPathLossModel(PathLossModel pathLossModel);
+
+    /**
+     * @brief Replace the per receiver path loss evaluation with a model that appends only the links in range of the
+     * sender, so a transmission costs the size of its neighbourhood rather than the size of the network.
+     * Links to ids that aren't registered on this channel are ignored.
+     */
+    void setTopologyModel(TopologyModel topologyModel);
+
+    /**
+     * @brief Record every resolved transmission with its per receiver outcome, null stops capturing.
+     * @param channelId written into each record so several channels can share one writer
+     */
+    void setCapture(std::shared_ptr<CaptureWriter> writer, uint16_t channelId = 0);
+
+    RadioChannelStats getStats() const;
+    void resetStats();
+
+    /**
+     * @brief Minimum SIR in dB for a packet at desiredSf to survive an interferer at interfererSf
+     */
+    static float sirThreshold(uint8_t desiredSf, uint8_t interfererSf, float captureThreshold);
+
+    /**
+     * @brief Minimum SNR in dB needed to demodulate at the given sf
+     */
+    static float demodulationFloor(uint8_t spreadingFactor);
 
 private:
 
 	struct Receiver {
+		ReceiveCallback callback;
+		uint8_t spreadingFactor;
+		uint64_t order;     // registration sequence number
+	};
+
+	struct LinkPower {
 		void* receiverId;
+		uint64_t order;
+		float power;    // dBm at the receiver
+	};
+
+	struct Transmission {
+		std::shared_ptr<const std::vector<uint8_t>> data;
+		void* senderId;
+		uint64_t start;
+		uint64_t end;
+		uint8_t spreadingFactor;
+		float txPower;     // dBm
+		bool delivered;
+		std::vector<LinkPower> rxPower;    // receivers in range and listening when the packet started, sorted by order
+	};
+
+	struct Delivery {
 		ReceiveCallback callback;
+		std::shared_ptr<const std::vector<uint8_t>> data;
+		RadioReception reception;
+		void* senderId;
+		void* receiverId;
+		uint64_t due;		// us, later than the end of the packet when jittered
+	};
+
+	using LinkKey = std::pair<void*, void*>;	// sender, receiver
+
+	struct FadeState {
+		bool bad;
+		uint64_t until;		// us, when the link next changes state
 	};
 
+	uint64_t now() const;
+	void resolve(const Transmission& transmission, std::vector<Delivery>& deliveries);
+	void capture(const Transmission& transmission);
+	void prune(uint64_t time);
+	static const float* findPower(const Transmission& transmission, uint64_t receiverOrder);
+	const RadioImpairment* impairmentOf(void* senderId, void* receiverId) const;
+	bool lostToLossModel(const RadioImpairment& impairment, const LinkKey& link, uint64_t time);
+	std::shared_ptr<const std::vector<uint8_t>> corrupt(const std::shared_ptr<const std::vector<uint8_t>>& data, float bitErrorRate);
+
     mutable std::mutex mtx;
+    std::mutex m_deliveryMtx;
+
+    TimeSource m_timeSource;
+    std::deque<Transmission> m_transmissions;   // ordered by start time
+    std::unordered_map<void*, Receiver> m_receivers;
+    uint64_t m_nextReceiverOrder = 0;
+
+    RadioChannelConfig m_config;
+    PathLossModel m_pathLossModel;
+    TopologyModel m_topologyModel;
+    std::vector<RadioLink> m_links;     // scratch for the topology model
+    RadioChannelStats m_stats{};
 
-    bool m_busy = false;
-	bool m_collisionDetected = false;
+    Xoshiro256 m_rng;
 
-    std::chrono::steady_clock::time_point m_busyUntil;
-    std::vector<Receiver> m_receivers;
+    std::shared_ptr<CaptureWriter> m_capture;
+    uint16_t m_captureChannel = 0;
+    std::vector<CaptureReceiver> m_captureReceivers;    // scratch, filled by resolve() while capturing
 
 	float m_packetDropProbability = 0.0;
-};
 
+	RadioImpairment m_impairment;
+	std::map<LinkKey, RadioImpairment> m_linkImpairments;
+	std::map<LinkKey, FadeState> m_fades;		// gilbert elliott state per link, created on the link's first packet
+	bool m_impaired = false;					// anything set, keeps the unimpaired path free of lookups
+	std::vector<Delivery> m_delayed;			// jittered deliveries not yet due, ordered by due
+};
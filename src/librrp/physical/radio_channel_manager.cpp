@@ -1,18 +1,281 @@
 #include "radio_channel_manager.h"
+#include <cmath>
+#include <algorithm>
+#include <mutex>
+
+RadioChannelManager::RadioChannelManager(RadioChannel::TimeSource timeSource, SeedSource seedSource):
+    m_timeSource(std::move(timeSource)),
+    m_seedSource(std::move(seedSource))
+{
+    setPathLossConfig(PathLossConfig{});
+}
 
 std::shared_ptr<RadioChannel> RadioChannelManager::getChannel(int channelId) {
-    if (channels.find(channelId) == channels.end()) {
-        channels[channelId] = std::make_shared<RadioChannel>();
+    {
+        std::shared_lock<std::shared_mutex> lock(m_channelsMtx);
+        auto channel = channels.find(channelId);
+        if (channel != channels.end()) {
+            return channel->second;
+        }
     }
-    return channels[channelId];
+
+    std::unique_lock<std::shared_mutex> lock(m_channelsMtx);
+    auto& channel = channels[channelId];
+    if (!channel) {     // someone else may have created it between the locks
+        channel = std::make_shared<RadioChannel>(m_timeSource, m_seedSource ? m_seedSource() : std::random_device{}());
+        // the manager owns the channels so it outlives them
+        channel->setTopologyModel([this](void* senderId, std::vector<RadioLink>& links) { getLinks(senderId, links); });
+        if (m_capture) {
+            channel->setCapture(m_capture, static_cast<uint16_t>(channelId));
+        }
+    }
+    return channel;
 }
 
-void RadioChannelManager::registerNode(int channelId, void* nodeId, RadioChannel::ReceiveCallback callback) {
-	getChannel(channelId)->registerReceiver(nodeId, callback);
+void RadioChannelManager::setCapture(std::shared_ptr<CaptureWriter> writer) {
+    std::unique_lock<std::shared_mutex> lock(m_channelsMtx);
+    m_capture = std::move(writer);
+    for (auto& channel : channels) {
+        channel.second->setCapture(m_capture, static_cast<uint16_t>(channel.first));
+    }
+}
+
+void RadioChannelManager::registerNode(int channelId, void* nodeId, RadioChannel::ReceiveCallback callback, uint8_t spreadingFactor) {
+    {
+        std::unique_lock<std::shared_mutex> lock(m_topologyMtx);
+        findOrAddNode(nodeId);
+    }
+	getChannel(channelId)->registerReceiver(nodeId, callback, spreadingFactor);
 }
 
 void RadioChannelManager::unregisterNode(int channelId, void* nodeId) {
-    if (channels.find(channelId) != channels.end()) {
-        channels[channelId]->unregisterReceiver(nodeId);
+    std::shared_ptr<RadioChannel> channel;
+    {
+        std::shared_lock<std::shared_mutex> lock(m_channelsMtx);
+        auto it = channels.find(channelId);
+        if (it == channels.end()) {
+            return;
+        }
+        channel = it->second;
+    }
+    channel->unregisterReceiver(nodeId);
+}
+
+void RadioChannelManager::removeNode(void* nodeId) {
+    std::unique_lock<std::shared_mutex> lock(m_topologyMtx);
+
+    auto node = m_nodes.find(nodeId);
+    if (node != m_nodes.end()) {
+        if (node->second.placed) {
+            removeFromCell(nodeId, node->second.cell);
+        }
+        else {
+            m_unplaced.erase(std::remove(m_unplaced.begin(), m_unplaced.end(), nodeId), m_unplaced.end());
+        }
+        m_nodes.erase(node);
+    }
+
+    auto overrides = m_linkOverrides.find(nodeId);
+    if (overrides != m_linkOverrides.end()) {
+        for (const auto& link : overrides->second) {
+            m_linkOverrides[link.first].erase(nodeId);
+        }
+        m_linkOverrides.erase(overrides);
+    }
+}
+
+void RadioChannelManager::setPathLossConfig(const PathLossConfig& config) {
+    std::unique_lock<std::shared_mutex> lock(m_topologyMtx);
+    m_pathLossConfig = config;
+    // a cell is as wide as the range, so everything in range of a node is in its own or a neighbouring cell
+    m_cellSize = std::max(config.referenceDistance * std::pow(10.0f, (config.maxPathLoss - config.referenceLoss) / (10.0f * config.exponent)), 1.0f);
+    rebuildGrid();
+}
+
+PathLossConfig RadioChannelManager::getPathLossConfig() const {
+    std::shared_lock<std::shared_mutex> lock(m_topologyMtx);
+    return m_pathLossConfig;
+}
+
+void RadioChannelManager::setNodePosition(void* nodeId, const NodePosition& position) {
+    std::unique_lock<std::shared_mutex> lock(m_topologyMtx);
+    Node& node = findOrAddNode(nodeId);
+    const CellKey cell = cellOf(position);
+
+    if (!node.placed) {
+        m_unplaced.erase(std::remove(m_unplaced.begin(), m_unplaced.end(), nodeId), m_unplaced.end());
+        addToCell(nodeId, cell);
+    }
+    else if (node.cell != cell) {
+        removeFromCell(nodeId, node.cell);
+        addToCell(nodeId, cell);
+    }
+    node.placed = true;
+    node.position = position;
+    node.cell = cell;
+}
+
+bool RadioChannelManager::getNodePosition(void* nodeId, NodePosition& position) const {
+    std::shared_lock<std::shared_mutex> lock(m_topologyMtx);
+    auto node = m_nodes.find(nodeId);
+    if (node == m_nodes.end() || !node->second.placed) {
+        return false;
+    }
+    position = node->second.position;
+    return true;
+}
+
+void RadioChannelManager::setLinkPathLoss(void* nodeA, void* nodeB, float pathLoss) {
+    std::unique_lock<std::shared_mutex> lock(m_topologyMtx);
+    m_linkOverrides[nodeA][nodeB] = pathLoss;
+    m_linkOverrides[nodeB][nodeA] = pathLoss;
+}
+
+void RadioChannelManager::clearLinkPathLoss(void* nodeA, void* nodeB) {
+    std::unique_lock<std::shared_mutex> lock(m_topologyMtx);
+    m_linkOverrides[nodeA].erase(nodeB);
+    m_linkOverrides[nodeB].erase(nodeA);
+}
+
+float RadioChannelManager::getPathLoss(void* senderId, void* receiverId) const {
+    std::shared_lock<std::shared_mutex> lock(m_topologyMtx);
+
+    float loss = m_pathLossConfig.unplacedLoss;
+    auto sender = m_nodes.find(senderId);
+    auto receiver = m_nodes.find(receiverId);
+    if (sender != m_nodes.end() && receiver != m_nodes.end()) {
+        loss = linkLoss(sender->second, receiver->second);
+    }
+
+    auto overrides = m_linkOverrides.find(senderId);
+    if (overrides != m_linkOverrides.end()) {
+        auto link = overrides->second.find(receiverId);
+        if (link != overrides->second.end()) {
+            loss = link->second;
+        }
+    }
+    return (loss > m_pathLossConfig.maxPathLoss) ? INFINITY : loss;
+}
+
+void RadioChannelManager::getLinks(void* senderId, std::vector<RadioLink>& links) const {
+    std::shared_lock<std::shared_mutex> lock(m_topologyMtx);
+    const size_t first = links.size();
+
+    auto sender = m_nodes.find(senderId);
+    if (sender == m_nodes.end() || !sender->second.placed) {
+        // nowhere in particular, so it reaches everyone
+        for (const auto& node : m_nodes) {
+            if (node.first != senderId) {
+                links.push_back({node.first, m_pathLossConfig.unplacedLoss});
+            }
+        }
+    }
+    else {
+        const NodePosition& position = sender->second.position;
+        const int32_t cx = static_cast<int32_t>(std::floor(position.x / m_cellSize));
+        const int32_t cy = static_cast<int32_t>(std::floor(position.y / m_cellSize));
+        for (int32_t dx = -1; dx <= 1; ++dx) {
+            for (int32_t dy = -1; dy <= 1; ++dy) {
+                auto cell = m_cells.find(makeKey(cx + dx, cy + dy));
+                if (cell == m_cells.end()) {
+                    continue;
+                }
+                for (void* nodeId : cell->second) {
+                    if (nodeId == senderId) {
+                        continue;
+                    }
+                    const float loss = distanceLoss(position, m_nodes.at(nodeId).position);
+                    if (loss <= m_pathLossConfig.maxPathLoss) {
+                        links.push_back({nodeId, loss});
+                    }
+                }
+            }
+        }
+        for (void* nodeId : m_unplaced) {
+            links.push_back({nodeId, m_pathLossConfig.unplacedLoss});
+        }
+    }
+
+    auto overrides = m_linkOverrides.find(senderId);
+    if (overrides == m_linkOverrides.end() || overrides->second.empty()) {
+        return;
+    }
+
+    size_t overridden = 0;
+    for (size_t i = first; i < links.size(); ++i) {
+        auto link = overrides->second.find(links[i].receiverId);
+        if (link != overrides->second.end()) {
+            links[i].pathLoss = link->second;
+            ++overridden;
+        }
+    }
+    if (overridden < overrides->second.size()) {
+        // overrides can also join nodes that are out of range of each other
+        for (const auto& link : overrides->second) {
+            auto existing = std::find_if(links.begin() + first, links.end(),
+                [&link](const RadioLink& candidate) { return candidate.receiverId == link.first; });
+            if (existing == links.end()) {
+                links.push_back({link.first, link.second});
+            }
+        }
+    }
+    links.erase(std::remove_if(links.begin() + first, links.end(),
+        [this](const RadioLink& link) { return !(link.pathLoss <= m_pathLossConfig.maxPathLoss); }), links.end());
+}
+
+RadioChannelManager::CellKey RadioChannelManager::cellOf(const NodePosition& position) const {
+    return makeKey(static_cast<int32_t>(std::floor(position.x / m_cellSize)), static_cast<int32_t>(std::floor(position.y / m_cellSize)));
+}
+
+RadioChannelManager::CellKey RadioChannelManager::makeKey(int32_t cx, int32_t cy) {
+    return (static_cast<CellKey>(cx) << 32) | static_cast<uint32_t>(cy);
+}
+
+float RadioChannelManager::distanceLoss(const NodePosition& a, const NodePosition& b) const {
+    const float dx = a.x - b.x;
+    const float dy = a.y - b.y;
+    const float dz = a.z - b.z;
+    const float distance = std::max(std::sqrt(dx * dx + dy * dy + dz * dz), m_pathLossConfig.referenceDistance);
+    return m_pathLossConfig.referenceLoss + 10.0f * m_pathLossConfig.exponent * std::log10(distance / m_pathLossConfig.referenceDistance);
+}
+
+float RadioChannelManager::linkLoss(const Node& sender, const Node& receiver) const {
+    if (!sender.placed || !receiver.placed) {
+        return m_pathLossConfig.unplacedLoss;
+    }
+    return distanceLoss(sender.position, receiver.position);
+}
+
+void RadioChannelManager::addToCell(void* nodeId, CellKey cell) {
+    m_cells[cell].push_back(nodeId);
+}
+
+void RadioChannelManager::removeFromCell(void* nodeId, CellKey cell) {
+    auto it = m_cells.find(cell);
+    if (it == m_cells.end()) {
+        return;
+    }
+    it->second.erase(std::remove(it->second.begin(), it->second.end(), nodeId), it->second.end());
+    if (it->second.empty()) {
+        m_cells.erase(it);
+    }
+}
+
+void RadioChannelManager::rebuildGrid() {
+    m_cells.clear();
+    for (auto& node : m_nodes) {
+        if (node.second.placed) {
+            node.second.cell = cellOf(node.second.position);
+            addToCell(node.first, node.second.cell);
+        }
+    }
+}
+
+RadioChannelManager::Node& RadioChannelManager::findOrAddNode(void* nodeId) {
+    auto node = m_nodes.find(nodeId);
+    if (node != m_nodes.end()) {
+        return node->second;
     }
+    m_unplaced.push_back(nodeId);
+    return m_nodes[nodeId] = Node{false, {0, 0, 0}, 0};
 }
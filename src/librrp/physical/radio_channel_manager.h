@@ -3,14 +3,119 @@
 #include "radio_channel.h"
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <functional>
+#include <cstdint>
 
+struct NodePosition {
+    float x;    // m
+    float y;    // m
+    float z;    // m
+};
+
+/**
+ * @brief Log distance path loss, PL(d) = referenceLoss + 10 * exponent * log10(d / referenceDistance)
+ */
+struct PathLossConfig {
+    float referenceLoss = 40.05;    // dB at the reference distance, free space at 2.4GHz and 1m
+    float referenceDistance = 1.0;  // m
+    float exponent = 2.7;           // 2 free space, ~2.7-3.5 outdoors with obstructions
+    float maxPathLoss = 140.0;      // dB, weaker links are out of range and never considered (sets the spatial index cell size)
+    float unplacedLoss = 83.0;      // dB, used for links to or from nodes that have no position
+};
+
+/**
+ * @brief Owns the simulated channels and the topology shared by all of them. Nodes are placed with setNodePosition
+ * and linked by log distance path loss, individual links can be overridden (or cut with INFINITY) with
+ * setLinkPathLoss to build explicit link matrices. Nodes without a position hear everyone at unplacedLoss, so a
+ * simulation that never places anything behaves like a full mesh.
+ *
+ * Placed nodes are kept in a uniform grid with cells as wide as the maximum range, a transmission only looks at the
+ * 3x3 cells around the sender.
+ *
+ * All methods are safe to call from any node thread.
+ */
 class RadioChannelManager {
 public:
+    using SeedSource = std::function<uint64_t()>;
+
+    /**
+     * @param timeSource clock handed to every channel, steady clock if null
+     * @param seedSource seed for each new channel's rng, random if null
+     */
+    RadioChannelManager(RadioChannel::TimeSource timeSource = nullptr, SeedSource seedSource = nullptr);
+    RadioChannelManager(const RadioChannelManager&) = delete;
+    RadioChannelManager& operator=(const RadioChannelManager&) = delete;
+
     std::shared_ptr<RadioChannel> getChannel(int channelId);
 
-    void registerNode(int channelId, void* nodeId, RadioChannel::ReceiveCallback callback);
+    /**
+     * @brief Capture every channel, existing and future, into one writer. Null stops capturing.
+     */
+    void setCapture(std::shared_ptr<CaptureWriter> writer);
+
+    void registerNode(int channelId, void* nodeId, RadioChannel::ReceiveCallback callback, uint8_t spreadingFactor = 7);
     void unregisterNode(int channelId, void* nodeId);
 
+    /**
+     * @brief Forget a node's position and link overrides, call when the node is destroyed
+     */
+    void removeNode(void* nodeId);
+
+    void setPathLossConfig(const PathLossConfig& config);
+    PathLossConfig getPathLossConfig() const;
+
+    void setNodePosition(void* nodeId, const NodePosition& position);
+    bool getNodePosition(void* nodeId, NodePosition& position) const;
+
+    /**
+     * @brief Override the path loss between two nodes in both directions, INFINITY removes the link
+     */
+    void setLinkPathLoss(void* nodeA, void* nodeB, float pathLoss);
+    void clearLinkPathLoss(void* nodeA, void* nodeB);
+
+    /**
+     * @brief Path loss between two nodes in dB, INFINITY if they are out of range
+     */
+    float getPathLoss(void* senderId, void* receiverId) const;
+
+    /**
+     * @brief Append every node in range of the sender with its path loss, this is the channels' topology model
+     */
+    void getLinks(void* senderId, std::vector<RadioLink>& links) const;
+
 private:
+    using CellKey = int64_t;
+
+    struct Node {
+        bool placed;
+        NodePosition position;
+        CellKey cell;
+    };
+
+    CellKey cellOf(const NodePosition& position) const;
+    static CellKey makeKey(int32_t cx, int32_t cy);
+    float distanceLoss(const NodePosition& a, const NodePosition& b) const;
+    float linkLoss(const Node& sender, const Node& receiver) const;
+    void addToCell(void* nodeId, CellKey cell);
+    void removeFromCell(void* nodeId, CellKey cell);
+    void rebuildGrid();
+    Node& findOrAddNode(void* nodeId);
+
+    RadioChannel::TimeSource m_timeSource;
+    SeedSource m_seedSource;
+
+    mutable std::shared_mutex m_channelsMtx;
     std::map<int, std::shared_ptr<RadioChannel>> channels;
+    std::shared_ptr<CaptureWriter> m_capture;
+
+    mutable std::shared_mutex m_topologyMtx;
+    PathLossConfig m_pathLossConfig;
+    float m_cellSize = 1.0;    // m
+    std::unordered_map<void*, Node> m_nodes;
+    std::unordered_map<CellKey, std::vector<void*>> m_cells;
+    std::vector<void*> m_unplaced;
+    std::unordered_map<void*, std::unordered_map<void*, float>> m_linkOverrides;
 };
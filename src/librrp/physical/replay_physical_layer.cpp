@@ -0,0 +1,54 @@
+#include "replay_physical_layer.h"
+#include "capture.h"
+#include <libriccore/riccorelogging.h>
+
+ReplayPhysicalLayer::ReplayPhysicalLayer(std::vector<ReplayFrame> frames, TimeSource timeSource, float frequency, float bandwidth, uint8_t spreadingFactor, uint8_t codingRate, uint8_t preambleLength, bool crcEnabled, bool implicitHeader, bool lowDataRateOptimization):
+	m_frames(std::move(frames)),
+	m_timeSource(std::move(timeSource))
+	{
+		m_info.frequency = frequency;
+		m_info.bandwidth = bandwidth;
+		m_info.spreadingFactor = spreadingFactor;
+		m_info.codingRate = codingRate;
+		m_info.preambleLength = preambleLength;
+		m_info.crcEnabled = crcEnabled;
+		m_info.implicitHeader = implicitHeader;
+		m_info.lowDataRateOptimization = lowDataRateOptimization;
+	}
+
+size_t ReplayPhysicalLayer::sendPacket(std::vector<uint8_t> data){
+	const uint64_t now = m_timeSource();
+	m_txEnd = now + static_cast<uint64_t>(calculateAirtime(data.size()) * 1e6f);
+	const size_t size = data.size();
+	m_transmissions.push_back({now, std::move(data)});
+	return size;
+}
+
+#if !defined(ESP_PLATFORM)
+
+bool ReplayPhysicalLayer::loadCapture(const std::string& path, uint32_t receiver, std::vector<ReplayFrame>& frames, int channel){
+	CaptureReader reader;
+	if (!reader.open(path)) {
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Replay: can't read capture " + path);
+		return false;
+	}
+
+	CaptureRecord record;
+	while (reader.next(record)) {
+		if (channel >= 0 && record.header.channel != channel) {
+			continue;
+		}
+		for (const auto& rx : record.receivers) {
+			if (rx.receiver == receiver && (rx.outcome == CaptureOutcome::DELIVERED || rx.outcome == CaptureOutcome::CAPTURED)) {
+				frames.push_back({record.header.end, std::vector<uint8_t>(record.payload, record.payload + record.header.payloadSize), rx.rssi, rx.snr, 0});
+				break;
+			}
+		}
+	}
+
+	// records are written in order of finishing already, but don't rely on it
+	std::stable_sort(frames.begin(), frames.end(), [](const ReplayFrame& a, const ReplayFrame& b) { return a.time < b.time; });
+	return true;
+}
+
+#endif
@@ -0,0 +1,128 @@
+#pragma once
+#include "physical_layer_base.h"
+
+// std
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+// ric
+#include "lora_sim_physical_layer.h"
+#include <librrp/util/clock.h>
+
+/**
+ * @brief A frame as it came off air at the node being replayed
+ */
+struct ReplayFrame {
+    uint64_t time;      // us on the replay clock at which the frame finished arriving
+    std::vector<uint8_t> data;
+    float rssi;         // dBm
+    float snr;          // dB
+    float freqError;    // Hz
+};
+
+/**
+ * @brief A frame the replayed datalink sent
+ */
+struct ReplayTransmission {
+    uint64_t time;      // us, when sendPacket was called
+    std::vector<uint8_t> data;
+};
+
+/**
+ * @brief Physical layer that plays back a recorded stream of received frames, each one becomes readable once the
+ * replay clock reaches the time it originally arrived. Nothing sent goes anywhere, transmissions are kept so they
+ * can be compared against the recording.
+ *
+ * Driven by a VirtualClock (see replay()) the datalink above runs through a recording as fast as it can process it,
+ * the same frames at the same times on every run, which is what the datalink receive path wants for profiling and
+ * what a desync regression test wants for reproducing the exact field sequence that broke it.
+ */
+class ReplayPhysicalLayer final {
+
+    public:
+        using TimeSource = std::function<uint64_t()>;   // us
+
+        /**
+         * @param frames in order of arrival
+         * @param timeSource the replay clock, the same one the datalink runs on
+         */
+        ReplayPhysicalLayer(std::vector<ReplayFrame> frames, TimeSource timeSource, float frequency, float bandwidth, uint8_t spreadingFactor,
+            uint8_t codingRate = 1, uint8_t preambleLength = 8, bool crcEnabled = true, bool implicitHeader = false, bool lowDataRateOptimization = false);
+
+        bool setup() {return true;}
+        size_t sendPacket(std::vector<uint8_t> data);
+
+        size_t readPacket(std::vector<uint8_t>& data)
+        {
+            if (m_nextFrame == m_frames.size() || m_frames[m_nextFrame].time > m_timeSource()) {
+                return 0;
+            }
+            ReplayFrame& frame = m_frames[m_nextFrame++];
+            data = frame.data;
+            m_info.timeLastPacketReceived = static_cast<uint32_t>(frame.time / 1000);
+            m_info.packetRssi = frame.rssi;
+            m_info.packetSnr = frame.snr;
+            m_info.packetFreqError = frame.freqError;
+            return data.size();
+        }
+
+        bool isBusy() {return m_timeSource() < m_txEnd;}
+        void restart() {}
+        float calculateAirtime(size_t payloadSize) const {return loraAirtime(m_info, payloadSize);}
+        void setChannel(uint8_t) {}
+        const PhysicalLayerInfo* getInfo() {return &m_info;}
+
+        /**
+         * @brief Replay time (us) of the next frame to become readable, UINT64_MAX once everything has been read
+         */
+        uint64_t nextEventTime() const {return (m_nextFrame < m_frames.size()) ? m_frames[m_nextFrame].time : UINT64_MAX;}
+
+        bool finished() const {return m_nextFrame == m_frames.size();}
+        size_t getFramesRead() const {return m_nextFrame;}
+
+        const std::vector<ReplayTransmission>& getTransmissions() const {return m_transmissions;}
+
+        /**
+         * @brief Frames a node received in a RadioChannel capture, i.e every record with a delivered or captured
+         * outcome for that node, timed by when the packet came off air. False if the capture can't be read. Host only.
+         * @param receiver capture node id, see CaptureWriter::nodeId
+         * @param channel only frames on this capture channel, any channel if negative
+         */
+        static bool loadCapture(const std::string& path, uint32_t receiver, std::vector<ReplayFrame>& frames, int channel = -1);
+
+    private:
+        std::vector<ReplayFrame> m_frames;
+        size_t m_nextFrame = 0;
+        TimeSource m_timeSource;
+        LoRaSimPhysicalLayerInfo m_info{};
+
+        uint64_t m_txEnd = 0;
+        std::vector<ReplayTransmission> m_transmissions;
+};
+
+/**
+ * @brief Run a datalink over a replay until every frame has been read and the clock has reached until, stepping the
+ * clock straight from one datalink deadline or frame arrival to the next. The datalink must run on the same clock.
+ * @return number of datalink updates
+ */
+template <typename Radio>
+size_t replay(Radio& radio, ReplayPhysicalLayer& physicalLayer, VirtualClock& clock, uint64_t until = 0)
+{
+    size_t steps = 0;
+    while (true){
+        radio.update();
+        ++steps;
+        if (physicalLayer.finished() && clock.micros() >= until){
+            break;
+        }
+        uint64_t next = std::min(radio.nextDeadline(), physicalLayer.nextEventTime());
+        if (physicalLayer.finished()){
+            next = std::min(next, until);
+        }
+        clock.advanceTo(next);
+    }
+    return steps;
+}
@@ -0,0 +1,39 @@
+#include "sim_world.h"
+#include <algorithm>
+#include <chrono>
+
+SimWorld::SimWorld(uint64_t seed, TimeSource timeSource):
+    m_seed(seed),
+    m_timeSource(std::move(timeSource)),
+    // channels read the clock and draw seeds through the world so they all agree with it
+    m_channelManager([this]() { return now(); }, [this]() { return nextSeed(); })
+{
+    if (!m_timeSource) {
+        const auto epoch = std::chrono::steady_clock::now();
+        m_timeSource = [epoch]() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count());
+        };
+    }
+}
+
+uint64_t SimWorld::nextSeed() {
+    // splitmix64 over a counter, well spread streams even from neighbouring root seeds
+    return splitmix64(m_seed + (m_seedCounter.fetch_add(1, std::memory_order_relaxed) + 1) * 0x9E3779B97F4A7C15ull);
+}
+
+void SimWorld::registerAddress(int address) {
+    std::unique_lock<std::shared_mutex> lock(m_addressMtx);
+    if (std::find(m_addresses.begin(), m_addresses.end(), address) == m_addresses.end()) {
+        m_addresses.push_back(address);
+    }
+}
+
+void SimWorld::unregisterAddress(int address) {
+    std::unique_lock<std::shared_mutex> lock(m_addressMtx);
+    m_addresses.erase(std::remove(m_addresses.begin(), m_addresses.end(), address), m_addresses.end());
+}
+
+std::vector<int> SimWorld::getAddresses() const {
+    std::shared_lock<std::shared_mutex> lock(m_addressMtx);
+    return m_addresses;
+}
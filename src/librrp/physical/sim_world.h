@@ -0,0 +1,66 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <vector>
+
+#include "radio_channel.h"
+#include "radio_channel_manager.h"
+
+/**
+ * @brief Everything a simulation shares between its nodes: the radio channels and topology, the clock the channels
+ * run on, the rng everything is seeded from, and the addresses of the simulated nodes. Nothing here is static, so
+ * any number of worlds can run side by side (on separate threads) in one process without seeing each other.
+ *
+ * The world must outlive every LoRaSimPhysicalLayer created in it. All methods are thread safe.
+ */
+class SimWorld {
+public:
+    using TimeSource = RadioChannel::TimeSource;   // us
+
+    /**
+     * @param seed root seed, every channel and node rng is derived from it in creation order
+     * @param timeSource clock for the channels, steady clock since construction if null
+     */
+    SimWorld(uint64_t seed = std::random_device{}(), TimeSource timeSource = nullptr);
+    SimWorld(const SimWorld&) = delete;
+    SimWorld& operator=(const SimWorld&) = delete;
+
+    std::shared_ptr<RadioChannel> getChannel(int channelId) {return m_channelManager.getChannel(channelId);}
+    RadioChannelManager& getChannelManager() {return m_channelManager;}
+
+    /**
+     * @brief Current world time in us
+     */
+    uint64_t now() const {return m_timeSource();}
+    const TimeSource& getTimeSource() const {return m_timeSource;}
+
+    uint64_t getSeed() const {return m_seed;}
+
+    /**
+     * @brief Next seed in this world's sequence, for giving each component its own rng stream
+     */
+    uint64_t nextSeed();
+
+    /**
+     * @brief Record the network address of a simulated node so traffic generators can pick destinations
+     */
+    void registerAddress(int address);
+    void unregisterAddress(int address);
+    std::vector<int> getAddresses() const;
+
+private:
+    const uint64_t m_seed;
+    std::atomic<uint64_t> m_seedCounter{0};
+    TimeSource m_timeSource;
+
+    RadioChannelManager m_channelManager;
+
+    mutable std::shared_mutex m_addressMtx;
+    std::vector<int> m_addresses;
+};
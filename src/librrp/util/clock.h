@@ -0,0 +1,122 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#if defined(ESP32)
+#include <esp_timer.h>
+#endif
+
+/**
+ * Clock policies for the datalinks. A clock is a small copyable object with
+ *
+ *     uint64_t micros() const;    // monotonic us since an arbitrary epoch, never wraps in practice
+ *     uint32_t millis() const;    // micros() / 1000, wraps like the platform millis()
+ *
+ * The datalinks take the policy as a template parameter and hold their own copy, so every node in a simulation can
+ * run on its own clock.
+ */
+
+/**
+ * @brief The hardware clock, esp_timer on the esp32 and the steady clock everywhere else
+ */
+class PlatformClock
+{
+	public:
+		uint64_t micros() const
+		{
+#if defined(ESP32)
+			return static_cast<uint64_t>(esp_timer_get_time());
+#else
+			static const auto epoch = std::chrono::steady_clock::now();
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count());
+#endif
+		}
+
+		uint32_t millis() const { return static_cast<uint32_t>(micros() / 1000); }
+};
+
+/**
+ * @brief A simulated crystal, runs off a shared source clock (e.g the sim world's) at a fixed drift. Copies share the
+ * source, so the node and its datalink see the same time.
+ */
+class DriftingClock
+{
+	public:
+		using TimeSource = std::function<uint64_t()>;	// us
+
+		/**
+		 * @param source reference time in us, the platform clock if null
+		 * @param driftPPM how fast this clock runs against the source, positive runs fast
+		 */
+		DriftingClock(TimeSource source = nullptr, double driftPPM = 0):
+			m_source(source ? std::move(source) : TimeSource([]() { return PlatformClock().micros(); })),
+			m_rate(1.0 + driftPPM * 1e-6),
+			m_driftPPM(driftPPM)
+		{}
+
+		uint64_t micros() const { return toLocal(m_source()); }
+		uint32_t millis() const { return static_cast<uint32_t>(micros() / 1000); }
+
+		double getDriftPPM() const { return m_driftPPM; }
+
+		/**
+		 * @brief Local time shown when the source reads sourceMicros
+		 */
+		uint64_t toLocal(uint64_t sourceMicros) const
+		{
+			return static_cast<uint64_t>(std::llround(static_cast<double>(sourceMicros) * m_rate));
+		}
+
+		/**
+		 * @brief Earliest source time at which this clock reads at least localMicros, for scheduling a node's local
+		 * deadline on the shared clock
+		 */
+		uint64_t toSource(uint64_t localMicros) const
+		{
+			uint64_t source = static_cast<uint64_t>(std::ceil(static_cast<double>(localMicros) / m_rate));
+			while (toLocal(source) < localMicros){		// guard against rounding landing one tick short
+				++source;
+			}
+			return source;
+		}
+
+	private:
+		TimeSource m_source;
+		double m_rate;
+		double m_driftPPM;
+};
+
+/**
+ * @brief Discrete event clock that only moves when told to, for running a simulation as fast as the cpu allows and for
+ * stepping slot timing exactly in tests. Copies share the same time, so one clock can drive a whole sim world.
+ */
+class VirtualClock
+{
+	public:
+		explicit VirtualClock(uint64_t start = 0):
+			m_now(std::make_shared<std::atomic<uint64_t>>(start))
+		{}
+
+		uint64_t micros() const { return m_now->load(std::memory_order_acquire); }
+		uint32_t millis() const { return static_cast<uint32_t>(micros() / 1000); }
+
+		/**
+		 * @brief Move the clock forward to time, never backwards
+		 */
+		void advanceTo(uint64_t time)
+		{
+			uint64_t current = m_now->load(std::memory_order_relaxed);
+			while (current < time && !m_now->compare_exchange_weak(current, time, std::memory_order_acq_rel)){}
+		}
+
+		void advance(uint64_t duration) { m_now->fetch_add(duration, std::memory_order_acq_rel); }
+
+	private:
+		std::shared_ptr<std::atomic<uint64_t>> m_now;
+};
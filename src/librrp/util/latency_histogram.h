@@ -0,0 +1,183 @@
+#pragma once
+
+// std
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+// librrp
+#include <librrp/util/seqlock.h>
+
+/**
+ * @brief Summary of a LatencyHistogram taken in one consistent read, all values in us
+ */
+struct LatencySummary
+{
+	uint64_t count;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+	uint64_t max;
+};
+
+/**
+ * @brief Fixed memory log-linear histogram of durations in us, in the style of HdrHistogram. Values below
+ * SubBuckets are counted exactly, above that each power of two is split into SubBuckets equal buckets, so any
+ * recorded value is reported to within 1 / SubBuckets of itself. Values past MaxValue land in the top bucket
+ * (max is still exact).
+ *
+ * Written only from the radio loop, read from anywhere without blocking it (same seqlock as LinkStatsTable).
+ *
+ * @tparam SubBuckets buckets per power of two, a power of two itself
+ * @tparam MaxValueBits values up to 2^MaxValueBits us are resolved, default ~134s
+ */
+template <size_t SubBuckets = 16, size_t MaxValueBits = 27>
+class LatencyHistogram
+{
+	static_assert(SubBuckets >= 2 && (SubBuckets & (SubBuckets - 1)) == 0, "LatencyHistogram SubBuckets must be a power of two!");
+
+	public:
+		LatencyHistogram() = default;
+
+		// copies take a consistent snapshot, so info structs holding a histogram stay copyable
+		LatencyHistogram(const LatencyHistogram& other)
+		{
+			other.m_lock.read([this, &other]() { copyFrom(other); });
+		}
+
+		LatencyHistogram& operator=(const LatencyHistogram& other)
+		{
+			if (this != &other){
+				LatencyHistogram copy(other);
+				m_lock.write([this, &copy]() { copyFrom(copy); });
+			}
+			return *this;
+		}
+
+		/**
+		 * @brief Writer side, radio loop only
+		 *
+		 * @param value us
+		 */
+		void record(uint64_t value)
+		{
+			const size_t index = bucketIndex(value);
+			m_lock.write([this, index, value]() {
+				++m_counts[index];
+				++m_count;
+				m_max = std::max(m_max, value);
+			});
+		}
+
+		/**
+		 * @brief Writer side, radio loop only
+		 */
+		void reset()
+		{
+			m_lock.write([this]() {
+				m_counts.fill(0);
+				m_count = 0;
+				m_max = 0;
+			});
+		}
+
+		/**
+		 * @param percentile 0 - 100
+		 * @return us, the highest value equivalent to the bucket the percentile falls in, 0 if empty
+		 */
+		uint64_t percentile(float percentile) const
+		{
+			uint64_t value = 0;
+			m_lock.read([&]() { value = percentileUnlocked(percentile); });
+			return value;
+		}
+
+		LatencySummary summary() const
+		{
+			LatencySummary summary{};
+			m_lock.read([&]() {
+				summary.count = m_count;
+				summary.p50 = percentileUnlocked(50);
+				summary.p90 = percentileUnlocked(90);
+				summary.p99 = percentileUnlocked(99);
+				summary.max = m_max;
+			});
+			return summary;
+		}
+
+		uint64_t count() const
+		{
+			uint64_t count = 0;
+			m_lock.read([&]() { count = m_count; });
+			return count;
+		}
+
+		static constexpr size_t bucketCount() {return numBuckets;}
+
+	private:
+		static constexpr size_t subBucketBits()
+		{
+			size_t bits = 0;
+			while ((size_t(1) << bits) < SubBuckets){
+				++bits;
+			}
+			return bits;
+		}
+
+		static constexpr size_t numBuckets = SubBuckets * (MaxValueBits - subBucketBits() + 1);
+
+		static size_t bucketIndex(uint64_t value)
+		{
+			if (value < SubBuckets){
+				return static_cast<size_t>(value);
+			}
+			size_t msb = 63;
+			while (!(value >> msb)){
+				--msb;
+			}
+			const size_t shift = msb - subBucketBits();		// width of a bucket in this power of two is 2^shift
+			const size_t index = SubBuckets * (shift + 1) + static_cast<size_t>(value >> shift) - SubBuckets;
+			return std::min(index, numBuckets - 1);
+		}
+
+		// highest value that lands in the bucket
+		static uint64_t bucketTop(size_t index)
+		{
+			if (index < SubBuckets){
+				return index;
+			}
+			const size_t shift = index / SubBuckets - 1;
+			const uint64_t bottom = static_cast<uint64_t>(SubBuckets + index % SubBuckets) << shift;
+			return bottom + (uint64_t(1) << shift) - 1;
+		}
+
+		uint64_t percentileUnlocked(float percentile) const
+		{
+			if (!m_count){
+				return 0;
+			}
+			// rank of the sample the percentile falls on, at least the first
+			const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(percentile / 100.0f * m_count + 0.5f));
+			uint64_t seen = 0;
+			for (size_t i = 0; i < numBuckets; ++i){
+				seen += m_counts[i];
+				if (seen >= rank){
+					return std::min(bucketTop(i), m_max);
+				}
+			}
+			return m_max;
+		}
+
+		void copyFrom(const LatencyHistogram& other)
+		{
+			m_counts = other.m_counts;
+			m_count = other.m_count;
+			m_max = other.m_max;
+		}
+
+		std::array<uint32_t, numBuckets> m_counts{};
+		uint64_t m_count = 0;
+		uint64_t m_max = 0;
+		SeqLock m_lock;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+// std
+#include <array>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Fixed capacity FIFO with inline storage. Slots are reused rather than destroyed on pop so
+ * element types that own heap memory (e.g std::vector) keep their capacity and do not reallocate
+ * once the buffer has warmed up. Not thread safe.
+ *
+ * @tparam T element type
+ * @tparam Capacity maximum number of elements
+ */
+template <typename T, size_t Capacity>
+class RingBuffer
+{
+	static_assert(Capacity > 0, "RingBuffer capacity must be greater than zero!");
+
+	public:
+		bool push(T item)
+		{
+			if (full()){
+				return false;
+			}
+			m_buffer[m_tail] = std::move(item);
+			m_tail = next(m_tail);
+			++m_size;
+			return true;
+		}
+
+		/**
+		 * @brief Access the next free slot in place, e.g to read data straight into an already allocated
+		 * buffer. The element is only added once commit() is called. Must not be called when full.
+		 */
+		T& acquire() { return m_buffer[m_tail]; }
+
+		void commit()
+		{
+			if (full()){
+				return;
+			}
+			m_tail = next(m_tail);
+			++m_size;
+		}
+
+		T& front() { return m_buffer[m_head]; }
+		const T& front() const { return m_buffer[m_head]; }
+
+		void pop()
+		{
+			if (empty()){
+				return;
+			}
+			m_head = next(m_head);
+			--m_size;
+		}
+
+		void clear()
+		{
+			m_head = 0;
+			m_tail = 0;
+			m_size = 0;
+		}
+
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		bool full() const { return m_size == Capacity; }
+		static constexpr size_t capacity() { return Capacity; }
+
+	private:
+		static constexpr size_t next(size_t index) { return (index + 1) % Capacity; }
+
+		std::array<T, Capacity> m_buffer{};
+		size_t m_head = 0;
+		size_t m_tail = 0;
+		size_t m_size = 0;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+// std
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Single writer, many reader sequence lock. The writer never blocks, readers retry if they raced a write,
+ * so stats written from the radio loop can be read consistently from any other task.
+ */
+class SeqLock
+{
+	public:
+		SeqLock() = default;
+
+		// the version belongs to the data it guards, a copy of that data starts over
+		SeqLock(const SeqLock&) {}
+		SeqLock& operator=(const SeqLock&) {return *this;}
+
+		template <typename Func>
+		void write(Func&& func)
+		{
+			m_version.fetch_add(1, std::memory_order_relaxed);	// odd while writing
+			std::atomic_thread_fence(std::memory_order_release);
+			func();
+			m_version.fetch_add(1, std::memory_order_release);
+		}
+
+		template <typename Func>
+		void read(Func&& func) const
+		{
+			uint32_t before;
+			uint32_t after;
+			do {
+				before = m_version.load(std::memory_order_acquire);
+				func();
+				std::atomic_thread_fence(std::memory_order_acquire);
+				after = m_version.load(std::memory_order_relaxed);
+			} while ((before & 1) || before != after);
+		}
+
+	private:
+		std::atomic<uint32_t> m_version{0};
+};
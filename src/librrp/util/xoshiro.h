@@ -0,0 +1,82 @@
+#pragma once
+
+// std
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+/**
+ * @brief splitmix64 finaliser, spreads a counter or a poorly distributed seed over all 64 bits
+ */
+inline uint64_t splitmix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+/**
+ * @brief xoshiro256** (Blackman & Vigna), small fast generator with 256 bits of state. Satisfies
+ * UniformRandomBitGenerator so it works with the std distributions, and its own helpers give the same sequence on
+ * every platform and standard library, which the std distributions don't guarantee.
+ */
+class Xoshiro256
+{
+	public:
+		using result_type = uint64_t;
+
+		explicit Xoshiro256(uint64_t seed = 0) { this->seed(seed); }
+
+		void seed(uint64_t seed)
+		{
+			// expand the seed with splitmix64 so related seeds give unrelated streams and the state is never all zero
+			for (auto& word : m_state){
+				seed += 0x9E3779B97F4A7C15ull;
+				word = splitmix64(seed);
+			}
+		}
+
+		result_type operator()()
+		{
+			const uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+			const uint64_t t = m_state[1] << 17;
+
+			m_state[2] ^= m_state[0];
+			m_state[3] ^= m_state[1];
+			m_state[1] ^= m_state[2];
+			m_state[0] ^= m_state[3];
+			m_state[2] ^= t;
+			m_state[3] = rotl(m_state[3], 45);
+
+			return result;
+		}
+
+		/**
+		 * @brief Uniform in [0, 1)
+		 */
+		float nextFloat() { return static_cast<float>((*this)() >> 40) * 0x1.0p-24f; }
+
+		/**
+		 * @brief Uniform in [0, bound), bound must be non zero
+		 */
+		uint32_t nextBelow(uint32_t bound) { return static_cast<uint32_t>(((*this)() >> 32) * bound >> 32); }
+
+		/**
+		 * @brief Normal with mean 0 and standard deviation 1, Box-Muller over two nextFloat() draws. The second
+		 * value of the pair is dropped so every call takes the same two draws.
+		 */
+		float nextNormal()
+		{
+			const float u1 = 1.0f - nextFloat();	// (0, 1], keeps the log finite
+			const float u2 = nextFloat();
+			return std::sqrt(-2.0f * std::log(u1)) * std::cos(6.28318531f * u2);
+		}
+
+		static constexpr result_type min() { return 0; }
+		static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	private:
+		static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+		uint64_t m_state[4];
+};
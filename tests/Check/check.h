@@ -0,0 +1,24 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+/**
+ * @brief Pass/fail bookkeeping shared by the self checking test programs. Each check prints a line, failures are
+ * counted and checkSummary() gives the footer and the exit code for main.
+ */
+inline int checkFailures = 0;
+
+inline void check(bool condition, const std::string& description)
+{
+    std::cout << (condition ? "[PASS] " : "[FAIL] ") << description << std::endl;
+    if (!condition){
+        ++checkFailures;
+    }
+}
+
+inline int checkSummary()
+{
+    std::cout << (checkFailures ? "FAILED: " + std::to_string(checkFailures) : std::string("ALL PASSED")) << std::endl;
+    return (checkFailures ? 1 : 0);
+}
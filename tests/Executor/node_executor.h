@@ -0,0 +1,214 @@
+#pragma once
+
+// std
+#include <vector>
+#include <queue>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <optional>
+#include <cstdint>
+
+// librrp
+#include <librrp/physical/sim_world.h>
+#include <librrp/util/clock.h>
+
+/**
+ * @brief Runs many simulated nodes cooperatively on a small fixed pool of worker threads. Each node is a step
+ * function that runs the node once and returns the world time it next needs to run, the executor keeps the nodes
+ * in a deadline ordered queue and only runs a node when its deadline is due or when something wakes it (e.g. a
+ * packet landing in its rx buffer). A node is never run on two workers at once.
+ *
+ * In real time mode workers sleep until the next deadline. In virtual time mode the world runs on a VirtualClock and
+ * the executor jumps the clock straight to the next deadline whenever no node is running, so a simulation goes as
+ * fast as the cpu allows. Virtual time with a single worker is fully sequential.
+ */
+class NodeExecutor
+{
+public:
+    using TaskId = size_t;
+    using Step = std::function<uint64_t()>;     // returns the world time (us) the task next needs to run
+
+    NodeExecutor(SimWorld& world, size_t numWorkers = std::thread::hardware_concurrency())
+        : m_world(world),
+          m_numWorkers(std::max<size_t>(numWorkers, 1))
+    {}
+
+    /**
+     * @brief Virtual time executor, world must have been created on clock
+     */
+    NodeExecutor(SimWorld& world, VirtualClock clock, size_t numWorkers = 1)
+        : m_world(world),
+          m_numWorkers(std::max<size_t>(numWorkers, 1)),
+          m_virtualClock(std::move(clock))
+    {}
+
+    NodeExecutor(const NodeExecutor&) = delete;
+    NodeExecutor& operator=(const NodeExecutor&) = delete;
+
+    /**
+     * @brief Add a task, it first runs as soon as the executor is running. Not safe to call while run() is active.
+     */
+    TaskId addTask(Step step)
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        const TaskId id = m_tasks.size();
+        m_tasks.push_back(Task{std::move(step), 0, false, false});
+        schedule(id, m_world.now());
+        return id;
+    }
+
+    /**
+     * @brief Run the task as soon as possible, safe to call from any thread including from inside a step
+     */
+    void wake(TaskId id)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            Task& task = m_tasks[id];
+            if (task.running){
+                task.wakePending = true;    // picked up when the current step returns
+                return;
+            }
+            schedule(id, m_world.now());
+        }
+        m_cv.notify_one();
+    }
+
+    /**
+     * @brief Run the workers until the world clock reaches until (us), blocks the caller
+     */
+    void runUntil(uint64_t until)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_until = until;
+        }
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < m_numWorkers; ++i){
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+        for (auto& worker : workers){
+            worker.join();
+        }
+    }
+
+    void runFor(uint64_t duration) {runUntil(m_world.now() + duration);}
+
+    uint64_t getSteps() const {return m_steps.load(std::memory_order_relaxed);}
+    size_t size() const {return m_tasks.size();}
+
+private:
+    struct Task
+    {
+        Step step;
+        uint64_t generation;    // bumped on every reschedule, older queue entries for the task are stale
+        bool running;
+        bool wakePending;
+    };
+
+    struct Entry
+    {
+        uint64_t deadline;
+        TaskId id;
+        uint64_t generation;
+        bool operator>(const Entry& other) const {return (deadline != other.deadline) ? deadline > other.deadline : id > other.id;}
+    };
+
+    void schedule(TaskId id, uint64_t deadline)
+    {
+        m_queue.push({deadline, id, ++m_tasks[id].generation});
+    }
+
+    void workerLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        for (;;){
+            const uint64_t now = m_world.now();
+            if (now >= m_until){
+                m_cv.notify_all();
+                return;
+            }
+
+            // drop entries superseded by a later wake or reschedule
+            while (!m_queue.empty() && m_queue.top().generation != m_tasks[m_queue.top().id].generation){
+                m_queue.pop();
+            }
+
+            const uint64_t next = m_queue.empty() ? m_until : std::min(m_queue.top().deadline, m_until);
+            if (m_queue.empty() || m_queue.top().deadline > now){
+                if (!m_virtualClock){
+                    m_cv.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::microseconds(next - now));
+                }
+                else if (m_running == 0){
+                    m_virtualClock->advanceTo(next);    // nothing running can schedule anything sooner
+                }
+                else{
+                    m_cv.wait(lock);
+                }
+                continue;
+            }
+
+            const Entry entry = m_queue.top();
+            m_queue.pop();
+            Task& task = m_tasks[entry.id];
+            task.running = true;
+            ++m_running;
+
+            lock.unlock();
+            uint64_t deadline = task.step();
+            m_steps.fetch_add(1, std::memory_order_relaxed);
+            lock.lock();
+
+            task.running = false;
+            --m_running;
+            if (task.wakePending){
+                task.wakePending = false;
+                deadline = m_world.now();
+            }
+            const bool sooner = m_queue.empty() || deadline < m_queue.top().deadline;
+            schedule(entry.id, deadline);
+            if (m_virtualClock){
+                m_cv.notify_all();    // workers waiting for the running count to drop before advancing the clock
+            }
+            else if (sooner){
+                m_cv.notify_one();    // a sleeping worker may be waiting on a later deadline
+            }
+        }
+    }
+
+    SimWorld& m_world;
+    const size_t m_numWorkers;
+    std::optional<VirtualClock> m_virtualClock;
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    std::deque<Task> m_tasks;   // deque so references stay valid as tasks are added
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_queue;
+    uint64_t m_until = 0;
+    size_t m_running = 0;
+    std::atomic<uint64_t> m_steps{0};
+};
+
+/**
+ * @brief Drive a SimNode from the executor: the node runs at its datalink's next deadline, when a packet it sent
+ * comes off air (so the channel gets resolved), and whenever a packet is delivered to it.
+ */
+template <typename SimNodeType>
+NodeExecutor::TaskId addSimNode(NodeExecutor& executor, SimNodeType& node)
+{
+    const NodeExecutor::TaskId id = executor.addTask([&node]() {
+        node.update();
+
+        // the node's deadline is on its own drifting clock, the queue runs on world time
+        const uint64_t deadline = node.getClock().toSource(node.nextDeadline());
+        return std::min(deadline, node.getPhysicalLayer()->nextEventTime());
+    });
+    node.getPhysicalLayer()->setRxNotifier([&executor, id]() { executor.wake(id); });
+    return id;
+}
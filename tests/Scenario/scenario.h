@@ -0,0 +1,985 @@
+#pragma once
+
+// std
+#include <vector>
+#include <string>
+#include <memory>
+#include <set>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// librrp
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/util/clock.h>
+
+#include "../SimNode.h"
+#include "../Traffic/traffic_generator.h"
+#include "../Traffic/traffic_sink.h"
+
+/**
+ * Scenario files describe a TDMA simulation declaratively: the nodes, the traffic they send, what happens to them
+ * and when, and what has to hold by the end. One statement per line, # starts a comment. Times take a unit (us, ms,
+ * s, min), a bare number is seconds.
+ *
+ *   name <text>                                     shown in the results, the file name if not given
+ *   seed <n>                                        world seed, default 1
+ *   duration <time>                                 simulated time, required
+ *   tick <time>                                     node update period on the virtual clock, default 1ms
+ *
+ *   node <id> [freq=868e6] [bw=250e3] [sf=7] [channel=0] [drift=0] [fec=0/0] [yield=off] [start=0s]
+ *       drift in ppm, fec is data/parity frames per block (TDMARadio::setFec, on for every node or none as it sets
+ *       the window length), yield=on hands idle tx windows to
+ *       backlogged nodes (TDMARadio::setSlotYielding), start is when the node first powers up (start=never leaves
+ *       it off until a join event)
+ *
+ *   traffic <id> cbr|poisson <rate> [size=16|min-max] [to=id,id,...] [service=20] [relay=id] [start=0s]
+ *   traffic <id> onoff <rate> on=<time> off=<time> [...]
+ *   traffic <id> trace <file> [...]                 file relative to the scenario, see TraceTraffic::load
+ *       rate in packets/s, to picks destinations among node ids (any other node if omitted), relay sends them as
+ *       packets forwarded for another node (its rnp source, the tdma link source is still this node's). Every node
+ *       listens on every service used, and traffic restarts with the node after a reboot.
+ *
+ *   at <time> join <id>                             power a node up (no-op if already up)
+ *   at <time> leave <id>                            power a node off, it rejoins from scratch on its next join
+ *   at <time> reboot <id>                           leave and join at the same instant
+ *   at <time> channel <id> <channel>                retune a running node, a reboot returns it to its node channel
+ *   at <time> link <a> <b> down|up [for <time>]     cut or restore the link between two nodes, both directions
+ *   at <time> partition <ids> <ids>... [for <time>] cut every link between the groups, e.g partition 0,1 2,3
+ *   at <time> heal                                  restore every cut link
+ *   at <time> drop <id> <type> [count=1] [from=<id>]
+ *       node id misses its next count tdma frames of type normal|joinrequest|heartbeat|fecdata|fecparity|yield|any,
+ *       or grant for frames carrying a join grant (TDMAControl)
+ *   at <time> impair channel <n> [loss=<p>] [burst=<loss>/<fade time>] [ber=<rate>] [jitter=<time>]
+ *   at <time> impair <a> <b> [...]                  one way, a to b on b's node channel, see RadioImpairment
+ *       independent or bursty loss, bit errors and delivery jitter, no options clears them
+ *
+ *   expect joined <id>|all [within <time>]          every power up joined, in time if given (power ups shorter
+ *                                                   than the limit are let off)
+ *   expect goodput <id>|all <op> <bytes/s>          payload received over the whole run
+ *   expect delivery <op> <ratio>                    packets received / sent, all traffic
+ *   expect latency p<percentile> <op> <time>        one way, all traffic
+ *   expect unexpected <id>|all <op> <n>             frames heard from a node other than the owner of their window
+ *       op is one of >= <= > < ==
+ */
+
+enum class ScenarioAction : uint8_t
+{
+    JOIN,
+    LEAVE,
+    REBOOT,
+    CHANNEL,
+    LINK_DOWN,
+    LINK_UP,
+    PARTITION,
+    HEAL,
+    DROP,
+    IMPAIR
+};
+
+struct ScenarioEvent
+{
+    uint64_t time = 0;                      // us
+    ScenarioAction action{};
+    int node = -1;
+    int peer = -1;                          // LINK_* other end, DROP sender (-1 for any)
+    int value = 0;                          // CHANNEL and IMPAIR channel, DROP packet type (-1 for any, -2 for grants)
+    uint32_t count = 1;                     // DROP frames
+    std::vector<std::vector<int>> groups{}; // PARTITION
+    RadioImpairment impairment{};           // IMPAIR
+};
+
+struct ScenarioNodeSpec
+{
+    int id;
+    float frequency = 868e6;
+    float bandwidth = 250e3;
+    uint8_t spreadingFactor = 7;
+    uint8_t channel = 0;
+    double driftPPM = 0;
+    uint8_t fecData = 0;
+    uint8_t fecParity = 0;
+    bool slotYielding = false;
+    uint64_t start = 0;         // us, UINT64_MAX to start off
+};
+
+struct ScenarioTrafficSpec
+{
+    int node = 0;
+    std::string model{};        // cbr, poisson, onoff, trace
+    float rate = 1;             // packets/s, while on for onoff
+    float meanOn = 1;           // s, onoff
+    float meanOff = 1;          // s, onoff
+    std::vector<TrafficEvent> trace{};
+    std::vector<int> to{};      // node ids
+    TrafficProfile profile{};   // destinations filled in from to
+    int relay = -1;             // node id the packets are forwarded for, -1 for the node's own
+    uint64_t start = 0;         // us
+};
+
+enum class ScenarioMetric : uint8_t
+{
+    JOINED,
+    GOODPUT,
+    DELIVERY,
+    LATENCY,
+    UNEXPECTED
+};
+
+struct ScenarioExpectation
+{
+    ScenarioMetric metric;
+    int node = -1;              // -1 for all
+    std::string op = ">=";
+    double value = 0;           // JOINED: within in us (0 for no limit), LATENCY: us
+    float percentile = 50;      // LATENCY
+    std::string text;           // as written, for reporting
+};
+
+struct Scenario
+{
+    std::string name;
+    uint64_t seed = 1;
+    uint64_t duration = 0;      // us
+    uint64_t tick = 1000;       // us
+    std::vector<ScenarioNodeSpec> nodes;
+    std::vector<ScenarioTrafficSpec> traffic;
+    std::vector<ScenarioEvent> events;      // in time order once loaded
+    std::vector<ScenarioExpectation> expectations;
+
+    /**
+     * @return false with error set to file:line: reason if the file can't be read or doesn't parse
+     */
+    static bool load(const std::string& path, Scenario& scenario, std::string& error)
+    {
+        std::ifstream in(path);
+        if (!in){
+            error = path + ": can't open";
+            return false;
+        }
+        const size_t slash = path.find_last_of('/');
+        const std::string directory = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+        std::string file = (slash == std::string::npos) ? path : path.substr(slash + 1);
+        scenario.name = file.substr(0, file.find_last_of('.'));
+
+        std::string line;
+        for (size_t lineNum = 1; std::getline(in, line); ++lineNum){
+            std::string reason;
+            try {
+                if (!scenario.parseLine(line.substr(0, line.find('#')), directory, reason)){
+                    error = path + ":" + std::to_string(lineNum) + ": " + reason;
+                    return false;
+                }
+            }
+            catch (std::exception&){
+                error = path + ":" + std::to_string(lineNum) + ": bad number in '" + line + "'";
+                return false;
+            }
+        }
+        return scenario.validate(path, error);
+    }
+
+    /**
+     * @brief Time with an optional unit, in us
+     */
+    static uint64_t parseTime(const std::string& text)
+    {
+        size_t end = 0;
+        const double value = std::stod(text, &end);
+        const std::string unit = text.substr(end);
+        double scale = 1e6;
+        if (unit == "us"){
+            scale = 1;
+        }
+        else if (unit == "ms"){
+            scale = 1e3;
+        }
+        else if (unit == "min"){
+            scale = 60e6;
+        }
+        else if (!unit.empty() && unit != "s"){
+            throw std::invalid_argument(text);
+        }
+        return static_cast<uint64_t>(std::llround(value * scale));
+    }
+
+private:
+    static std::vector<int> parseIds(const std::string& text)
+    {
+        std::vector<int> ids;
+        std::stringstream stream(text);
+        std::string id;
+        while (std::getline(stream, id, ',')){
+            ids.push_back(std::stoi(id));
+        }
+        return ids;
+    }
+
+    // splits key=value options off the end of a statement
+    static std::map<std::string, std::string> options(std::vector<std::string>& words, size_t from)
+    {
+        std::map<std::string, std::string> found;
+        std::vector<std::string> kept(words.begin(), words.begin() + std::min(from, words.size()));
+        for (size_t i = from; i < words.size(); ++i){
+            const size_t equals = words[i].find('=');
+            if (equals == std::string::npos){
+                kept.push_back(words[i]);
+            }
+            else {
+                found[words[i].substr(0, equals)] = words[i].substr(equals + 1);
+            }
+        }
+        words = kept;
+        return found;
+    }
+
+    static int packetType(const std::string& name)
+    {
+        static const std::map<std::string, int> types = {
+            {"any", -1}, {"grant", -2}, {"normal", PACKET_TYPE::NORMAL},
+            {"joinrequest", PACKET_TYPE::JOINREQUEST}, {"heartbeat", PACKET_TYPE::HEARTBEAT},
+            {"fecdata", PACKET_TYPE::FEC_DATA}, {"fecparity", PACKET_TYPE::FEC_PARITY}, {"yield", PACKET_TYPE::YIELD}};
+        auto it = types.find(name);
+        if (it == types.end()){
+            throw std::invalid_argument(name);
+        }
+        return it->second;
+    }
+
+    const ScenarioNodeSpec* findNode(int id) const
+    {
+        for (const auto& node : nodes){
+            if (node.id == id){
+                return &node;
+            }
+        }
+        return nullptr;
+    }
+
+    bool parseLine(const std::string& line, const std::string& directory, std::string& reason)
+    {
+        std::vector<std::string> words;
+        std::stringstream stream(line);
+        for (std::string word; stream >> word;){
+            words.push_back(word);
+        }
+        if (words.empty()){
+            return true;
+        }
+        const std::string& keyword = words[0];
+
+        if (keyword == "name" && words.size() > 1){
+            name = line.substr(line.find(words[1]));
+            name.erase(name.find_last_not_of(" \t\r") + 1);
+        }
+        else if (keyword == "seed" && words.size() == 2){
+            seed = std::stoull(words[1]);
+        }
+        else if (keyword == "duration" && words.size() == 2){
+            duration = parseTime(words[1]);
+        }
+        else if (keyword == "tick" && words.size() == 2){
+            tick = std::max<uint64_t>(parseTime(words[1]), 1);
+        }
+        else if (keyword == "node" && words.size() >= 2){
+            ScenarioNodeSpec node{std::stoi(words[1])};
+            for (const auto& [key, value] : options(words, 2)){
+                if (key == "freq") node.frequency = std::stof(value);
+                else if (key == "bw") node.bandwidth = std::stof(value);
+                else if (key == "sf") node.spreadingFactor = static_cast<uint8_t>(std::stoul(value));
+                else if (key == "channel") node.channel = static_cast<uint8_t>(std::stoul(value));
+                else if (key == "drift") node.driftPPM = std::stod(value);
+                else if (key == "fec"){
+                    const size_t slash = value.find('/');
+                    node.fecData = static_cast<uint8_t>(std::stoul(value.substr(0, slash)));
+                    node.fecParity = (slash == std::string::npos) ? 0 : static_cast<uint8_t>(std::stoul(value.substr(slash + 1)));
+                }
+                else if (key == "yield" && (value == "on" || value == "off")) node.slotYielding = (value == "on");
+                else if (key == "start") node.start = (value == "never") ? UINT64_MAX : parseTime(value);
+                else {
+                    reason = "unknown node option " + key;
+                    return false;
+                }
+            }
+            if (words.size() != 2 || findNode(node.id) || node.id < 0 || node.id > 253){
+                reason = "bad or duplicate node";
+                return false;
+            }
+            nodes.push_back(node);
+        }
+        else if (keyword == "traffic" && words.size() >= 3){
+            ScenarioTrafficSpec traffic{std::stoi(words[1]), words[2]};
+            for (const auto& [key, value] : options(words, 3)){
+                if (key == "size"){
+                    const size_t dash = value.find('-');
+                    traffic.profile.minPayloadSize = std::stoul(value.substr(0, dash));
+                    traffic.profile.maxPayloadSize = (dash == std::string::npos) ? traffic.profile.minPayloadSize : std::stoul(value.substr(dash + 1));
+                }
+                else if (key == "to") traffic.to = parseIds(value);
+                else if (key == "service") traffic.profile.service = static_cast<uint8_t>(std::stoul(value));
+                else if (key == "relay") traffic.relay = std::stoi(value);
+                else if (key == "start") traffic.start = parseTime(value);
+                else if (key == "on") traffic.meanOn = parseTime(value) / 1e6f;
+                else if (key == "off") traffic.meanOff = parseTime(value) / 1e6f;
+                else {
+                    reason = "unknown traffic option " + key;
+                    return false;
+                }
+            }
+            if (traffic.model == "trace"){
+                if (words.size() != 4 || !TraceTraffic::load(directory + words[3], traffic.trace)){
+                    reason = "can't load trace";
+                    return false;
+                }
+            }
+            else if ((traffic.model == "cbr" || traffic.model == "poisson" || traffic.model == "onoff") && words.size() == 4){
+                traffic.rate = std::stof(words[3]);
+            }
+            else {
+                reason = "expected traffic <id> cbr|poisson|onoff <rate> or traffic <id> trace <file>";
+                return false;
+            }
+            this->traffic.push_back(traffic);
+        }
+        else if (keyword == "at" && words.size() >= 3){
+            return parseEvent(words, reason);
+        }
+        else if (keyword == "expect" && words.size() >= 2){
+            return parseExpectation(words, line, reason);
+        }
+        else {
+            reason = "can't parse '" + line + "'";
+            return false;
+        }
+        return true;
+    }
+
+    bool parseEvent(std::vector<std::string>& words, std::string& reason)
+    {
+        ScenarioEvent event{parseTime(words[1])};
+        const std::string& action = words[2];
+        uint64_t lasts = 0;
+        auto forClause = [&words, &lasts](size_t at) {
+            if (words.size() == at + 2 && words[at] == "for"){
+                lasts = parseTime(words[at + 1]);
+                words.resize(at);
+            }
+        };
+
+        if ((action == "join" || action == "leave" || action == "reboot") && words.size() == 4){
+            event.action = (action == "join") ? ScenarioAction::JOIN : (action == "leave") ? ScenarioAction::LEAVE : ScenarioAction::REBOOT;
+            event.node = std::stoi(words[3]);
+        }
+        else if (action == "channel" && words.size() == 5){
+            event.action = ScenarioAction::CHANNEL;
+            event.node = std::stoi(words[3]);
+            event.value = std::stoi(words[4]);
+        }
+        else if (action == "link" && words.size() >= 6){
+            forClause(6);
+            if (words.size() != 6 || (words[5] != "down" && words[5] != "up")){
+                reason = "expected link <a> <b> down|up [for <time>]";
+                return false;
+            }
+            event.action = (words[5] == "down") ? ScenarioAction::LINK_DOWN : ScenarioAction::LINK_UP;
+            event.node = std::stoi(words[3]);
+            event.peer = std::stoi(words[4]);
+        }
+        else if (action == "partition" && words.size() >= 5){
+            forClause(words.size() - 2);
+            event.action = ScenarioAction::PARTITION;
+            for (size_t i = 3; i < words.size(); ++i){
+                event.groups.push_back(parseIds(words[i]));
+            }
+        }
+        else if (action == "heal" && words.size() == 3){
+            event.action = ScenarioAction::HEAL;
+        }
+        else if (action == "drop" && words.size() >= 5){
+            event.action = ScenarioAction::DROP;
+            for (const auto& [key, value] : options(words, 5)){
+                if (key == "count") event.count = static_cast<uint32_t>(std::stoul(value));
+                else if (key == "from") event.peer = std::stoi(value);
+                else {
+                    reason = "unknown drop option " + key;
+                    return false;
+                }
+            }
+            if (words.size() != 5){
+                reason = "expected drop <id> <type> [count=n] [from=id]";
+                return false;
+            }
+            event.node = std::stoi(words[3]);
+            event.value = packetType(words[4]);
+        }
+        else if (action == "impair" && words.size() >= 5){
+            event.action = ScenarioAction::IMPAIR;
+            for (const auto& [key, value] : options(words, 5)){
+                if (key == "loss"){
+                    event.impairment.lossModel = RadioLossModel::BERNOULLI;
+                    event.impairment.lossProbability = std::stof(value);
+                }
+                else if (key == "burst"){
+                    const size_t slash = value.find('/');
+                    if (slash == std::string::npos){
+                        reason = "expected burst=<loss>/<fade time>";
+                        return false;
+                    }
+                    RadioImpairment burst = RadioImpairment::burst(std::stof(value.substr(0, slash)), static_cast<float>(parseTime(value.substr(slash + 1))));
+                    event.impairment.lossModel = burst.lossModel;
+                    event.impairment.meanGoodTime = burst.meanGoodTime;
+                    event.impairment.meanBadTime = burst.meanBadTime;
+                }
+                else if (key == "ber") event.impairment.bitErrorRate = std::stof(value);
+                else if (key == "jitter") event.impairment.maxJitter = static_cast<uint32_t>(parseTime(value));
+                else {
+                    reason = "unknown impair option " + key;
+                    return false;
+                }
+            }
+            if (words.size() != 5){
+                reason = "expected impair channel <n> or impair <a> <b>";
+                return false;
+            }
+            if (words[3] == "channel"){
+                event.value = std::stoi(words[4]);
+            }
+            else {
+                event.node = std::stoi(words[3]);
+                event.peer = std::stoi(words[4]);
+            }
+        }
+        else {
+            reason = "unknown or malformed event " + action;
+            return false;
+        }
+        events.push_back(event);
+
+        if (lasts){
+            // the matching restore, links in a partition come back together
+            ScenarioEvent restore = event;
+            restore.time += lasts;
+            restore.action = (event.action == ScenarioAction::LINK_DOWN) ? ScenarioAction::LINK_UP : ScenarioAction::HEAL;
+            events.push_back(restore);
+        }
+        return true;
+    }
+
+    bool parseExpectation(const std::vector<std::string>& words, const std::string& line, std::string& reason)
+    {
+        ScenarioExpectation expectation;
+        expectation.text = line.substr(line.find(words[1]));
+        expectation.text.erase(expectation.text.find_last_not_of(" \t\r") + 1);
+        const std::string& metric = words[1];
+        static const std::set<std::string> ops = {">=", "<=", ">", "<", "=="};
+
+        if (metric == "joined" && (words.size() == 3 || (words.size() == 5 && words[3] == "within"))){
+            expectation.metric = ScenarioMetric::JOINED;
+            expectation.node = (words[2] == "all") ? -1 : std::stoi(words[2]);
+            expectation.value = (words.size() == 5) ? parseTime(words[4]) : 0;
+        }
+        else if (metric == "goodput" && words.size() == 5 && ops.count(words[3])){
+            expectation.metric = ScenarioMetric::GOODPUT;
+            expectation.node = (words[2] == "all") ? -1 : std::stoi(words[2]);
+            expectation.op = words[3];
+            expectation.value = std::stod(words[4]);
+        }
+        else if (metric == "delivery" && words.size() == 4 && ops.count(words[2])){
+            expectation.metric = ScenarioMetric::DELIVERY;
+            expectation.op = words[2];
+            expectation.value = std::stod(words[3]);
+        }
+        else if (metric == "latency" && words.size() == 5 && words[2].size() > 1 && words[2][0] == 'p' && ops.count(words[3])){
+            expectation.metric = ScenarioMetric::LATENCY;
+            expectation.percentile = std::stof(words[2].substr(1));
+            expectation.op = words[3];
+            expectation.value = parseTime(words[4]);
+        }
+        else if (metric == "unexpected" && words.size() == 5 && ops.count(words[3])){
+            expectation.metric = ScenarioMetric::UNEXPECTED;
+            expectation.node = (words[2] == "all") ? -1 : std::stoi(words[2]);
+            expectation.op = words[3];
+            expectation.value = std::stod(words[4]);
+        }
+        else {
+            reason = "unknown or malformed expectation " + metric;
+            return false;
+        }
+        expectations.push_back(expectation);
+        return true;
+    }
+
+    bool validate(const std::string& path, std::string& error)
+    {
+        auto fail = [&path, &error](const std::string& reason) {
+            error = path + ": " + reason;
+            return false;
+        };
+        if (!duration){
+            return fail("no duration");
+        }
+        if (nodes.empty()){
+            return fail("no nodes");
+        }
+        auto known = [this](int id) { return id == -1 || findNode(id) != nullptr; };
+        for (auto& spec : traffic){
+            if (!known(spec.node)){
+                return fail("traffic from unknown node " + std::to_string(spec.node));
+            }
+            for (int id : spec.to){
+                if (!findNode(id)){
+                    return fail("traffic to unknown node " + std::to_string(id));
+                }
+            }
+            if (!known(spec.relay)){
+                return fail("traffic relayed for unknown node " + std::to_string(spec.relay));
+            }
+        }
+        for (const auto& event : events){
+            bool ok = known(event.node) && known(event.peer);
+            for (const auto& group : event.groups){
+                ok = ok && std::all_of(group.begin(), group.end(), [&known](int id) { return id >= 0 && known(id); });
+            }
+            if (!ok){
+                return fail("event on unknown node");
+            }
+        }
+        for (const auto& expectation : expectations){
+            if (!known(expectation.node)){
+                return fail("expectation on unknown node " + std::to_string(expectation.node));
+            }
+        }
+        std::stable_sort(events.begin(), events.end(), [](const ScenarioEvent& a, const ScenarioEvent& b) { return a.time < b.time; });
+        return true;
+    }
+};
+
+/**
+ * @brief RNP address SimNode gives a node number
+ */
+inline uint8_t scenarioAddress(int node)
+{
+    return static_cast<uint8_t>(1 + (100 + node) % 254);
+}
+
+struct ScenarioCheckResult
+{
+    std::string description;
+    bool passed;
+    std::string measured;
+};
+
+struct ScenarioResult
+{
+    std::string name{};
+    std::vector<ScenarioCheckResult> checks{};
+    bool passed() const {return std::all_of(checks.begin(), checks.end(), [](const ScenarioCheckResult& check) { return check.passed; });}
+};
+
+/**
+ * @brief Runs a scenario to completion on the calling thread, on a virtual clock stepped one tick at a time. Nodes
+ * that leave are destroyed and come back as fresh SimNodes with the same address, so every join starts from
+ * discovery. The same scenario and seed always give the same result.
+ */
+class ScenarioRunner
+{
+public:
+    using Node = SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>;
+
+    explicit ScenarioRunner(const Scenario& scenario)
+        : m_scenario(scenario),
+          m_world(scenario.seed, [clock = m_clock]() { return clock.micros(); })
+    {
+        for (const auto& spec : scenario.traffic){
+            m_services.insert(spec.profile.service);
+        }
+        for (const auto& spec : scenario.nodes){
+            m_nodes[spec.id].spec = &spec;
+        }
+    }
+
+    ScenarioResult run()
+    {
+        std::vector<ScenarioEvent> events;
+        for (const auto& spec : m_scenario.nodes){
+            if (spec.start != UINT64_MAX){
+                events.push_back(ScenarioEvent{spec.start, ScenarioAction::JOIN, spec.id});
+            }
+        }
+        events.insert(events.end(), m_scenario.events.begin(), m_scenario.events.end());
+        std::stable_sort(events.begin(), events.end(), [](const ScenarioEvent& a, const ScenarioEvent& b) { return a.time < b.time; });
+
+        size_t nextEvent = 0;
+        while (m_world.now() < m_scenario.duration){
+            const uint64_t now = m_world.now();
+            for (; nextEvent < events.size() && events[nextEvent].time <= now; ++nextEvent){
+                apply(events[nextEvent]);
+            }
+            for (auto& [id, state] : m_nodes){
+                if (state.node){
+                    state.node->update();
+                    if (!state.joined && static_cast<const TDMARadioInterfaceInfo*>(state.node->getRadioInfo())->joined){
+                        state.joined = true;
+                        state.joinTimes.push_back(now - state.startedAt);
+                    }
+                }
+            }
+            m_clock.advance(m_scenario.tick);
+        }
+        for (auto& [id, state] : m_nodes){
+            powerDown(state);
+        }
+        return evaluate();
+    }
+
+private:
+    struct DropRule
+    {
+        int type;       // -1 for any, -2 for frames carrying a join grant
+        int from;       // address, -1 for any
+        uint32_t remaining;
+    };
+
+    struct NodeState
+    {
+        const ScenarioNodeSpec* spec;
+        std::unique_ptr<Node> node;
+        uint64_t startedAt = 0;
+        bool joined = false;                    // since startedAt
+        std::vector<uint64_t> joinTimes;        // us from power up, one per power up that joined
+        std::vector<uint64_t> unjoinedUptimes;  // us powered up, one per power up that never joined
+        std::vector<DropRule> drops;
+        // accumulated over every power up
+        uint64_t sent = 0;
+        uint64_t received = 0;
+        uint64_t bytes = 0;
+        std::vector<uint64_t> latencies;
+        uint64_t unexpected = 0;                // SlotStats::unexpectedSource
+    };
+
+    const Scenario& m_scenario;
+    VirtualClock m_clock;
+    SimWorld m_world;
+    std::map<int, NodeState> m_nodes;
+    std::set<uint8_t> m_services;
+    std::set<std::pair<int, int>> m_cuts;       // node ids, lower first
+    std::map<std::pair<int, int>, RadioImpairment> m_linkImpairments;     // sender, receiver node ids
+
+    void apply(const ScenarioEvent& event)
+    {
+        switch (event.action){
+            case ScenarioAction::JOIN: powerUp(m_nodes[event.node]); break;
+            case ScenarioAction::LEAVE: powerDown(m_nodes[event.node]); break;
+            case ScenarioAction::REBOOT: {
+                powerDown(m_nodes[event.node]);
+                powerUp(m_nodes[event.node]);
+                break;
+            }
+            case ScenarioAction::CHANNEL: {
+                if (m_nodes[event.node].node){
+                    m_nodes[event.node].node->getPhysicalLayer()->setChannel(static_cast<uint8_t>(event.value));
+                }
+                break;
+            }
+            case ScenarioAction::LINK_DOWN: setLink(event.node, event.peer, false); break;
+            case ScenarioAction::LINK_UP: setLink(event.node, event.peer, true); break;
+            case ScenarioAction::PARTITION: {
+                for (size_t i = 0; i < event.groups.size(); ++i){
+                    for (size_t j = i + 1; j < event.groups.size(); ++j){
+                        for (int a : event.groups[i]){
+                            for (int b : event.groups[j]){
+                                setLink(a, b, false);
+                            }
+                        }
+                    }
+                }
+                break;
+            }
+            case ScenarioAction::HEAL: {
+                const auto cuts = m_cuts;
+                for (const auto& cut : cuts){
+                    setLink(cut.first, cut.second, true);
+                }
+                break;
+            }
+            case ScenarioAction::DROP: {
+                const int from = (event.peer < 0) ? -1 : scenarioAddress(event.peer);
+                m_nodes[event.node].drops.push_back(DropRule{event.value, from, event.count});
+                break;
+            }
+            case ScenarioAction::IMPAIR: {
+                if (event.node < 0){
+                    m_world.getChannel(event.value)->setImpairment(event.impairment);
+                }
+                else {
+                    m_linkImpairments[{event.node, event.peer}] = event.impairment;
+                    setLinkImpairment(event.node, event.peer);
+                }
+                break;
+            }
+        }
+    }
+
+    void setLinkImpairment(int sender, int receiver)
+    {
+        Node* from = m_nodes[sender].node.get();
+        Node* to = m_nodes[receiver].node.get();
+        if (!from || !to){
+            return;     // applied when the missing end powers up
+        }
+        const RadioImpairment& impairment = m_linkImpairments[{sender, receiver}];
+        std::shared_ptr<RadioChannel> channel = m_world.getChannel(m_nodes[receiver].spec->channel);
+        if (impairment.enabled()){
+            channel->setLinkImpairment(from->getPhysicalLayer(), to->getPhysicalLayer(), impairment);
+        }
+        else {
+            channel->clearLinkImpairment(from->getPhysicalLayer(), to->getPhysicalLayer());
+        }
+    }
+
+    void powerUp(NodeState& state)
+    {
+        if (state.node){
+            return;
+        }
+        const ScenarioNodeSpec& spec = *state.spec;
+        state.node = std::make_unique<Node>(m_world, spec.id, spec.frequency, spec.bandwidth, spec.spreadingFactor, false, spec.driftPPM);
+        state.node->getRadio().setFec(spec.fecData, spec.fecParity);
+        state.node->getRadio().setSlotYielding(spec.slotYielding);
+        state.node->setup();
+        if (spec.channel){
+            state.node->getPhysicalLayer()->setChannel(spec.channel);
+        }
+        for (uint8_t service : m_services){
+            state.node->listen(service);
+        }
+        for (const auto& traffic : m_scenario.traffic){
+            if (traffic.node == spec.id){
+                state.node->addTrafficGenerator(makeGenerator(traffic));
+            }
+        }
+        state.node->getPhysicalLayer()->setRxFilter([&state](const std::vector<uint8_t>& frame) { return !dropped(state, frame); });
+        for (const auto& cut : m_cuts){
+            if (cut.first == spec.id || cut.second == spec.id){
+                setLink(cut.first, cut.second, false);     // the old phy's overrides went with it
+            }
+        }
+        for (const auto& [link, impairment] : m_linkImpairments){
+            if (link.first == spec.id || link.second == spec.id){
+                setLinkImpairment(link.first, link.second);
+            }
+        }
+        state.startedAt = m_world.now();
+        state.joined = false;
+    }
+
+    void powerDown(NodeState& state)
+    {
+        if (!state.node){
+            return;
+        }
+        state.sent += state.node->getTrafficSent();
+        for (uint8_t service : m_services){
+            const TrafficSink* sink = state.node->getTrafficSink(service);
+            state.received += sink->getReceived();
+            state.bytes += sink->getBytes();
+            state.latencies.insert(state.latencies.end(), sink->getLatencies().begin(), sink->getLatencies().end());
+        }
+        state.unexpected += static_cast<const TDMARadioInterfaceInfo*>(state.node->getRadioInfo())->slotStats.get().unexpectedSource;
+        if (!state.joined){
+            state.unjoinedUptimes.push_back(m_world.now() - state.startedAt);
+        }
+        state.node.reset();
+    }
+
+    void setLink(int a, int b, bool up)
+    {
+        const std::pair<int, int> link{std::min(a, b), std::max(a, b)};
+        if (up){
+            m_cuts.erase(link);
+        }
+        else {
+            m_cuts.insert(link);
+        }
+        Node* nodeA = m_nodes[a].node.get();
+        Node* nodeB = m_nodes[b].node.get();
+        if (!nodeA || !nodeB){
+            return;     // applied when the missing end powers up
+        }
+        RadioChannelManager& manager = m_world.getChannelManager();
+        if (up){
+            manager.clearLinkPathLoss(nodeA->getPhysicalLayer(), nodeB->getPhysicalLayer());
+        }
+        else {
+            manager.setLinkPathLoss(nodeA->getPhysicalLayer(), nodeB->getPhysicalLayer(), INFINITY);
+        }
+    }
+
+    static bool dropped(NodeState& state, const std::vector<uint8_t>& frame)
+    {
+        // tdma header: type, registered nodes, time window, source, destination, info, sequence, then TDMAControl
+        constexpr size_t tdmaHeaderSize = 7;
+        if (frame.size() < 4){
+            return false;
+        }
+        const int type = frame[0] & ~PACKET_TYPE_FLAGS;
+        const size_t grantAddress = tdmaHeaderSize + TDMAControl::grantOffset;
+        const bool grant = (frame[0] & PACKET_TYPE_CONTROL) && frame.size() > grantAddress && frame[grantAddress];
+        for (auto& rule : state.drops){
+            const bool matches = (rule.type == -1) || (rule.type == -2 ? grant : rule.type == type);
+            if (rule.remaining && matches && (rule.from < 0 || rule.from == frame[3])){
+                --rule.remaining;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::unique_ptr<TrafficGenerator> makeGenerator(const ScenarioTrafficSpec& spec)
+    {
+        TrafficProfile profile = spec.profile;
+        for (int id : spec.to){
+            profile.destinations.push_back(scenarioAddress(id));
+        }
+        if (spec.relay >= 0){
+            profile.source = scenarioAddress(spec.relay);
+        }
+        std::unique_ptr<TrafficGenerator> generator;
+        if (spec.model == "cbr"){
+            generator = std::make_unique<CbrTraffic>(profile, spec.rate);
+        }
+        else if (spec.model == "poisson"){
+            generator = std::make_unique<PoissonTraffic>(profile, spec.rate);
+        }
+        else if (spec.model == "onoff"){
+            generator = std::make_unique<OnOffTraffic>(profile, spec.rate, spec.meanOn, spec.meanOff);
+        }
+        else {
+            generator = std::make_unique<TraceTraffic>(profile, spec.trace);
+        }
+        if (spec.start){
+            return std::make_unique<DelayedTraffic>(std::move(generator), spec.start);
+        }
+        return generator;
+    }
+
+    /**
+     * @brief Holds a generator back until a world time, nodes start their generators when they power up
+     */
+    class DelayedTraffic : public TrafficGenerator
+    {
+    public:
+        DelayedTraffic(std::unique_ptr<TrafficGenerator> generator, uint64_t start)
+            : TrafficGenerator(generator->getProfile()),
+              m_generator(std::move(generator)),
+              m_start(start)
+        {}
+
+        bool next(uint64_t now, Xoshiro256& rng, TrafficEvent& event) override
+        {
+            return m_generator->next(std::max(now, m_start), rng, event);
+        }
+
+    protected:
+        uint64_t interval(Xoshiro256&) override {return 0;}
+
+    private:
+        std::unique_ptr<TrafficGenerator> m_generator;
+        const uint64_t m_start;
+    };
+
+    static bool compare(double measured, const std::string& op, double expected)
+    {
+        if (op == ">=") return measured >= expected;
+        if (op == "<=") return measured <= expected;
+        if (op == ">") return measured > expected;
+        if (op == "<") return measured < expected;
+        return measured == expected;
+    }
+
+    static std::string format(double value)
+    {
+        std::ostringstream out;
+        out << value;
+        return out.str();
+    }
+
+    ScenarioResult evaluate() const
+    {
+        ScenarioResult result{m_scenario.name};
+        const double seconds = m_scenario.duration / 1e6;
+
+        uint64_t sent = 0;
+        uint64_t received = 0;
+        std::vector<uint64_t> latencies;
+        for (const auto& [id, state] : m_nodes){
+            sent += state.sent;
+            received += state.received;
+            latencies.insert(latencies.end(), state.latencies.begin(), state.latencies.end());
+        }
+
+        for (const auto& expectation : m_scenario.expectations){
+            ScenarioCheckResult check{expectation.text, true, ""};
+            switch (expectation.metric){
+                case ScenarioMetric::JOINED: {
+                    uint64_t slowest = 0;
+                    for (const auto& [id, state] : m_nodes){
+                        if (expectation.node >= 0 && id != expectation.node){
+                            continue;
+                        }
+                        for (uint64_t joinTime : state.joinTimes){
+                            slowest = std::max(slowest, joinTime);
+                        }
+                        // a power up too short to have had the chance to join doesn't count against it
+                        for (uint64_t uptime : state.unjoinedUptimes){
+                            check.passed = check.passed && expectation.value && uptime < expectation.value;
+                        }
+                        check.passed = check.passed && !state.joinTimes.empty();
+                    }
+                    check.passed = check.passed && (!expectation.value || slowest <= expectation.value);
+                    check.measured = "slowest join " + format(slowest / 1e3) + "ms";
+                    break;
+                }
+                case ScenarioMetric::GOODPUT: {
+                    uint64_t bytes = 0;
+                    for (const auto& [id, state] : m_nodes){
+                        bytes += (expectation.node < 0 || id == expectation.node) ? state.bytes : 0;
+                    }
+                    const double goodput = bytes / seconds;
+                    check.passed = compare(goodput, expectation.op, expectation.value);
+                    check.measured = format(goodput) + "B/s";
+                    break;
+                }
+                case ScenarioMetric::DELIVERY: {
+                    const double ratio = sent ? static_cast<double>(received) / sent : 0;
+                    check.passed = compare(ratio, expectation.op, expectation.value);
+                    check.measured = format(received) + "/" + format(sent);
+                    break;
+                }
+                case ScenarioMetric::LATENCY: {
+                    const uint64_t latency = TrafficSink::percentile(latencies, expectation.percentile);
+                    check.passed = !latencies.empty() && compare(static_cast<double>(latency), expectation.op, expectation.value);
+                    check.measured = format(latency / 1e3) + "ms";
+                    break;
+                }
+                case ScenarioMetric::UNEXPECTED: {
+                    uint64_t unexpected = 0;
+                    for (const auto& [id, state] : m_nodes){
+                        unexpected += (expectation.node < 0 || id == expectation.node) ? state.unexpected : 0;
+                    }
+                    check.passed = compare(static_cast<double>(unexpected), expectation.op, expectation.value);
+                    check.measured = format(unexpected) + " frames";
+                    break;
+                }
+            }
+            result.checks.push_back(check);
+        }
+        return result;
+    }
+};
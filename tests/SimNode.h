@@ -7,35 +7,66 @@
 
 // librrp
 #include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
 #include <librrp/datalink/turn_timeout.h>
 #include <librrp/datalink/tdma.h>
-
-// libriccore
-#include <libriccore/platform/millis.h>
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
 
 #include "DummyCommands/dummy_commandhandler.h"
+#include "Traffic/traffic_generator.h"
+#include "Traffic/traffic_sink.h"
 
 #include <mutex>
 #include <memory>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <map>
+#include <tuple>
 
 enum class SimNode_COMMAND_IDS : uint8_t {
     getTime = 10
 };
 
+// datalinks with randomness of their own (TDMA backoff) take a seed so the world seed covers them too
+template <typename T, typename = void>
+struct has_setSeed : std::false_type {};
+template <typename T>
+struct has_setSeed<T, std::void_t<decltype(std::declval<T&>().setSeed(uint64_t{}))>> : std::true_type {};
+
+/**
+ * @tparam DataLinkProtocol datalink over LoRaSimPhysicalLayer running on a DriftingClock, e.g
+ * TDMARadio<LoRaSimPhysicalLayer, DriftingClock>
+ */
 template <typename DataLinkProtocol>
 class SimNode {
 public:
-    SimNode(int nodeNum, float frequency, float bandwidth, uint8_t spreadingFactor, bool pushDummyPackets = false)
-        : m_nodeNum(nodeNum),
+    /**
+     * @param driftPPM how fast this node's clock runs against the world clock
+     */
+    SimNode(SimWorld& world, int nodeNum, float frequency, float bandwidth, uint8_t spreadingFactor, bool pushDummyPackets = false, double driftPPM = 0)
+        : m_world(world),
+          m_nodeNum(nodeNum),
           m_pushDummyPackets(pushDummyPackets),
-          m_simphysicallayer(frequency, bandwidth, spreadingFactor),
+          m_clock(world.getTimeSource(), driftPPM),
+          m_simphysicallayer(world, frequency, bandwidth, spreadingFactor),
 		  m_networkmanager(100, NODETYPE::LEAF, true),
-		  m_radio(m_simphysicallayer, m_networkmanager),
+		  m_radio(m_simphysicallayer, m_networkmanager, m_clock),
           m_dummycommandhandler(static_cast<uint8_t>(DEFAULT_SERVICES::COMMAND), createCommandMap()) 
-    {RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("node" + std::to_string(m_nodeNum) + " constructed!");}
+    {
+        if constexpr (has_setSeed<DataLinkProtocol>::value) {
+            m_radio.setSeed(world.nextSeed());
+        }
+        RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("node" + std::to_string(m_nodeNum) + " constructed!");
+    }
 
     ~SimNode() 
-	{RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("node" + std::to_string(m_nodeNum) + " destroyed!");}
+	{
+		m_world.unregisterAddress(m_networkmanager.getAddress());
+		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("node" + std::to_string(m_nodeNum) + " destroyed!");
+	}
 
     void setup() {
         m_radio.setup();
@@ -48,26 +79,91 @@ public:
 		m_networkmanager.setLogCb([](const std::string& msg) {
 			std::cout << "NetworkManager Log: " << msg << std::endl; 
 			RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>(msg);});
-		int RNPAddress = 101 + m_nodeNum;
-		if (find(simulatedRNPAddresses.begin(), simulatedRNPAddresses.end(), RNPAddress) == simulatedRNPAddresses.end()){
-			simulatedRNPAddresses.push_back(RNPAddress);
-		}
+		int RNPAddress = 1 + (100 + m_nodeNum) % 254;	// 101, 102, ... wrapping round to 1 so up to 254 nodes stay unique and off the broadcast address
+		m_world.registerAddress(RNPAddress);
 		m_networkmanager.setAddress(RNPAddress);
 		RicCoreLogging::log<RicCoreLoggingConfig::LOGGERS::SYS>("Created sim node with RNP address = " + std::to_string(m_networkmanager.getAddress()));
 
-        m_timeLastPacketPushed = millis();
+        m_timeLastPacketPushed = m_clock.micros();
     }
 
     void update() {
 		m_networkmanager.update();
         m_radio.update();
 
+        const uint64_t now = m_clock.micros();
+        for (auto& traffic : m_traffic) {
+            while (traffic.active && traffic.next.time <= now) {
+                sendTraffic(traffic.next);
+                traffic.active = traffic.generator->next(traffic.next.time, m_trafficRng, traffic.next);
+            }
+        }
+
         if (m_pushDummyPackets) {
-            if (millis() - m_timeLastPacketPushed > m_sendDelta) {
+            if (m_clock.micros() - m_timeLastPacketPushed > m_sendDelta) {
                 pushDummyPackets();
-                m_timeLastPacketPushed = millis();
+                m_timeLastPacketPushed = m_clock.micros();
+            }
+        }
+    }
+
+    /**
+     * @brief Time on the node's clock (us) at which update() next has work, see TDMARadio::nextDeadline()
+     */
+    uint64_t nextDeadline() {
+        uint64_t deadline = m_radio.nextDeadline();
+        if (m_pushDummyPackets) {
+            deadline = std::min(deadline, m_timeLastPacketPushed + m_sendDelta + 1);
+        }
+        for (const auto& traffic : m_traffic) {
+            if (traffic.active) {
+                deadline = std::min(deadline, traffic.next.time);
             }
         }
+        return deadline;
+    }
+
+    /**
+     * @brief Send TrafficPackets as the generator decides, from now on. Packets are stamped with world time and
+     * numbered per destination, so the receiving node's TrafficSink (see listen()) works out loss and latency.
+     * Packets the profile gives another node's source go to the radio directly, as a routing node forwards them.
+     */
+    void addTrafficGenerator(std::unique_ptr<TrafficGenerator> generator) {
+        if (m_traffic.empty()) {
+            m_trafficRng.seed(m_world.nextSeed());  // drawn on first use so nodes without traffic leave the seed sequence alone
+        }
+        Traffic traffic{std::move(generator), {}, true};
+        traffic.active = traffic.generator->next(m_clock.micros(), m_trafficRng, traffic.next);
+        m_traffic.push_back(std::move(traffic));
+    }
+
+    /**
+     * @brief Receive TrafficPackets sent to service, returns the sink counting them
+     */
+    const TrafficSink& listen(uint8_t service = TrafficProfile().service) {
+        auto it = m_sinks.find(service);
+        if (it == m_sinks.end()) {
+            SimWorld& world = m_world;
+            it = m_sinks.emplace(service, std::make_unique<TrafficSink>(service, [&world]() { return world.now(); })).first;
+            m_networkmanager.registerService(service, it->second->getCallback());
+        }
+        return *it->second;
+    }
+
+    /**
+     * @return nullptr if the node isn't listening on service
+     */
+    const TrafficSink* getTrafficSink(uint8_t service = TrafficProfile().service) const {
+        auto it = m_sinks.find(service);
+        return (it == m_sinks.end()) ? nullptr : it->second.get();
+    }
+
+    uint64_t getTrafficSent() const {
+        return m_trafficSent;
+    }
+
+    const DriftingClock& getClock() const {
+        return m_clock;
     }
 
     LoRaSimPhysicalLayer* getPhysicalLayer() {
@@ -78,23 +174,69 @@ public:
 		return m_nodeNum;
 	}
 
+	const RnpInterfaceInfo* getRadioInfo() {
+		return m_radio.getInfo();
+	}
+
+	DataLinkProtocol& getRadio() {
+		return m_radio;
+	}
+
 private:
+	SimWorld& m_world;
 	int m_nodeNum;
 	bool m_pushDummyPackets;
+	DriftingClock m_clock;
 	LoRaSimPhysicalLayer m_simphysicallayer;
 	RnpNetworkManager m_networkmanager;
 	DataLinkProtocol m_radio;
     DummyCommandHandler<SimNode_COMMAND_IDS> m_dummycommandhandler;
 
-	static std::vector<int> simulatedRNPAddresses; 
+    uint64_t m_timeLastPacketPushed = 0;   // us on m_clock
+    uint64_t m_sendDelta = 1000000;
+
+    struct Traffic {
+        std::unique_ptr<TrafficGenerator> generator;
+        TrafficEvent next;      // due on m_clock
+        bool active;
+    };
+    std::vector<Traffic> m_traffic;
+    Xoshiro256 m_trafficRng;
+    std::map<std::tuple<uint8_t, uint8_t, uint8_t>, uint32_t> m_trafficSequence;     // next sequence number per source, destination and service
+    std::map<uint8_t, std::unique_ptr<TrafficSink>> m_sinks;              // by service
+    uint64_t m_trafficSent = 0;
+
+    void sendTraffic(const TrafficEvent& event) {
+        int destination = event.destination;
+        if (destination < 0) {
+            std::vector<int> others = m_world.getAddresses();
+            others.erase(std::remove(others.begin(), others.end(), static_cast<int>(m_networkmanager.getAddress())), others.end());
+            if (others.empty()) {
+                return;
+            }
+            destination = others[m_trafficRng.nextBelow(static_cast<uint32_t>(others.size()))];
+        }
 
-    uint32_t m_timeLastPacketPushed = 0;
-    uint32_t m_sendDelta = 1000;
+        const uint8_t address = static_cast<uint8_t>(destination);
+        const uint8_t source = (event.source < 0) ? m_networkmanager.getAddress() : static_cast<uint8_t>(event.source);
+        TrafficPacket packet(event.service, m_trafficSequence[{source, address, event.service}]++, m_world.now(), event.payloadSize);
+        packet.header.source = source;
+        packet.header.source_service = event.service;
+        packet.header.destination = address;
+        packet.header.destination_service = event.service;
+        if (event.source < 0) {
+            m_networkmanager.sendPacket(packet);
+        }
+        else {
+            m_radio.sendPacket(packet);     // forwarded for another node, the rnp source stays its address
+        }
+        ++m_trafficSent;
+    }
 
     void getTimeCommand(const RnpPacketSerialized& packet) {
         SimpleCommandPacket commandpacket(packet);
 
-        uint32_t time = millis();
+        uint32_t time = m_clock.millis();
 
         BasicDataPacket<uint32_t, 0, 105> responsePacket(time);
         responsePacket.header.source_service = m_dummycommandhandler.getServiceID(); 
@@ -113,6 +255,7 @@ private:
         simplecommandpacket.header.source_service = m_dummycommandhandler.getServiceID();
 
 		int destAddress = -1;
+		const std::vector<int> simulatedRNPAddresses = m_world.getAddresses();
 		for (size_t i = 0; i < simulatedRNPAddresses.size(); ++i) {
 			if (simulatedRNPAddresses[i] != m_networkmanager.getAddress()) {
 				destAddress = simulatedRNPAddresses[i];
@@ -134,6 +277,3 @@ private:
         };
     }
 };
-
-template <typename DataLinkProtocol>
-std::vector<int> SimNode<DataLinkProtocol>::simulatedRNPAddresses;
\ No newline at end of file
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include <librrp/util/xoshiro.h>
+
+#include "traffic_packet.h"
+
+/**
+ * @brief One packet a generator wants sent
+ */
+struct TrafficEvent
+{
+    uint64_t time;          // us on the sending node's clock
+    size_t payloadSize;     // bytes of TrafficPacket payload, at least TrafficPacket::minPayloadSize
+    int destination;        // rnp address, -1 for any other node in the world
+    uint8_t service;        // rnp service on both ends
+    int source = -1;        // rnp address the packet is from, -1 for the sending node
+};
+
+/**
+ * @brief What the packets of a generator look like, whatever their timing
+ */
+struct TrafficProfile
+{
+    size_t minPayloadSize = 16;         // bytes, each packet is uniform between min and max
+    size_t maxPayloadSize = 16;
+    std::vector<uint8_t> destinations;  // one picked uniformly per packet, any other node in the world if empty
+    uint8_t service = 20;
+    int source = -1;                    // rnp address, another node's to send its packets as though forwarding them
+};
+
+/**
+ * @brief Decides when a node sends and what. Subclasses supply the timing, the profile supplies size, destination
+ * and service.
+ */
+class TrafficGenerator
+{
+public:
+    explicit TrafficGenerator(TrafficProfile profile)
+        : m_profile(std::move(profile))
+    {}
+
+    virtual ~TrafficGenerator() = default;
+
+    /**
+     * @brief The packet after the one due at now (or the first one, if now is when the generator starts)
+     *
+     * @return false once the generator has nothing more to send
+     */
+    virtual bool next(uint64_t now, Xoshiro256& rng, TrafficEvent& event)
+    {
+        event.time = now + interval(rng);
+        event.payloadSize = m_profile.minPayloadSize;
+        if (m_profile.maxPayloadSize > m_profile.minPayloadSize){
+            event.payloadSize += rng.nextBelow(static_cast<uint32_t>(m_profile.maxPayloadSize - m_profile.minPayloadSize + 1));
+        }
+        event.payloadSize = std::max(event.payloadSize, TrafficPacket::minPayloadSize);
+        event.destination = m_profile.destinations.empty() ? -1 : m_profile.destinations[rng.nextBelow(static_cast<uint32_t>(m_profile.destinations.size()))];
+        event.service = m_profile.service;
+        event.source = m_profile.source;
+        return true;
+    }
+
+    const TrafficProfile& getProfile() const {return m_profile;}
+
+protected:
+    /**
+     * @brief us from one packet to the next
+     */
+    virtual uint64_t interval(Xoshiro256& rng) = 0;
+
+    // exponentially distributed, mean in us
+    static uint64_t exponential(Xoshiro256& rng, float mean)
+    {
+        return static_cast<uint64_t>(-std::log(1.0f - rng.nextFloat()) * mean);
+    }
+
+    TrafficProfile m_profile;
+};
+
+/**
+ * @brief Constant bit rate, e.g periodic telemetry. The first packet comes at a random phase within one interval so
+ * nodes started together don't all send on the same tick.
+ */
+class CbrTraffic : public TrafficGenerator
+{
+public:
+    /**
+     * @param rate packets per second
+     */
+    CbrTraffic(TrafficProfile profile, float rate)
+        : TrafficGenerator(std::move(profile)),
+          m_interval(static_cast<uint64_t>(1e6f / rate))
+    {}
+
+protected:
+    uint64_t interval(Xoshiro256& rng) override
+    {
+        if (m_first){
+            m_first = false;
+            return rng() % (m_interval + 1);
+        }
+        return m_interval;
+    }
+
+private:
+    const uint64_t m_interval;      // us
+    bool m_first = true;
+};
+
+/**
+ * @brief Poisson arrivals, e.g sporadic commands
+ */
+class PoissonTraffic : public TrafficGenerator
+{
+public:
+    /**
+     * @param rate mean packets per second
+     */
+    PoissonTraffic(TrafficProfile profile, float rate)
+        : TrafficGenerator(std::move(profile)),
+          m_meanInterval(1e6f / rate)
+    {}
+
+protected:
+    uint64_t interval(Xoshiro256& rng) override
+    {
+        return exponential(rng, m_meanInterval);
+    }
+
+private:
+    const float m_meanInterval;     // us
+};
+
+/**
+ * @brief Bursty on/off source, e.g log dumps. Sends at a constant rate while on, nothing while off, with on and off
+ * periods exponentially distributed around their means.
+ */
+class OnOffTraffic : public TrafficGenerator
+{
+public:
+    /**
+     * @param rate packets per second while on
+     * @param meanOn s
+     * @param meanOff s
+     */
+    OnOffTraffic(TrafficProfile profile, float rate, float meanOn, float meanOff)
+        : TrafficGenerator(std::move(profile)),
+          m_interval(static_cast<uint64_t>(1e6f / rate)),
+          m_meanOn(meanOn * 1e6f),
+          m_meanOff(meanOff * 1e6f)
+    {}
+
+protected:
+    uint64_t interval(Xoshiro256& rng) override
+    {
+        if (m_first){
+            m_first = false;
+            m_remainingOn = exponential(rng, m_meanOn);
+            return exponential(rng, m_meanOff);     // start part way through an off period
+        }
+        if (m_remainingOn >= m_interval){
+            m_remainingOn -= m_interval;
+            return m_interval;
+        }
+        // burst over, the next one starts after an off period
+        const uint64_t gap = m_remainingOn + exponential(rng, m_meanOff);
+        m_remainingOn = exponential(rng, m_meanOn);
+        return gap;
+    }
+
+private:
+    const uint64_t m_interval;      // us
+    const float m_meanOn;           // us
+    const float m_meanOff;          // us
+    uint64_t m_remainingOn = 0;     // us left in the current burst
+    bool m_first = true;
+};
+
+/**
+ * @brief Replays a recorded packet sequence, times relative to when the generator starts
+ */
+class TraceTraffic : public TrafficGenerator
+{
+public:
+    /**
+     * @param events time is us from the start, destination and service override the profile's (destination -1 and
+     * service 0 keep the profile's choice)
+     */
+    TraceTraffic(TrafficProfile profile, std::vector<TrafficEvent> events)
+        : TrafficGenerator(std::move(profile)),
+          m_events(std::move(events))
+    {
+        std::stable_sort(m_events.begin(), m_events.end(), [](const TrafficEvent& a, const TrafficEvent& b) { return a.time < b.time; });
+    }
+
+    /**
+     * @brief Read a trace file, one packet per line as time_us,payload_size[,destination[,service]]. Blank lines and
+     * lines starting with # are skipped.
+     *
+     * @return false if the file can't be opened or a line can't be parsed
+     */
+    static bool load(const std::string& path, std::vector<TrafficEvent>& events)
+    {
+        std::ifstream in(path);
+        if (!in){
+            return false;
+        }
+        std::string line;
+        while (std::getline(in, line)){
+            if (line.empty() || line[0] == '#'){
+                continue;
+            }
+            std::vector<std::string> fields;
+            std::stringstream stream(line);
+            std::string field;
+            while (std::getline(stream, field, ',')){
+                fields.push_back(field);
+            }
+            if (fields.size() < 2){
+                return false;
+            }
+            try {
+                TrafficEvent event{std::stoull(fields[0]), std::stoull(fields[1]), -1, 0};
+                if (fields.size() > 2){
+                    event.destination = std::stoi(fields[2]);
+                }
+                if (fields.size() > 3){
+                    event.service = static_cast<uint8_t>(std::stoul(fields[3]));
+                }
+                events.push_back(event);
+            }
+            catch (std::exception&){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool next(uint64_t now, Xoshiro256& rng, TrafficEvent& event) override
+    {
+        if (!m_started){
+            m_start = now;
+            m_started = true;
+        }
+        if (m_index >= m_events.size()){
+            return false;
+        }
+        TrafficGenerator::next(now, rng, event);
+        const TrafficEvent& recorded = m_events[m_index++];
+        event.time = m_start + recorded.time;
+        event.payloadSize = std::max(recorded.payloadSize, TrafficPacket::minPayloadSize);
+        if (recorded.destination >= 0){
+            event.destination = recorded.destination;
+        }
+        if (recorded.service){
+            event.service = recorded.service;
+        }
+        return true;
+    }
+
+protected:
+    uint64_t interval(Xoshiro256&) override {return 0;}
+
+private:
+    std::vector<TrafficEvent> m_events;
+    size_t m_index = 0;
+    uint64_t m_start = 0;
+    bool m_started = false;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include <librnp/rnp_packet.h>
+
+/**
+ * @brief Measurement packet for simulated traffic, carries a per source sequence number and the (world) time it
+ * was generated, padded out to the requested payload size
+ */
+class TrafficPacket : public RnpPacket
+{
+public:
+    static constexpr uint8_t packetType = 110;
+    static constexpr size_t minPayloadSize = sizeof(uint32_t) + sizeof(uint64_t);
+
+    TrafficPacket(uint8_t serviceID, uint32_t sequence, uint64_t timestamp, size_t payloadSize)
+        : RnpPacket(serviceID, packetType, std::max(payloadSize, minPayloadSize)),
+          sequence(sequence),
+          timestamp(timestamp),
+          payloadSize(std::max(payloadSize, minPayloadSize))
+    {}
+
+    TrafficPacket(const RnpPacketSerialized& packet)
+        : RnpPacket(packet.header)
+    {
+        const std::vector<uint8_t> body = packet.getBody();
+        if (body.size() < minPayloadSize){
+            throw std::runtime_error("traffic packet too short");
+        }
+        std::memcpy(&sequence, body.data(), sizeof(sequence));
+        std::memcpy(&timestamp, body.data() + sizeof(sequence), sizeof(timestamp));
+        payloadSize = body.size();
+    }
+
+    void serialize(std::vector<uint8_t>& buf) override
+    {
+        RnpPacket::serialize(buf);
+        const size_t offset = buf.size();
+        buf.resize(offset + payloadSize, 0);
+        std::memcpy(buf.data() + offset, &sequence, sizeof(sequence));
+        std::memcpy(buf.data() + offset + sizeof(sequence), &timestamp, sizeof(timestamp));
+    }
+
+    uint32_t sequence;
+    uint64_t timestamp;     // us
+    size_t payloadSize;
+};
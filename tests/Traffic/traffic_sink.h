@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <memory>
+
+#include <librnp/rnp_networkservice.h>
+#include <librnp/rnp_packet.h>
+
+#include "traffic_packet.h"
+
+/**
+ * @brief Network service that receives TrafficPackets and records delivery, loss and end to end latency. Loss is
+ * read from gaps in each source's sequence numbers, which count up from 0 per source and destination. A packet
+ * arriving late (e.g rebuilt from FEC parity) fills its gap if it is within the last 64 sequence numbers.
+ */
+class TrafficSink : public RnpNetworkService
+{
+public:
+    using TimeSource = std::function<uint64_t()>;  // us, must be the clock the senders stamp with
+
+    TrafficSink(uint8_t serviceID, TimeSource timeSource)
+        : RnpNetworkService(serviceID),
+          m_timeSource(std::move(timeSource))
+    {}
+
+    uint64_t getReceived() const {return m_received;}
+    uint64_t getDuplicates() const {return m_duplicates;}
+    uint64_t getReordered() const {return m_reordered;}     // received after a later sequence number, also in received
+    uint64_t getLost() const {return m_lost;}     // missing sequence numbers, only counted once a later packet arrives
+    uint64_t getBytes() const {return m_bytes;}
+    const std::vector<uint64_t>& getLatencies() const {return m_latencies;}   // us, in order of arrival
+
+    /**
+     * @brief Latency percentile in us (nearest rank) over everything received so far, 0 if nothing received
+     */
+    static uint64_t percentile(std::vector<uint64_t> latencies, float p)
+    {
+        if (latencies.empty()){
+            return 0;
+        }
+        const size_t rank = std::min(latencies.size() - 1, static_cast<size_t>(p / 100.0f * latencies.size()));
+        std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+        return latencies[rank];
+    }
+
+private:
+    void networkCallback(packetptr_t packetptr) override
+    {
+        if (packetptr->header.type != TrafficPacket::packetType){
+            return;
+        }
+        TrafficPacket packet(*packetptr);
+
+        auto last = m_lastSequence.find(packet.header.source);
+        if (last != m_lastSequence.end() && packet.sequence <= last->second.sequence){
+            const uint32_t behind = last->second.sequence - packet.sequence;
+            const uint64_t bit = (behind > 0 && behind <= 64) ? uint64_t(1) << (behind - 1) : 0;
+            if (!(last->second.missing & bit)){
+                ++m_duplicates;
+                return;
+            }
+            last->second.missing &= ~bit;
+            --m_lost;
+            ++m_reordered;
+        }
+        else {
+            SourceState& state = m_lastSequence[packet.header.source];
+            const uint32_t gap = (last == m_lastSequence.end()) ? packet.sequence : packet.sequence - state.sequence - 1;
+            m_lost += gap;
+            // bit n - 1 of missing is sequence - n
+            const uint32_t shift = (last == m_lastSequence.end()) ? 0 : gap + 1;
+            state.missing = (shift >= 64) ? 0 : state.missing << shift;
+            state.missing |= (gap >= 64) ? ~uint64_t(0) : (uint64_t(1) << gap) - 1;
+            state.sequence = packet.sequence;
+        }
+
+        ++m_received;
+        m_bytes += packet.payloadSize;
+        m_latencies.push_back(m_timeSource() - packet.timestamp);
+    }
+
+    struct SourceState
+    {
+        uint32_t sequence = 0;      // highest received
+        uint64_t missing = 0;       // bit n - 1 set if sequence - n hasn't arrived
+    };
+
+    TimeSource m_timeSource;
+    uint64_t m_received = 0;
+    uint64_t m_duplicates = 0;
+    uint64_t m_reordered = 0;
+    uint64_t m_lost = 0;
+    uint64_t m_bytes = 0;
+    std::vector<uint64_t> m_latencies;
+    std::map<uint8_t, SourceState> m_lastSequence;
+};
@@ -0,0 +1,352 @@
+#pragma once
+
+// std
+#include <vector>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstdint>
+
+// librnp
+#include <librnp/rnp_networkmanager.h>
+
+// librrp
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/datalink/turn_timeout.h>
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
+
+#include "../Traffic/traffic_packet.h"
+#include "../Traffic/traffic_sink.h"
+
+enum class BenchTraffic : uint8_t
+{
+    SATURATED,      // nodes paired off, each keeps its datalink's send buffer from ever running dry
+    MIXED,          // node 0 is the ground station sending small commands, everyone else streams telemetry to it
+    RANDOM          // constant rate to random destinations
+};
+
+/**
+ * @brief A standard benchmark scenario, every datalink runs the same ones
+ */
+struct BenchScenario
+{
+    std::string name;
+    size_t nodes;
+    float duration;                 // s, simulated on a virtual clock
+    BenchTraffic traffic;
+    size_t payloadSize = 32;        // bytes, telemetry payload in MIXED
+    float rate = 0.5;               // packets per second per node, telemetry rate in MIXED
+    size_t commandSize = 8;         // bytes, MIXED only
+    float commandRate = 1;          // commands per second from the ground station, MIXED only
+    float churnInterval = 0;        // s between a random node dropping out, 0 for no churn
+    float churnDowntime = 5;        // s a dropped node stays off
+};
+
+inline std::vector<BenchScenario> standardScenarios()
+{
+    std::vector<BenchScenario> scenarios(4);
+    scenarios[0].name = "saturated_unicast";
+    scenarios[0].nodes = 4;
+    scenarios[0].duration = 60;
+    scenarios[0].traffic = BenchTraffic::SATURATED;
+
+    scenarios[1].name = "mixed_telemetry_command";
+    scenarios[1].nodes = 5;
+    scenarios[1].duration = 60;
+    scenarios[1].traffic = BenchTraffic::MIXED;
+    scenarios[1].payloadSize = 48;
+    scenarios[1].rate = 2;
+
+    scenarios[2].name = "join_storm";
+    scenarios[2].nodes = 16;
+    scenarios[2].duration = 60;
+    scenarios[2].traffic = BenchTraffic::RANDOM;
+    scenarios[2].rate = 0.2;
+
+    scenarios[3].name = "node_churn";
+    scenarios[3].nodes = 6;
+    scenarios[3].duration = 120;
+    scenarios[3].traffic = BenchTraffic::RANDOM;
+    scenarios[3].churnInterval = 20;
+    return scenarios;
+}
+
+struct BenchResult
+{
+    std::string scenario;
+    std::string datalink;
+    uint64_t seed;
+
+    uint64_t sent;
+    uint64_t delivered;
+    float deliveryRatio;
+    float goodput;                  // delivered payload bytes/s
+    float latencyP50;               // ms
+    float latencyP99;               // ms
+    float airtimeEfficiency;        // share of the time on air spent carrying delivered payload bits
+    float meanJoinTime;             // s from a node starting to it joining, over every (re)start that joined
+    float maxJoinTime;              // s
+    size_t unjoined;                // nodes still in discovery at the end
+};
+
+/**
+ * @brief What the benchmark needs to know about each datalink
+ */
+template <typename DataLink>
+struct BenchDataLink;
+
+template <typename PhysicalLayer, typename Clock>
+struct BenchDataLink<TDMARadio<PhysicalLayer, Clock>>
+{
+    using Info = TDMARadioInterfaceInfo;
+    static constexpr const char* name = "tdma";
+    static bool runs(const BenchScenario&) {return true;}
+    static bool joined(const Info* info) {return info->joined;}
+    static void seed(TDMARadio<PhysicalLayer, Clock>& radio, uint64_t seed) {radio.setSeed(seed);}
+};
+
+template <typename PhysicalLayer, typename Clock>
+struct BenchDataLink<TimeoutRadio<PhysicalLayer, Clock>>
+{
+    using Info = RadioInterfaceInfo;
+    static constexpr const char* name = "timeout";
+    // no backoff, every node that hears a frame answers it at once, so with more than a pair saturating the channel
+    // nothing but collisions go on air and there is nothing worth measuring
+    static bool runs(const BenchScenario& scenario) {return scenario.traffic != BenchTraffic::SATURATED || scenario.nodes <= 2;}
+    static bool joined(const Info*) {return true;}     // no membership, it can send straight away
+    static void seed(TimeoutRadio<PhysicalLayer, Clock>&, uint64_t) {}
+};
+
+/**
+ * @brief A datalink over the simulated phy with a traffic source and sink. Traffic starts once the node has joined,
+ * the time that took is its join time.
+ */
+template <typename DataLink>
+class BenchNode
+{
+public:
+    using Traits = BenchDataLink<DataLink>;
+    static constexpr uint8_t trafficService = 20;
+
+    BenchNode(SimWorld& world, uint8_t address, const BenchScenario& scenario, double driftPPM, uint8_t peer)
+        : m_world(world),
+          m_scenario(scenario),
+          m_peer(peer),
+          m_physicalLayer(world, 868e6, 250e3, 7),
+          m_networkManager(address, NODETYPE::HUB, true),
+          m_radio(m_physicalLayer, m_networkManager, DriftingClock(world.getTimeSource(), driftPPM)),
+          m_sink(trafficService, [&world]() { return world.now(); }),
+          m_rng(world.nextSeed()),
+          m_startTime(world.now())
+    {
+        Traits::seed(m_radio, world.nextSeed());
+
+        m_radio.setup();
+        m_networkManager.registerService(trafficService, m_sink.getCallback());
+        m_networkManager.setNodeType(NODETYPE::HUB);
+        m_networkManager.addInterface(&m_radio);
+        m_networkManager.generateDefaultRoutes();
+        m_networkManager.enableAutoRouteGen(true);
+        m_networkManager.setNoRouteAction(NOROUTE_ACTION::BROADCAST, {2});
+        m_networkManager.setAddress(address);
+        m_world.registerAddress(address);
+    }
+
+    ~BenchNode()
+    {
+        m_world.unregisterAddress(m_networkManager.getAddress());
+    }
+
+    void update()
+    {
+        m_networkManager.update();
+        m_radio.update();
+
+        const uint64_t now = m_world.now();
+        if (!m_joined && Traits::joined(radioInfo())){
+            m_joined = true;
+            m_joinTime = now - m_startTime;
+            m_nextSend = now + nextInterval();
+        }
+        if (!m_joined){
+            return;
+        }
+
+        if (m_scenario.traffic == BenchTraffic::SATURATED){
+            if (radioInfo()->currentSendBufferSize == 0){
+                send(m_peer, m_scenario.payloadSize, now);
+            }
+        }
+        else if (now >= m_nextSend){
+            sendScheduled(now);
+            m_nextSend += nextInterval();
+        }
+    }
+
+    const typename Traits::Info* radioInfo() {return static_cast<const typename Traits::Info*>(m_radio.getInfo());}
+    const TrafficSink& sink() const {return m_sink;}
+    uint64_t sent() const {return m_sent;}
+    bool joined() const {return m_joined;}
+    uint64_t joinTime() const {return m_joinTime;}     // us since this node started
+
+private:
+    bool isGroundStation() const {return m_scenario.traffic == BenchTraffic::MIXED && m_networkManager.getAddress() == m_peer;}
+
+    uint64_t nextInterval()
+    {
+        // constant rate with a random phase per node, so nodes don't all generate on the same tick
+        const float rate = isGroundStation() ? m_scenario.commandRate : m_scenario.rate;
+        const uint64_t interval = static_cast<uint64_t>(1e6f / rate);
+        return m_sent ? interval : m_rng() % (interval + 1);
+    }
+
+    void sendScheduled(uint64_t now)
+    {
+        const std::vector<int> addresses = m_world.getAddresses();
+        if (addresses.size() < 2){
+            return;
+        }
+        if (m_scenario.traffic == BenchTraffic::MIXED && !isGroundStation()){
+            send(m_peer, m_scenario.payloadSize, now);
+            return;
+        }
+        int destination;
+        do {
+            destination = addresses[m_rng.nextBelow(static_cast<uint32_t>(addresses.size()))];
+        } while (destination == m_networkManager.getAddress());
+        send(static_cast<uint8_t>(destination), isGroundStation() ? m_scenario.commandSize : m_scenario.payloadSize, now);
+    }
+
+    void send(uint8_t destination, size_t payloadSize, uint64_t now)
+    {
+        TrafficPacket packet(trafficService, m_sequence++, now, payloadSize);
+        packet.header.source = m_networkManager.getAddress();
+        packet.header.destination = destination;
+        packet.header.destination_service = trafficService;
+        m_networkManager.sendPacket(packet);
+        ++m_sent;
+    }
+
+    SimWorld& m_world;
+    const BenchScenario& m_scenario;
+    const uint8_t m_peer;       // saturated: the other half of the pair, mixed: the ground station
+
+    LoRaSimPhysicalLayer m_physicalLayer;
+    RnpNetworkManager m_networkManager;
+    DataLink m_radio;
+    TrafficSink m_sink;
+
+    Xoshiro256 m_rng;
+    uint32_t m_sequence = 0;
+    uint64_t m_sent = 0;
+    const uint64_t m_startTime;
+    bool m_joined = false;
+    uint64_t m_joinTime = 0;
+    uint64_t m_nextSend = 0;
+};
+
+/**
+ * @brief Run one scenario to completion on the calling thread, on a virtual clock stepped a tick at a time like the
+ * sweep. Nodes that churn out are destroyed and come back as a fresh node with the same address, so they rejoin from
+ * scratch.
+ */
+template <typename DataLink>
+BenchResult runBench(const BenchScenario& scenario, uint64_t seed)
+{
+    using Node = BenchNode<DataLink>;
+    constexpr uint64_t tick = 1000;     // us
+    constexpr uint8_t firstAddress = 101;
+
+    VirtualClock clock;
+    SimWorld world(seed, [clock]() { return clock.micros(); });
+    Xoshiro256 rng(world.nextSeed());
+
+    BenchResult result{};
+    result.scenario = scenario.name;
+    result.datalink = BenchDataLink<DataLink>::name;
+    result.seed = seed;
+
+    std::vector<float> drifts;
+    std::vector<uint64_t> latencies;
+    std::vector<float> joinTimes;
+    uint64_t bytes = 0;
+
+    auto peerOf = [&scenario](size_t i) {
+        if (scenario.traffic == BenchTraffic::SATURATED){
+            return static_cast<uint8_t>(firstAddress + (i ^ 1) % scenario.nodes);
+        }
+        return firstAddress;
+    };
+    auto collect = [&](Node& node) {
+        result.sent += node.sent();
+        result.delivered += node.sink().getReceived();
+        bytes += node.sink().getBytes();
+        latencies.insert(latencies.end(), node.sink().getLatencies().begin(), node.sink().getLatencies().end());
+        if (node.joined()){
+            joinTimes.push_back(node.joinTime() / 1e6f);
+        }
+    };
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    for (size_t i = 0; i < scenario.nodes; ++i){
+        drifts.push_back((rng.nextFloat() * 2.0f - 1.0f) * 10.0f);
+        nodes.push_back(std::make_unique<Node>(world, static_cast<uint8_t>(firstAddress + i), scenario, drifts[i], peerOf(i)));
+    }
+
+    const uint64_t end = static_cast<uint64_t>(scenario.duration * 1e6f);
+    const uint64_t churnInterval = static_cast<uint64_t>(scenario.churnInterval * 1e6f);
+    const uint64_t churnDowntime = static_cast<uint64_t>(scenario.churnDowntime * 1e6f);
+    uint64_t nextChurn = churnInterval ? churnInterval : UINT64_MAX;
+    size_t churned = 0;
+    uint64_t restart = UINT64_MAX;
+
+    while (world.now() < end){
+        for (auto& node : nodes){
+            if (node){
+                node->update();
+            }
+        }
+        clock.advance(tick);
+
+        const uint64_t now = world.now();
+        if (now >= nextChurn && nodes.size() > 1){
+            churned = 1 + rng.nextBelow(static_cast<uint32_t>(nodes.size() - 1));     // never node 0
+            collect(*nodes[churned]);
+            nodes[churned].reset();
+            restart = now + churnDowntime;
+            nextChurn += churnInterval;
+        }
+        if (now >= restart){
+            nodes[churned] = std::make_unique<Node>(world, static_cast<uint8_t>(firstAddress + churned), scenario, drifts[churned], peerOf(churned));
+            restart = UINT64_MAX;
+        }
+    }
+
+    for (auto& node : nodes){
+        if (node){
+            collect(*node);
+            result.unjoined += node->joined() ? 0 : 1;
+        }
+    }
+
+    result.deliveryRatio = result.sent ? static_cast<float>(result.delivered) / result.sent : 0;
+    result.goodput = bytes / scenario.duration;
+    result.latencyP50 = TrafficSink::percentile(latencies, 50) / 1e3f;
+    result.latencyP99 = TrafficSink::percentile(latencies, 99) / 1e3f;
+    if (!joinTimes.empty()){
+        result.meanJoinTime = std::accumulate(joinTimes.begin(), joinTimes.end(), 0.0f) / joinTimes.size();
+        result.maxJoinTime = *std::max_element(joinTimes.begin(), joinTimes.end());
+    }
+
+    // raw lora bit rate at sf7, 250kHz, cr 4/5
+    const float bitRate = 7.0f * 250e3f / std::pow(2.0f, 7.0f) * 4.0f / 5.0f;
+    const RadioChannelStats stats = world.getChannel(0)->getStats();
+    result.airtimeEfficiency = stats.airtime ? (bytes * 8.0f) / (bitRate * stats.airtime / 1e6f) : 0;
+
+    return result;
+}
@@ -0,0 +1,227 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "bench_scenario.h"
+
+/**
+ * MAC level benchmark. Runs the standard scenarios (saturated unicast, mixed telemetry and command, join storm, node
+ * churn) over both datalinks on the simulator and reports goodput, latency, airtime efficiency and join time.
+ * A datalink can sit out a scenario it has no meaningful result for (the timeout radio with a saturated channel).
+ * Everything runs on a virtual clock from a fixed seed, so the same build gives the same numbers every run.
+ *
+ * Given a baseline the results are compared metric by metric and any that is worse than the baseline by more than
+ * its tolerance fails the run, --write-baseline records the current results as the new baseline.
+ *
+ * usage: librrp_bench [--seed 1] [--format json|csv] [--out results.json] [--baseline baseline.csv]
+ *                     [--write-baseline baseline.csv] [--tolerance 0.1]
+ */
+
+struct Metric
+{
+	const char* name;
+	bool higherIsBetter;
+	std::function<double(const BenchResult&)> value;
+};
+
+static const std::vector<Metric>& metrics()
+{
+	static const std::vector<Metric> list = {
+		{"goodput_Bps", true, [](const BenchResult& r) { return r.goodput; }},
+		{"delivery_ratio", true, [](const BenchResult& r) { return r.deliveryRatio; }},
+		{"latency_p50_ms", false, [](const BenchResult& r) { return r.latencyP50; }},
+		{"latency_p99_ms", false, [](const BenchResult& r) { return r.latencyP99; }},
+		{"airtime_efficiency", true, [](const BenchResult& r) { return r.airtimeEfficiency; }},
+		{"mean_join_s", false, [](const BenchResult& r) { return r.meanJoinTime; }},
+		{"max_join_s", false, [](const BenchResult& r) { return r.maxJoinTime; }},
+		{"unjoined", false, [](const BenchResult& r) { return static_cast<double>(r.unjoined); }},
+	};
+	return list;
+}
+
+static void writeCsv(std::ostream& out, const std::vector<BenchResult>& results)
+{
+	out << "scenario,datalink,seed,sent,delivered";
+	for (const auto& metric : metrics()){
+		out << "," << metric.name;
+	}
+	out << "\n";
+	for (const auto& r : results){
+		out << r.scenario << "," << r.datalink << "," << r.seed << "," << r.sent << "," << r.delivered;
+		for (const auto& metric : metrics()){
+			out << "," << metric.value(r);
+		}
+		out << "\n";
+	}
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results)
+{
+	out << "[\n";
+	for (size_t i = 0; i < results.size(); ++i){
+		const BenchResult& r = results[i];
+		out << "  {\"scenario\": \"" << r.scenario << "\", \"datalink\": \"" << r.datalink << "\", \"seed\": " << r.seed
+			<< ", \"sent\": " << r.sent << ", \"delivered\": " << r.delivered;
+		for (const auto& metric : metrics()){
+			out << ", \"" << metric.name << "\": " << metric.value(r);
+		}
+		out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "]\n";
+}
+
+/**
+ * @brief Baseline file, one metric per line: scenario,datalink,metric,value,tolerance. Tolerance is relative, a
+ * metric regresses once it is worse than value by more than tolerance * |value|.
+ */
+static void writeBaseline(std::ostream& out, const std::vector<BenchResult>& results, double tolerance)
+{
+	out << "scenario,datalink,metric,value,tolerance\n";
+	for (const auto& r : results){
+		for (const auto& metric : metrics()){
+			out << r.scenario << "," << r.datalink << "," << metric.name << "," << metric.value(r) << "," << tolerance << "\n";
+		}
+	}
+}
+
+template <typename DataLink>
+static void runIfSupported(const BenchScenario& scenario, uint64_t seed, std::vector<BenchResult>& results)
+{
+	if (BenchDataLink<DataLink>::runs(scenario)){
+		results.push_back(runBench<DataLink>(scenario, seed));
+	}
+	else {
+		std::cerr << scenario.name << "/" << BenchDataLink<DataLink>::name << ": not run" << std::endl;
+	}
+}
+
+/**
+ * @return number of regressions, or -1 if the baseline has no entries to compare against
+ */
+static int compareBaseline(std::istream& in, const std::vector<BenchResult>& results)
+{
+	std::map<std::string, const BenchResult*> byKey;
+	for (const auto& r : results){
+		byKey[r.scenario + "," + r.datalink] = &r;
+	}
+	std::map<std::string, const Metric*> metricByName;
+	for (const auto& metric : metrics()){
+		metricByName[metric.name] = &metric;
+	}
+
+	int regressions = 0;
+	int compared = 0;
+	std::string line;
+	std::getline(in, line);		// header
+	while (std::getline(in, line)){
+		std::vector<std::string> fields;
+		std::stringstream stream(line);
+		std::string field;
+		while (std::getline(stream, field, ',')){
+			fields.push_back(field);
+		}
+		if (fields.size() != 5){
+			continue;
+		}
+		auto result = byKey.find(fields[0] + "," + fields[1]);
+		auto metric = metricByName.find(fields[2]);
+		if (result == byKey.end() || metric == metricByName.end()){
+			std::cerr << "baseline entry " << fields[0] << "/" << fields[1] << "/" << fields[2] << " not measured" << std::endl;
+			continue;
+		}
+
+		double baseline;
+		double tolerance;
+		try {
+			baseline = std::stod(fields[3]);
+			tolerance = std::stod(fields[4]) * std::fabs(baseline);
+		}
+		catch (std::exception&){
+			std::cerr << "baseline entry " << fields[0] << "/" << fields[1] << "/" << fields[2] << " can't be read" << std::endl;
+			continue;
+		}
+		++compared;
+		const double value = metric->second->value(*result->second);
+		const bool regressed = metric->second->higherIsBetter ? value < baseline - tolerance : value > baseline + tolerance;
+		if (regressed){
+			++regressions;
+		}
+		std::cerr << (regressed ? "[REGRESSED] " : "[OK] ") << fields[0] << "/" << fields[1] << " " << fields[2] << " = " << value
+			<< " (baseline " << baseline << ")" << std::endl;
+	}
+	return compared ? regressions : -1;
+}
+
+int main(int argc, char* argv[])
+{
+	std::map<std::string, std::string> args;
+	for (int i = 1; i + 1 < argc; i += 2){
+		std::string name = argv[i];
+		if (name.rfind("--", 0) != 0){
+			std::cerr << "unexpected argument " << name << std::endl;
+			return 1;
+		}
+		args[name.substr(2)] = argv[i + 1];
+	}
+	const uint64_t seed = args.count("seed") ? std::stoull(args["seed"]) : 1;
+	const std::string format = args.count("format") ? args["format"] : "json";
+
+	std::vector<BenchResult> results;
+	for (const auto& scenario : standardScenarios()){
+		const size_t first = results.size();
+		runIfSupported<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>(scenario, seed, results);
+		runIfSupported<TimeoutRadio<LoRaSimPhysicalLayer, DriftingClock>>(scenario, seed, results);
+		for (size_t i = first; i < results.size(); ++i){
+			std::cerr << results[i].scenario << "/" << results[i].datalink << ": goodput = " << results[i].goodput
+				<< " B/s, p99 = " << results[i].latencyP99 << " ms" << std::endl;
+		}
+	}
+
+	if (args.count("out")){
+		std::ofstream out(args["out"]);
+		if (!out){
+			std::cerr << "failed to open " << args["out"] << std::endl;
+			return 1;
+		}
+		(format == "csv") ? writeCsv(out, results) : writeJson(out, results);
+	}
+	else{
+		(format == "csv") ? writeCsv(std::cout, results) : writeJson(std::cout, results);
+	}
+
+	if (args.count("write-baseline")){
+		std::ofstream out(args["write-baseline"]);
+		if (!out){
+			std::cerr << "failed to open " << args["write-baseline"] << std::endl;
+			return 1;
+		}
+		writeBaseline(out, results, args.count("tolerance") ? std::stod(args["tolerance"]) : 0.1);
+		std::cerr << "baseline written to " << args["write-baseline"] << std::endl;
+	}
+
+	if (args.count("baseline")){
+		std::ifstream in(args["baseline"]);
+		if (!in){
+			std::cerr << "failed to open " << args["baseline"] << std::endl;
+			return 1;
+		}
+		const int regressions = compareBaseline(in, results);
+		if (regressions < 0){
+			std::cerr << args["baseline"] << " has no baseline entries to compare against" << std::endl;
+			return 1;
+		}
+		if (regressions){
+			std::cerr << regressions << " metrics regressed against " << args["baseline"] << std::endl;
+			return 1;
+		}
+		std::cerr << "no regressions against " << args["baseline"] << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <cstdint>
+
+// librrp
+#include <librrp/physical/capture.h>
+#include <librrp/datalink/tdma.h>
+
+// librnp
+#include <librnp/rnp_packet.h>
+
+#include "Traffic/traffic_sink.h"
+
+/**
+ * Offline analysis of a RadioChannel capture. Decodes the datalink header (7 byte TDMA or version, sender and sequence
+ * for the turn timeout datalink) and the RNP header under it, then reports channel occupancy, per TDMA slot utilisation,
+ * per link loss and end to end latency of RNP packets (first time a packet went on air to the first time its
+ * destination received it).
+ *
+ * usage: librrp_capture_analyzer capture.rrpcap [--datalink tdma|timeout]
+ */
+
+static constexpr size_t tdmaHeaderSize = 7;
+static constexpr size_t timeoutHeaderSize = 3;
+static constexpr size_t outcomeCount = static_cast<size_t>(CaptureOutcome::CORRUPTED) + 1;
+
+static const char* outcomeName(CaptureOutcome outcome)
+{
+	static const char* names[outcomeCount] = {"delivered", "captured", "collision", "inter sf collision", "half duplex",
+		"below sensitivity", "random drop", "not listening", "link loss", "corrupted"};
+	const size_t index = static_cast<size_t>(outcome);
+	return index < outcomeCount ? names[index] : "unknown";
+}
+
+static const char* packetTypeName(uint8_t type)
+{
+	switch (type){
+		case PACKET_TYPE::NORMAL: return "normal";
+		case PACKET_TYPE::JOINREQUEST: return "join";
+		case PACKET_TYPE::HEARTBEAT: return "heartbeat";
+		case PACKET_TYPE::FEC_DATA: return "fec_data";
+		case PACKET_TYPE::FEC_PARITY: return "fec_parity";
+		case PACKET_TYPE::YIELD: return "yield";
+		default: return "unknown";
+	}
+}
+
+static bool received(CaptureOutcome outcome)
+{
+	return outcome == CaptureOutcome::DELIVERED || outcome == CaptureOutcome::CAPTURED;
+}
+
+struct SlotCounts {
+	uint64_t frames = 0;
+	uint64_t airtime = 0;		// us
+	uint64_t attempts = 0;		// listening receivers
+	uint64_t delivered = 0;
+	std::array<uint64_t, PACKET_TYPE::YIELD + 1> types{};
+	uint64_t stolen = 0;		// sent by a node the owner yielded the window to
+};
+
+struct LinkCounts {
+	uint64_t attempts = 0;
+	uint64_t delivered = 0;
+};
+
+struct PacketTiming {
+	uint64_t firstStart;		// us
+	int destination;
+	bool delivered;
+};
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2){
+		std::cerr << "usage: librrp_capture_analyzer capture.rrpcap [--datalink tdma|timeout]" << std::endl;
+		return 1;
+	}
+	std::map<std::string, std::string> args;
+	for (int i = 2; i + 1 < argc; i += 2){
+		std::string name = argv[i];
+		if (name.rfind("--", 0) != 0){
+			std::cerr << "unexpected argument " << name << std::endl;
+			return 1;
+		}
+		args[name.substr(2)] = argv[i + 1];
+	}
+	const bool tdma = !args.count("datalink") || args["datalink"] == "tdma";
+	const size_t linkHeaderSize = tdma ? tdmaHeaderSize : timeoutHeaderSize;
+
+	CaptureReader reader;
+	if (!reader.open(argv[1])){
+		std::cerr << "can't read capture " << argv[1] << std::endl;
+		return 1;
+	}
+
+	uint64_t records = 0;
+	uint64_t firstStart = UINT64_MAX;
+	uint64_t lastEnd = 0;
+	uint64_t busy = 0;			// us with at least one packet on air
+	uint64_t busyUntil = 0;
+	uint64_t undecodable = 0;
+	std::array<uint64_t, outcomeCount> outcomes{};
+	std::map<uint8_t, SlotCounts> slots;
+	std::map<std::pair<uint32_t, uint32_t>, LinkCounts> links;
+	std::map<uint32_t, int> addresses;									// capture node id -> network address
+	std::map<std::pair<int, uint16_t>, PacketTiming> packets;			// (rnp source, uid)
+	std::vector<uint64_t> latencies;
+	std::vector<uint64_t> airtimes;
+
+	// first pass learns addresses so receivers that are heard before they transmit can still be matched
+	CaptureRecord record;
+	while (reader.next(record)){
+		if (record.header.payloadSize >= linkHeaderSize){
+			if (tdma){
+				addresses[record.header.sender] = record.payload[3];
+			}
+			else {
+				addresses[record.header.sender] = record.payload[1];
+			}
+		}
+	}
+	reader.rewind();
+
+	while (reader.next(record)){
+		const CaptureRecordHeader& header = record.header;
+		++records;
+		firstStart = std::min(firstStart, header.start);
+		lastEnd = std::max(lastEnd, header.end);
+		airtimes.push_back(header.end - header.start);
+
+		// records come out in order of finishing, so merge the intervals against everything seen so far
+		if (header.end > busyUntil){
+			busy += header.end - std::max(header.start, busyUntil);
+			busyUntil = header.end;
+		}
+
+		uint64_t attempts = 0;
+		uint64_t delivered = 0;
+		for (const auto& receiver : record.receivers){
+			++outcomes[std::min<size_t>(static_cast<size_t>(receiver.outcome), outcomeCount - 1)];
+			if (receiver.outcome == CaptureOutcome::NOT_LISTENING){
+				continue;
+			}
+			++attempts;
+			LinkCounts& link = links[{header.sender, receiver.receiver}];
+			++link.attempts;
+			if (received(receiver.outcome)){
+				++delivered;
+				++link.delivered;
+			}
+		}
+
+		if (header.payloadSize < linkHeaderSize){
+			++undecodable;
+			continue;
+		}
+		size_t rnpOffset = linkHeaderSize;
+		if (tdma){
+			SlotCounts& slot = slots[record.payload[2]];
+			++slot.frames;
+			slot.airtime += header.end - header.start;
+			slot.attempts += attempts;
+			slot.delivered += delivered;
+			const uint8_t type = record.payload[0] & ~PACKET_TYPE_FLAGS;
+			if (type < slot.types.size()){
+				++slot.types[type];
+			}
+			if (record.payload[0] & PACKET_TYPE_STOLEN){
+				++slot.stolen;
+			}
+			if (record.payload[0] & PACKET_TYPE_CONTROL){
+				rnpOffset += TDMAControl::size;
+			}
+			if (record.payload[0] & PACKET_TYPE_REPORTS){
+				if (header.payloadSize <= rnpOffset){
+					++undecodable;
+					continue;
+				}
+				rnpOffset += 1 + record.payload[rnpOffset] * TDMAControl::reportSize;
+			}
+			if (type == PACKET_TYPE::FEC_DATA){
+				rnpOffset += FecHeader::dataSize;
+			}
+			else if (type != PACKET_TYPE::NORMAL){
+				continue;
+			}
+		}
+		if (header.payloadSize < rnpOffset){
+			++undecodable;
+			continue;
+		}
+
+		std::vector<uint8_t> rnpBytes(record.payload + rnpOffset, record.payload + header.payloadSize);
+		try {
+			RnpPacketSerialized packet(rnpBytes);
+			auto key = std::make_pair(static_cast<int>(packet.header.source), packet.header.uid);
+			auto it = packets.find(key);
+			if (it == packets.end()){
+				it = packets.emplace(key, PacketTiming{header.start, packet.header.destination, false}).first;
+			}
+			if (it->second.delivered){
+				continue;
+			}
+			for (const auto& receiver : record.receivers){
+				auto address = addresses.find(receiver.receiver);
+				if (received(receiver.outcome) && address != addresses.end() && address->second == it->second.destination){
+					it->second.delivered = true;
+					latencies.push_back(header.end - it->second.firstStart);
+					break;
+				}
+			}
+		} catch (std::exception& e){
+			++undecodable;
+		}
+	}
+
+	const uint64_t duration = records ? lastEnd - firstStart : 0;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "records: " << records << " (" << undecodable << " undecodable)" << std::endl;
+	std::cout << "duration: " << duration / 1e6 << "s, channel busy " << (duration ? 100.0 * busy / duration : 0.0) << "%" << std::endl;
+	std::cout << "airtime p50/p90/p99: " << TrafficSink::percentile(airtimes, 50) << "/" << TrafficSink::percentile(airtimes, 90)
+		<< "/" << TrafficSink::percentile(airtimes, 99) << " us" << std::endl;
+
+	std::cout << "--- outcomes ---" << std::endl;
+	for (size_t i = 0; i < outcomeCount; ++i){
+		std::cout << std::setw(20) << outcomeName(static_cast<CaptureOutcome>(i)) << ": " << outcomes[i] << std::endl;
+	}
+
+	if (tdma){
+		std::cout << "--- slots ---" << std::endl;
+		std::cout << "slot  frames  airtime%  delivery%  types" << std::endl;
+		for (const auto& entry : slots){
+			const SlotCounts& slot = entry.second;
+			std::cout << std::setw(4) << static_cast<int>(entry.first) << std::setw(8) << slot.frames
+				<< std::setw(10) << (duration ? 100.0 * slot.airtime / duration : 0.0)
+				<< std::setw(11) << (slot.attempts ? 100.0 * slot.delivered / slot.attempts : 0.0) << "  ";
+			for (size_t type = 0; type < slot.types.size(); ++type){
+				if (slot.types[type]){
+					std::cout << packetTypeName(static_cast<uint8_t>(type)) << "=" << slot.types[type] << " ";
+				}
+			}
+			if (slot.stolen){
+				std::cout << "(stolen=" << slot.stolen << ")";
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	std::cout << "--- links ---" << std::endl;
+	std::cout << "sender  receiver  attempts  delivered  loss%" << std::endl;
+	for (const auto& entry : links){
+		const LinkCounts& link = entry.second;
+		std::cout << std::setw(6) << entry.first.first << std::setw(10) << entry.first.second << std::setw(10) << link.attempts
+			<< std::setw(11) << link.delivered << std::setw(7) << 100.0 * (link.attempts - link.delivered) / link.attempts << std::endl;
+	}
+
+	size_t lost = 0;
+	for (const auto& entry : packets){
+		lost += entry.second.delivered ? 0 : 1;
+	}
+	std::cout << "--- rnp packets ---" << std::endl;
+	std::cout << "sent: " << packets.size() << ", delivered: " << latencies.size() << ", lost: " << lost << std::endl;
+	std::cout << "latency p50/p90/p99: " << TrafficSink::percentile(latencies, 50) << "/" << TrafficSink::percentile(latencies, 90)
+		<< "/" << TrafficSink::percentile(latencies, 99) << " us" << std::endl;
+	return 0;
+}
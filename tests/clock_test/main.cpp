@@ -0,0 +1,102 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/datalink/tdma.h>
+
+// librnp
+#include <librnp/rnp_networkmanager.h>
+
+#include "../Check/check.h"
+
+static void testVirtualClock()
+{
+	std::cout << "--- virtual clock ---" << std::endl;
+	VirtualClock clock(5);
+	VirtualClock copy = clock;
+	check(clock.micros() == 5, "starts at the given time");
+
+	clock.advance(1500);
+	check(copy.micros() == 1505 && copy.millis() == 1, "copies share the time");
+
+	clock.advanceTo(1000);
+	check(clock.micros() == 1505, "never runs backwards");
+	clock.advanceTo(2000000);
+	check(clock.micros() == 2000000, "jumps forward");
+}
+
+static void testDriftingClock()
+{
+	std::cout << "--- drifting clock ---" << std::endl;
+	VirtualClock source;
+	DriftingClock fast([source]() { return source.micros(); }, 100);
+	DriftingClock slow([source]() { return source.micros(); }, -100);
+
+	source.advance(1000000);
+	check(fast.micros() == 1000100, "+100ppm gains 100us a second");
+	check(slow.micros() == 999900, "-100ppm loses 100us a second");
+
+	bool exact = true;
+	for (uint64_t local : {uint64_t(0), uint64_t(1), uint64_t(999), uint64_t(1000100), uint64_t(3600000000ull)}){
+		const uint64_t sourceTime = fast.toSource(local);
+		exact &= fast.toLocal(sourceTime) >= local && (sourceTime == 0 || fast.toLocal(sourceTime - 1) < local);
+	}
+	check(exact, "toSource gives the first source time the local clock reaches a deadline");
+}
+
+/**
+ * @brief A lone TDMA node on a virtual clock, stepped straight from one deadline to the next
+ */
+static void testTdmaOnVirtualClock()
+{
+	std::cout << "--- tdma slot timing on a virtual clock ---" << std::endl;
+	VirtualClock clock;
+	SimWorld world(1, [clock]() { return clock.micros(); });
+
+	LoRaSimPhysicalLayer physicalLayer(world, 868e6, 250e3, 7);
+	RnpNetworkManager networkManager(101, NODETYPE::HUB, true);
+	TDMARadio<LoRaSimPhysicalLayer, VirtualClock> radio(physicalLayer, networkManager, clock);
+	radio.setup();
+	auto info = static_cast<const TDMARadioInterfaceInfo*>(radio.getInfo());
+
+	size_t steps = 0;
+	while (!info->joined && clock.micros() < 20000000 && steps < 100000){
+		radio.update();
+		clock.advanceTo(radio.nextDeadline());
+		++steps;
+	}
+	check(info->joined, "lone node initialises its own network");
+	check(clock.micros() >= 8000000 && clock.micros() <= 12001000, "network initialised after the 8-12s discovery timeout");
+	check(steps < 1000, "discovery is a handful of deadlines rather than a poll every loop");
+
+	// once joined the node idles from window edge to window edge
+	std::vector<uint64_t> windowEdges;
+	for (int i = 0; i < 20; ++i){
+		radio.update();
+		const uint64_t deadline = radio.nextDeadline();
+		if (deadline > clock.micros()){
+			windowEdges.push_back(deadline);
+		}
+		clock.advanceTo(deadline);
+	}
+	bool periodic = windowEdges.size() >= 3;
+	for (size_t i = 2; i < windowEdges.size(); ++i){
+		periodic &= (windowEdges[i] - windowEdges[i - 1]) == (windowEdges[1] - windowEdges[0]);
+	}
+	check(periodic, "window edges land exactly one window length apart");
+}
+
+int main()
+{
+	testVirtualClock();
+	testDriftingClock();
+	testTdmaOnVirtualClock();
+
+	return checkSummary();
+}
@@ -0,0 +1,263 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/datalink/tdma.h>
+
+#include "../SimNode.h"
+#include "../Traffic/traffic_generator.h"
+#include "../Check/check.h"
+
+/**
+ * @brief Reaches the TDMARadio internals checked here, see the friend declaration in tdma.h
+ */
+struct TDMARadioProbe
+{
+	template <typename Radio>
+	static uint64_t timeWindowLength(const Radio& radio) {return radio.m_timeWindowLength;}
+
+	template <typename Radio>
+	static void unpackTDMAHeader(Radio& radio, std::vector<uint8_t>& packet) {radio.unpackTDMAHeader(packet);}
+
+	template <typename Radio>
+	static TDMAControl lastControl(const Radio& radio) {return radio.m_lastPacketControl;}
+};
+
+using Node = SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>;
+
+static void testHeader()
+{
+	std::cout << "--- header ---" << std::endl;
+	VirtualClock clock;
+	SimWorld world(1, [clock]() { return clock.micros(); });
+	Node node(world, 0, 868e6, 250e3, 7, false, 0);
+	node.setup();
+	auto& radio = node.getRadio();
+	const LoRaSimPhysicalLayer& phy = *node.getPhysicalLayer();
+
+	// what the window used to be: the biggest frame, then time for a header only ack frame
+	const uint64_t window = TDMARadioProbe::timeWindowLength(radio);
+	const uint64_t withAck = static_cast<uint64_t>((phy.calculateAirtime(80 + 7) + phy.calculateAirtime(7) + 4e-5f) * 1e6f);
+	const uint64_t biggest = static_cast<uint64_t>(phy.calculateAirtime(80 + 7 + TDMAControl::size) * 1e6f);
+	std::cout << "window = " << window << "us, with an ack frame = " << withAck << "us" << std::endl;
+	check(window < withAck, "no time set aside for ack frames");
+	check(window >= biggest, "biggest frame fits with its control section");
+
+	// FEC overhead is only paid for by networks running it
+	Node fecNode(world, 1, 868e6, 250e3, 7, false, 0);
+	fecNode.getRadio().setFec(4, 2);
+	fecNode.setup();
+	const uint64_t fecWindow = TDMARadioProbe::timeWindowLength(fecNode.getRadio());
+	const uint64_t biggestFec = static_cast<uint64_t>(phy.calculateAirtime(80 + 7 + TDMAControl::size + FecHeader::maxSize + FecHeader::symbolOverhead) * 1e6f);
+	check(fecWindow >= biggestFec && window < fecWindow, "FEC overhead only in the window when FEC is on");
+
+	std::vector<uint8_t> frame = {PACKET_TYPE::HEARTBEAT | PACKET_TYPE_VERSION | PACKET_TYPE_CONTROL | PACKET_TYPE_REPORTS, 2, 1, 102, 0, 255, 9, 0x80, 0x01, 3, 103, 2, 2, 101, 0x01, 0x02, 104, 0, 7};
+	TDMARadioProbe::unpackTDMAHeader(radio, frame);
+	const TDMAControl control = TDMARadioProbe::lastControl(radio);
+	check(frame.empty() && control.heard == 0x8001 && control.queued == 3 && control.grantAddress == 103 && control.grantWindow == 2,
+		"control section read and stripped");
+	check(control.reports == 2 && control.report[0].address == 101 && control.report[0].heardCount == 0x0102
+		&& control.report[1].address == 104 && control.report[1].heardCount == 7, "heard count reports read");
+
+	frame = {PACKET_TYPE::NORMAL | PACKET_TYPE_VERSION, 2, 1, 102, 0, 255, 10, 0xAB};
+	TDMARadioProbe::unpackTDMAHeader(radio, frame);
+	check(frame.size() == 1 && frame[0] == 0xAB, "frame without a control section left alone");
+
+	// past 255 bytes the size check must not wrap
+	frame = {PACKET_TYPE::NORMAL | PACKET_TYPE_VERSION, 2, 1, 102, 0, 255, 13};
+	frame.resize(260, 0xCD);
+	TDMARadioProbe::unpackTDMAHeader(radio, frame);
+	check(frame.size() == 260 - 7 && frame[0] == 0xCD, "frame over 255 bytes unpacked");
+
+	bool threw = false;
+	try {
+		frame = {PACKET_TYPE::HEARTBEAT | PACKET_TYPE_VERSION | PACKET_TYPE_CONTROL, 2, 1, 102, 0, 255, 11, 0x80};
+		TDMARadioProbe::unpackTDMAHeader(radio, frame);
+	}
+	catch (std::runtime_error&){
+		threw = true;
+	}
+	check(threw, "truncated control section rejected");
+
+	threw = false;
+	try {
+		frame = {PACKET_TYPE::HEARTBEAT | PACKET_TYPE_VERSION | PACKET_TYPE_CONTROL | PACKET_TYPE_REPORTS, 2, 1, 102, 0, 255, 12, 0x80, 0x01, 3, 0, 0, 2, 101, 0, 1};
+		TDMARadioProbe::unpackTDMAHeader(radio, frame);
+	}
+	catch (std::runtime_error&){
+		threw = true;
+	}
+	check(threw, "truncated reports rejected");
+
+	threw = false;
+	try {
+		// 6 byte header older firmware sends, a heartbeat with no sequence
+		frame = {PACKET_TYPE::HEARTBEAT, 2, 1, 102, 0, 255, 0xAB};
+		TDMARadioProbe::unpackTDMAHeader(radio, frame);
+	}
+	catch (std::runtime_error&){
+		threw = true;
+	}
+	check(threw, "frame from older firmware rejected");
+}
+
+// the two nodes the acknowledgement tests run on, node1 joining the network node0 set up
+static std::vector<std::unique_ptr<Node>> joinPair(SimWorld& world, VirtualClock& clock)
+{
+	std::vector<std::unique_ptr<Node>> nodes;
+	while (world.now() < 30000000){
+		if (nodes.size() < 2 && world.now() >= nodes.size() * 14000000){
+			nodes.push_back(std::make_unique<Node>(world, static_cast<int>(nodes.size()), 868e6, 250e3, 7, false, (nodes.size() - 0.5) * 10.0));
+			nodes.back()->setup();
+		}
+		for (auto& node : nodes){
+			node->update();
+		}
+		clock.advance(1000);
+	}
+	check(static_cast<const TDMARadioInterfaceInfo*>(nodes[0]->getRadioInfo())->joined
+		&& static_cast<const TDMARadioInterfaceInfo*>(nodes[1]->getRadioInfo())->joined, "both joined");
+	return nodes;
+}
+
+static void runUntil(SimWorld& world, VirtualClock& clock, std::vector<std::unique_ptr<Node>>& nodes, uint64_t until)
+{
+	while (world.now() < until){
+		for (auto& node : nodes){
+			node->update();
+		}
+		clock.advance(1000);
+	}
+}
+
+// frames with a control section sent in the node's own windows
+static uint32_t ownFramesSent(const SlotStats& stats)
+{
+	return stats.slotsUsed + stats.slotsHeartbeat + stats.slotsYielded;
+}
+
+/**
+ * @brief Two nodes sending to each other with node1 missing about a third of what node0 sends, node0 should find
+ * out from the acknowledgements node1 piggybacks
+ */
+static void testAcknowledgements()
+{
+	std::cout << "--- acknowledgements ---" << std::endl;
+	VirtualClock clock;
+	SimWorld world(7, [clock]() { return clock.micros(); });
+	std::vector<std::unique_ptr<Node>> nodes = joinPair(world, clock);
+	const auto* info0 = static_cast<const TDMARadioInterfaceInfo*>(nodes[0]->getRadioInfo());
+	const auto* info1 = static_cast<const TDMARadioInterfaceInfo*>(nodes[1]->getRadioInfo());
+
+	RadioImpairment loss;
+	loss.lossModel = RadioLossModel::BERNOULLI;
+	loss.lossProbability = 0.3f;
+	world.getChannel(0)->setLinkImpairment(nodes[0]->getPhysicalLayer(), nodes[1]->getPhysicalLayer(), loss);
+
+	TrafficProfile telemetry;
+	telemetry.minPayloadSize = 24;
+	telemetry.maxPayloadSize = 48;
+	for (size_t i = 0; i < 2; ++i){
+		nodes[i]->listen();
+		telemetry.destinations = {static_cast<uint8_t>(i ? 101 : 102)};
+		nodes[i]->addTrafficGenerator(std::make_unique<CbrTraffic>(telemetry, 2));
+	}
+	runUntil(world, clock, nodes, 150000000);
+
+	LinkStats fromNode1;
+	LinkStats fromNode0;
+	check(info0->linkStats.get(102, fromNode1) && info1->linkStats.get(101, fromNode0), "both have link stats for the other");
+	const double missed = static_cast<double>(fromNode1.unackedCount) / (fromNode1.ackedCount + fromNode1.unackedCount);
+	std::cout << "node0 frames acked by node1 = " << fromNode1.ackedCount << ", missed = " << fromNode1.unackedCount
+		<< "; node1 frames acked by node0 = " << fromNode0.ackedCount << ", missed = " << fromNode0.unackedCount << std::endl;
+	// every frame is counted, by the heard bitmaps or by the heard counts after them
+	check(fromNode1.ackedCount > 150 && missed > 0.1 && missed < 0.5, "sender learns the loss on a lossy link");
+	check(fromNode0.ackedCount > 200 && fromNode0.unackedCount == 0, "and none on the clean way back");
+}
+
+/**
+ * @brief node1 has nothing to send so it only reports in a heartbeat every 10 frames, long after node0's frames have
+ * left its heard bitmap. Its heard counts should still account for every one of them.
+ */
+static void testIdleReporter()
+{
+	std::cout << "--- idle reporter ---" << std::endl;
+	VirtualClock clock;
+	SimWorld world(11, [clock]() { return clock.micros(); });
+	std::vector<std::unique_ptr<Node>> nodes = joinPair(world, clock);
+	const auto* info0 = static_cast<const TDMARadioInterfaceInfo*>(nodes[0]->getRadioInfo());
+
+	TrafficProfile telemetry;
+	telemetry.minPayloadSize = 24;
+	telemetry.maxPayloadSize = 48;
+	telemetry.destinations = {102};
+	nodes[0]->addTrafficGenerator(std::make_unique<CbrTraffic>(telemetry, 2));
+	nodes[1]->listen();
+	const uint32_t sentBefore = ownFramesSent(info0->slotStats.get());
+	LinkStats fromNode1{};
+	info0->linkStats.get(102, fromNode1);
+	const uint32_t reportedBefore = fromNode1.ackedCount + fromNode1.unackedCount;
+	runUntil(world, clock, nodes, 150000000);
+
+	const uint32_t sent = ownFramesSent(info0->slotStats.get()) - sentBefore;
+	check(info0->linkStats.get(102, fromNode1), "node0 has link stats for node1");
+	const uint32_t reported = fromNode1.ackedCount + fromNode1.unackedCount - reportedBefore;
+	std::cout << "node0 frames sent = " << sent << ", reported on by node1 = " << reported << ", missed = " << fromNode1.unackedCount << std::endl;
+	// the last few frames go out after node1's last heartbeat, one sent just before the traffic started may be reported after
+	check(reported + 12 >= sent && reported <= sent + 1 && fromNode1.unackedCount == 0, "frames beyond the heard bitmap still acknowledged");
+}
+
+/**
+ * @brief node0 has a backlog of frames too big to leave room for a heard count report, it should still get its
+ * reports out by sending a heartbeat in place of a frame now and again
+ */
+static void testFullFrames()
+{
+	std::cout << "--- full frames ---" << std::endl;
+	VirtualClock clock;
+	SimWorld world(13, [clock]() { return clock.micros(); });
+	std::vector<std::unique_ptr<Node>> nodes = joinPair(world, clock);
+	const auto* info0 = static_cast<const TDMARadioInterfaceInfo*>(nodes[0]->getRadioInfo());
+	const auto* info1 = static_cast<const TDMARadioInterfaceInfo*>(nodes[1]->getRadioInfo());
+
+	TrafficProfile bulk;
+	bulk.minPayloadSize = 69;		// 80 byte rnp frames, as big as they go
+	bulk.maxPayloadSize = 69;
+	bulk.destinations = {102};
+	nodes[0]->addTrafficGenerator(std::make_unique<CbrTraffic>(bulk, 10));
+	nodes[1]->listen();
+	const SlotStats before0 = info0->slotStats.get();
+	const uint32_t sentBefore1 = ownFramesSent(info1->slotStats.get());
+	LinkStats fromNode0{};
+	info1->linkStats.get(101, fromNode0);
+	const uint32_t reportedBefore = fromNode0.ackedCount + fromNode0.unackedCount;
+	runUntil(world, clock, nodes, 150000000);
+
+	const SlotStats after0 = info0->slotStats.get();
+	const uint32_t used = after0.slotsUsed - before0.slotsUsed;
+	const uint32_t heartbeats = after0.slotsHeartbeat - before0.slotsHeartbeat;
+	const uint32_t sent1 = ownFramesSent(info1->slotStats.get()) - sentBefore1;
+	check(info1->linkStats.get(101, fromNode0), "node1 has link stats for node0");
+	const uint32_t reported = fromNode0.ackedCount + fromNode0.unackedCount - reportedBefore;
+	std::cout << "node0 windows with data = " << used << ", with a heartbeat = " << heartbeats
+		<< "; node1 frames sent = " << sent1 << ", reported on by node0 = " << reported << std::endl;
+	check(heartbeats > 0 && heartbeats * 8 < used, "busy node reports in a heartbeat now and again");
+	check(reported + 12 >= sent1 && reported <= sent1 + 1 && fromNode0.unackedCount == 0, "and its reports account for everything");
+}
+
+int main()
+{
+	testHeader();
+	testAcknowledgements();
+	testIdleReporter();
+	testFullFrames();
+
+	return checkSummary();
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <stdexcept>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/datalink/fec.h>
+#include <librrp/datalink/tdma.h>
+
+#include "../SimNode.h"
+#include "../Traffic/traffic_generator.h"
+#include "../Check/check.h"
+
+static std::vector<uint8_t> randomFrame(Xoshiro256& rng, size_t minSize, size_t maxSize)
+{
+	std::vector<uint8_t> frame(minSize + rng.nextBelow(static_cast<uint32_t>(maxSize - minSize + 1)));
+	for (auto& byte : frame){
+		byte = static_cast<uint8_t>(rng());
+	}
+	return frame;
+}
+
+struct CodedBlock
+{
+	std::vector<std::vector<uint8_t>> payloads;
+	std::vector<std::vector<uint8_t>> data;		// on air, with block headers
+	std::vector<std::vector<uint8_t>> parity;
+};
+
+// one block through an encoder, closed early if count is below its block size
+static CodedBlock encodeBlock(FecEncoder& encoder, Xoshiro256& rng, size_t count)
+{
+	CodedBlock block;
+	for (size_t i = 0; i < count; ++i){
+		block.payloads.push_back(randomFrame(rng, 1, 90));
+		block.data.emplace_back();
+		encoder.dataFrame(block.payloads.back(), block.data.back());
+		encoder.dataSent(block.payloads.back());
+	}
+	encoder.flush();
+	std::vector<uint8_t> frame;
+	while (encoder.parityFrame(frame)){
+		block.parity.push_back(frame);
+		encoder.paritySent();
+	}
+	return block;
+}
+
+// the block through a decoder with the frames in lost missing, true if every payload came out intact
+static bool decodeBlock(FecDecoder& decoder, const CodedBlock& block, uint64_t lost, size_t& recovered)
+{
+	std::vector<std::vector<uint8_t>> delivered(block.payloads.size());
+	std::vector<bool> have(block.payloads.size(), false);
+	recovered = 0;
+	auto collect = [&](size_t count) {
+		for (size_t i = 0; i < count; ++i){
+			// a rebuilt frame is matched to its payload by content, the decoder doesn't say which it was
+			for (size_t j = 0; j < block.payloads.size(); ++j){
+				if (!have[j] && decoder.recovered(i) == block.payloads[j]){
+					have[j] = true;
+					++recovered;
+					break;
+				}
+			}
+		}
+	};
+	for (size_t i = 0; i < block.data.size(); ++i){
+		if (lost & (uint64_t(1) << i)){
+			continue;
+		}
+		std::vector<uint8_t> frame = block.data[i];
+		const size_t count = decoder.receive(7, frame);
+		have[i] = (frame == block.payloads[i]);
+		collect(count);
+	}
+	for (size_t i = 0; i < block.parity.size(); ++i){
+		if (lost & (uint64_t(1) << (block.data.size() + i))){
+			continue;
+		}
+		std::vector<uint8_t> frame = block.parity[i];
+		collect(decoder.receive(7, frame));
+	}
+	for (bool h : have){
+		if (!h){
+			return false;
+		}
+	}
+	return true;
+}
+
+static void testCodec()
+{
+	std::cout << "--- codec ---" << std::endl;
+	bool field = true;
+	for (unsigned a = 1; a < 256; ++a){
+		field = field && ReedSolomon::multiply(static_cast<uint8_t>(a), ReedSolomon::inverse(static_cast<uint8_t>(a))) == 1;
+	}
+	check(field, "every non zero element has an inverse");
+
+	Xoshiro256 rng(3);
+	FecEncoder encoder(6, 3);
+	FecDecoder decoder;
+
+	// every loss pattern of up to 3 of the 9 frames is rebuilt, any 4 are not
+	size_t patterns = 0;
+	size_t rebuilt = 0;
+	size_t unrecoverable = 0;
+	size_t spurious = 0;
+	for (uint64_t lost = 0; lost < (1 << 9); ++lost){
+		int count = 0;
+		for (uint64_t bits = lost; bits; bits &= bits - 1){
+			++count;
+		}
+		if (count > 4){
+			continue;
+		}
+		const CodedBlock block = encodeBlock(encoder, rng, 6);
+		size_t recovered = 0;
+		const bool intact = decodeBlock(decoder, block, lost, recovered);
+		++patterns;
+		if (count <= 3){
+			rebuilt += intact ? 1 : 0;
+		}
+		else {
+			// with 4 gone there is only any hope when all of them were parity
+			unrecoverable += (!intact || (lost & 0x3F) == 0) ? 1 : 0;
+			spurious += recovered;
+		}
+	}
+	check(rebuilt == 1 + 9 + 36 + 84, "any 3 of 9 frames lost are rebuilt");
+	check(unrecoverable == 126 && spurious == 0, "4 of 9 lost are never rebuilt, nor anything half made up");
+
+	// blocks closed early keep the same parity rows, and a short frame among long ones survives the padding
+	bool early = true;
+	for (size_t count = 1; count < 6; ++count){
+		const CodedBlock block = encodeBlock(encoder, rng, count);
+		size_t recovered = 0;
+		early = early && block.parity.size() == 3 && decodeBlock(decoder, block, 0x1, recovered) && recovered == 1;
+	}
+	check(early, "blocks closed early are decoded");
+
+	// senders are tracked independently
+	FecEncoder other(6, 3);
+	const CodedBlock mine = encodeBlock(encoder, rng, 6);
+	const CodedBlock theirs = encodeBlock(other, rng, 6);
+	size_t interleaved = 0;
+	for (size_t i = 0; i < 6; ++i){
+		std::vector<uint8_t> frame;
+		if (i != 2){
+			frame = mine.data[i];
+			decoder.receive(1, frame);
+		}
+		if (i != 4){
+			frame = theirs.data[i];
+			decoder.receive(2, frame);
+		}
+	}
+	std::vector<uint8_t> frame = mine.parity[0];
+	interleaved += (decoder.receive(1, frame) == 1 && decoder.recovered(0) == mine.payloads[2]) ? 1 : 0;
+	frame = theirs.parity[1];
+	interleaved += (decoder.receive(2, frame) == 1 && decoder.recovered(0) == theirs.payloads[4]) ? 1 : 0;
+	check(interleaved == 2, "interleaved senders decoded separately");
+
+	// parity for a block still helps while the next one is filling, but not once a third has started
+	std::vector<CodedBlock> blocks;
+	for (size_t i = 0; i < 4; ++i){
+		blocks.push_back(encodeBlock(encoder, rng, 6));
+	}
+	for (size_t i = 0; i < 4; ++i){
+		frame = blocks[i].data[1];
+		decoder.receive(1, frame);
+	}
+	frame = blocks[0].parity[0];
+	check(decoder.receive(1, frame) == 0, "parity for an abandoned block rebuilds nothing");
+	for (size_t i = 1; i < 6; ++i){
+		frame = blocks[2].data[i];
+		decoder.receive(1, frame);
+	}
+	frame = blocks[2].parity[0];
+	check(decoder.receive(1, frame) == 1 && decoder.recovered(0) == blocks[2].payloads[0], "parity for the previous block still rebuilds");
+
+	bool threw = false;
+	try {
+		frame = {1};
+		decoder.receive(1, frame);
+	}
+	catch (std::runtime_error&){
+		threw = true;
+	}
+	check(threw, "truncated block header rejected");
+
+	// a bigger block, closer to what a busy link would use
+	FecEncoder wide(32, 8);
+	const CodedBlock block = encodeBlock(wide, rng, 32);
+	size_t recovered = 0;
+	const uint64_t lost = (uint64_t(1) << 0) | (uint64_t(1) << 5) | (uint64_t(1) << 9) | (uint64_t(1) << 17) | (uint64_t(1) << 23)
+		| (uint64_t(1) << 31) | (uint64_t(1) << 33) | (uint64_t(1) << 38);
+	check(decodeBlock(decoder, block, lost, recovered) && recovered == 6, "32 + 8 block rebuilds 6 data frames with 6 of its parity");
+}
+
+/**
+ * @brief Delivery over TDMA on a lossy channel with and without FEC, from a node with spare tx windows
+ */
+static double delivery(uint8_t dataFrames, uint8_t parityFrames, float loss, uint32_t& recovered)
+{
+	using Node = SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>;
+	VirtualClock clock;
+	SimWorld world(11, [clock]() { return clock.micros(); });
+
+	// the second node comes up once the first has a network for it to join, and both are joined before the loss
+	// starts, so each run measures the data path alone
+	std::vector<std::unique_ptr<Node>> nodes;
+	while (world.now() < 30000000){
+		if (nodes.size() < 2 && world.now() >= nodes.size() * 14000000){
+			nodes.push_back(std::make_unique<Node>(world, static_cast<int>(nodes.size()), 868e6, 250e3, 7, false, (nodes.size() - 0.5) * 10.0));
+			nodes.back()->getRadio().setFec(dataFrames, parityFrames);
+			nodes.back()->setup();
+		}
+		for (auto& node : nodes){
+			node->update();
+		}
+		clock.advance(1000);
+	}
+	world.getChannel(0)->setPacketDropProbability(loss);
+
+	TrafficProfile telemetry;
+	telemetry.minPayloadSize = 24;
+	telemetry.maxPayloadSize = 48;
+	telemetry.destinations = {102};
+	nodes[1]->listen();
+	nodes[0]->addTrafficGenerator(std::make_unique<CbrTraffic>(telemetry, 2));
+
+	while (world.now() < 150000000){
+		for (auto& node : nodes){
+			node->update();
+		}
+		clock.advance(1000);
+	}
+
+	const auto* info = static_cast<const TDMARadioInterfaceInfo*>(nodes[1]->getRadioInfo());
+	recovered = info->fecRecovered;
+	return static_cast<double>(nodes[1]->getTrafficSink()->getReceived()) / nodes[0]->getTrafficSent();
+}
+
+static void testTdma()
+{
+	std::cout << "--- tdma ---" << std::endl;
+	uint32_t recovered = 0;
+	const double clean = delivery(4, 2, 0, recovered);
+	check(clean > 0.97 && recovered == 0, "fec on a clean channel delivers everything without rebuilding");
+
+	const double plain = delivery(0, 0, 0.2f, recovered);
+	const double coded = delivery(4, 2, 0.2f, recovered);
+	std::cout << "delivery at 20% loss: plain = " << plain << ", fec 4+2 = " << coded << ", rebuilt = " << recovered << std::endl;
+	check(plain < 0.85, "plain tdma loses frames");
+	check(coded > 0.95 && recovered > 0, "fec rebuilds most of them from parity in spare windows");
+}
+
+int main()
+{
+	testCodec();
+	testTdma();
+
+	return checkSummary();
+}
@@ -0,0 +1,167 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/util/latency_histogram.h>
+#include <librrp/util/xoshiro.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/datalink/turn_timeout.h>
+
+// librnp
+#include <librnp/rnp_networkmanager.h>
+
+#include "../Traffic/traffic_packet.h"
+#include "../Check/check.h"
+
+static bool within(uint64_t value, uint64_t expected, double tolerance)
+{
+	return std::fabs(static_cast<double>(value) - static_cast<double>(expected)) <= tolerance * expected;
+}
+
+static void testHistogram()
+{
+	std::cout << "--- histogram ---" << std::endl;
+	LatencyHistogram<> histogram;
+	check(histogram.percentile(50) == 0 && histogram.summary().count == 0, "empty histogram reports 0");
+
+	for (uint64_t value = 0; value < 16; ++value){
+		histogram.record(value);
+	}
+	check(histogram.percentile(100) == 15 && histogram.percentile(50) == 7, "small values are exact");
+
+	// uniform over 1ms - 1s, every percentile should land within the bucket precision (1/16)
+	histogram.reset();
+	Xoshiro256 rng(1);
+	std::vector<uint64_t> values;
+	for (size_t i = 0; i < 100000; ++i){
+		values.push_back(1000 + rng.nextBelow(999000));
+		histogram.record(values.back());
+	}
+	std::sort(values.begin(), values.end());
+	const LatencySummary summary = histogram.summary();
+	check(summary.count == values.size(), "every value counted");
+	check(within(summary.p50, values[values.size() / 2], 1.0 / 16), "p50 within bucket precision");
+	check(within(summary.p90, values[values.size() * 9 / 10], 1.0 / 16), "p90 within bucket precision");
+	check(within(summary.p99, values[values.size() * 99 / 100], 1.0 / 16), "p99 within bucket precision");
+	check(summary.max == values.back(), "max is exact");
+
+	histogram.record(uint64_t(1) << 40);
+	check(histogram.summary().max == uint64_t(1) << 40 && histogram.percentile(100) == (uint64_t(1) << 27) - 1, "out of range value kept in the top bucket");
+
+	LatencyHistogram<> copy = histogram;
+	check(copy.summary().count == histogram.summary().count && copy.percentile(99) == histogram.percentile(99), "copies take a snapshot");
+	histogram.reset();
+	check(histogram.count() == 0 && copy.count() == values.size() + 1, "reset clears only the original");
+}
+
+/**
+ * @brief Two timeout radios ping ponging, the second one holds a backlog so its frames wait in the queue
+ */
+static void testTimeoutLatency()
+{
+	std::cout << "--- timeout radio ---" << std::endl;
+	using Radio = TimeoutRadio<LoRaSimPhysicalLayer, VirtualClock>;
+	VirtualClock clock;
+	SimWorld world(1, [clock]() { return clock.micros(); });
+	LoRaSimPhysicalLayer physicalLayerA(world, 868e6, 250e3, 7);
+	LoRaSimPhysicalLayer physicalLayerB(world, 868e6, 250e3, 7);
+	RnpNetworkManager networkManagerA(101, NODETYPE::HUB, true);
+	RnpNetworkManager networkManagerB(102, NODETYPE::HUB, true);
+	Radio radioA(physicalLayerA, networkManagerA, clock);
+	Radio radioB(physicalLayerB, networkManagerB, clock);
+	radioA.setup();
+	radioB.setup();
+
+	auto queue = [&clock](Radio& radio, uint8_t source, uint8_t destination, uint32_t sequence) {
+		TrafficPacket packet(1, sequence, clock.micros(), 32);
+		packet.header.source = source;
+		packet.header.destination = destination;
+		radio.sendPacket(packet);
+	};
+
+	queue(radioA, 101, 102, 0);
+	for (uint32_t i = 0; i < 10; ++i){
+		queue(radioB, 102, 101, i);
+	}
+	while (clock.micros() < 10000000){
+		radioA.update();
+		radioB.update();
+		clock.advance(1000);
+	}
+
+	const auto* info = static_cast<const RadioInterfaceInfo*>(radioB.getInfo());
+	const LatencySummary wait = info->queueLatency.queueWait.summary();
+	const LatencySummary total = info->queueLatency.total.summary();
+	const uint64_t airtime = static_cast<uint64_t>(physicalLayerB.calculateAirtime(45) * 1e6f);	// link header + rnp header + 32B
+	check(wait.count == info->txCount && wait.count == 10, "one sample per frame sent");
+	check(wait.max >= 9 * 250000, "last of the backlog waited out nine turn timeouts");
+	check(total.max == wait.max + airtime, "total is wait plus airtime");	// max is exact, every frame is the same size
+
+	radioB.resetQueueLatency();
+	check(info->queueLatency.queueWait.count() == 10, "reset waits for the radio loop");
+	radioB.update();
+	check(info->queueLatency.queueWait.count() == 0 && info->queueLatency.total.count() == 0, "reset clears both histograms");
+}
+
+/**
+ * @brief A queued TDMA frame waits for its node's slot, so queue wait is bounded by the frame length
+ */
+static void testTdmaLatency()
+{
+	std::cout << "--- tdma radio ---" << std::endl;
+	using Radio = TDMARadio<LoRaSimPhysicalLayer, VirtualClock>;
+	VirtualClock clock;
+	SimWorld world(2, [clock]() { return clock.micros(); });
+	std::vector<std::unique_ptr<LoRaSimPhysicalLayer>> physicalLayers;
+	std::vector<std::unique_ptr<RnpNetworkManager>> networkManagers;
+	std::vector<std::unique_ptr<Radio>> radios;
+	for (size_t i = 0; i < 3; ++i){
+		physicalLayers.push_back(std::make_unique<LoRaSimPhysicalLayer>(world, 868e6, 250e3, 7));
+		networkManagers.push_back(std::make_unique<RnpNetworkManager>(static_cast<uint8_t>(101 + i), NODETYPE::HUB, true));
+		radios.push_back(std::make_unique<Radio>(*physicalLayers.back(), *networkManagers.back(), clock));
+		radios.back()->setSeed(world.nextSeed());
+		radios.back()->setup();
+	}
+
+	uint32_t sequence = 0;
+	while (clock.micros() < 40000000){
+		const auto* info = static_cast<const TDMARadioInterfaceInfo*>(radios[0]->getInfo());
+		if (info->joined && clock.micros() % 500000 == 0){		// one frame every 500ms, whatever the slot timing
+			TrafficPacket packet(1, sequence++, clock.micros(), 32);
+			packet.header.source = 101;
+			packet.header.destination = 102;
+			radios[0]->sendPacket(packet);
+		}
+		for (auto& radio : radios){
+			radio->update();
+		}
+		clock.advance(1000);
+	}
+
+	const auto* info = static_cast<const TDMARadioInterfaceInfo*>(radios[0]->getInfo());
+	const LatencySummary wait = info->queueLatency.queueWait.summary();
+	const LatencySummary total = info->queueLatency.total.summary();
+	const float frameLength = info->slotStats.get().frameLength;
+	check(wait.count > 0 && wait.count <= sequence, "frames sent are sampled");
+	check(wait.p50 > 0 && wait.p50 <= total.p50 && wait.p99 <= total.p99, "total latency includes queue wait");
+	check(wait.max <= frameLength * 1.1f, "no frame waits longer than a tdma frame");
+	std::cout << "queue wait p50 = " << wait.p50 << "us, p99 = " << wait.p99 << "us, total p99 = " << total.p99
+		<< "us, frame = " << frameLength << "us" << std::endl;
+}
+
+int main()
+{
+	testHistogram();
+	testTimeoutLatency();
+	testTdmaLatency();
+
+	return checkSummary();
+}
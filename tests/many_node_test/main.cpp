@@ -0,0 +1,103 @@
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+// librrp
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/capture.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
+
+#include "../SimNode.h"
+#include "../Executor/node_executor.h"
+
+/**
+ * Large TDMA network on the cooperative executor, no thread per node. Nodes are all in range of each other and
+ * join one after another, progress is reported every report interval. By default the world runs on a virtual clock
+ * and simulated time goes as fast as the nodes can be stepped, pass realtime = 1 to run against the wall clock.
+ * Given a capture path every transmission is recorded for librrp_capture_analyzer.
+ *
+ * usage: librrp_many_node_test [nodes = 250] [duration s = 600] [workers = 1] [seed = 1] [realtime = 0] [capture path]
+ */
+
+using Node = SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>;
+
+int main(int argc, char* argv[])
+{
+	const size_t numNodes = (argc > 1) ? std::stoul(argv[1]) : 250;
+	const uint64_t duration = (argc > 2) ? std::stoull(argv[2]) : 600;
+	const size_t numWorkers = (argc > 3) ? std::stoul(argv[3]) : 1;
+	const uint64_t seed = (argc > 4) ? std::stoull(argv[4]) : 1;
+	const bool realtime = (argc > 5) && std::stoi(argv[5]);
+	const std::string capturePath = (argc > 6) ? argv[6] : "";
+	constexpr uint64_t reportInterval = 10;	// s
+
+	if (numNodes > 254){
+		std::cerr << "TDMA supports at most 254 nodes" << std::endl;
+		return 1;
+	}
+
+	// LoRa params
+	float freq = 868e6;
+	float bw = 500e3;
+	uint8_t sf = 7;
+
+	VirtualClock clock;
+	SimWorld world(seed, realtime ? SimWorld::TimeSource() : SimWorld::TimeSource([clock]() { return clock.micros(); }));
+	std::unique_ptr<NodeExecutor> executorPtr = realtime ? std::make_unique<NodeExecutor>(world, numWorkers) : std::make_unique<NodeExecutor>(world, clock, numWorkers);
+	NodeExecutor& executor = *executorPtr;
+	Xoshiro256 rng(world.nextSeed());
+
+	auto capture = std::make_shared<CaptureWriter>();
+	if (!capturePath.empty()){
+		if (!capture->open(capturePath)){
+			std::cerr << "can't create capture " << capturePath << std::endl;
+			return 1;
+		}
+		world.getChannelManager().setCapture(capture);
+	}
+
+	std::vector<std::unique_ptr<Node>> nodes;
+	for (size_t i = 0; i < numNodes; ++i){
+		const int driftPPM = static_cast<int>(rng.nextBelow(21)) - 10;
+		nodes.push_back(std::make_unique<Node>(world, static_cast<int>(i), freq, bw, sf, false, driftPPM));
+		nodes.back()->setup();
+		addSimNode(executor, *nodes.back());
+	}
+
+	std::cout << numNodes << " nodes on " << numWorkers << " workers, " << (realtime ? "real" : "virtual") << " time" << std::endl;
+	const auto start = std::chrono::steady_clock::now();
+
+	for (uint64_t elapsed = 0; elapsed < duration; elapsed += reportInterval){
+		executor.runFor(reportInterval * 1000000);
+
+		size_t joined = 0;
+		for (auto& node : nodes){
+			joined += static_cast<const TDMARadioInterfaceInfo*>(node->getRadioInfo())->joined;
+		}
+		const RadioChannelStats stats = world.getChannel(0)->getStats();
+		std::cout << "t = " << elapsed + reportInterval << "s: joined = " << joined << "/" << numNodes
+			<< ", steps = " << executor.getSteps() << ", packets on air = " << stats.transmissions
+			<< ", collisions = " << stats.collisions << std::endl;
+
+		if (joined == numNodes){
+			break;
+		}
+	}
+
+	const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "ran " << executor.getSteps() << " node steps, " << world.now() / 1e6 << "s simulated in " << wall << "s wall time ("
+		<< executor.getSteps() / wall << " steps/s)" << std::endl;
+
+	// executor is idle, nodes can go in any order
+	nodes.clear();
+	if (capture->isOpen()){
+		std::cout << "captured " << capture->getRecordCount() << " transmissions, " << capture->getBytesWritten() << " bytes" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,361 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/physical/physical_layer_base.h>
+#include <librrp/physical/radio_channel.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/datalink/turn_timeout.h>
+#include <librrp/datalink/fec.h>
+
+// librnp
+#include <librnp/rnp_networkmanager.h>
+#include <librnp/rnp_packet.h>
+
+#include "microbench.h"
+
+/**
+ * Per call cost of the functions that run for every frame, each exercised on its own against a fixture that does
+ * as little as possible around it. Reports ns/op and heap allocations/op (plus cycles/op on the esp32).
+ *
+ * usage: librrp_microbench [--format table|csv] [--time us per benchmark = 200000]
+ */
+
+// every heap allocation in the process goes through here so the harness can count them. Both new and delete are
+// replaced, in scalar and array form, so memory from malloc is only ever given back to free
+static std::atomic<uint64_t> allocationCount{0};
+
+static void* countedAllocate(size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = std::malloc(size ? size : 1)){
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size)
+{
+	return countedAllocate(size);
+}
+
+void* operator new[](size_t size)
+{
+	return countedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+/**
+ * @brief Physical layer that hands back the same frame on every read and swallows everything sent, so the datalink
+ * is the only thing being measured
+ */
+class LoopbackPhysicalLayer
+{
+	public:
+		LoopbackPhysicalLayer()
+		{
+			m_info.timeLastPacketReceived = 0;
+			m_info.packetRssi = -80;
+			m_info.packetSnr = 7;
+			m_info.packetFreqError = 0;
+			m_info.frequency = 868e6;
+			m_info.bandwidth = 250e3;
+			m_info.spreadingFactor = 7;
+			m_info.codingRate = 5;
+			m_info.preambleLength = 8;
+			m_info.crcEnabled = true;
+			m_info.implicitHeader = false;
+			m_info.lowDataRateOptimization = false;
+		}
+
+		bool setup() {return true;}
+		size_t sendPacket(std::vector<uint8_t> data) {doNotOptimize(data.data()); return data.size();}
+		size_t readPacket(std::vector<uint8_t>& data)
+		{
+			if (frame.empty()){
+				return 0;
+			}
+			data.assign(frame.begin(), frame.end());
+			return data.size();
+		}
+		bool isBusy() {return false;}
+		void restart() {}
+		float calculateAirtime(size_t payloadSize) const {return loraAirtime(m_info, payloadSize);}
+		void setChannel(uint8_t) {}
+		const PhysicalLayerInfo* getInfo() {return &m_info;}
+
+		std::vector<uint8_t> frame;
+
+	private:
+		LoRaSimPhysicalLayerInfo m_info;
+};
+
+/**
+ * @brief Reaches the TDMARadio internals the benchmarks call directly, see the friend declaration in tdma.h
+ */
+struct TDMARadioProbe
+{
+	template <typename Radio>
+	static void unpackTDMAHeader(Radio& radio, std::vector<uint8_t>& packet) {radio.unpackTDMAHeader(packet);}
+
+	template <typename Radio>
+	static size_t sendPacketWithTDMAHeader(Radio& radio, std::vector<uint8_t>& packet) {return radio.sendPacketWithTDMAHeader(packet, PACKET_TYPE::NORMAL, 0);}
+
+	template <typename Radio>
+	static void getPacket(Radio& radio) {radio.getPacket();}
+};
+
+static std::vector<uint8_t> rnpFrame(uint8_t source, uint8_t destination, size_t bodySize)
+{
+	RnpHeader header;
+	header.source = source;
+	header.destination = destination;
+	header.packet_len = static_cast<uint16_t>(bodySize);
+	std::vector<uint8_t> frame;
+	header.serialize(frame);
+	frame.resize(frame.size() + bodySize, 0xAB);
+	return frame;
+}
+
+static std::vector<uint8_t> tdmaFrame(uint8_t type, uint8_t source, const std::vector<uint8_t>& body)
+{
+	std::vector<uint8_t> frame = {static_cast<uint8_t>(type | PACKET_TYPE_VERSION), 3, 1, source, 0, 255, 42};
+	frame.insert(frame.end(), body.begin(), body.end());
+	return frame;
+}
+
+static void benchTdma(Microbench& bench)
+{
+	using Radio = TDMARadio<LoopbackPhysicalLayer, VirtualClock>;
+	VirtualClock clock;
+	LoopbackPhysicalLayer physicalLayer;
+	RnpNetworkManager networkManager(101, NODETYPE::HUB, true);
+	Radio radio(physicalLayer, networkManager, clock);
+	radio.setSeed(1);
+	radio.setup();
+	packetBuffer_t packetBuffer;
+	radio.setPacketBuffer(&packetBuffer);
+
+	// the per op refill of the frame is part of the cost, into storage that is already big enough
+	const std::vector<uint8_t> heartbeat = tdmaFrame(PACKET_TYPE::HEARTBEAT, 102, {});
+	const std::vector<uint8_t> normal = tdmaFrame(PACKET_TYPE::NORMAL, 102, rnpFrame(102, 101, 32));
+	std::vector<uint8_t> packet;
+	packet.reserve(256);
+
+	bench.run("TDMARadio::unpackTDMAHeader (header only)", [&]() {
+		packet.assign(heartbeat.begin(), heartbeat.end());
+		TDMARadioProbe::unpackTDMAHeader(radio, packet);
+		doNotOptimize(packet.size());
+	});
+	bench.run("TDMARadio::unpackTDMAHeader (43B rnp)", [&]() {
+		packet.assign(normal.begin(), normal.end());
+		TDMARadioProbe::unpackTDMAHeader(radio, packet);
+		doNotOptimize(packet.size());
+	});
+
+	const std::vector<uint8_t> payload = rnpFrame(101, 102, 32);
+	bench.run("TDMARadio::sendPacketWithTDMAHeader (43B rnp)", [&]() {
+		packet.assign(payload.begin(), payload.end());
+		doNotOptimize(TDMARadioProbe::sendPacketWithTDMAHeader(radio, packet));
+	});
+
+	physicalLayer.frame = heartbeat;
+	bench.run("TDMARadio::getPacket (heartbeat)", [&]() {
+		TDMARadioProbe::getPacket(radio);
+	});
+
+	physicalLayer.frame = normal;
+	bench.run("TDMARadio::getPacket (43B rnp, incl RnpPacketSerialized)", [&]() {
+		TDMARadioProbe::getPacket(radio);
+		packetBuffer.pop();
+	});
+}
+
+static void benchTimeout(Microbench& bench)
+{
+	using Radio = TimeoutRadio<LoopbackPhysicalLayer, VirtualClock>;
+	VirtualClock clock;
+	LoopbackPhysicalLayer physicalLayer;
+	RnpNetworkManager networkManager(101, NODETYPE::HUB, true);
+	Radio radio(physicalLayer, networkManager, clock);
+	radio.setup();
+	packetBuffer_t packetBuffer;
+	radio.setPacketBuffer(&packetBuffer);
+
+	bench.run("TimeoutRadio::update (idle)", [&]() {
+		radio.update();
+	});
+
+	physicalLayer.frame = rnpFrame(102, 101, 32);
+	physicalLayer.frame.insert(physicalLayer.frame.begin(), {102, 7});
+	bench.run("TimeoutRadio::update (43B rnp received)", [&]() {
+		radio.update();
+		packetBuffer.pop();
+	});
+}
+
+/**
+ * @brief One block through the FEC encoder and decoder. Decode throughput is the block's data bytes over ns/op.
+ */
+static void benchFec(Microbench& bench, uint8_t dataFrames, uint8_t parityFrames, size_t frameSize)
+{
+	const std::string shape = std::to_string(dataFrames) + "+" + std::to_string(parityFrames) + " x " + std::to_string(frameSize) + "B";
+	std::vector<std::vector<uint8_t>> payloads(dataFrames, std::vector<uint8_t>(frameSize));
+	for (size_t i = 0; i < payloads.size(); ++i){
+		for (size_t j = 0; j < frameSize; ++j){
+			payloads[i][j] = static_cast<uint8_t>(i * 31 + j * 7 + 1);
+		}
+	}
+
+	FecEncoder encoder(dataFrames, parityFrames);
+	std::vector<uint8_t> frame;
+	frame.reserve(frameSize + 16);
+	bench.run("FecEncoder block (" + shape + ")", [&]() {
+		for (const auto& payload : payloads){
+			encoder.dataFrame(payload, frame);
+			encoder.dataSent(payload);
+		}
+		while (encoder.parityFrame(frame)){
+			encoder.paritySent();
+		}
+		doNotOptimize(frame.data());
+	});
+
+	// one block encoded up front, its frames replayed with as many data frames lost as there is parity to rebuild them
+	std::vector<std::vector<uint8_t>> onAir;
+	for (const auto& payload : payloads){
+		encoder.dataFrame(payload, frame);
+		encoder.dataSent(payload);
+		onAir.push_back(frame);
+	}
+	while (encoder.parityFrame(frame)){
+		onAir.push_back(frame);
+		encoder.paritySent();
+	}
+	FecDecoder decoder;
+	uint8_t block = 0;
+	std::vector<uint8_t> received;
+	received.reserve(frameSize + 16);
+	bench.run("FecDecoder block, rebuild " + std::to_string(parityFrames) + " (" + shape + ")", [&]() {
+		// a fresh block id each time so the decoder doesn't see a block it already finished
+		++block;
+		size_t recovered = 0;
+		for (size_t i = parityFrames; i < onAir.size(); ++i){
+			received.assign(onAir[i].begin(), onAir[i].end());
+			received[0] = block;
+			recovered += decoder.receive(1, received);
+		}
+		doNotOptimize(recovered);
+	});
+}
+
+static void benchPhysical(Microbench& bench)
+{
+	VirtualClock clock;
+	SimWorld world(1, [clock]() { return clock.micros(); });
+	LoRaSimPhysicalLayer physicalLayer(world, 868e6, 250e3, 7);
+
+	size_t size = 0;
+	bench.run("LoRaSimPhysicalLayer::calculateAirtime", [&]() {
+		doNotOptimize(physicalLayer.calculateAirtime(size));
+		size = (size + 1) & 0xFF;
+	});
+}
+
+static void benchChannel(Microbench& bench, size_t receivers)
+{
+	uint64_t time = 0;
+	RadioChannel channel([&time]() { return time; }, 1);
+	std::vector<int> radios(receivers + 1);
+	for (auto& radio : radios){
+		channel.registerReceiver(&radio, [](const std::vector<uint8_t>& data, const RadioReception&) { doNotOptimize(data.data()); });
+	}
+	const std::vector<uint8_t> data(48, 0xAB);
+
+	// each packet has to be resolved and pruned or the channel grows without bound, so this is the full life of a
+	// packet on air: transmit, then the update that delivers it
+	bench.run("RadioChannel::transmitPacket + update (" + std::to_string(receivers) + " receivers)", [&]() {
+		channel.transmitPacket(data, 1000, &radios[0]);
+		time += 1000;
+		channel.update();
+	});
+}
+
+int main(int argc, char* argv[])
+{
+	std::string format = "table";
+	uint64_t targetTime = 200000;
+	for (int i = 1; i + 1 < argc; i += 2){
+		const std::string name = argv[i];
+		if (name == "--format"){
+			format = argv[i + 1];
+		}
+		else if (name == "--time"){
+			targetTime = std::stoull(argv[i + 1]);
+		}
+		else{
+			std::cerr << "unexpected argument " << name << std::endl;
+			return 1;
+		}
+	}
+
+	Microbench bench([]() { return allocationCount.load(std::memory_order_relaxed); }, targetTime);
+	benchTdma(bench);
+	benchTimeout(bench);
+	benchFec(bench, 4, 2, 64);
+	benchFec(bench, 16, 4, 64);
+	benchPhysical(bench);
+	benchChannel(bench, 8);
+	benchChannel(bench, 64);
+
+	if (format == "csv"){
+		std::cout << "name,iterations,ns_per_op,allocs_per_op,cycles_per_op\n";
+		for (const auto& result : bench.getResults()){
+			std::cout << "\"" << result.name << "\"," << result.iterations << "," << result.nsPerOp << "," << result.allocsPerOp
+				<< "," << result.cyclesPerOp << "\n";
+		}
+		return 0;
+	}
+
+	std::cout << std::left << std::setw(64) << "benchmark" << std::right << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op";
+#if defined(ESP32)
+	std::cout << std::setw(12) << "cycles/op";
+#endif
+	std::cout << std::endl << std::fixed;
+	for (const auto& result : bench.getResults()){
+		std::cout << std::left << std::setw(64) << result.name << std::right << std::setprecision(1) << std::setw(12) << result.nsPerOp
+			<< std::setprecision(2) << std::setw(12) << result.allocsPerOp;
+#if defined(ESP32)
+		std::cout << std::setprecision(0) << std::setw(12) << result.cyclesPerOp;
+#endif
+		std::cout << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/clock.h>
+
+#if defined(ESP32)
+#include <xtensa/hal.h>
+#endif
+
+/**
+ * @brief Keep a value alive so the compiler can't drop the work that produced it
+ */
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct MicrobenchResult
+{
+	std::string name;
+	uint64_t iterations;
+	double nsPerOp;
+	double allocsPerOp;
+	double cyclesPerOp;		// cpu cycle counter, only on the esp32, 0 elsewhere
+};
+
+/**
+ * @brief Minimal timing loop. Each benchmark is warmed up and then run for enough iterations to fill the target
+ * time, allocations are counted through whatever the caller hooked into operator new.
+ */
+class Microbench
+{
+	public:
+		using AllocationCounter = std::function<uint64_t()>;
+
+		/**
+		 * @param allocations running total of heap allocations made by this process
+		 * @param targetTime us each benchmark runs for
+		 */
+		Microbench(AllocationCounter allocations, uint64_t targetTime = 200000):
+			m_allocations(std::move(allocations)),
+			m_targetTime(targetTime)
+		{}
+
+		template <typename Op>
+		const MicrobenchResult& run(const std::string& name, Op&& op)
+		{
+			// grow the batch until it takes a measurable slice of the target, then size the real run from it
+			uint64_t iterations = 1;
+			uint64_t probeTime = 0;
+			while (iterations < (uint64_t(1) << 30)){
+				probeTime = batch(op, iterations);
+				if (probeTime >= m_targetTime / 20){
+					break;
+				}
+				iterations *= 2;
+			}
+			iterations = std::max<uint64_t>(1, iterations * m_targetTime / std::max<uint64_t>(probeTime, 1));
+
+			const uint64_t allocationsBefore = m_allocations();
+#if defined(ESP32)
+			const uint32_t cyclesBefore = xthal_get_ccount();
+#endif
+			const uint64_t elapsed = batch(op, iterations);
+#if defined(ESP32)
+			// the counter wraps every ~18s at 240MHz, plenty for a 0.2s run
+			const uint32_t cycles = xthal_get_ccount() - cyclesBefore;
+#else
+			const uint32_t cycles = 0;
+#endif
+			const uint64_t allocations = m_allocations() - allocationsBefore;
+
+			MicrobenchResult result;
+			result.name = name;
+			result.iterations = iterations;
+			result.nsPerOp = elapsed * 1000.0 / iterations;
+			result.allocsPerOp = static_cast<double>(allocations) / iterations;
+			result.cyclesPerOp = static_cast<double>(cycles) / iterations;
+			m_results.push_back(result);
+			return m_results.back();
+		}
+
+		const std::vector<MicrobenchResult>& getResults() const {return m_results;}
+
+	private:
+		template <typename Op>
+		uint64_t batch(Op& op, uint64_t iterations)
+		{
+			const uint64_t start = m_clock.micros();
+			for (uint64_t i = 0; i < iterations; ++i){
+				op();
+			}
+			return m_clock.micros() - start;
+		}
+
+		AllocationCounter m_allocations;
+		const uint64_t m_targetTime;
+		PlatformClock m_clock;
+		std::vector<MicrobenchResult> m_results;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+// Minimal stand-in for the arduino core so hardware drivers can be built and exercised on linux
+
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <array>
+
+#define INPUT (0x01)
+#define OUTPUT (0x03)
+
+inline void delay(uint32_t ms)
+{
+	std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// pins start unconfigured, reads from a pin that was never made an input are counted so tests can catch them
+inline std::array<uint8_t, 256> mockPinModes{};
+inline uint32_t mockUnconfiguredReads = 0;
+
+inline void pinMode(uint8_t pin, uint8_t mode)
+{
+	mockPinModes[pin] = mode;
+}
+
+// pin levels are provided by whichever mock owns the pin, unclaimed pins read low
+inline std::function<int(uint8_t)> mockDigitalRead;
+
+inline int digitalRead(uint8_t pin)
+{
+	if (mockPinModes[pin] != INPUT)
+		++mockUnconfiguredReads;
+	return (mockDigitalRead ? mockDigitalRead(pin) : 0);
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+// Stand-in for the subset of RadioLib used by the SX1280 driver. The radio is modelled as a simple state
+// machine, tests drive interrupts explicitly through the simulate* hooks so driver behaviour is deterministic.
+
+#include "Arduino.h"
+#include "SPI.h"
+
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#define RADIOLIB_ERR_NONE (0)
+#define RADIOLIB_ERR_UNKNOWN (-1)
+#define RADIOLIB_ERR_CHIP_NOT_FOUND (-2)
+#define RADIOLIB_ERR_PACKET_TOO_LONG (-4)
+#define RADIOLIB_ERR_TX_TIMEOUT (-5)
+#define RADIOLIB_ERR_CRC_MISMATCH (-7)
+#define RADIOLIB_ERR_INVALID_BANDWIDTH (-8)
+#define RADIOLIB_ERR_INVALID_SPREADING_FACTOR (-9)
+#define RADIOLIB_ERR_INVALID_CODING_RATE (-10)
+#define RADIOLIB_ERR_INVALID_FREQUENCY (-12)
+#define RADIOLIB_ERR_INVALID_OUTPUT_POWER (-13)
+#define RADIOLIB_ERR_INVALID_PREAMBLE_LENGTH (-18)
+#define RADIOLIB_ERR_INVALID_CRC_CONFIGURATION (-100)
+
+class Module
+{
+	public:
+		Module(int cs, int irq, int rst, int gpio, SPIClass&):
+			cs(cs), irq(irq), rst(rst), gpio(gpio)
+		{}
+
+		int cs;
+		int irq;
+		int rst;
+		int gpio;
+};
+
+class SX1280
+{
+	public:
+		enum class MockState : uint8_t
+		{
+			STANDBY,
+			RX,
+			TX
+		};
+
+		struct Frame
+		{
+			std::vector<uint8_t> data;
+		};
+
+		SX1280(Module* mod):
+			m_module(mod)
+		{
+			lastInstance = this;
+			holdBusy(powerOnBusyTime);
+			mockDigitalRead = [this](uint8_t pin) {
+				return (pin == m_module->gpio && std::chrono::steady_clock::now() < m_busyUntil) ? 1 : 0;
+			};
+		}
+
+		~SX1280()
+		{
+			if (lastInstance == this)
+			{
+				lastInstance = nullptr;
+				mockDigitalRead = nullptr;
+			}
+		}
+
+		int16_t begin()
+		{
+			++beginCalls;
+			state = MockState::STANDBY;
+			holdBusy(resetBusyTime);
+			return (beginResult);
+		}
+
+		int16_t standby() { state = MockState::STANDBY; return (RADIOLIB_ERR_NONE); }
+
+		void setDio1Action(void (*func)(void)) { m_dio1Action = func; }
+		void setPacketReceivedAction(void (*func)(void)) { m_dio1Action = func; }
+		void setPacketSentAction(void (*func)(void)) { m_dio1Action = func; }
+
+		int16_t setFrequency(float freq) { ++configWrites; frequency = freq; return (RADIOLIB_ERR_NONE); }
+		int16_t setBandwidth(float bw) { ++configWrites; bandwidth = bw; return (RADIOLIB_ERR_NONE); }
+		int16_t setSpreadingFactor(uint8_t sf)
+		{
+			++configWrites;
+			if (sf < 5 || sf > 12)
+				return (RADIOLIB_ERR_INVALID_SPREADING_FACTOR);
+			spreadingFactor = sf;
+			return (RADIOLIB_ERR_NONE);
+		}
+		int16_t setCodingRate(uint8_t cr) { ++configWrites; codingRate = cr; return (RADIOLIB_ERR_NONE); }
+		int16_t setSyncWord(uint8_t sw) { ++configWrites; syncWord = sw; return (RADIOLIB_ERR_NONE); }
+		int16_t setOutputPower(int8_t pwr) { ++configWrites; outputPower = pwr; return (RADIOLIB_ERR_NONE); }
+		int16_t setPreambleLength(uint32_t len) { ++configWrites; preambleLength = len; return (RADIOLIB_ERR_NONE); }
+		int16_t setCRC(uint8_t crc) { ++configWrites; crcEnabled = crc; return (RADIOLIB_ERR_NONE); }
+
+		int16_t transmit(const uint8_t* data, size_t len)
+		{
+			transmitted.push_back({std::vector<uint8_t>(data, data + len)});
+			delay(getTimeOnAir(len) / 1000);
+			return (RADIOLIB_ERR_NONE);
+		}
+
+		int16_t startTransmit(const uint8_t* data, size_t len)
+		{
+			if (len > 255)
+				return (RADIOLIB_ERR_PACKET_TOO_LONG);
+			++startTransmitCalls;
+			transmitted.push_back({std::vector<uint8_t>(data, data + len)});
+			state = MockState::TX;
+			return (RADIOLIB_ERR_NONE);
+		}
+
+		int16_t finishTransmit() { state = MockState::STANDBY; return (RADIOLIB_ERR_NONE); }
+
+		int16_t startReceive() { ++startReceiveCalls; state = MockState::RX; return (RADIOLIB_ERR_NONE); }
+
+		size_t getPacketLength() { return (m_fifo.size()); }
+
+		float getRSSI() { return (m_packetRssi); }
+		float getSNR() { return (m_packetSnr); }
+		double getFrequencyError() { return (m_packetFreqError); }
+
+		int16_t readData(uint8_t* data, size_t len)
+		{
+			state = MockState::STANDBY;
+			if (readDataResult != RADIOLIB_ERR_NONE)
+				return (readDataResult);
+			std::memcpy(data, m_fifo.data(), std::min(len, m_fifo.size()));
+			return (RADIOLIB_ERR_NONE);
+		}
+
+		uint32_t getTimeOnAir(size_t len)
+		{
+			// SX1280 datasheet time on air, returned in us like RadioLib
+			const uint8_t sf = spreadingFactor;
+			float coeff1 = (sf < 7) ? 6.25f : 4.25f;
+			int16_t coeff2 = (sf < 7) ? 4 * sf : 4 * sf + 8;
+			int16_t coeff3 = (sf < 11) ? 4 * sf : 4 * (sf - 2);
+			int16_t payloadBits = static_cast<int16_t>(8 * len + (crcEnabled ? 16 : 0) - coeff2 + 20);
+			float symbols = preambleLength + coeff1 + 8.0f + std::ceil(static_cast<float>(std::max<int16_t>(payloadBits, 0)) / coeff3) * codingRate;
+			return (static_cast<uint32_t>((static_cast<float>(1 << sf) / bandwidth) * symbols * 1000.0f));
+		}
+
+		// test hooks
+
+		/**
+		 * @brief Completes the transmission currently on air and fires dio1
+		 */
+		bool simulateTransmitDone()
+		{
+			if (state != MockState::TX)
+				return (false);
+			state = MockState::STANDBY;
+			fireDio1();
+			return (true);
+		}
+
+		/**
+		 * @brief Places a frame in the radio fifo and fires dio1 if the radio is listening. A frame arriving
+		 * while the previous one is still in the fifo overwrites it, like the real chip.
+		 */
+		bool simulateReceive(std::vector<uint8_t> data, float rssi = -60.0f, float snr = 10.0f, double freqError = 0.0)
+		{
+			if (state != MockState::RX)
+			{
+				++framesMissed;
+				return (false);
+			}
+			m_fifo = std::move(data);
+			m_packetRssi = rssi;
+			m_packetSnr = snr;
+			m_packetFreqError = freqError;
+			fireDio1();
+			return (true);
+		}
+
+		/**
+		 * @brief Hold the busy line high for the given time, like the chip does during calibration
+		 */
+		void holdBusy(std::chrono::microseconds duration)
+		{
+			m_busyUntil = std::chrono::steady_clock::now() + duration;
+		}
+
+		static SX1280* lastInstance;
+
+		std::chrono::microseconds powerOnBusyTime{3000};
+		std::chrono::microseconds resetBusyTime{1500};
+
+		MockState state = MockState::STANDBY;
+		std::vector<Frame> transmitted;
+		int16_t beginResult = RADIOLIB_ERR_NONE;
+		int16_t readDataResult = RADIOLIB_ERR_NONE;
+		uint32_t beginCalls = 0;
+		uint32_t configWrites = 0;
+		uint32_t startTransmitCalls = 0;
+		uint32_t startReceiveCalls = 0;
+		uint32_t framesMissed = 0;
+
+		float frequency = 2400.0;
+		float bandwidth = 812.5;
+		uint8_t spreadingFactor = 9;
+		uint8_t codingRate = 7;
+		uint8_t syncWord = 0x12;
+		int8_t outputPower = 10;
+		uint32_t preambleLength = 12;
+		bool crcEnabled = true;
+
+	private:
+		void fireDio1()
+		{
+			if (m_dio1Action != nullptr)
+				m_dio1Action();
+		}
+
+		Module* m_module;
+		void (*m_dio1Action)(void) = nullptr;
+		std::chrono::steady_clock::time_point m_busyUntil;
+		std::vector<uint8_t> m_fifo;
+		float m_packetRssi = 0;
+		float m_packetSnr = 0;
+		double m_packetFreqError = 0;
+};
+
+inline SX1280* SX1280::lastInstance = nullptr;
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "Arduino.h"
+
+class SPIClass
+{
+	public:
+		SPIClass() = default;
+		SPIClass(uint8_t){};
+};
@@ -0,0 +1,420 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <utility>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <cmath>
+#include <bitset>
+#include <algorithm>
+
+// librrp
+#include <librrp/physical/radio_channel.h>
+#include <librrp/physical/capture.h>
+
+#include "../Check/check.h"
+
+/**
+ * @brief A channel on a manually stepped clock with a handful of radios and a settable path loss per link
+ */
+struct TestMedium
+{
+	struct Radio
+	{
+		std::vector<std::vector<uint8_t>> received;
+		std::vector<RadioReception> receptions;
+	};
+
+	TestMedium():
+		channel([this]() { return time; })
+	{
+		channel.setPathLossModel([this](void* sender, void* receiver) {
+			auto it = pathLoss.find({sender, receiver});
+			return (it != pathLoss.end()) ? it->second : 83.0f;
+		});
+	}
+
+	void add(Radio& radio, uint8_t spreadingFactor = 7)
+	{
+		channel.registerReceiver(&radio, [&radio](const std::vector<uint8_t>& data, const RadioReception& reception) {
+			radio.received.push_back(data);
+			radio.receptions.push_back(reception);
+		}, spreadingFactor);
+	}
+
+	void setPathLoss(Radio& a, Radio& b, float loss)
+	{
+		pathLoss[{&a, &b}] = loss;
+		pathLoss[{&b, &a}] = loss;
+	}
+
+	void advance(uint64_t us)
+	{
+		time += us;
+		channel.update();
+	}
+
+	uint64_t time = 0;
+	std::map<std::pair<void*, void*>, float> pathLoss;
+	RadioChannel channel;
+};
+
+static void testDelivery()
+{
+	std::cout << "--- delivery ---" << std::endl;
+	TestMedium medium;
+	TestMedium::Radio a, b;
+	medium.add(a);
+	medium.add(b);
+
+	medium.channel.transmitPacket({1, 2, 3}, 1000, &a);
+	check(medium.channel.isBusy() && medium.channel.isTransmitting(&a), "channel busy while packet on air");
+	medium.advance(999);
+	check(b.received.empty(), "nothing delivered before the packet finishes");
+	medium.advance(1);
+	check(b.received.size() == 1 && b.received[0] == std::vector<uint8_t>{1, 2, 3}, "delivered once off air");
+	check(a.received.empty(), "sender doesn't hear itself");
+	check(b.receptions.size() == 1 && b.receptions[0].rssi == 13.0f - 83.0f, "rssi is tx power less path loss");
+	check(b.receptions.size() == 1 && b.receptions[0].snr == b.receptions[0].rssi + 105.0f, "snr against the noise floor");
+	check(!medium.channel.isBusy(), "channel idle after the packet");
+
+	const RadioChannelStats stats = medium.channel.getStats();
+	check(stats.transmissions == 1 && stats.delivered == 1 && stats.collisions == 0, "stats count the delivery");
+}
+
+static void testCapture()
+{
+	std::cout << "--- capture ---" << std::endl;
+	TestMedium medium;
+	TestMedium::Radio strong, weak, rx;
+	medium.add(strong);
+	medium.add(weak);
+	medium.add(rx);
+	medium.setPathLoss(strong, rx, 70);
+	medium.setPathLoss(weak, rx, 90);
+
+	// weak starts first, strong lands on top 20dB hotter
+	medium.channel.transmitPacket({1}, 1000, &weak);
+	medium.advance(200);
+	medium.channel.transmitPacket({2}, 1000, &strong);
+	medium.advance(2000);
+
+	check(rx.received.size() == 1 && rx.received[0] == std::vector<uint8_t>{2}, "stronger packet captured");
+	check(rx.receptions.size() == 1 && rx.receptions[0].snr < rx.receptions[0].rssi + 105.0f - 1.0f, "interference shows up in the snr");
+
+	const RadioChannelStats stats = medium.channel.getStats();
+	check(stats.captured == 1, "capture counted");
+	check(stats.collisions >= 1, "weaker packet lost to collision");
+}
+
+static void testCollision()
+{
+	std::cout << "--- equal power collision ---" << std::endl;
+	TestMedium medium;
+	TestMedium::Radio a, b, rx;
+	medium.add(a);
+	medium.add(b);
+	medium.add(rx);
+
+	medium.channel.transmitPacket({1}, 1000, &a);
+	medium.advance(999);
+	medium.channel.transmitPacket({2}, 1000, &b);	// overlaps by a single microsecond
+	medium.advance(2000);
+	check(rx.received.empty(), "partially overlapping equal power packets both lost at a third node");
+	check(medium.channel.getStats().collisions >= 2, "both losses counted");
+
+	medium.channel.resetStats();
+	medium.channel.transmitPacket({3}, 1000, &a);
+	medium.advance(1000);
+	medium.channel.transmitPacket({4}, 1000, &b);	// back to back, no overlap
+	medium.advance(1000);
+	check(rx.received.size() == 2, "back to back packets both delivered");
+	check(medium.channel.getStats().collisions == 0, "no collisions counted for back to back packets");
+}
+
+static void testSpreadingFactors()
+{
+	std::cout << "--- spreading factor orthogonality ---" << std::endl;
+	TestMedium medium;
+	TestMedium::Radio tx7, tx9, rx7, rx9;
+	medium.add(tx7, 7);
+	medium.add(tx9, 9);
+	medium.add(rx7, 7);
+	medium.add(rx9, 9);
+
+	medium.channel.transmitPacket({7}, 1000, &tx7, 7);
+	medium.channel.transmitPacket({9}, 1000, &tx9, 9);
+	medium.advance(1000);
+	check(rx7.received.size() == 1 && rx7.received[0] == std::vector<uint8_t>{7}, "sf7 receiver gets sf7 packet through concurrent sf9");
+	check(rx9.received.size() == 1 && rx9.received[0] == std::vector<uint8_t>{9}, "sf9 receiver gets sf9 packet through concurrent sf7");
+
+	// an interferer far hotter than the rejection can still kill a packet on another sf
+	medium.setPathLoss(tx9, rx7, 60);
+	medium.channel.transmitPacket({7}, 1000, &tx7, 7);
+	medium.channel.transmitPacket({9}, 1000, &tx9, 9);
+	medium.advance(1000);
+	check(rx7.received.size() == 1, "overwhelming inter sf interference still destroys the packet");
+	check(medium.channel.getStats().interSfCollisions == 1, "inter sf loss counted");
+
+	check(RadioChannel::sirThreshold(7, 7, 6) == 6, "same sf uses the capture threshold");
+	check(RadioChannel::sirThreshold(12, 7, 6) < RadioChannel::sirThreshold(7, 12, 6), "higher sf rejects more");
+}
+
+static void testHalfDuplexAndSensitivity()
+{
+	std::cout << "--- half duplex and sensitivity ---" << std::endl;
+	TestMedium medium;
+	TestMedium::Radio a, b, far;
+	medium.add(a);
+	medium.add(b);
+	medium.add(far);
+	medium.setPathLoss(a, far, 130);
+	medium.setPathLoss(b, far, 130);
+
+	medium.channel.transmitPacket({1}, 1000, &a);
+	medium.advance(500);
+	medium.channel.transmitPacket({2}, 100, &b);
+	medium.advance(1000);
+	check(b.received.empty(), "no reception while transmitting");
+	check(a.received.empty(), "packet sent during our own transmission is missed too");
+	check(far.received.empty(), "packets below sensitivity are not delivered");
+
+	const RadioChannelStats stats = medium.channel.getStats();
+	check(stats.halfDuplexLosses == 2, "half duplex losses counted");
+	check(stats.belowSensitivity == 2, "sensitivity losses counted");
+}
+
+static void testLateListener()
+{
+	std::cout << "--- late listener ---" << std::endl;
+	TestMedium medium;
+	TestMedium::Radio a, late;
+	medium.add(a);
+
+	medium.channel.transmitPacket({1}, 1000, &a);
+	medium.advance(500);
+	medium.add(late);
+	medium.advance(1000);
+	check(late.received.empty(), "a radio that joins mid packet doesn't receive it");
+
+	medium.channel.unregisterReceiver(&late);
+	medium.channel.transmitPacket({2}, 1000, &a);
+	medium.advance(1000);
+	check(late.received.empty(), "unregistered radio receives nothing");
+}
+
+/**
+ * @brief Send count 10 byte packets a to b, one every interval, return which got through
+ */
+static std::vector<bool> sendSeries(TestMedium& medium, TestMedium::Radio& a, TestMedium::Radio& b, size_t count, uint64_t interval = 10000)
+{
+	std::vector<bool> delivered;
+	for (size_t i = 0; i < count; ++i){
+		const size_t before = b.received.size();
+		medium.channel.transmitPacket(std::vector<uint8_t>(10, 0x55), 1000, &a);
+		medium.advance(interval);
+		delivered.push_back(b.received.size() > before);
+	}
+	return delivered;
+}
+
+static float lossRate(const std::vector<bool>& delivered)
+{
+	return static_cast<float>(std::count(delivered.begin(), delivered.end(), false)) / delivered.size();
+}
+
+// mean length of a run of consecutive losses
+static float meanBurst(const std::vector<bool>& delivered)
+{
+	size_t bursts = 0;
+	size_t lost = 0;
+	for (size_t i = 0; i < delivered.size(); ++i){
+		lost += delivered[i] ? 0 : 1;
+		bursts += (!delivered[i] && (i == 0 || delivered[i - 1])) ? 1 : 0;
+	}
+	return bursts ? static_cast<float>(lost) / bursts : 0;
+}
+
+static void testImpairments()
+{
+	std::cout << "--- impairments ---" << std::endl;
+	{
+		TestMedium medium;
+		TestMedium::Radio a, b;
+		medium.add(a);
+		medium.add(b);
+		RadioImpairment bernoulli;
+		bernoulli.lossModel = RadioLossModel::BERNOULLI;
+		bernoulli.lossProbability = 0.2f;
+		medium.channel.setImpairment(bernoulli);
+		const std::vector<bool> delivered = sendSeries(medium, a, b, 10000);
+		check(std::fabs(lossRate(delivered) - 0.2f) < 0.02f, "bernoulli loses its probability");
+		check(meanBurst(delivered) < 1.5f, "bernoulli losses are independent");
+		check(medium.channel.getStats().linkLosses == 10000 - b.received.size(), "link losses counted");
+
+		// same long run loss, lost in 500ms fades, packets every 10ms
+		medium.channel.setImpairment(RadioImpairment::burst(0.2f, 500e3f));
+		const std::vector<bool> bursty = sendSeries(medium, a, b, 20000);
+		check(std::fabs(lossRate(bursty) - 0.2f) < 0.06f, "gilbert elliott long run loss");
+		check(meanBurst(bursty) > 20.0f, "gilbert elliott losses come in bursts");
+		std::cout << "bernoulli burst = " << meanBurst(delivered) << ", gilbert elliott burst = " << meanBurst(bursty) << " packets" << std::endl;
+	}
+	{
+		TestMedium medium;
+		TestMedium::Radio a, b, c;
+		medium.add(a);
+		medium.add(b);
+		medium.add(c);
+		RadioImpairment outage;
+		outage.outages.push_back({100000, 50000, 200000});	// 50ms out of every 200ms from 100ms
+		medium.channel.setLinkImpairment(&a, &b, outage);
+		const std::vector<bool> delivered = sendSeries(medium, a, b, 100);	// sent at 0, 10ms, ...
+		bool matches = true;
+		for (size_t i = 0; i < delivered.size(); ++i){
+			const uint64_t start = i * 10000;
+			matches = matches && delivered[i] == !(start >= 100000 && (start - 100000) % 200000 < 50000);
+		}
+		check(matches, "scheduled outages repeat every period");
+		check(c.received.size() == 100, "other links unaffected");
+		medium.channel.transmitPacket({1}, 1000, &b);
+		medium.advance(2000);
+		check(a.received.size() == 1, "link impairment is one way");
+		check(medium.channel.getStats().outageLosses == 100 - b.received.size(), "outage losses counted");
+
+		medium.channel.clearLinkImpairment(&a, &b);
+		sendSeries(medium, a, b, 10);
+		check(medium.channel.getStats().outageLosses == 100 - (b.received.size() - 10), "cleared link back to normal");
+	}
+	{
+		TestMedium medium;
+		TestMedium::Radio a, b;
+		medium.add(a);
+		medium.add(b);
+		RadioImpairment noisy;
+		noisy.bitErrorRate = 1e-3f;
+		medium.channel.setImpairment(noisy);
+		const std::vector<uint8_t> frame(100, 0);
+		size_t flipped = 0;
+		size_t corrupted = 0;
+		for (size_t i = 0; i < 1000; ++i){
+			medium.channel.transmitPacket(frame, 1000, &a);
+			medium.advance(2000);
+			for (uint8_t byte : b.received.back()){
+				flipped += std::bitset<8>(byte).count();
+			}
+			corrupted += b.receptions.back().corrupted ? 1 : 0;
+		}
+		// 800 bits a frame at 1e-3: 0.8 errors per frame, 1 - e^-0.8 = 55% of frames hit
+		check(std::fabs(flipped / 1000.0f - 0.8f) < 0.1f, "bit errors at the set rate");
+		check(corrupted == medium.channel.getStats().corrupted && std::fabs(corrupted / 1000.0f - 0.55f) < 0.05f, "corrupted frames flagged");
+	}
+	{
+		TestMedium medium;
+		TestMedium::Radio a, b, gone;
+		medium.add(a);
+		medium.add(b);
+		medium.add(gone);
+		RadioImpairment jitter;
+		jitter.maxJitter = 5000;
+		medium.channel.setImpairment(jitter);
+		medium.channel.transmitPacket({0}, 1000, &a);
+		check(medium.channel.nextCompletion(&a) == 1000, "completion at the end of the packet");
+		medium.advance(1000);
+		check(b.received.empty() == (medium.channel.nextCompletion(&a) != UINT64_MAX), "completion covers a held back delivery");
+		medium.advance(5000);
+		check(b.received.size() == 1 && medium.channel.nextCompletion(&a) == UINT64_MAX, "held back delivery made");
+
+		uint64_t latest = 0;
+		bool inRange = true;
+		for (size_t i = 0; i < 200; ++i){
+			medium.channel.transmitPacket({static_cast<uint8_t>(i)}, 1000, &a);
+			const uint64_t end = medium.time + 1000;
+			const size_t before = b.received.size();
+			medium.advance(1000);
+			while (b.received.size() == before && medium.time < end + 10000){
+				medium.advance(100);
+			}
+			inRange = inRange && b.received.size() == before + 1 && medium.time - end <= 5000;
+			latest = std::max(latest, medium.time - end);
+			medium.advance(10000);
+		}
+		check(inRange, "deliveries held back at most the jitter");
+		check(latest > 4000 && medium.channel.getStats().jittered > 150, "deliveries jittered");
+		std::cout << "latest delivery " << latest << "us after the packet" << std::endl;
+
+		medium.channel.transmitPacket({1}, 1000, &a);
+		medium.advance(1000);
+		medium.channel.unregisterReceiver(&gone);
+		const size_t before = gone.received.size();
+		medium.advance(10000);
+		check(gone.received.size() == before, "held back delivery dropped when the receiver goes");
+	}
+}
+
+/**
+ * @brief Capture file round trip, the same collision as testCapture written out and read back
+ */
+static void testCaptureFile()
+{
+	std::cout << "--- capture file ---" << std::endl;
+	const std::string path = "radio_channel_test.rrpcap";
+	auto writer = std::make_shared<CaptureWriter>();
+	check(writer->open(path), "capture file created");
+
+	TestMedium medium;
+	TestMedium::Radio strong, weak, rx, other;
+	medium.add(strong);
+	medium.add(weak);
+	medium.add(rx);
+	medium.add(other, 9);
+	medium.setPathLoss(strong, rx, 70);
+	medium.setPathLoss(weak, rx, 90);
+	medium.channel.setCapture(writer, 3);
+
+	medium.channel.transmitPacket({1}, 1000, &weak);
+	medium.advance(200);
+	medium.channel.transmitPacket({2, 3}, 1000, &strong, 7, 10.0f);
+	medium.advance(2000);
+	check(writer->getRecordCount() == 2, "one record per transmission");
+	writer->close();
+
+	CaptureReader reader;
+	check(reader.open(path) && reader.getRecordCount() == 2, "capture file read back");
+
+	// nodes are numbered by first appearance: weak's packet resolves first, its receivers in registration order then weak
+	CaptureRecord record;
+	check(reader.next(record), "first record");
+	check(record.header.start == 0 && record.header.end == 1000 && record.header.channel == 3 && record.header.spreadingFactor == 7,
+		"timing, channel and sf recorded");
+	check(record.header.payloadSize == 1 && record.payload[0] == 1, "payload recorded");
+	check(record.receivers.size() == 3 && record.receivers[1].outcome == CaptureOutcome::COLLISION,
+		"weak packet lost to collision at rx");
+	check(record.receivers[2].outcome == CaptureOutcome::NOT_LISTENING, "receiver on another sf not listening");
+
+	check(reader.next(record), "second record");
+	const uint32_t rxId = record.receivers.size() == 3 ? record.receivers[1].receiver : UINT32_MAX;
+	check(record.header.payloadSize == 2 && record.payload[1] == 3 && record.header.txPower == 10.0f, "payload and tx power recorded");
+	check(rxId == 1 && record.header.sender == 0 && record.receivers[1].outcome == CaptureOutcome::CAPTURED && record.receivers[1].rssi == -60.0f,
+		"strong packet captured at rx");
+	check(record.receivers[0].outcome == CaptureOutcome::HALF_DUPLEX, "weak sender was transmitting");
+	check(!reader.next(record), "nothing after the last record");
+
+	reader.close();
+	std::remove(path.c_str());
+}
+
+int main()
+{
+	testDelivery();
+	testCapture();
+	testCollision();
+	testSpreadingFactors();
+	testHalfDuplexAndSensitivity();
+	testLateListener();
+	testCaptureFile();
+	testImpairments();
+
+	return checkSummary();
+}
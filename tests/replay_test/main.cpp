@@ -0,0 +1,192 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/capture.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/replay_physical_layer.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/datalink/turn_timeout.h>
+
+// librnp
+#include <librnp/rnp_networkmanager.h>
+#include <librnp/rnp_packet.h>
+
+#include "../Check/check.h"
+
+static constexpr float freq = 868e6;
+static constexpr float bw = 500e3;
+static constexpr uint8_t sf = 7;
+
+struct SimTdmaNode
+{
+	SimTdmaNode(SimWorld& world, VirtualClock& clock, uint8_t address, uint64_t seed):
+		physicalLayer(world, freq, bw, sf),
+		networkManager(address, NODETYPE::HUB, true),
+		radio(physicalLayer, networkManager, clock)
+	{
+		radio.setSeed(seed);
+		radio.setup();
+	}
+
+	LoRaSimPhysicalLayer physicalLayer;
+	RnpNetworkManager networkManager;
+	TDMARadio<LoRaSimPhysicalLayer, VirtualClock> radio;
+};
+
+/**
+ * @brief Capture a small TDMA network, then replay what one node heard into a fresh radio with the same address and
+ * seed. The replayed radio has to make exactly the same transmissions at exactly the same times.
+ */
+static void testCaptureReplay()
+{
+	std::cout << "--- tdma capture replay ---" << std::endl;
+	const std::string path = "replay_test.rrpcap";
+	constexpr uint64_t duration = 30000000;		// us
+
+	std::vector<ReplayTransmission> recorded;
+	uint32_t replayedId;
+	bool recordedJoined;
+	{
+		VirtualClock clock;
+		SimWorld world(7, [clock]() { return clock.micros(); });
+		auto capture = std::make_shared<CaptureWriter>();
+		check(capture->open(path), "capture file created");
+		world.getChannelManager().setCapture(capture);
+
+		std::vector<std::unique_ptr<SimTdmaNode>> nodes;
+		for (uint8_t i = 0; i < 3; ++i){
+			nodes.push_back(std::make_unique<SimTdmaNode>(world, clock, 101 + i, 100 + i));
+		}
+		while (clock.micros() < duration){
+			uint64_t next = duration;
+			for (auto& node : nodes){
+				node->radio.update();
+			}
+			for (auto& node : nodes){
+				next = std::min({next, node->radio.nextDeadline(), node->physicalLayer.nextEventTime()});
+			}
+			clock.advanceTo(next);
+		}
+
+		SimTdmaNode& replayed = *nodes[1];
+		replayedId = capture->nodeId(&replayed.physicalLayer);
+		recordedJoined = static_cast<const TDMARadioInterfaceInfo*>(replayed.radio.getInfo())->joined;
+		capture->close();
+
+		CaptureReader reader;
+		reader.open(path);
+		CaptureRecord record;
+		while (reader.next(record)){
+			if (record.header.sender == replayedId){
+				recorded.push_back({record.header.start, std::vector<uint8_t>(record.payload, record.payload + record.header.payloadSize)});
+			}
+		}
+	}
+	check(recordedJoined && recorded.size() > 2, "recorded node joined and transmitted");
+
+	std::vector<ReplayFrame> frames;
+	check(ReplayPhysicalLayer::loadCapture(path, replayedId, frames) && !frames.empty(), "frames heard by the node loaded");
+	std::remove(path.c_str());
+
+	auto replayOnce = [&frames, duration](std::vector<ReplayTransmission>& transmissions, size_t& framesRead) {
+		VirtualClock clock;
+		ReplayPhysicalLayer physicalLayer(frames, [clock]() { return clock.micros(); }, freq, bw, sf);
+		RnpNetworkManager networkManager(102, NODETYPE::HUB, true);
+		TDMARadio<ReplayPhysicalLayer, VirtualClock> radio(physicalLayer, networkManager, clock);
+		radio.setSeed(101);
+		radio.setup();
+		replay(radio, physicalLayer, clock, duration);
+		transmissions = physicalLayer.getTransmissions();
+		framesRead = physicalLayer.getFramesRead();
+		return static_cast<const TDMARadioInterfaceInfo*>(radio.getInfo())->joined;
+	};
+
+	std::vector<ReplayTransmission> replayed;
+	size_t framesRead = 0;
+	const bool joined = replayOnce(replayed, framesRead);
+	check(framesRead == frames.size(), "every frame delivered");
+	check(joined, "replayed radio joins");
+
+	bool identical = replayed.size() == recorded.size();
+	for (size_t i = 0; identical && i < replayed.size(); ++i){
+		identical = replayed[i].time == recorded[i].time && replayed[i].data == recorded[i].data;
+	}
+	check(identical, "replay makes the recorded transmissions at the recorded times");
+
+	std::vector<ReplayTransmission> again;
+	replayOnce(again, framesRead);
+	identical = again.size() == replayed.size();
+	for (size_t i = 0; identical && i < again.size(); ++i){
+		identical = again[i].time == replayed[i].time && again[i].data == replayed[i].data;
+	}
+	check(identical, "replay is deterministic");
+}
+
+// rnp header alone, as firmware from before the timeout link header sent it
+static std::vector<uint8_t> rnpFrame(uint8_t source, uint16_t uid)
+{
+	RnpHeader header;
+	header.source = source;
+	header.destination = 50;
+	header.uid = uid;
+	std::vector<uint8_t> frame;
+	header.serialize(frame);
+	return frame;
+}
+
+static std::vector<uint8_t> timeoutFrame(uint8_t sender, uint8_t sequence, uint8_t source, uint16_t uid)
+{
+	std::vector<uint8_t> frame = {1, sender, sequence};
+	const std::vector<uint8_t> rnp = rnpFrame(source, uid);
+	frame.insert(frame.end(), rnp.begin(), rnp.end());
+	return frame;
+}
+
+/**
+ * @brief Hand written field sequence into the timeout datalink: malformed frames are dropped without disturbing the
+ * link statistics of the frames around them, which are kept per link sender rather than per rnp source
+ */
+static void testTimeoutMalformed()
+{
+	std::cout << "--- timeout malformed frames ---" << std::endl;
+	std::vector<ReplayFrame> frames = {
+		{1000, timeoutFrame(5, 0, 5, 1), -60, 8, 0},
+		{2000, {1, 5, 1}, -60, 8, 0},					// link header only, no rnp header
+		{3000, {1, 5, 2, 0x12, 0x34, 0x56}, -60, 8, 0},	// bad rnp start byte
+		{4000, timeoutFrame(5, 3, 9, 2), -70, 6, 0},	// forwarded by 5 for 9
+		{5000, rnpFrame(7, 3), -60, 8, 0},				// older firmware, no link header
+	};
+
+	VirtualClock clock;
+	ReplayPhysicalLayer physicalLayer(frames, [clock]() { return clock.micros(); }, freq, bw, sf);
+	RnpNetworkManager networkManager(50, NODETYPE::HUB, true);
+	TimeoutRadio<ReplayPhysicalLayer, VirtualClock> radio(physicalLayer, networkManager, clock);
+	radio.setup();
+	networkManager.addInterface(&radio);
+
+	replay(radio, physicalLayer, clock, 6000);
+	const auto* info = static_cast<const RadioInterfaceInfo*>(radio.getInfo());
+	check(physicalLayer.finished() && clock.micros() == 6000, "replay ran to the end");
+	check(info->rxCount == 2, "only the well formed frames are received");
+
+	LinkStats stats{};
+	check(info->linkStats.get(5, stats) && stats.rxCount == 2 && stats.lostCount == 2, "sequence gap over the dropped frames counted as loss");
+	check(stats.packetRssi == -70.0f, "link quality taken from the replayed frame");
+	check(!info->linkStats.get(9, stats), "forwarded frame kept under the node that sent it");
+	check(info->rxCount == 2 && !info->linkStats.get(0xAF, stats), "frame without a link header refused");
+}
+
+int main()
+{
+	testCaptureReplay();
+	testTimeoutMalformed();
+
+	return checkSummary();
+}
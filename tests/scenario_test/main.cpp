@@ -0,0 +1,77 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+
+#include "../Scenario/scenario.h"
+
+/**
+ * Runs scenario files (see tests/Scenario/scenario.h) and checks their expectations. Directories are searched for
+ * *.scn files, run in name order. The scenarios in ./scenarios cover the hand run two node tests from Tests.txt.
+ *
+ * usage: librrp_scenario_test [scenario file or directory...]
+ */
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> arguments(argv + 1, argv + argc);
+	if (arguments.empty()){
+		arguments.push_back("scenarios");
+	}
+
+	std::vector<std::string> paths;
+	for (const auto& argument : arguments){
+		if (std::filesystem::is_directory(argument)){
+			std::vector<std::string> found;
+			for (const auto& entry : std::filesystem::directory_iterator(argument)){
+				if (entry.path().extension() == ".scn"){
+					found.push_back(entry.path().string());
+				}
+			}
+			std::sort(found.begin(), found.end());
+			paths.insert(paths.end(), found.begin(), found.end());
+		}
+		else {
+			paths.push_back(argument);
+		}
+	}
+	if (paths.empty()){
+		std::cerr << "no scenarios found" << std::endl;
+		return 1;
+	}
+
+	int failures = 0;
+	std::vector<std::string> failed;
+	for (const auto& path : paths){
+		Scenario scenario;
+		std::string error;
+		if (!Scenario::load(path, scenario, error)){
+			std::cerr << error << std::endl;
+			++failures;
+			failed.push_back(path);
+			continue;
+		}
+
+		const auto start = std::chrono::steady_clock::now();
+		ScenarioRunner runner(scenario);
+		const ScenarioResult result = runner.run();
+		const double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		std::cout << "--- " << result.name << " (" << scenario.duration / 1e6 << "s simulated in " << wall << "s) ---" << std::endl;
+		for (const auto& check : result.checks){
+			std::cout << (check.passed ? "[PASS] " : "[FAIL] ") << check.description << " (" << check.measured << ")" << std::endl;
+			failures += check.passed ? 0 : 1;
+		}
+		if (!result.passed()){
+			failed.push_back(result.name);
+		}
+	}
+
+	for (const auto& name : failed){
+		std::cout << "failed: " << name << std::endl;
+	}
+	std::cout << (failures ? "FAILED: " + std::to_string(failures) : std::string("ALL PASSED")) << std::endl;
+	return (failures ? 1 : 0);
+}
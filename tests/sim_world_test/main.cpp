@@ -0,0 +1,467 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <array>
+#include <sstream>
+#include <cmath>
+
+// librrp
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/datalink/slot_tracer.h>
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
+
+// librnp
+#include <librnp/rnp_networkmanager.h>
+
+#include "../Traffic/traffic_packet.h"
+#include "../Check/check.h"
+
+static std::unique_ptr<LoRaSimPhysicalLayer> makeRadio(SimWorld& world)
+{
+	auto radio = std::make_unique<LoRaSimPhysicalLayer>(world, 868e6, 250e3, 7);
+	radio->setup();
+	radio->setChannel(0);
+	return radio;
+}
+
+static void testIsolation()
+{
+	std::cout << "--- isolation ---" << std::endl;
+	uint64_t timeA = 0;
+	uint64_t timeB = 0;
+	SimWorld worldA(1, [&timeA]() { return timeA; });
+	SimWorld worldB(2, [&timeB]() { return timeB; });
+
+	auto senderA = makeRadio(worldA);
+	auto receiverA = makeRadio(worldA);
+	auto receiverB = makeRadio(worldB);
+
+	check(worldA.getChannel(0) != worldB.getChannel(0), "same channel id is a different channel in each world");
+
+	senderA->sendPacket({1, 2, 3});
+	check(senderA->isBusy(), "sender busy on world time");
+	timeA += 1000000;
+	timeB += 1000000;
+
+	std::vector<uint8_t> data;
+	check(receiverA->readPacket(data) == 3, "packet delivered within its world");
+	check(receiverB->readPacket(data) == 0, "packet doesn't leak into another world");
+
+	worldA.registerAddress(101);
+	check(worldA.getAddresses().size() == 1 && worldB.getAddresses().empty(), "addresses are per world");
+}
+
+static void testConcurrentLookup()
+{
+	std::cout << "--- concurrent channel lookup ---" << std::endl;
+	SimWorld world;
+	constexpr size_t numThreads = 8;
+	std::vector<std::shared_ptr<RadioChannel>> found(numThreads);
+	std::atomic<bool> go{false};
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < numThreads; ++i){
+		threads.emplace_back([&, i]() {
+			while (!go.load()){}
+			for (int channel = 0; channel < 100; ++channel){
+				auto result = world.getChannel(channel);
+				if (channel == 42){
+					found[i] = result;
+				}
+			}
+		});
+	}
+	go.store(true);
+	for (auto& thread : threads){
+		thread.join();
+	}
+
+	bool same = true;
+	for (const auto& channel : found){
+		same &= (channel && channel == found[0]);
+	}
+	check(same, "racing lookups agree on a single channel");
+}
+
+static void testSeeds()
+{
+	std::cout << "--- seeds ---" << std::endl;
+	SimWorld a(1234);
+	SimWorld b(1234);
+	SimWorld c(1235);
+	bool equal = true;
+	bool differs = false;
+	for (int i = 0; i < 16; ++i){
+		const uint64_t seedA = a.nextSeed();
+		equal &= (seedA == b.nextSeed());
+		differs |= (seedA != c.nextSeed());
+	}
+	check(equal, "same root seed gives the same seed sequence");
+	check(differs, "neighbouring root seeds give different sequences");
+
+	// fading and frequency error draw from nextNormal(), so it has to be a unit normal and finite for every draw
+	Xoshiro256 rng(1234);
+	double sum = 0.0;
+	double sumSquares = 0.0;
+	bool finite = true;
+	constexpr int draws = 100000;
+	for (int i = 0; i < draws; ++i){
+		const float x = rng.nextNormal();
+		finite &= std::isfinite(x);
+		sum += x;
+		sumSquares += static_cast<double>(x) * x;
+	}
+	const double mean = sum / draws;
+	const double variance = sumSquares / draws - mean * mean;
+	check(finite && std::abs(mean) < 0.02 && std::abs(variance - 1.0) < 0.03, "nextNormal is a unit normal");
+}
+
+/**
+ * @brief Round robin exchange between a few radios on a private virtual clock, returns packets received
+ */
+static size_t runWorld(uint64_t seed, size_t numRadios, size_t rounds)
+{
+	uint64_t time = 0;
+	SimWorld world(seed, [&time]() { return time; });
+	std::vector<std::unique_ptr<LoRaSimPhysicalLayer>> radios;
+	for (size_t i = 0; i < numRadios; ++i){
+		radios.push_back(makeRadio(world));
+	}
+
+	size_t received = 0;
+	std::vector<uint8_t> data;
+	for (size_t round = 0; round < rounds; ++round){
+		for (auto& sender : radios){
+			sender->sendPacket({static_cast<uint8_t>(round)});
+			time += 100000;
+			for (auto& radio : radios){
+				while (radio->readPacket(data)){
+					++received;
+				}
+			}
+		}
+	}
+	return received;
+}
+
+static void testParallelWorlds()
+{
+	std::cout << "--- parallel worlds ---" << std::endl;
+	constexpr size_t numWorlds = 4;
+	constexpr size_t numRadios = 5;
+	constexpr size_t rounds = 200;
+
+	std::vector<size_t> received(numWorlds, 0);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < numWorlds; ++i){
+		threads.emplace_back([&received, i]() { received[i] = runWorld(i, numRadios, rounds); });
+	}
+	for (auto& thread : threads){
+		thread.join();
+	}
+
+	bool complete = true;
+	for (size_t count : received){
+		complete &= (count == rounds * numRadios * (numRadios - 1));
+	}
+	check(complete, "every world delivers all of its own traffic and nothing else");
+}
+
+/**
+ * @brief A few drifting TDMA nodes on a lossy fading channel, stepped on a virtual clock. Returns everything that
+ * depends on a random draw: join times, channel outcome counters and per node rx counts.
+ */
+static std::vector<uint64_t> traceTdma(uint64_t seed)
+{
+	using Radio = TDMARadio<LoRaSimPhysicalLayer, DriftingClock>;
+	constexpr size_t numNodes = 4;
+
+	VirtualClock clock;
+	SimWorld world(seed, [clock]() { return clock.micros(); });
+	RadioChannelConfig config;
+	config.fadingStdDev = 4;
+	world.getChannel(0)->setConfig(config);
+	world.getChannel(0)->setPacketDropProbability(0.1);
+	Xoshiro256 rng(world.nextSeed());
+
+	std::vector<std::unique_ptr<LoRaSimPhysicalLayer>> physicalLayers;
+	std::vector<std::unique_ptr<RnpNetworkManager>> networkManagers;
+	std::vector<std::unique_ptr<Radio>> radios;
+	for (size_t i = 0; i < numNodes; ++i){
+		physicalLayers.push_back(std::make_unique<LoRaSimPhysicalLayer>(world, 868e6, 250e3, 7));
+		networkManagers.push_back(std::make_unique<RnpNetworkManager>(static_cast<uint8_t>(101 + i), NODETYPE::HUB, true));
+		const double driftPPM = (rng.nextFloat() * 2.0f - 1.0f) * 20.0f;
+		radios.push_back(std::make_unique<Radio>(*physicalLayers.back(), *networkManagers.back(), DriftingClock(world.getTimeSource(), driftPPM)));
+		radios.back()->setSeed(world.nextSeed());
+		radios.back()->setup();
+	}
+
+	std::vector<uint64_t> trace(numNodes, 0);
+	while (clock.micros() < 30000000){
+		for (size_t i = 0; i < numNodes; ++i){
+			radios[i]->update();
+			if (!trace[i] && static_cast<const TDMARadioInterfaceInfo*>(radios[i]->getInfo())->joined){
+				trace[i] = clock.micros();
+			}
+		}
+		clock.advance(1000);
+	}
+
+	const RadioChannelStats stats = world.getChannel(0)->getStats();
+	trace.insert(trace.end(), {stats.transmissions, stats.delivered, stats.collisions, stats.randomDrops});
+	for (auto& radio : radios){
+		std::array<LinkStats, 16> links;
+		const size_t count = static_cast<const TDMARadioInterfaceInfo*>(radio->getInfo())->linkStats.snapshot(links);
+		for (size_t i = 0; i < count; ++i){
+			trace.push_back(links[i].rxCount);
+		}
+	}
+	return trace;
+}
+
+static void testReproducibility()
+{
+	std::cout << "--- reproducibility ---" << std::endl;
+	const std::vector<uint64_t> first = traceTdma(7);
+	const std::vector<uint64_t> second = traceTdma(7);
+	const std::vector<uint64_t> other = traceTdma(8);
+	check(first == second, "same seed gives an identical run, joins, collisions, drops and all");
+	check(first != other, "a different seed gives a different run");
+
+	// printed so separate processes (different heap addresses) can be compared too
+	uint64_t digest = 0;
+	for (uint64_t value : first){
+		digest = splitmix64(digest ^ value);
+	}
+	std::cout << "seed 7 trace digest = " << digest << " over " << first.size() << " values" << std::endl;
+}
+
+/**
+ * @brief Three TDMA nodes, only the first one with traffic. Every owned window is accounted for exactly once and
+ * what goes on air shows up on the other side.
+ */
+static void testSlotAccounting()
+{
+	std::cout << "--- slot accounting ---" << std::endl;
+	using Radio = TDMARadio<LoRaSimPhysicalLayer, VirtualClock>;
+	constexpr size_t numNodes = 3;
+
+	VirtualClock clock;
+	SimWorld world(3, [clock]() { return clock.micros(); });
+	std::vector<std::unique_ptr<LoRaSimPhysicalLayer>> physicalLayers;
+	std::vector<std::unique_ptr<RnpNetworkManager>> networkManagers;
+	std::vector<std::unique_ptr<Radio>> radios;
+	for (size_t i = 0; i < numNodes; ++i){
+		physicalLayers.push_back(std::make_unique<LoRaSimPhysicalLayer>(world, 868e6, 250e3, 7));
+		networkManagers.push_back(std::make_unique<RnpNetworkManager>(static_cast<uint8_t>(101 + i), NODETYPE::HUB, true));
+		radios.push_back(std::make_unique<Radio>(*physicalLayers.back(), *networkManagers.back(), clock));
+		radios.back()->setSeed(world.nextSeed());
+		radios.back()->setup();
+	}
+
+	uint32_t sequence = 0;
+	while (clock.micros() < 40000000){
+		const auto* info = static_cast<const TDMARadioInterfaceInfo*>(radios[0]->getInfo());
+		if (info->joined && info->currentSendBufferSize == 0){
+			TrafficPacket packet(1, sequence++, clock.micros(), 32);
+			packet.header.source = 101;
+			packet.header.destination = 102;
+			radios[0]->sendPacket(packet);
+		}
+		for (auto& radio : radios){
+			radio->update();
+		}
+		clock.advance(1000);
+	}
+
+	std::vector<SlotStats> stats;
+	bool joined = true;
+	for (auto& radio : radios){
+		const auto* info = static_cast<const TDMARadioInterfaceInfo*>(radio->getInfo());
+		joined = joined && info->joined;
+		stats.push_back(info->slotStats.get());
+	}
+	check(joined, "all nodes joined");
+
+	bool partitioned = true;
+	for (const auto& s : stats){
+		partitioned = partitioned && s.slotsOwned > 0 && s.slotsOwned == s.slotsUsed + s.slotsHeartbeat + s.slotsYielded + s.slotsIdle;
+	}
+	check(partitioned, "every owned window is used, heartbeat, yielded or idle");
+	check(stats[0].slotsUsed > 0 && stats[0].slotUtilisation > 0.5f, "node with traffic uses its windows");
+	check(stats[1].slotsUsed == 0 && stats[1].slotsHeartbeat > 0 && stats[1].slotsIdle > stats[1].slotsHeartbeat, "idle node only heartbeats");
+	check(stats[1].heartbeatsReceived > 0 || stats[0].heartbeatsReceived > 0, "heartbeats heard");
+
+	const uint64_t airtimeSent = stats[0].airtimeSent + stats[1].airtimeSent + stats[2].airtimeSent;
+	check(stats[1].airtimeReceived > 0 && stats[1].airtimeReceived <= airtimeSent, "airtime received bounded by airtime sent");
+	check(stats[0].txDutyCycle > stats[1].txDutyCycle && stats[0].txDutyCycle < 1.0f, "busy node has the highest duty cycle");
+	check(stats[0].frameLength > 0, "frame length measured");
+
+	TDMARadioInterfaceInfo copy = *static_cast<const TDMARadioInterfaceInfo*>(radios[0]->getInfo());
+	check(copy.slotStats.get().bytesSent == stats[0].bytesSent, "info copy carries the counters");
+}
+
+/**
+ * @brief Trace three TDMA nodes on the world clock, the trace agrees with the radios' own accounting and a small
+ * trace buffer keeps only the latest events
+ */
+static void testSlotTrace()
+{
+	std::cout << "--- slot trace ---" << std::endl;
+	using Radio = TDMARadio<LoRaSimPhysicalLayer, VirtualClock>;
+	constexpr size_t numNodes = 3;
+	constexpr size_t smallCapacity = 64;
+
+	VirtualClock clock;
+	SimWorld world(4, [clock]() { return clock.micros(); });
+	std::vector<std::unique_ptr<LoRaSimPhysicalLayer>> physicalLayers;
+	std::vector<std::unique_ptr<RnpNetworkManager>> networkManagers;
+	std::vector<std::unique_ptr<Radio>> radios;
+	std::vector<std::shared_ptr<SlotTracer>> tracers;
+	for (size_t i = 0; i < numNodes; ++i){
+		physicalLayers.push_back(std::make_unique<LoRaSimPhysicalLayer>(world, 868e6, 250e3, 7));
+		networkManagers.push_back(std::make_unique<RnpNetworkManager>(static_cast<uint8_t>(101 + i), NODETYPE::HUB, true));
+		radios.push_back(std::make_unique<Radio>(*physicalLayers.back(), *networkManagers.back(), clock));
+		tracers.push_back(std::make_shared<SlotTracer>("node" + std::to_string(i), i == 2 ? smallCapacity : 1 << 16, world.getTimeSource()));
+		radios.back()->setTracer(tracers.back());
+		radios.back()->setSeed(world.nextSeed());
+		radios.back()->setup();
+	}
+	while (clock.micros() < 30000000){
+		for (auto& radio : radios){
+			radio->update();
+		}
+		clock.advance(1000);
+	}
+
+	bool complete = true;
+	bool consistent = true;
+	for (size_t i = 0; i < 2; ++i){
+		uint64_t txBytes = 0;
+		uint64_t rxBytes = 0;
+		bool seen[6] = {};
+		for (const auto& event : tracers[i]->events()){
+			seen[static_cast<size_t>(event.type)] = true;
+			txBytes += (event.type == SlotTraceType::TX) ? event.value : 0;
+			rxBytes += (event.type == SlotTraceType::RX) ? event.value : 0;
+		}
+		complete = complete && seen[0] && seen[1] && seen[2] && seen[4] && seen[5] && tracers[i]->getDropped() == 0;
+		const SlotStats stats = static_cast<const TDMARadioInterfaceInfo*>(radios[i]->getInfo())->slotStats.get();
+		consistent = consistent && txBytes == stats.bytesSent && rxBytes == stats.bytesReceived;
+	}
+	check(complete, "slots, frames on air and discovery all traced");
+	check(consistent, "traced frames match the radio's byte counts");
+
+	const std::vector<SlotTraceEvent> recent = tracers[2]->events();
+	bool ordered = true;
+	for (size_t i = 1; i < recent.size(); ++i){
+		// rx events are placed at the start of their frame, everything else is in the order it happened
+		ordered = ordered && (recent[i].type == SlotTraceType::RX || recent[i].time >= recent[i - 1].time || recent[i - 1].type == SlotTraceType::RX);
+	}
+	check(recent.size() == smallCapacity && tracers[2]->getDropped() > 0 && ordered, "bounded trace keeps the latest events in order");
+	check(recent.back().time > 29000000, "bounded trace reaches the end of the run");
+
+	std::stringstream json;
+	SlotTracer::writeChromeTrace(json, {tracers[0].get(), tracers[1].get(), tracers[2].get()});
+	const std::string text = json.str();
+	int depth = 0;
+	bool balanced = true;
+	for (char c : text){
+		depth += (c == '{' || c == '[') - (c == '}' || c == ']');
+		balanced = balanced && depth >= 0;
+	}
+	size_t processes = 0;
+	for (size_t at = text.find("process_name"); at != std::string::npos; at = text.find("process_name", at + 1)){
+		++processes;
+	}
+	check(balanced && depth == 0 && text.rfind("{\"displayTimeUnit\"", 0) == 0, "chrome trace is well formed");
+	check(processes == numNodes && text.find("earlier events dropped") != std::string::npos, "one process per node, truncation marked");
+}
+
+/**
+ * @brief Bit errors injected by the channel are caught by the phy crc when it's enabled, and reach the datalink
+ * when it isn't
+ */
+static void testBitErrors()
+{
+	std::cout << "--- bit errors ---" << std::endl;
+	VirtualClock clock;
+	SimWorld world(9, [clock]() { return clock.micros(); });
+	RadioImpairment noisy;
+	noisy.bitErrorRate = 5e-3f;
+	world.getChannel(0)->setImpairment(noisy);
+
+	LoRaSimPhysicalLayer sender(world, 868e6, 250e3, 7);
+	LoRaSimPhysicalLayer withCrc(world, 868e6, 250e3, 7);
+	LoRaSimPhysicalLayer withoutCrc(world, 868e6, 250e3, 7, 1, 8, false);
+	for (LoRaSimPhysicalLayer* physicalLayer : {&sender, &withCrc, &withoutCrc}){
+		physicalLayer->setChannel(0);
+	}
+
+	const std::vector<uint8_t> frame(20, 0xA5);
+	size_t cleanWithCrc = 0;
+	size_t receivedWithoutCrc = 0;
+	size_t corruptedWithoutCrc = 0;
+	for (size_t i = 0; i < 200; ++i){
+		sender.sendPacket(frame);
+		clock.advance(100000);
+		std::vector<uint8_t> data;
+		while (withCrc.readPacket(data)){
+			cleanWithCrc += (data == frame) ? 1 : 0;
+		}
+		while (withoutCrc.readPacket(data)){
+			++receivedWithoutCrc;
+			corruptedWithoutCrc += (data != frame) ? 1 : 0;
+		}
+	}
+	const auto* info = static_cast<const LoRaSimPhysicalLayerInfo*>(withCrc.getInfo());
+	check(cleanWithCrc + info->crcErrors == 200 && info->crcErrors > 0, "crc throws corrupted frames away");
+	check(receivedWithoutCrc == 200 && corruptedWithoutCrc > 0, "without crc corrupted frames are delivered");
+
+	// tdma over a noisy channel with no crc, corrupted headers have to be survived
+	using Radio = TDMARadio<LoRaSimPhysicalLayer, VirtualClock>;
+	noisy.bitErrorRate = 2e-3f;
+	world.getChannel(0)->setImpairment(noisy);
+	std::vector<std::unique_ptr<LoRaSimPhysicalLayer>> physicalLayers;
+	std::vector<std::unique_ptr<RnpNetworkManager>> networkManagers;
+	std::vector<std::unique_ptr<Radio>> radios;
+	for (size_t i = 0; i < 3; ++i){
+		physicalLayers.push_back(std::make_unique<LoRaSimPhysicalLayer>(world, 868e6, 250e3, 7, 1, 8, false));
+		networkManagers.push_back(std::make_unique<RnpNetworkManager>(static_cast<uint8_t>(101 + i), NODETYPE::HUB, true));
+		radios.push_back(std::make_unique<Radio>(*physicalLayers.back(), *networkManagers.back(), clock));
+		radios.back()->setSeed(world.nextSeed());
+		radios.back()->setup();
+	}
+	const uint64_t end = clock.micros() + 60000000;
+	while (clock.micros() < end){
+		for (auto& radio : radios){
+			radio->update();
+		}
+		clock.advance(1000);
+	}
+	size_t joined = 0;
+	for (auto& radio : radios){
+		joined += static_cast<const TDMARadioInterfaceInfo*>(radio->getInfo())->joined ? 1 : 0;
+	}
+	check(world.getChannel(0)->getStats().corrupted > 0 && joined > 0, "tdma runs on through corrupted frames");
+}
+
+int main()
+{
+	testIsolation();
+	testConcurrentLookup();
+	testSeeds();
+	testParallelWorlds();
+	testReproducibility();
+	testSlotAccounting();
+	testSlotTrace();
+	testBitErrors();
+
+	return checkSummary();
+}
@@ -0,0 +1,193 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <cstdlib>
+
+#include "sweep_scenario.h"
+#include "work_stealing_pool.h"
+
+/**
+ * Parameter sweep over the TDMA datalink on the simulated channel. Every combination of the lists given runs once
+ * per seed, scenarios are spread across a work stealing pool (one thread per scenario, nodes are updated
+ * cooperatively within it) and results are written one row per run.
+ *
+ * usage: librrp_sweep [--nodes 3,5,10] [--sf 7,9] [--bw 250e3,500e3] [--payload 16,64] [--rate 0.5,2]
+ *                     [--drift 0,20] [--loss 0,0.1] [--burst 0,500] [--fec 0,4/2] [--seeds 4] [--duration 60]
+ *                     [--threads N] [--format csv|json] [--out sweep.csv]
+ *
+ * burst is the mean fade length in ms, with it the loss comes in gilbert elliott fades rather than independently.
+ * fec is data/parity frames per FEC block, 0 for none, e.g --loss 0,0.1,0.2,0.3 --fec 0,4/2,8/2 gives goodput against
+ * loss rate for each code.
+ */
+
+static std::vector<std::string> split(const std::string& list)
+{
+	std::vector<std::string> values;
+	std::stringstream stream(list);
+	std::string value;
+	while (std::getline(stream, value, ',')){
+		if (!value.empty()){
+			values.push_back(value);
+		}
+	}
+	return values;
+}
+
+template <typename T>
+static std::vector<T> parseList(const std::map<std::string, std::string>& args, const std::string& name, T defaultValue)
+{
+	auto it = args.find(name);
+	if (it == args.end()){
+		return {defaultValue};
+	}
+	std::vector<T> values;
+	for (const auto& value : split(it->second)){
+		values.push_back(static_cast<T>(std::stod(value)));
+	}
+	return values;
+}
+
+// data/parity pairs, 0 for no FEC
+static std::vector<std::pair<uint8_t, uint8_t>> parseFec(const std::map<std::string, std::string>& args)
+{
+	auto it = args.find("fec");
+	if (it == args.end()){
+		return {{0, 0}};
+	}
+	std::vector<std::pair<uint8_t, uint8_t>> values;
+	for (const auto& value : split(it->second)){
+		const size_t slash = value.find('/');
+		const int data = std::stoi(value.substr(0, slash));
+		const int parity = (slash == std::string::npos) ? 0 : std::stoi(value.substr(slash + 1));
+		values.emplace_back(static_cast<uint8_t>(data), static_cast<uint8_t>(data ? parity : 0));
+	}
+	return values;
+}
+
+static std::vector<SweepParameters> expandGrid(const std::map<std::string, std::string>& args)
+{
+	const SweepParameters defaults;
+	const float duration = parseList<float>(args, "duration", defaults.duration).front();
+
+	std::vector<SweepParameters> grid;
+	for (size_t nodes : parseList<size_t>(args, "nodes", defaults.nodes))
+	for (int sf : parseList<int>(args, "sf", defaults.spreadingFactor))
+	for (float bw : parseList<float>(args, "bw", defaults.bandwidth))
+	for (size_t payload : parseList<size_t>(args, "payload", defaults.payloadSize))
+	for (float rate : parseList<float>(args, "rate", defaults.rate))
+	for (float drift : parseList<float>(args, "drift", defaults.drift))
+	for (float loss : parseList<float>(args, "loss", defaults.loss))
+	for (float burst : parseList<float>(args, "burst", defaults.burst))
+	for (const auto& fec : parseFec(args)){
+		SweepParameters parameters;
+		parameters.nodes = nodes;
+		parameters.spreadingFactor = static_cast<uint8_t>(sf);
+		parameters.bandwidth = bw;
+		parameters.payloadSize = payload;
+		parameters.rate = rate;
+		parameters.drift = drift;
+		parameters.loss = loss;
+		parameters.burst = burst;
+		parameters.fecData = fec.first;
+		parameters.fecParity = fec.second;
+		parameters.duration = duration;
+		grid.push_back(parameters);
+	}
+	return grid;
+}
+
+static void writeCsv(std::ostream& out, const std::vector<SweepResult>& results)
+{
+	out << "nodes,sf,bw,payload,rate,drift,loss,burst_ms,fec_data,fec_parity,duration,seed,"
+		<< "sent,delivered,delivery_ratio,goodput_Bps,latency_p50_ms,latency_p90_ms,latency_p99_ms,"
+		<< "mean_join_s,max_join_s,unjoined,collision_rate,tx_errors,resyncs,fec_recovered\n";
+	for (const auto& r : results){
+		const SweepParameters& p = r.parameters;
+		out << p.nodes << "," << static_cast<int>(p.spreadingFactor) << "," << p.bandwidth << "," << p.payloadSize << ","
+			<< p.rate << "," << p.drift << "," << p.loss << "," << p.burst << "," << static_cast<int>(p.fecData) << ","
+			<< static_cast<int>(p.fecParity) << "," << p.duration << "," << r.seed << ","
+			<< r.sent << "," << r.delivered << "," << r.deliveryRatio << "," << r.goodput << ","
+			<< r.latencyP50 << "," << r.latencyP90 << "," << r.latencyP99 << ","
+			<< r.meanJoinTime << "," << r.maxJoinTime << "," << r.unjoined << "," << r.collisionRate << "," << r.txErrors << "," << r.resyncs << "," << r.fecRecovered << "\n";
+	}
+}
+
+static void writeJson(std::ostream& out, const std::vector<SweepResult>& results)
+{
+	out << "[\n";
+	for (size_t i = 0; i < results.size(); ++i){
+		const SweepResult& r = results[i];
+		const SweepParameters& p = r.parameters;
+		out << "  {\"nodes\": " << p.nodes << ", \"sf\": " << static_cast<int>(p.spreadingFactor) << ", \"bw\": " << p.bandwidth
+			<< ", \"payload\": " << p.payloadSize << ", \"rate\": " << p.rate << ", \"drift\": " << p.drift
+			<< ", \"loss\": " << p.loss << ", \"burst_ms\": " << p.burst << ", \"fec_data\": " << static_cast<int>(p.fecData)
+			<< ", \"fec_parity\": " << static_cast<int>(p.fecParity) << ", \"duration\": " << p.duration << ", \"seed\": " << r.seed
+			<< ", \"sent\": " << r.sent << ", \"delivered\": " << r.delivered << ", \"delivery_ratio\": " << r.deliveryRatio
+			<< ", \"goodput_Bps\": " << r.goodput << ", \"latency_p50_ms\": " << r.latencyP50
+			<< ", \"latency_p90_ms\": " << r.latencyP90 << ", \"latency_p99_ms\": " << r.latencyP99
+			<< ", \"mean_join_s\": " << r.meanJoinTime << ", \"max_join_s\": " << r.maxJoinTime
+			<< ", \"unjoined\": " << r.unjoined << ", \"collision_rate\": " << r.collisionRate
+			<< ", \"tx_errors\": " << r.txErrors << ", \"resyncs\": " << r.resyncs << ", \"fec_recovered\": " << r.fecRecovered << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "]\n";
+}
+
+int main(int argc, char* argv[])
+{
+	std::map<std::string, std::string> args;
+	for (int i = 1; i + 1 < argc; i += 2){
+		std::string name = argv[i];
+		if (name.rfind("--", 0) != 0){
+			std::cerr << "unexpected argument " << name << std::endl;
+			return 1;
+		}
+		args[name.substr(2)] = argv[i + 1];
+	}
+
+	const std::vector<SweepParameters> grid = expandGrid(args);
+	const size_t seeds = parseList<size_t>(args, "seeds", 1).front();
+	const size_t threads = parseList<size_t>(args, "threads", std::max(std::thread::hardware_concurrency(), 1u)).front();
+	const std::string format = args.count("format") ? args["format"] : "csv";
+	const std::string outPath = args.count("out") ? args["out"] : "sweep." + format;
+
+	std::vector<SweepResult> results(grid.size() * seeds);
+	std::mutex progressMutex;
+	size_t finished = 0;
+
+	std::cerr << "running " << results.size() << " scenarios on " << threads << " threads" << std::endl;
+	{
+		WorkStealingPool pool(threads);
+		for (size_t i = 0; i < grid.size(); ++i){
+			for (size_t seed = 0; seed < seeds; ++seed){
+				const size_t index = i * seeds + seed;
+				pool.submit([&, i, seed, index]() {
+					results[index] = runScenario(grid[i], seed);
+					std::lock_guard<std::mutex> lock(progressMutex);
+					std::cerr << "[" << ++finished << "/" << results.size() << "] nodes = " << grid[i].nodes
+						<< ", sf = " << static_cast<int>(grid[i].spreadingFactor) << ", seed = " << seed
+						<< ": delivery = " << results[index].deliveryRatio << std::endl;
+				});
+			}
+		}
+		pool.wait();
+	}
+
+	std::ofstream out(outPath);
+	if (!out){
+		std::cerr << "failed to open " << outPath << std::endl;
+		return 1;
+	}
+	if (format == "json"){
+		writeJson(out, results);
+	}
+	else{
+		writeCsv(out, results);
+	}
+	std::cerr << "results written to " << outPath << std::endl;
+	return 0;
+}
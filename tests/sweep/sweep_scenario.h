@@ -0,0 +1,239 @@
+#pragma once
+
+// std
+#include <vector>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <cstdint>
+
+// librnp
+#include <librnp/rnp_networkmanager.h>
+
+// librrp
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/datalink/tdma.h>
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
+
+#include "../Traffic/traffic_packet.h"
+#include "../Traffic/traffic_sink.h"
+
+/**
+ * @brief One point of the parameter grid
+ */
+struct SweepParameters
+{
+    size_t nodes = 3;
+    uint8_t spreadingFactor = 7;
+    float bandwidth = 250e3;        // Hz
+    size_t payloadSize = 16;        // bytes of rnp payload per traffic packet
+    float rate = 0.5;               // traffic packets per second per node
+    float drift = 10;               // ppm, each node draws its drift uniformly from +-drift
+    float loss = 0;                 // random drop probability per reception
+    float burst = 0;                // ms, mean fade length when loss comes in gilbert elliott bursts, 0 for independent loss
+    uint8_t fecData = 0;            // data frames per FEC block, 0 for no FEC
+    uint8_t fecParity = 0;          // parity frames per FEC block
+    float duration = 60;            // s of simulated time, runs on a virtual clock so independent of wall time
+};
+
+struct SweepResult
+{
+    SweepParameters parameters;
+    uint64_t seed;
+
+    uint64_t sent;
+    uint64_t delivered;
+    float deliveryRatio;
+    float goodput;                  // delivered payload bytes/s over the whole run
+    float latencyP50;               // ms
+    float latencyP90;               // ms
+    float latencyP99;               // ms
+    float meanJoinTime;             // s, over the nodes that joined
+    float maxJoinTime;              // s
+    size_t unjoined;                // nodes still in discovery at the end
+    float collisionRate;            // receptions lost to interference / receptions attempted
+    uint64_t resyncs;               // slot boundary corrections, over every node
+    uint64_t fecRecovered;          // frames lost on air and rebuilt from FEC parity, over every node
+    uint64_t txErrors;
+};
+
+/**
+ * @brief A node for sweeps, a datalink over the simulated phy with a traffic source and sink. Traffic starts
+ * once the node has joined so the sweep measures the MAC in steady state rather than its discovery backlog.
+ *
+ * @tparam DataLinkProtocol datalink running on a DriftingClock
+ */
+template <typename DataLinkProtocol>
+class SweepNode
+{
+public:
+    static constexpr uint8_t trafficService = 20;
+
+    SweepNode(SimWorld& world, uint8_t address, const SweepParameters& parameters, double driftPPM)
+        : m_world(world),
+          m_parameters(parameters),
+          m_physicalLayer(world, 868e6, parameters.bandwidth, parameters.spreadingFactor),
+          m_networkManager(address, NODETYPE::HUB, true),
+          m_radio(m_physicalLayer, m_networkManager, DriftingClock(world.getTimeSource(), driftPPM)),
+          m_sink(trafficService, [&world]() { return world.now(); }),
+          m_rng(world.nextSeed())
+    {
+        m_radio.setSeed(world.nextSeed());
+        m_radio.setFec(parameters.fecData, parameters.fecParity);
+    }
+
+    void setup()
+    {
+        const uint8_t address = m_networkManager.getAddress();
+        m_radio.setup();
+        m_networkManager.registerService(trafficService, m_sink.getCallback());
+        m_networkManager.setNodeType(NODETYPE::HUB);
+        m_networkManager.addInterface(&m_radio);
+        m_networkManager.generateDefaultRoutes();
+        m_networkManager.enableAutoRouteGen(true);
+        m_networkManager.setNoRouteAction(NOROUTE_ACTION::BROADCAST, {2});
+        m_networkManager.setAddress(address);
+        m_world.registerAddress(address);
+    }
+
+    void update()
+    {
+        m_networkManager.update();
+        m_radio.update();
+
+        const uint64_t now = m_world.now();
+        if (!m_joinTime && radioInfo()->joined){
+            m_joinTime = now;
+            m_nextSend = now + nextInterval();
+        }
+        if (m_joinTime && m_parameters.rate > 0 && now >= m_nextSend){
+            sendTraffic(now);
+            m_nextSend += nextInterval();
+        }
+    }
+
+    const TDMARadioInterfaceInfo* radioInfo() {return static_cast<const TDMARadioInterfaceInfo*>(m_radio.getInfo());}
+    const TrafficSink& sink() const {return m_sink;}
+    uint64_t sent() const {return m_sent;}
+    uint64_t joinTime() const {return m_joinTime;}     // world us, 0 if not joined
+
+private:
+    uint64_t nextInterval()
+    {
+        // constant rate with a random phase per node, so nodes don't all generate on the same tick
+        const uint64_t interval = static_cast<uint64_t>(1e6f / m_parameters.rate);
+        return m_sent ? interval : m_rng() % (interval + 1);
+    }
+
+    void sendTraffic(uint64_t now)
+    {
+        const std::vector<int> addresses = m_world.getAddresses();
+        if (addresses.size() < 2){
+            return;
+        }
+        int destination;
+        do {
+            destination = addresses[m_rng.nextBelow(static_cast<uint32_t>(addresses.size()))];
+        } while (destination == m_networkManager.getAddress());
+
+        TrafficPacket packet(trafficService, m_sequence++, now, m_parameters.payloadSize);
+        packet.header.source = m_networkManager.getAddress();
+        packet.header.destination = static_cast<uint8_t>(destination);
+        packet.header.destination_service = trafficService;
+        m_networkManager.sendPacket(packet);
+        ++m_sent;
+    }
+
+    SimWorld& m_world;
+    const SweepParameters m_parameters;
+
+    LoRaSimPhysicalLayer m_physicalLayer;
+    RnpNetworkManager m_networkManager;
+    DataLinkProtocol m_radio;
+    TrafficSink m_sink;
+
+    Xoshiro256 m_rng;
+    uint32_t m_sequence = 0;
+    uint64_t m_sent = 0;
+    uint64_t m_joinTime = 0;
+    uint64_t m_nextSend = 0;
+};
+
+/**
+ * @brief Run one scenario to completion on the calling thread. Every node is updated cooperatively from this
+ * thread, so a sweep uses one thread per scenario rather than one per node, and the world runs on a virtual clock
+ * stepped a tick at a time so a scenario takes as long as the cpu needs rather than its simulated duration.
+ */
+inline SweepResult runScenario(const SweepParameters& parameters, uint64_t seed)
+{
+    using Node = SweepNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>;
+    constexpr uint64_t tick = 1000;     // us, the loop rate nodes would run at on hardware
+
+    VirtualClock clock;
+    SimWorld world(seed, [clock]() { return clock.micros(); });
+    if (parameters.burst > 0){
+        world.getChannel(0)->setImpairment(RadioImpairment::burst(parameters.loss, parameters.burst * 1e3f));
+    }
+    else {
+        world.getChannel(0)->setPacketDropProbability(parameters.loss);
+    }
+
+    Xoshiro256 rng(world.nextSeed());
+
+    std::vector<std::unique_ptr<Node>> nodes;
+    for (size_t i = 0; i < parameters.nodes; ++i){
+        const uint8_t address = static_cast<uint8_t>(101 + i);
+        const float drift = (rng.nextFloat() * 2.0f - 1.0f) * parameters.drift;
+        nodes.push_back(std::make_unique<Node>(world, address, parameters, drift));
+        nodes.back()->setup();
+    }
+
+    const uint64_t end = static_cast<uint64_t>(parameters.duration * 1e6f);
+    while (world.now() < end){
+        for (auto& node : nodes){
+            node->update();
+        }
+        clock.advance(tick);
+    }
+
+    SweepResult result{};
+    result.parameters = parameters;
+    result.seed = seed;
+
+    std::vector<uint64_t> latencies;
+    uint64_t bytes = 0;
+    std::vector<float> joinTimes;
+    for (auto& node : nodes){
+        result.sent += node->sent();
+        result.delivered += node->sink().getReceived();
+        result.txErrors += node->radioInfo()->txerror;
+        result.resyncs += node->radioInfo()->slotStats.get().resyncs;
+        result.fecRecovered += node->radioInfo()->fecRecovered;
+        bytes += node->sink().getBytes();
+        latencies.insert(latencies.end(), node->sink().getLatencies().begin(), node->sink().getLatencies().end());
+        if (node->joinTime()){
+            joinTimes.push_back(node->joinTime() / 1e6f);
+        }
+    }
+
+    result.deliveryRatio = result.sent ? static_cast<float>(result.delivered) / result.sent : 0;
+    result.goodput = bytes / parameters.duration;
+    result.latencyP50 = TrafficSink::percentile(latencies, 50) / 1e3f;
+    result.latencyP90 = TrafficSink::percentile(latencies, 90) / 1e3f;
+    result.latencyP99 = TrafficSink::percentile(latencies, 99) / 1e3f;
+    result.unjoined = nodes.size() - joinTimes.size();
+    if (!joinTimes.empty()){
+        result.meanJoinTime = std::accumulate(joinTimes.begin(), joinTimes.end(), 0.0f) / joinTimes.size();
+        result.maxJoinTime = *std::max_element(joinTimes.begin(), joinTimes.end());
+    }
+
+    const RadioChannelStats stats = world.getChannel(0)->getStats();
+    const uint64_t attempts = stats.delivered + stats.collisions + stats.interSfCollisions + stats.halfDuplexLosses + stats.belowSensitivity + stats.randomDrops
+        + stats.linkLosses + stats.outageLosses;
+    result.collisionRate = attempts ? static_cast<float>(stats.collisions + stats.interSfCollisions) / attempts : 0;
+
+    return result;
+}
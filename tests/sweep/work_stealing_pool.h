@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @brief Fixed size thread pool where each worker has its own deque. Workers take their newest task first and,
+ * when they run dry, steal the oldest task from another worker, so long and short jobs even out across the
+ * pool without a single contended queue.
+ */
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(size_t numThreads = std::thread::hardware_concurrency())
+    {
+        numThreads = std::max<size_t>(numThreads, 1);
+        for (size_t i = 0; i < numThreads; ++i){
+            m_queues.push_back(std::make_unique<Queue>());
+        }
+        for (size_t i = 0; i < numThreads; ++i){
+            m_workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_stopping = true;
+        }
+        m_workAvailable.notify_all();
+        for (auto& worker : m_workers){
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void submit(Task task)
+    {
+        const size_t index = m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+        {
+            std::lock_guard<std::mutex> lock(m_queues[index]->mtx);
+            m_queues[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            ++m_pending;
+            ++m_queued;
+        }
+        m_workAvailable.notify_one();
+    }
+
+    /**
+     * @brief Block until every submitted task has finished
+     */
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_allDone.wait(lock, [this]() { return m_pending == 0; });
+    }
+
+    size_t size() const {return m_workers.size();}
+
+private:
+    struct Queue
+    {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    bool popLocal(size_t index, Task& task)
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mtx);
+        if (m_queues[index]->tasks.empty()){
+            return false;
+        }
+        task = std::move(m_queues[index]->tasks.back());
+        m_queues[index]->tasks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t thief, Task& task)
+    {
+        for (size_t offset = 1; offset < m_queues.size(); ++offset){
+            Queue& victim = *m_queues[(thief + offset) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mtx);
+            if (!victim.tasks.empty()){
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index)
+    {
+        for (;;){
+            Task task;
+            if (popLocal(index, task) || steal(index, task)){
+                {
+                    std::lock_guard<std::mutex> lock(m_mtx);
+                    --m_queued;
+                }
+                task();
+                std::lock_guard<std::mutex> lock(m_mtx);
+                if (--m_pending == 0){
+                    m_allDone.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mtx);
+            if (m_stopping){
+                return;
+            }
+            // a task taken before submit counted it drives m_queued negative, so the count can't strand work
+            m_workAvailable.wait(lock, [this]() { return m_stopping || m_queued > 0; });
+            if (m_stopping){
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::atomic<size_t> m_nextQueue{0};
+
+    std::mutex m_mtx;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+    size_t m_pending = 0;    // submitted and not finished
+    int64_t m_queued = 0;    // submitted and not yet picked up
+    bool m_stopping = false;
+};
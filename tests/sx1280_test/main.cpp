@@ -0,0 +1,251 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <chrono>
+#include <cmath>
+#include <type_traits>
+
+// librrp
+#include <librrp/physical/lora_sx1280.h>
+#include <librrp/physical/physical_layer_traits.h>
+
+// mocked RadioLib
+#include <RadioLib.h>
+
+#include "../Check/check.h"
+
+static_assert(PhysicalLayerTraits::Check<LoRaSX1280>::value, "LoRaSX1280 must satisfy the physical layer contract");
+static_assert(PhysicalLayerTraits::Check<PhysicalLayerBase>::value, "PhysicalLayerBase must satisfy the physical layer contract");
+static_assert(!std::is_polymorphic_v<LoRaSX1280>, "LoRaSX1280 calls should not need virtual dispatch");
+
+static void testAsyncTransmit(LoRaSX1280& radio, SX1280& mock)
+{
+	std::cout << "--- async transmit ---" << std::endl;
+
+	check(mock.state == SX1280::MockState::RX, "radio is listening after setup");
+	check(!radio.isBusy(), "radio idle after setup");
+
+	check(radio.sendPacket({1, 2, 3}) == 3, "first packet accepted");
+	check(mock.state == SX1280::MockState::TX, "first packet put on air without blocking");
+	check(radio.isBusy(), "busy while packet in flight");
+
+	check(radio.sendPacket({4, 5}) == 2, "second packet queued behind in-flight packet");
+	check(mock.startTransmitCalls == 1, "second packet not started while first is on air");
+
+	mock.simulateTransmitDone();
+	check(radio.isBusy(), "busy while second packet in flight");
+	check(mock.startTransmitCalls == 2, "queued packet started on tx done");
+
+	mock.simulateTransmitDone();
+	check(!radio.isBusy(), "idle once queue drained");
+	check(mock.state == SX1280::MockState::RX, "radio returns to receive after tx");
+	check(mock.transmitted.size() == 2 && mock.transmitted[1].data == std::vector<uint8_t>{4, 5}, "packets sent in order");
+}
+
+static void testTxQueueFull(LoRaSX1280& radio, SX1280& mock)
+{
+	std::cout << "--- tx queue full ---" << std::endl;
+
+	radio.sendPacket({0});	// on air
+	for (size_t i = 0; i < LoRaSX1280::txQueueSize; ++i){
+		check(radio.sendPacket({static_cast<uint8_t>(i)}) == 1, "packet " + std::to_string(i) + " queued");
+	}
+	check(radio.sendPacket({0xFF}) == 0, "packet rejected once tx queue is full");
+
+	while (mock.simulateTransmitDone()){
+		radio.isBusy();
+	}
+	check(!radio.isBusy(), "queue drains");
+}
+
+static void testTxWhileRxPending(LoRaSX1280& radio, SX1280& mock)
+{
+	std::cout << "--- tx with unread rx ---" << std::endl;
+
+	mock.simulateReceive({9, 9});
+	check(radio.sendPacket({7}) == 1, "packet accepted while rx is unread");
+	check(mock.state == SX1280::MockState::TX, "tx started once the pending rx was drained from the fifo");
+	mock.simulateTransmitDone();
+	check(!radio.isBusy() && mock.state == SX1280::MockState::RX, "back to receive");
+
+	std::vector<uint8_t> data;
+	check(radio.readPacket(data) == 2 && data == std::vector<uint8_t>{9, 9}, "rx that arrived before the tx is still delivered");
+}
+
+static void testRxBurst(LoRaSX1280& radio, SX1280& mock)
+{
+	std::cout << "--- rx burst ---" << std::endl;
+
+	const auto* info = static_cast<const LoRaSX1280LayerInfo*>(radio.getInfo());
+	const uint32_t rearmsBefore = mock.startReceiveCalls;
+
+	mock.simulateReceive({1}, -70.0f, 5.0f);
+	radio.service();
+	mock.simulateReceive({2}, -80.0f, 2.5f, 1200.0);
+	radio.service();
+	check(mock.startReceiveCalls == rearmsBefore + 2, "receive re-armed after every frame");
+
+	mock.simulateReceive({3});
+	mock.simulateReceive({4});	// overwrites 3 before the handler runs
+	radio.service();
+	check(info->rxMissedCount == 1, "frame overwritten in the fifo is counted as missed");
+
+	std::vector<uint8_t> data;
+	check(radio.readPacket(data) == 1 && data[0] == 1, "first frame of burst kept");
+	check(info->packetRssi == -70.0f && info->packetSnr == 5.0f, "link metrics reported for first frame");
+	check(radio.readPacket(data) == 1 && data[0] == 2, "second frame of burst kept");
+	check(info->packetRssi == -80.0f && info->packetSnr == 2.5f && info->packetFreqError == 1200.0f, "link metrics reported for second frame");
+	check(radio.readPacket(data) == 1 && data[0] == 4, "latest frame kept");
+	check(radio.readPacket(data) == 0, "ring empty");
+}
+
+static void testRxRingOverflow(LoRaSX1280& radio, SX1280& mock)
+{
+	std::cout << "--- rx ring overflow ---" << std::endl;
+
+	const auto* info = static_cast<const LoRaSX1280LayerInfo*>(radio.getInfo());
+
+	for (size_t i = 0; i < LoRaSX1280::rxRingSize + 1; ++i){
+		mock.simulateReceive({static_cast<uint8_t>(i)});
+		radio.service();
+	}
+	check(info->rxOverflowCount == 1, "overflow counted");
+
+	// a frame that can't be read out of the fifo doesn't push a good one out of the full ring
+	mock.readDataResult = RADIOLIB_ERR_CRC_MISMATCH;
+	mock.simulateReceive({0xEE});
+	radio.service();
+	mock.readDataResult = RADIOLIB_ERR_NONE;
+	check(info->rxReadErrors == 1 && info->rxOverflowCount == 1, "failed read counted separately, nothing evicted");
+
+	std::vector<uint8_t> data;
+	check(radio.readPacket(data) == 1 && data[0] == 1, "oldest frame discarded on overflow");
+	size_t remaining = 0;
+	while (radio.readPacket(data)){
+		++remaining;
+	}
+	check(remaining == LoRaSX1280::rxRingSize - 1, "remaining frames delivered");
+}
+
+static uint32_t elapsedUs(std::chrono::steady_clock::time_point start)
+{
+	return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void testLiveReconfig(LoRaSX1280& radio, SX1280& mock)
+{
+	std::cout << "--- live reconfiguration ---" << std::endl;
+
+	LoRaSX1280Config config = radio.getConfig();
+	config.spreadingFactor = 7;
+	uint32_t writesBefore = mock.configWrites;
+	auto start = std::chrono::steady_clock::now();
+	check(radio.applyConfig(config), "spreading factor change applied");
+	uint32_t duration = elapsedUs(start);
+	std::cout << "sf switch took " << duration << "us" << std::endl;
+	check(mock.configWrites == writesBefore + 1, "only the changed parameter is written");
+	check(mock.spreadingFactor == 7, "radio retuned to new sf");
+	check(mock.state == SX1280::MockState::RX, "radio back in receive after reconfig");
+	check(duration < 5000, "sf switch completes within milliseconds");
+
+	writesBefore = mock.configWrites;
+	check(radio.applyConfig(config) && mock.configWrites == writesBefore, "unchanged config writes nothing");
+
+	start = std::chrono::steady_clock::now();
+	radio.setChannel(5);
+	duration = elapsedUs(start);
+	std::cout << "channel switch took " << duration << "us" << std::endl;
+	check(mock.frequency == LoRaSX1280::channelBaseFrequency + 5 * LoRaSX1280::channelSpacing, "channel switch retunes frequency");
+	check(duration < 5000, "channel switch completes within milliseconds");
+
+	radio.setChannel(200);
+	check(mock.frequency == LoRaSX1280::channelBaseFrequency + 5 * LoRaSX1280::channelSpacing, "out of band channel rejected");
+
+	radio.sendPacket({1, 2, 3});
+	config.spreadingFactor = 9;
+	radio.applyConfig(config);
+	check(mock.spreadingFactor == 7, "config deferred while packet is on air");
+	mock.simulateTransmitDone();
+	radio.isBusy();
+	check(mock.spreadingFactor == 9, "deferred config applied after tx done");
+	check(mock.state == SX1280::MockState::RX, "radio back in receive after deferred reconfig");
+
+	const uint32_t beginsBefore = mock.beginCalls;
+	start = std::chrono::steady_clock::now();
+	radio.restart();
+	duration = elapsedUs(start);
+	std::cout << "restart took " << duration << "us" << std::endl;
+	check(mock.beginCalls == beginsBefore + 1 && mock.spreadingFactor == 9, "restart reinitialises with the current config");
+	check(mock.state == SX1280::MockState::RX, "radio listening after restart");
+}
+
+struct AirtimeReference
+{
+	uint8_t spreadingFactor;
+	float bandwidth;		// kHz
+	uint8_t codingRate;
+	size_t length;
+	float airtime;			// us
+};
+
+static void testAirtime(LoRaSX1280& radio)
+{
+	std::cout << "--- airtime ---" << std::endl;
+
+	// worked by hand from the SX1280 datasheet time on air formula (12 symbol preamble, explicit header, crc on),
+	// covering the SF5-6, SF7-10 and SF11-12 branches
+	const AirtimeReference references[] = {
+		{5, 1625.0f, 5, 10, 1009.2f},
+		{7, 812.5f, 5, 0, 3820.3f},
+		{9, 812.5f, 7, 6, 24103.4f},
+		{9, 812.5f, 7, 86, 99091.7f},
+		{9, 812.5f, 7, 255, 266712.6f},
+		{12, 203.125f, 8, 50, 2102193.2f},
+	};
+
+	const LoRaSX1280Config original = radio.getConfig();
+	for (const AirtimeReference& reference : references){
+		LoRaSX1280Config config = original;
+		config.spreadingFactor = reference.spreadingFactor;
+		config.bandwidth = reference.bandwidth;
+		config.codingRate = reference.codingRate;
+		config.preambleLength = 12;
+		config.crcEnabled = true;
+		config.implicitHeader = false;
+		radio.applyConfig(config);
+		const float airtime = radio.calculateAirtime(reference.length) * 1e6f;
+		check(std::abs(airtime - reference.airtime) <= reference.airtime * 0.001f, "SF" + std::to_string(reference.spreadingFactor)
+			+ " " + std::to_string(reference.length) + " bytes takes " + std::to_string(airtime) + "us");
+	}
+	radio.applyConfig(original);
+
+	PhysicalLayerAdapter<LoRaSX1280> adapter(radio);
+	PhysicalLayerBase& base = adapter;
+	check(base.calculateAirtime(86) == radio.calculateAirtime(86), "adapter forwards to the wrapped physical layer");
+}
+
+int main()
+{
+	SPIClass spi;
+	LoRaSX1280 radio(1, 2, 3, 4, spi);
+	SX1280& mock = *SX1280::lastInstance;
+
+	auto bootStart = std::chrono::steady_clock::now();
+	check(radio.setup(), "setup");
+	const uint32_t bootTime = elapsedUs(bootStart);
+	std::cout << "boot took " << bootTime << "us" << std::endl;
+	check(bootTime < 50000, "boot waits on the busy line rather than fixed delays");
+	check(mockUnconfiguredReads == 0, "busy line made an input before it is polled");
+	check(mock.spreadingFactor == radio.getConfig().spreadingFactor, "full config written at boot");
+
+	testAsyncTransmit(radio, mock);
+	testTxQueueFull(radio, mock);
+	testTxWhileRxPending(radio, mock);
+	testRxBurst(radio, mock);
+	testRxRingOverflow(radio, mock);
+	testLiveReconfig(radio, mock);
+	testAirtime(radio);
+
+	return checkSummary();
+}
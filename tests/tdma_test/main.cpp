@@ -8,10 +8,17 @@
 #include <thread>
 #include <chrono>
 #include <functional>
+#include <array>
+#include <random>
+#include <string>
+#include <fstream>
 
 // librrp
 #include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
 #include <librrp/datalink/tdma.h>
+#include <librrp/datalink/slot_tracer.h>
+#include <librrp/util/xoshiro.h>
 
 // librnp
 #include <librnp/rnp_networkmanager.h>
@@ -24,16 +31,17 @@
 #include "../SimNode.h"
 
 int numNodes = 3;
+std::unique_ptr<SimWorld> world;	// declared before the nodes so it outlives them
+Xoshiro256 driftRng;
 std::mutex nodeMutex;
-std::vector<std::unique_ptr<SimNode<TDMARadio<LoRaSimPhysicalLayer>>>> simNodes(numNodes);
+std::vector<std::unique_ptr<SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>>> simNodes(numNodes);
 std::vector<std::atomic<bool>> nodeRunning(numNodes);
 std::vector<std::thread> nodeThreads(numNodes);
+std::string tracePath;
+std::vector<std::shared_ptr<SlotTracer>> tracers(numNodes);	// outlive their nodes so the trace can be written at the end
 
 
-void runNode(SimNode<TDMARadio<LoRaSimPhysicalLayer>>* simNode, int nodeNum) {
-	int driftPPM = -10 + (10 - (-10)) * static_cast<float>(rand())/RAND_MAX;
-	setClockDriftPPM(driftPPM);
-
+void runNode(SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>* simNode, int nodeNum) {
     while (nodeRunning[nodeNum].load()) {  // Check if the thread should continue running
         simNode->update();  // Perform node updates
         std::this_thread::sleep_for(std::chrono::milliseconds(2));  // 500Hz loop speed
@@ -41,7 +49,12 @@ void runNode(SimNode<TDMARadio<LoRaSimPhysicalLayer>>* simNode, int nodeNum) {
 }
 
 void spawnNode(int nodeNum, float freq, float bw, uint8_t sf) {
-    auto simNode = std::make_unique<SimNode<TDMARadio<LoRaSimPhysicalLayer>>>(nodeNum, freq, bw, sf, true);
+	int driftPPM = static_cast<int>(driftRng.nextBelow(21)) - 10;
+    auto simNode = std::make_unique<SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>>(*world, nodeNum, freq, bw, sf, true, driftPPM);
+	if (!tracePath.empty()){
+		tracers[nodeNum] = std::make_shared<SlotTracer>("node" + std::to_string(nodeNum) + " (" + std::to_string(driftPPM) + "ppm)", 1 << 16, world->getTimeSource());
+		simNode->getRadio().setTracer(tracers[nodeNum]);
+	}
     simNode->setup();
 
 	{
@@ -53,6 +66,33 @@ void spawnNode(int nodeNum, float freq, float bw, uint8_t sf) {
 	nodeThreads[nodeNum] = std::thread(runNode, simNodes[nodeNum].get(), nodeNum);
 }
 
+void printLinkStats(int nodeNum){
+	std::lock_guard<std::mutex> lock(nodeMutex);
+	if (!simNodes[nodeNum]){
+		return;
+	}
+	auto info = static_cast<const TDMARadioInterfaceInfo*>(simNodes[nodeNum]->getRadioInfo());
+	std::array<LinkStats, decltype(info->linkStats)::capacity()> stats;
+	size_t count = info->linkStats.snapshot(stats);
+	for (size_t i = 0; i < count; ++i){
+		std::cout << "node" << nodeNum << " <- " << static_cast<int>(stats[i].address) 
+			<< ": rx = " << stats[i].rxCount << ", lost = " << stats[i].lostCount 
+			<< ", per = " << stats[i].per << ", rssi = " << stats[i].rssi << "dBm, snr = " << stats[i].snr << "dB" << std::endl;
+	}
+}
+
+void printSlotStats(int nodeNum){
+	std::lock_guard<std::mutex> lock(nodeMutex);
+	if (!simNodes[nodeNum]){
+		return;
+	}
+	const SlotStats stats = static_cast<const TDMARadioInterfaceInfo*>(simNodes[nodeNum]->getRadioInfo())->slotStats.get();
+	std::cout << "node" << nodeNum << " slots: owned = " << stats.slotsOwned << ", used = " << stats.slotsUsed
+		<< ", heartbeat = " << stats.slotsHeartbeat << ", yielded = " << stats.slotsYielded << ", idle = " << stats.slotsIdle << ", utilisation = " << stats.slotUtilisation
+		<< ", tx duty = " << stats.txDutyCycle << ", rx duty = " << stats.rxDutyCycle << ", resyncs = " << stats.resyncs
+		<< ", resizes = " << stats.nodeListResizes << ", unexpected = " << stats.unexpectedSource << std::endl;
+}
+
 void despawnNode(int nodeNum){
 	nodeRunning[nodeNum].store(false);
 	std::this_thread::sleep_for(std::chrono::milliseconds(1));
@@ -81,15 +121,43 @@ void spawnManager(){
 	spawnNode(2, freq, bw, sf);
 
 	std::this_thread::sleep_for(std::chrono::seconds(60));
+	printLinkStats(0);
+	printLinkStats(1);
+	printLinkStats(2);
+	printSlotStats(0);
+	printSlotStats(1);
+	printSlotStats(2);
 	despawnNode(0);
 	despawnNode(1);
 	despawnNode(2);
 
+	if (!tracePath.empty()){
+		std::ofstream out(tracePath);
+		std::vector<const SlotTracer*> traced;
+		for (const auto& tracer : tracers){
+			if (tracer){
+				traced.push_back(tracer.get());
+			}
+		}
+		SlotTracer::writeChromeTrace(out, traced);
+		std::cout << "slot trace written to " << tracePath << ", open it in ui.perfetto.dev" << std::endl;
+	}
 
 }
 
-int main()
+/**
+ * usage: librrp_tdma_test [seed] [trace.json], the seed is printed so a run can be repeated. Given a path, a Chrome
+ * trace event timeline of every node's slots is written there at the end. Nodes run on their own threads
+ * against the wall clock, so runs with the same seed share every random draw but not the thread interleaving.
+ */
+int main(int argc, char* argv[])
 {
+	const uint64_t seed = (argc > 1) ? std::stoull(argv[1]) : std::random_device{}();
+	tracePath = (argc > 2) ? argv[2] : "";
+	std::cout << "seed = " << seed << std::endl;
+	world = std::make_unique<SimWorld>(seed);
+	driftRng.seed(world->nextSeed());
+
     // Start node manager thread
     std::thread spawnManagerThread(spawnManager);
 
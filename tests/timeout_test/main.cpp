@@ -11,6 +11,7 @@
 
 // librrp
 #include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/physical/sim_world.h>
 #include <librrp/datalink/turn_timeout.h>
 
 // librnp
@@ -24,12 +25,7 @@
 #include "../SimNode.h"
 
 
-void runNode(SimNode<TimeoutRadio<LoRaSimPhysicalLayer>>* simNode, int nodeNum) {
-
-	int driftPPM = (nodeNum == 0) ? -10 : 10;
-	setClockDriftPPM(driftPPM);
-
-	// std::this_thread::sleep_for(std::chrono::milliseconds(1000 + (100 * nodeNum)));
+void runNode(SimNode<TimeoutRadio<LoRaSimPhysicalLayer, DriftingClock>>* simNode) {
 
     for (;;) {
         simNode->update();
@@ -37,11 +33,11 @@ void runNode(SimNode<TimeoutRadio<LoRaSimPhysicalLayer>>* simNode, int nodeNum)
     }
 }
 
-int main(int argc, char* argv[]) {
+int main() {
     int numNodes = 2;
 
-    std::vector<std::unique_ptr<SimNode<TimeoutRadio<LoRaSimPhysicalLayer>>>> simNodes;
-	std::vector<std::unique_ptr<RnpNetworkManager>> networkManagers;
+    SimWorld world;
+    std::vector<std::unique_ptr<SimNode<TimeoutRadio<LoRaSimPhysicalLayer, DriftingClock>>>> simNodes;
 
     // LoRa params
     float freq = 868e6;
@@ -49,9 +45,8 @@ int main(int argc, char* argv[]) {
     uint8_t sf = 7;
 
     for (int i = 0; i < numNodes; ++i) {
-    	networkManagers.emplace_back(std::make_unique<RnpNetworkManager>(100, NODETYPE::LEAF, true));	// the address gets reset in simNode.setup()
-
-    	auto simNode = std::make_unique<SimNode<TimeoutRadio<LoRaSimPhysicalLayer>>>(*networkManagers[i], freq, bw, sf, true);
+		int driftPPM = (i == 0) ? -10 : 10;
+    	auto simNode = std::make_unique<SimNode<TimeoutRadio<LoRaSimPhysicalLayer, DriftingClock>>>(world, i, freq, bw, sf, true, driftPPM);
         simNode->setup();
 
         simNodes.push_back(std::move(simNode));
@@ -60,7 +55,7 @@ int main(int argc, char* argv[]) {
     // create threads for each node
     std::vector<std::thread> threads;
     for (int i = 0; i < numNodes; i++){
-        threads.emplace_back(runNode, simNodes[i].get(), i);
+        threads.emplace_back(runNode, simNodes[i].get());
     }
 
     for (auto& thread : threads) {
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <cstdint>
+
+// librrp
+#include <librrp/physical/radio_channel_manager.h>
+
+#include "../Check/check.h"
+
+/**
+ * @brief Simulated node, just counts what it receives
+ */
+struct Node
+{
+	std::vector<std::vector<uint8_t>> received;
+};
+
+static void registerNodes(RadioChannelManager& manager, std::vector<Node>& nodes)
+{
+	for (auto& node : nodes){
+		manager.registerNode(0, &node, [&node](const std::vector<uint8_t>& data, const RadioReception&) {
+			node.received.push_back(data);
+		});
+	}
+}
+
+static void testHiddenTerminal()
+{
+	std::cout << "--- hidden terminal ---" << std::endl;
+	RadioChannelManager manager;
+	std::vector<Node> nodes(3);
+	registerNodes(manager, nodes);
+	Node& a = nodes[0];
+	Node& b = nodes[1];
+	Node& c = nodes[2];
+
+	// a and c can both reach b but not each other
+	manager.setNodePosition(&a, {0, 0, 0});
+	manager.setNodePosition(&b, {1000, 0, 0});
+	manager.setNodePosition(&c, {2000, 0, 0});
+
+	const float sensitivity = 13.0f - RadioChannelConfig{}.noiseFloor - RadioChannel::demodulationFloor(7);	// max path loss we can decode
+	check(manager.getPathLoss(&a, &b) < sensitivity, "a in range of b");
+	check(manager.getPathLoss(&a, &c) > sensitivity, "a can't decode c");
+
+	auto channel = manager.getChannel(0);
+
+	channel->transmitPacket({1}, 1000, &a);
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	channel->update();
+	check(b.received.size() == 1, "b hears a alone");
+	check(c.received.empty(), "c doesn't hear a");
+
+	channel->transmitPacket({1}, 1000, &a);
+	channel->transmitPacket({3}, 1000, &c);
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	channel->update();
+	check(b.received.size() == 1, "a and c collide at b");
+	check(a.received.empty() && c.received.empty(), "a and c never hear each other");
+}
+
+static void testLinkMatrix()
+{
+	std::cout << "--- link matrix ---" << std::endl;
+	RadioChannelManager manager;
+	std::vector<Node> nodes(3);
+	registerNodes(manager, nodes);
+
+	check(manager.getPathLoss(&nodes[0], &nodes[2]) == manager.getPathLossConfig().unplacedLoss, "unplaced nodes form a full mesh");
+
+	manager.setLinkPathLoss(&nodes[0], &nodes[2], INFINITY);
+	check(std::isinf(manager.getPathLoss(&nodes[2], &nodes[0])), "cut link is symmetric");
+
+	std::vector<RadioLink> links;
+	manager.getLinks(&nodes[0], links);
+	check(links.size() == 1 && links[0].receiverId == &nodes[1], "cut link not offered to the channel");
+
+	manager.clearLinkPathLoss(&nodes[0], &nodes[2]);
+	links.clear();
+	manager.getLinks(&nodes[0], links);
+	check(links.size() == 2, "link restored");
+
+	// an override can join two placed nodes that are far out of range
+	manager.setNodePosition(&nodes[0], {0, 0, 0});
+	manager.setNodePosition(&nodes[1], {1e6, 0, 0});
+	manager.setLinkPathLoss(&nodes[0], &nodes[1], 90);
+	links.clear();
+	manager.getLinks(&nodes[1], links);
+	check(links.size() == 2, "override links far apart nodes, unplaced node still reachable");
+
+	manager.removeNode(&nodes[2]);
+	links.clear();
+	manager.getLinks(&nodes[1], links);
+	check(links.size() == 1, "removed node no longer linked");
+}
+
+static void testSpatialIndex()
+{
+	std::cout << "--- spatial index ---" << std::endl;
+	constexpr size_t side = 30;
+	constexpr float spacing = 1000;	// m
+
+	RadioChannelManager manager;
+	std::vector<Node> nodes(side * side);
+	registerNodes(manager, nodes);
+	for (size_t i = 0; i < nodes.size(); ++i){
+		manager.setNodePosition(&nodes[i], {spacing * (i % side), spacing * (i / side), 0});
+	}
+
+	// the grid has to find exactly the links brute force does
+	bool matches = true;
+	size_t totalLinks = 0;
+	size_t decodableLinks = 0;
+	const float sensitivity = 13.0f - RadioChannelConfig{}.noiseFloor - RadioChannel::demodulationFloor(7);
+	std::vector<RadioLink> links;
+	for (auto& sender : nodes){
+		size_t expected = 0;
+		for (auto& receiver : nodes){
+			if (&receiver != &sender && !std::isinf(manager.getPathLoss(&sender, &receiver))){
+				++expected;
+				decodableLinks += (manager.getPathLoss(&sender, &receiver) < sensitivity);
+			}
+		}
+		links.clear();
+		manager.getLinks(&sender, links);
+		matches &= (links.size() == expected);
+		totalLinks += links.size();
+	}
+	check(matches, "grid query matches brute force");
+	check(totalLinks < nodes.size() * (nodes.size() - 1) / 4, "each node only sees its neighbourhood");
+	std::cout << nodes.size() << " nodes, " << static_cast<float>(totalLinks) / nodes.size() << " links per node" << std::endl;
+
+	// one packet from each node in turn, every decodable link delivers
+	auto channel = manager.getChannel(0);
+	auto start = std::chrono::steady_clock::now();
+	for (auto& node : nodes){
+		channel->transmitPacket({1}, 10, &node);
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+		channel->update();
+	}
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+	size_t received = 0;
+	for (auto& node : nodes){
+		received += node.received.size();
+	}
+	check(received > 0 && received == decodableLinks, "every decodable link delivered");
+	std::cout << "delivered " << received << " packets in " << elapsed << "us" << std::endl;
+}
+
+int main()
+{
+	testHiddenTerminal();
+	testLinkMatrix();
+	testSpatialIndex();
+
+	return checkSummary();
+}
@@ -0,0 +1,151 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/util/xoshiro.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/datalink/tdma.h>
+
+#include "../SimNode.h"
+#include "../Traffic/traffic_generator.h"
+#include "../Check/check.h"
+
+// the first n packet times of a generator started at 0
+static std::vector<TrafficEvent> generate(TrafficGenerator& generator, size_t count, uint64_t seed = 1)
+{
+	Xoshiro256 rng(seed);
+	std::vector<TrafficEvent> events;
+	TrafficEvent event;
+	bool more = generator.next(0, rng, event);
+	while (more && events.size() < count){
+		events.push_back(event);
+		more = generator.next(event.time, rng, event);
+	}
+	return events;
+}
+
+static void testGenerators()
+{
+	std::cout << "--- generators ---" << std::endl;
+	TrafficProfile profile;
+	profile.minPayloadSize = 20;
+	profile.maxPayloadSize = 40;
+	profile.destinations = {5, 6};
+	profile.service = 30;
+
+	CbrTraffic cbr(profile, 10);
+	std::vector<TrafficEvent> events = generate(cbr, 1000);
+	bool periodic = events.front().time <= 100000;
+	bool shaped = true;
+	for (size_t i = 1; i < events.size(); ++i){
+		periodic = periodic && events[i].time - events[i - 1].time == 100000;
+	}
+	for (const auto& event : events){
+		shaped = shaped && event.payloadSize >= 20 && event.payloadSize <= 40 && (event.destination == 5 || event.destination == 6) && event.service == 30;
+	}
+	check(periodic, "cbr sends every interval after a random phase");
+	check(shaped, "sizes, destinations and service follow the profile");
+
+	PoissonTraffic poisson(profile, 10);
+	events = generate(poisson, 20000);
+	const double mean = events.back().time / 1e6 / events.size();
+	double variance = 0;
+	for (size_t i = 1; i < events.size(); ++i){
+		const double interval = (events[i].time - events[i - 1].time) / 1e6;
+		variance += (interval - mean) * (interval - mean);
+	}
+	const double cv = std::sqrt(variance / (events.size() - 1)) / mean;
+	check(std::fabs(mean - 0.1) < 0.003, "poisson mean interval matches the rate");
+	check(std::fabs(cv - 1.0) < 0.05, "poisson intervals are exponential (cv ~ 1)");
+
+	// 20 pkt/s while on, on 2s and off 8s on average: 4 pkt/s long run, in bursts
+	OnOffTraffic onOff(profile, 20, 2, 8);
+	events = generate(onOff, 20000);
+	const double rate = events.size() / (events.back().time / 1e6);
+	size_t bursts = 0;
+	for (size_t i = 1; i < events.size(); ++i){
+		bursts += (events[i].time - events[i - 1].time > 50000) ? 1 : 0;
+	}
+	check(std::fabs(rate - 4.0) < 0.4, "on/off long run rate is the on rate times the duty cycle");
+	check(bursts > 100 && bursts < events.size() / 10, "on/off traffic comes in bursts");
+
+	const std::string path = "traffic_test_trace.csv";
+	{
+		std::ofstream out(path);
+		out << "# time_us,payload_size,destination,service\n1000,30\n500,50,9\n\n2500,16,-1,44\n";
+	}
+	std::vector<TrafficEvent> recorded;
+	check(TraceTraffic::load(path, recorded) && recorded.size() == 3, "trace file loaded");
+	std::remove(path.c_str());
+	TraceTraffic trace(profile, recorded);
+	Xoshiro256 rng(1);
+	TrafficEvent event;
+	std::vector<TrafficEvent> replayed;
+	for (bool more = trace.next(10000, rng, event); more; more = trace.next(event.time, rng, event)){
+		replayed.push_back(event);
+	}
+	check(replayed.size() == 3 && replayed[0].time == 10500 && replayed[1].time == 11000 && replayed[2].time == 12500, "trace replays in time order from its start");
+	check(replayed[0].destination == 9 && replayed[0].payloadSize == 50 && replayed[2].service == 44 && replayed[1].service == 30, "trace fields override the profile");
+}
+
+/**
+ * @brief Telemetry and commands between SimNodes over TDMA, the receiving sink accounts for every packet sent
+ */
+static void testSimNodes()
+{
+	std::cout << "--- sim nodes ---" << std::endl;
+	using Node = SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>;
+	VirtualClock clock;
+	SimWorld world(5, [clock]() { return clock.micros(); });
+
+	std::vector<std::unique_ptr<Node>> nodes;
+	for (int i = 0; i < 3; ++i){
+		nodes.push_back(std::make_unique<Node>(world, i, 868e6, 250e3, 7, false, (i - 1) * 10.0));
+		nodes.back()->setup();
+	}
+	TrafficProfile telemetry;
+	telemetry.minPayloadSize = 32;
+	telemetry.maxPayloadSize = 32;
+	telemetry.destinations = {102};
+	TrafficProfile commands = telemetry;
+	commands.minPayloadSize = 12;
+	commands.maxPayloadSize = 24;
+	nodes[1]->listen();
+	nodes[0]->addTrafficGenerator(std::make_unique<CbrTraffic>(telemetry, 1));
+	nodes[2]->addTrafficGenerator(std::make_unique<PoissonTraffic>(commands, 0.5));
+
+	while (world.now() < 120000000){
+		for (auto& node : nodes){
+			node->update();
+		}
+		clock.advance(1000);
+	}
+
+	const TrafficSink* sink = nodes[1]->getTrafficSink();
+	const uint64_t sent = nodes[0]->getTrafficSent() + nodes[2]->getTrafficSent();
+	check(sink != nullptr && nodes[0]->getTrafficSink() == nullptr, "only the listening node has a sink");
+	check(nodes[0]->getTrafficSent() >= 119 && nodes[0]->getTrafficSent() <= 120, "cbr node sent at its rate");
+	check(sink->getReceived() > sent / 2, "most traffic delivered");
+	// what's neither received nor counted lost is still queued, or lost at the tail with nothing after it
+	check(sink->getReceived() + sink->getLost() <= sent && sent - sink->getReceived() - sink->getLost() <= 10, "loss accounted from sequence gaps");
+	const uint64_t p50 = TrafficSink::percentile(sink->getLatencies(), 50);
+	check(p50 > 0 && p50 < 2000000, "one way latency measured");
+	std::cout << "sent = " << sent << ", received = " << sink->getReceived() << ", lost = " << sink->getLost()
+		<< ", latency p50 = " << p50 / 1000 << "ms" << std::endl;
+}
+
+int main()
+{
+	testGenerators();
+	testSimNodes();
+
+	return checkSummary();
+}
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdint>
+
+// librrp
+#include <librrp/util/clock.h>
+#include <librrp/physical/sim_world.h>
+#include <librrp/physical/lora_sim_physical_layer.h>
+#include <librrp/datalink/tdma.h>
+
+#include "../SimNode.h"
+#include "../Traffic/traffic_generator.h"
+#include "../Check/check.h"
+
+struct YieldRun
+{
+	uint64_t busyReceived;		// node0's packets heard by node1
+	double busyQueued;			// frames node0 still had waiting at the end
+	double lightDelivery;		// node1's own traffic, which it must still get out in its own windows
+	SlotStats stats[3];			// since the traffic started
+};
+
+/**
+ * @brief Three nodes, node0 offering far more than one frame per tdma frame to node1, node1 sending a little back
+ * and node2 idle
+ */
+static YieldRun run(bool yielding)
+{
+	using Node = SimNode<TDMARadio<LoRaSimPhysicalLayer, DriftingClock>>;
+	VirtualClock clock;
+	SimWorld world(5, [clock]() { return clock.micros(); });
+
+	// staggered so each joins the network the first one made rather than starting its own
+	std::vector<std::unique_ptr<Node>> nodes;
+	while (world.now() < 45000000){
+		if (nodes.size() < 3 && world.now() >= nodes.size() * 14000000){
+			nodes.push_back(std::make_unique<Node>(world, static_cast<int>(nodes.size()), 868e6, 250e3, 7, false, (nodes.size() - 1.0) * 10.0));
+			nodes.back()->getRadio().setSlotYielding(yielding);
+			nodes.back()->setup();
+		}
+		for (auto& node : nodes){
+			node->update();
+		}
+		clock.advance(1000);
+	}
+
+	TrafficProfile bulk;
+	bulk.minPayloadSize = 24;
+	bulk.maxPayloadSize = 48;
+	bulk.destinations = {102};
+	TrafficProfile telemetry = bulk;
+	telemetry.destinations = {101};
+	SlotStats before[3];
+	for (size_t i = 0; i < 3; ++i){
+		nodes[i]->listen();
+		before[i] = static_cast<const TDMARadioInterfaceInfo*>(nodes[i]->getRadioInfo())->slotStats.get();
+	}
+	nodes[0]->addTrafficGenerator(std::make_unique<CbrTraffic>(bulk, 20));
+	nodes[1]->addTrafficGenerator(std::make_unique<CbrTraffic>(telemetry, 0.5f));
+
+	while (world.now() < 105000000){
+		for (auto& node : nodes){
+			node->update();
+		}
+		clock.advance(1000);
+	}
+
+	YieldRun result;
+	result.busyReceived = nodes[1]->getTrafficSink()->getReceived();
+	result.busyQueued = static_cast<const TDMARadioInterfaceInfo*>(nodes[0]->getRadioInfo())->currentSendBufferSize;
+	result.lightDelivery = static_cast<double>(nodes[0]->getTrafficSink()->getReceived()) / nodes[1]->getTrafficSent();
+	for (size_t i = 0; i < 3; ++i){
+		SlotStats& s = result.stats[i];
+		s = static_cast<const TDMARadioInterfaceInfo*>(nodes[i]->getRadioInfo())->slotStats.get();
+		s.slotsOwned -= before[i].slotsOwned;
+		s.slotsUsed -= before[i].slotsUsed;
+		s.slotsHeartbeat -= before[i].slotsHeartbeat;
+		s.slotsYielded -= before[i].slotsYielded;
+		s.slotsIdle -= before[i].slotsIdle;
+		s.slotsStolen -= before[i].slotsStolen;
+		s.unexpectedSource -= before[i].unexpectedSource;
+		s.nodeListResizes -= before[i].nodeListResizes;
+	}
+	return result;
+}
+
+int main()
+{
+	const YieldRun plain = run(false);
+	const YieldRun yielding = run(true);
+
+	std::cout << "busy node frames delivered: plain = " << plain.busyReceived << ", yielding = " << yielding.busyReceived << std::endl;
+	for (size_t i = 0; i < 3; ++i){
+		const SlotStats& s = yielding.stats[i];
+		std::cout << "node" << i << ": owned = " << s.slotsOwned << ", used = " << s.slotsUsed << ", yielded = " << s.slotsYielded
+			<< ", heartbeat = " << s.slotsHeartbeat << ", idle = " << s.slotsIdle << ", stolen = " << s.slotsStolen
+			<< ", unexpected = " << s.unexpectedSource << std::endl;
+	}
+
+	check(plain.stats[0].slotsStolen == 0 && plain.stats[1].slotsYielded == 0 && plain.stats[2].slotsYielded == 0, "nothing yielded unless asked for");
+	check(yielding.busyReceived > 2 * plain.busyReceived, "busy node gets the idle windows as well as its own");
+	check(yielding.stats[2].slotsYielded > yielding.stats[2].slotsOwned * 9 / 10, "idle node yields nearly every window");
+	check(yielding.stats[0].slotsStolen > 0 && yielding.stats[0].slotsYielded == 0, "only the backlogged node steals, and never yields");
+	check(yielding.lightDelivery > 0.95 && plain.lightDelivery > 0.95, "a node with its own traffic still sends it in its windows");
+
+	bool undisturbed = true;
+	for (size_t i = 0; i < 3; ++i){
+		undisturbed = undisturbed && yielding.stats[i].unexpectedSource == 0 && yielding.stats[i].nodeListResizes == 0;
+	}
+	check(undisturbed, "stolen frames aren't taken for the window's owner");
+
+	return checkSummary();
+}